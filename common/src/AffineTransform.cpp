@@ -0,0 +1,238 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file AffineTransform.cpp
+ *
+ * \brief
+ *    3x4 affine transform applied to float 4:4:4 frames in a single pass
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "Global.H"
+#include "AffineTransform.H"
+#include "CPUFeatures.H"
+#include "ThreadPool.H"
+
+//-----------------------------------------------------------------------------
+// SIMD kernels
+//-----------------------------------------------------------------------------
+
+// Four samples at a time, with the same double precision operations, in the same order,
+// as the scalar loop. Returns the number of samples processed.
+#if ENABLE_SIMD_DISPATCH
+SIMD_TARGET("avx2")
+static int affineAVX2 (float **oComp, const float * const *iComp, int start, int end, const double (*coef)[4], bool hasClip, float clipMin, float clipMax)
+{
+  const __m128 vMin = _mm_set1_ps(clipMin);
+  const __m128 vMax = _mm_set1_ps(clipMax);
+  __m256d vCoef[3][4];
+  for (int k = 0; k < 3; k++)
+    for (int j = 0; j < 4; j++)
+      vCoef[k][j] = _mm256_set1_pd(coef[k][j]);
+  int i = start;
+  
+  for (; i + 4 <= end; i += 4) {
+    __m256d comp0 = _mm256_cvtps_pd(_mm_loadu_ps(iComp[0] + i));
+    __m256d comp1 = _mm256_cvtps_pd(_mm_loadu_ps(iComp[1] + i));
+    __m256d comp2 = _mm256_cvtps_pd(_mm_loadu_ps(iComp[2] + i));
+    for (int k = 0; k < 3; k++) {
+      __m256d v = _mm256_add_pd(_mm256_mul_pd(vCoef[k][0], comp0), _mm256_mul_pd(vCoef[k][1], comp1));
+      v = _mm256_add_pd(_mm256_add_pd(v, _mm256_mul_pd(vCoef[k][2], comp2)), vCoef[k][3]);
+      __m128 r = _mm256_cvtpd_ps(v);
+      // Same operand order as fClip, so that NaNs are handled identically
+      if (hasClip)
+        r = _mm_min_ps(_mm_max_ps(r, vMin), vMax);
+      _mm_storeu_ps(oComp[k] + i, r);
+    }
+  }
+  return i;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Constructor/destructor
+//-----------------------------------------------------------------------------
+
+AffineTransform::AffineTransform() {
+  setIdentity();
+}
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+void AffineTransform::processBand(Frame *out, const Frame *inp, int start, int end) {
+  if (inp->m_compSize[Y_COMP] == inp->m_compSize[U_COMP]) {
+    int i = start;
+#if ENABLE_SIMD_DISPATCH
+    if (CPUFeatures::hasAVX2())
+      i = affineAVX2(out->m_floatComp, inp->m_floatComp, start, end, m_coef, m_hasClip, m_clipMin, m_clipMax);
+#endif
+    for (; i < end; i++) {
+      double comp0 = inp->m_floatComp[0][i];
+      double comp1 = inp->m_floatComp[1][i];
+      double comp2 = inp->m_floatComp[2][i];
+      for (int k = 0; k < 3; k++) {
+        float value = (float) (m_coef[k][0] * comp0 + m_coef[k][1] * comp1 + m_coef[k][2] * comp2 + m_coef[k][3]);
+        out->m_floatComp[k][i] = m_hasClip ? fClip(value, m_clipMin, m_clipMax) : value;
+      }
+    }
+  }
+  else {
+    // Diagonal transform on subsampled data. start/end refer to the luma samples
+    for (int k = 0; k < 3; k++) {
+      int64 cStart = (int64) start * inp->m_compSize[k] / inp->m_compSize[Y_COMP];
+      int64 cEnd   = (int64) end   * inp->m_compSize[k] / inp->m_compSize[Y_COMP];
+      for (int64 i = cStart; i < cEnd; i++) {
+        float value = (float) (m_coef[k][k] * (double) inp->m_floatComp[k][i] + m_coef[k][3]);
+        out->m_floatComp[k][i] = m_hasClip ? fClip(value, m_clipMin, m_clipMax) : value;
+      }
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+void AffineTransform::setIdentity() {
+  setScale(1.0);
+}
+
+void AffineTransform::setScale(double scale) {
+  for (int k = 0; k < 3; k++) {
+    for (int j = 0; j < 4; j++) {
+      m_coef[k][j] = (k == j) ? scale : 0.0;
+    }
+  }
+  m_hasClip = FALSE;
+  m_clipMin = 0.0f;
+  m_clipMax = 0.0f;
+}
+
+void AffineTransform::setMatrix(const double *matrix) {
+  for (int k = 0; k < 3; k++) {
+    for (int j = 0; j < 3; j++) {
+      m_coef[k][j] = matrix[3 * k + j];
+    }
+    m_coef[k][3] = 0.0;
+  }
+  m_hasClip = FALSE;
+}
+
+void AffineTransform::setClip(float minValue, float maxValue) {
+  m_hasClip = TRUE;
+  m_clipMin = minValue;
+  m_clipMax = maxValue;
+}
+
+bool AffineTransform::hasOffset() const {
+  return m_coef[0][3] != 0.0 || m_coef[1][3] != 0.0 || m_coef[2][3] != 0.0;
+}
+
+bool AffineTransform::isDiagonal() const {
+  for (int k = 0; k < 3; k++) {
+    for (int j = 0; j < 3; j++) {
+      if (k != j && m_coef[k][j] != 0.0)
+        return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+bool AffineTransform::isIdentity() const {
+  return m_hasClip == FALSE && hasOffset() == FALSE && isDiagonal() == TRUE 
+    && m_coef[0][0] == 1.0 && m_coef[1][1] == 1.0 && m_coef[2][2] == 1.0;
+}
+
+bool AffineTransform::append(const AffineTransform *next) {
+  if (m_hasClip == TRUE)
+    return FALSE;
+  
+  double coef[3][4];
+  for (int k = 0; k < 3; k++) {
+    for (int j = 0; j < 4; j++) {
+      coef[k][j] = next->m_coef[k][0] * m_coef[0][j] + next->m_coef[k][1] * m_coef[1][j] + next->m_coef[k][2] * m_coef[2][j];
+    }
+    coef[k][3] += next->m_coef[k][3];
+  }
+  for (int k = 0; k < 3; k++) {
+    for (int j = 0; j < 4; j++) {
+      m_coef[k][j] = coef[k][j];
+    }
+  }
+  m_hasClip = next->m_hasClip;
+  m_clipMin = next->m_clipMin;
+  m_clipMax = next->m_clipMax;
+  
+  return TRUE;
+}
+
+void AffineTransform::process(Frame *out, const Frame *inp) {
+  out->m_frameNo = inp->m_frameNo;
+  out->m_isAvailable = TRUE;
+  
+  // Same requirements as the matrix color transforms: float data of the same size. Subsampled
+  // frames can only be handled by diagonal transforms.
+  if (inp->m_isFloat == FALSE || out->m_isFloat == FALSE || inp->m_size != out->m_size)
+    return;
+  if (inp->m_compSize[Y_COMP] != inp->m_compSize[U_COMP] && isDiagonal() == FALSE)
+    return;
+  
+  int width  = inp->m_width[Y_COMP];
+  int height = inp->m_height[Y_COMP];
+  int bands  = ThreadPool::getBandCount(height, 16);
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int yStart = (int) ((int64) band * height / bands);
+    int yEnd   = (int) ((int64) (band + 1) * height / bands);
+    processBand(out, inp, yStart * width, yEnd * width);
+  });
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
@@ -0,0 +1,139 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file CPUFeatures.cpp
+ *
+ * \brief
+ *    Runtime detection of the SIMD instruction sets available on the host
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "Global.H"
+#include "CPUFeatures.H"
+
+//-----------------------------------------------------------------------------
+// Local functions
+//-----------------------------------------------------------------------------
+
+static SIMDLevel maxLevel = SIMD_AVX2;
+
+#if ENABLE_SIMD_DISPATCH && defined(_MSC_VER)
+// bit 'bit' of register 'reg' (0:eax, 1:ebx, 2:ecx, 3:edx) of cpuid leaf 'leaf'
+static bool cpuidBit(int leaf, int reg, int bit) {
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < leaf)
+    return FALSE;
+  __cpuidex(info, leaf, 0);
+  return ((info[reg] >> bit) & 1) ? TRUE : FALSE;
+}
+
+// the OS saves the AVX (ymm) state on context switches
+static bool osSupportsAVX() {
+  return (cpuidBit(1, 2, 27) && (_xgetbv(0) & 6) == 6) ? TRUE : FALSE;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+bool CPUFeatures::hasSSSE3() {
+#if ENABLE_SIMD_DISPATCH && defined(_MSC_VER)
+  static const bool result = cpuidBit(1, 2, 9);
+  return result && maxLevel >= SIMD_SSSE3;
+#elif ENABLE_SIMD_DISPATCH
+  static const bool result = __builtin_cpu_supports("ssse3") ? TRUE : FALSE;
+  return result && maxLevel >= SIMD_SSSE3;
+#else
+  return FALSE;
+#endif
+}
+
+bool CPUFeatures::hasSSE41() {
+#if ENABLE_SIMD_DISPATCH && defined(_MSC_VER)
+  static const bool result = cpuidBit(1, 2, 19);
+  return result && maxLevel >= SIMD_SSE41;
+#elif ENABLE_SIMD_DISPATCH
+  static const bool result = __builtin_cpu_supports("sse4.1") ? TRUE : FALSE;
+  return result && maxLevel >= SIMD_SSE41;
+#else
+  return FALSE;
+#endif
+}
+
+bool CPUFeatures::hasAVX2() {
+#if ENABLE_SIMD_DISPATCH && defined(_MSC_VER)
+  static const bool result = osSupportsAVX() && cpuidBit(7, 1, 5);
+  return result && maxLevel >= SIMD_AVX2;
+#elif ENABLE_SIMD_DISPATCH
+  static const bool result = __builtin_cpu_supports("avx2") ? TRUE : FALSE;
+  return result && maxLevel >= SIMD_AVX2;
+#else
+  return FALSE;
+#endif
+}
+
+bool CPUFeatures::hasFMA() {
+#if ENABLE_SIMD_DISPATCH && defined(_MSC_VER)
+  static const bool result = osSupportsAVX() && cpuidBit(1, 2, 12);
+  return result && maxLevel >= SIMD_AVX2;
+#elif ENABLE_SIMD_DISPATCH
+  static const bool result = __builtin_cpu_supports("fma") ? TRUE : FALSE;
+  return result && maxLevel >= SIMD_AVX2;
+#else
+  return FALSE;
+#endif
+}
+
+void CPUFeatures::setMaxLevel(SIMDLevel level) {
+  maxLevel = level;
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
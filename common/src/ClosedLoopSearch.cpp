@@ -0,0 +1,169 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file ClosedLoopSearch.cpp
+ *
+ * \brief
+ *    Luma code value search for the closed loop color transforms
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "Global.H"
+#include "ClosedLoopSearch.H"
+#include "CPUFeatures.H"
+
+//-----------------------------------------------------------------------------
+// Macros / Constants
+//-----------------------------------------------------------------------------
+
+// Number of candidates evaluated per pass
+#define CLS_BLOCK   8
+
+//-----------------------------------------------------------------------------
+// SIMD kernels
+//-----------------------------------------------------------------------------
+
+// Distortion of candidates start ... start + CLS_BLOCK - 1, using the same double precision
+// operations, in the same order, as ClosedLoopSearch::distortion
+#if ENABLE_SIMD_DISPATCH
+SIMD_TARGET("avx2")
+static void distortionAVX2 (double *error, const double *target, const double *weight, int start)
+{
+  const __m256d vStep = _mm256_set1_pd(4.0);
+  __m256d vY = _mm256_add_pd(_mm256_set1_pd((double) start), _mm256_set_pd(3.0, 2.0, 1.0, 0.0));
+  __m256d vTarget[3], vWeight[3];
+  for (int k = 0; k < 3; k++) {
+    vTarget[k] = _mm256_set1_pd(target[k]);
+    vWeight[k] = _mm256_set1_pd(weight[k]);
+  }
+  
+  for (int j = 0; j < CLS_BLOCK; j += 4) {
+    __m256d d0 = _mm256_sub_pd(vTarget[0], vY);
+    __m256d d1 = _mm256_sub_pd(vTarget[1], vY);
+    __m256d d2 = _mm256_sub_pd(vTarget[2], vY);
+    __m256d e  = _mm256_add_pd(_mm256_mul_pd(vWeight[0], _mm256_mul_pd(d0, d0)), _mm256_mul_pd(vWeight[1], _mm256_mul_pd(d1, d1)));
+    e = _mm256_add_pd(e, _mm256_mul_pd(vWeight[2], _mm256_mul_pd(d2, d2)));
+    _mm256_storeu_pd(error + j, e);
+    vY = _mm256_add_pd(vY, vStep);
+  }
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Constructor/destructor
+//-----------------------------------------------------------------------------
+
+ClosedLoopSearch::ClosedLoopSearch(double weightR, double weightG, double weightB) {
+  m_weight[0] = weightR;
+  m_weight[1] = weightG;
+  m_weight[2] = weightB;
+  m_weightSum = weightR + weightG + weightB;
+}
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+int ClosedLoopSearch::scan(const double *target, int first, int last, int best, double &bestError) const {
+  int j = first;
+  
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2()) {
+    double error[CLS_BLOCK];
+    for (; j + CLS_BLOCK - 1 <= last; j += CLS_BLOCK) {
+      distortionAVX2(error, target, m_weight, j);
+      for (int k = 0; k < CLS_BLOCK; k++) {
+        if (error[k] < bestError) {
+          bestError = error[k];
+          best = j + k;
+        }
+      }
+    }
+  }
+#endif
+  
+  for (; j <= last; j++) {
+    double curError = distortion(target[0], target[1], target[2], (double) j);
+    if (curError < bestError) {
+      bestError = curError;
+      best = j;
+    }
+  }
+  return best;
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+int ClosedLoopSearch::findBest(double rYComp, double gYComp, double bYComp, int first, int last, int initial, double initialError) const {
+  const double target[3] = { rYComp, gYComp, bYComp };
+  
+  if (last - first >= CLS_BLOCK && m_weightSum > 0.0) {
+    // The distortion is a parabola with its vertex at the weighted mean of the targets. Moving one code
+    // value away from the vertex increases it by at least m_weightSum, far above the rounding error of
+    // its computation, so only a window of CLS_BLOCK candidates around the vertex needs to be tested:
+    // every other candidate is strictly worse than one inside the window.
+    double vertex = (m_weight[0] * rYComp + m_weight[1] * gYComp + m_weight[2] * bYComp) / m_weightSum;
+    if (vertex == vertex) {
+      int start = (int) floor(dClip(vertex, (double) first, (double) last)) - (CLS_BLOCK / 2 - 1);
+      start = iClip(start, first, last - CLS_BLOCK + 1);
+      if (initial >= start && initial < start + CLS_BLOCK)
+        return scan(target, start, start + CLS_BLOCK - 1, initial, initialError);
+      
+      // The initial candidate is tested first, so it is kept unless the window does strictly better
+      double windowError = distortion(rYComp, gYComp, bYComp, (double) start);
+      int    windowBest  = scan(target, start, start + CLS_BLOCK - 1, start, windowError);
+      return windowError < initialError ? windowBest : initial;
+    }
+  }
+  return scan(target, first, last, initial, initialError);
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
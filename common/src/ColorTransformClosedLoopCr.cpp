@@ -55,6 +55,7 @@
 
 #include "Global.H"
 #include "ColorTransformClosedLoopCr.H"
+#include "ThreadPool.H"
 
 //-----------------------------------------------------------------------------
 // Macros / Constants
@@ -438,7 +439,6 @@ void ColorTransformClosedLoopCr::process ( Frame* out, const Frame *inp) {
   
   if (inp->m_compSize[Y_COMP] == out->m_compSize[Y_COMP] && inp->m_compSize[Y_COMP] == inp->m_compSize[U_COMP])  {
     if (inp->m_isFloat == TRUE && out->m_isFloat == TRUE)  {
-      double uComp, vComp;
       //double rComp, gComp, bComp;
       float *red   = inp->m_floatComp[0];
       float *green = inp->m_floatComp[1];
@@ -496,61 +496,68 @@ void ColorTransformClosedLoopCr::process ( Frame* out, const Frame *inp) {
       double uScale  = (2.0 * (1 - m_transform0[2]));
       double vScale  = (2.0 * (1 - m_transform0[0]));
 
-      for (int i = 0; i < inp->m_compSize[0]; i++) {
-        uComp  = (double) m_invFrameStore->m_floatComp[1][i];
-        vComp  = (double) m_invFrameStore->m_floatComp[2][i];       
+      int width  = inp->m_width[Y_COMP];
+      int height = inp->m_height[Y_COMP];
+      int bands  = ThreadPool::getBandCount(height, 16);
+      ThreadPool::parallelFor(bands, [&](int band) {
+        int start = (int) ((int64) band * height / bands) * width;
+        int end   = (int) ((int64) (band + 1) * height / bands) * width;
+        for (int i = start; i < end; i++) {
+          double uComp  = (double) m_invFrameStore->m_floatComp[1][i];
+          double vComp  = (double) m_invFrameStore->m_floatComp[2][i];       
                 
-        double vOffset = vComp * vScale;
-        double uOffset = uComp * uScale;
-        double gOffset = ((uOffset * m_transform0[2] +  vOffset * m_transform0[0]) * uvDenom);
+          double vOffset = vComp * vScale;
+          double uOffset = uComp * uScale;
+          double gOffset = ((uOffset * m_transform0[2] +  vOffset * m_transform0[0]) * uvDenom);
 
-        double yValueR = red  [i] - vOffset;
-        double yValueB = blue [i] - uOffset;
-        double yValueG = green[i] + gOffset;
+          double yValueR = red  [i] - vOffset;
+          double yValueB = blue [i] - uOffset;
+          double yValueG = green[i] + gOffset;
         
-        double yValueRQ = dRound(yValueR * m_lumaWeight) / m_lumaWeight;
-        double yValueBQ = dRound(yValueB * m_lumaWeight) / m_lumaWeight;
-        double yValueGQ = dRound(yValueG * m_lumaWeight) / m_lumaWeight;
+          double yValueRQ = dRound(yValueR * m_lumaWeight) / m_lumaWeight;
+          double yValueBQ = dRound(yValueB * m_lumaWeight) / m_lumaWeight;
+          double yValueGQ = dRound(yValueG * m_lumaWeight) / m_lumaWeight;
         
-        if (yValueRQ == yValueBQ && yValueBQ == yValueGQ) {
-          out->m_floatComp[0][i] = (float) yValueRQ;
-        }
-        else {
-          double errorRR = dAbs2(red  [i] - (yValueRQ + vOffset));
-          double errorRB = dAbs2(blue [i] - (yValueRQ + uOffset));
-          double errorRG = dAbs2(green[i] - (yValueRQ - gOffset));
+          if (yValueRQ == yValueBQ && yValueBQ == yValueGQ) {
+            out->m_floatComp[0][i] = (float) yValueRQ;
+          }
+          else {
+            double errorRR = dAbs2(red  [i] - (yValueRQ + vOffset));
+            double errorRB = dAbs2(blue [i] - (yValueRQ + uOffset));
+            double errorRG = dAbs2(green[i] - (yValueRQ - gOffset));
           
-          double errorBR = dAbs2(red  [i] - (yValueBQ + vOffset));
-          double errorBB = dAbs2(blue [i] - (yValueBQ + uOffset));
-          double errorBG = dAbs2(green[i] - (yValueBQ - gOffset));
+            double errorBR = dAbs2(red  [i] - (yValueBQ + vOffset));
+            double errorBB = dAbs2(blue [i] - (yValueBQ + uOffset));
+            double errorBG = dAbs2(green[i] - (yValueBQ - gOffset));
           
-          double errorGR = dAbs2(red  [i] - (yValueGQ + vOffset));
-          double errorGB = dAbs2(blue [i] - (yValueGQ + uOffset));
-          double errorGG = dAbs2(green[i] - (yValueGQ - gOffset));
-          //printf("yValue {%10.7f %10.7f %10.7f } [%10.7f]\n", yValueGQ, yValueBQ, yValueRQ,  dRound(m_fwdFrameStore->m_floatComp[0][i] * m_lumaWeight) / m_lumaWeight);
+            double errorGR = dAbs2(red  [i] - (yValueGQ + vOffset));
+            double errorGB = dAbs2(blue [i] - (yValueGQ + uOffset));
+            double errorGG = dAbs2(green[i] - (yValueGQ - gOffset));
+            //printf("yValue {%10.7f %10.7f %10.7f } [%10.7f]\n", yValueGQ, yValueBQ, yValueRQ,  dRound(m_fwdFrameStore->m_floatComp[0][i] * m_lumaWeight) / m_lumaWeight);
           
-          //printf("errors %10.7f %10.7f %10.7f\n", errorRR + errorRB + errorRG, errorBR + errorBB + errorBG, errorGR + errorGB + errorGG);
+            //printf("errors %10.7f %10.7f %10.7f\n", errorRR + errorRB + errorRG, errorBR + errorBB + errorBG, errorGR + errorGB + errorGG);
           
-          // The conversion below basically puts us back to the original space.
-          double yValue  = yValueGQ;
+            // The conversion below basically puts us back to the original space.
+            double yValue  = yValueGQ;
           
-          if (errorRR + errorRB + errorRG < errorBR + errorBB + errorBG) {
-            if (errorRR + errorRB + errorRG < errorGR + errorGB + errorGG) {
-              yValue = yValueRQ;
+            if (errorRR + errorRB + errorRG < errorBR + errorBB + errorBG) {
+              if (errorRR + errorRB + errorRG < errorGR + errorGB + errorGG) {
+                yValue = yValueRQ;
+              }
             }
-          }
-          else {
-            if (errorBR + errorBB + errorBG < errorGR + errorGB + errorGG) {
-              yValue = yValueBQ;
+            else {
+              if (errorBR + errorBB + errorBG < errorGR + errorGB + errorGG) {
+                yValue = yValueBQ;
+              }
             }
+            //yValue = dMax(yValueR, dMax(yValueG, yValueB));
+            //printf("yValue {%10.7f %10.7f %10.7f } %10.7f [%10.7f]\n", yValueG, yValueB, yValueR, yValue, m_fwdFrameStore->m_floatComp[0][i]);
+            //yValue = yValueR; // m_fwdFrameStore->m_floatComp[0][i];
+            //printf("new value %10.7f %10.7f \n", dRound(yValue * m_lumaWeight)/ m_lumaWeight, out->m_floatComp[0][i]);
+            out->m_floatComp[0][i] = (float) yValue; // dRound(yValue * m_lumaWeight)/ m_lumaWeight;
           }
-          //yValue = dMax(yValueR, dMax(yValueG, yValueB));
-          //printf("yValue {%10.7f %10.7f %10.7f } %10.7f [%10.7f]\n", yValueG, yValueB, yValueR, yValue, m_fwdFrameStore->m_floatComp[0][i]);
-          //yValue = yValueR; // m_fwdFrameStore->m_floatComp[0][i];
-          //printf("new value %10.7f %10.7f \n", dRound(yValue * m_lumaWeight)/ m_lumaWeight, out->m_floatComp[0][i]);
-          out->m_floatComp[0][i] = (float) yValue; // dRound(yValue * m_lumaWeight)/ m_lumaWeight;
         }
-      }
+      });
     }
     else { 
       // fixed precision, integer image data. 
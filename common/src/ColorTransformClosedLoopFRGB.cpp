@@ -58,6 +58,7 @@
 
 #include "Global.H"
 #include "ColorTransformClosedLoopFRGB.H"
+#include "ThreadPool.H"
 
 //-----------------------------------------------------------------------------
 // Macros / Constants
@@ -338,7 +339,6 @@ void ColorTransformClosedLoopFRGB::process ( Frame* out, const Frame *inp) {
   
   if (inp->m_compSize[Y_COMP] == out->m_compSize[Y_COMP] && inp->m_compSize[Y_COMP] == inp->m_compSize[U_COMP])  {
     if (inp->m_isFloat == TRUE && out->m_isFloat == TRUE)  {
-      double uComp, vComp;
       float *red   = inp->m_floatComp[0];
       float *green = inp->m_floatComp[1];
       float *blue  = inp->m_floatComp[2];
@@ -394,19 +394,26 @@ void ColorTransformClosedLoopFRGB::process ( Frame* out, const Frame *inp) {
       double uScale  = (2.0 * (1 - m_transform0[2]));
       double vScale  = (2.0 * (1 - m_transform0[0]));
       
-      for (int i = 0; i < inp->m_compSize[0]; i++) {
-        uComp  = (double) m_invFrameStore->m_floatComp[1][i];
-        vComp  = (double) m_invFrameStore->m_floatComp[2][i];       
+      int width  = inp->m_width[Y_COMP];
+      int height = inp->m_height[Y_COMP];
+      int bands  = ThreadPool::getBandCount(height, 16);
+      ThreadPool::parallelFor(bands, [&](int band) {
+        int start = (int) ((int64) band * height / bands) * width;
+        int end   = (int) ((int64) (band + 1) * height / bands) * width;
+        for (int i = start; i < end; i++) {
+          double uComp  = (double) m_invFrameStore->m_floatComp[1][i];
+          double vComp  = (double) m_invFrameStore->m_floatComp[2][i];       
                 
-        double vOffset = vComp * vScale;
-        double uOffset = uComp * uScale;
-        double gOffset = ((uOffset * m_transform0[2] +  vOffset * m_transform0[0]) * uvDenom);
+          double vOffset = vComp * vScale;
+          double uOffset = uComp * uScale;
+          double gOffset = ((uOffset * m_transform0[2] +  vOffset * m_transform0[0]) * uvDenom);
         
-        int yFinalRQ = (int) dRound((m_weight[0]  * (red[i] - vOffset) + m_weight[2] * (blue[i] - uOffset) + m_weight[1] * (green[i] + gOffset)) * m_lumaWeight);
-        //int yFinalRQ = (int) dRound((m_weight[0] * dMax(0.0, (red[i] - vOffset)) + m_weight[2] * dMax(0.0, (blue[i] - uOffset)) + m_weight[1] * dMax(0.0, (green[i] + gOffset))) * m_lumaWeight);
+          int yFinalRQ = (int) dRound((m_weight[0]  * (red[i] - vOffset) + m_weight[2] * (blue[i] - uOffset) + m_weight[1] * (green[i] + gOffset)) * m_lumaWeight);
+          //int yFinalRQ = (int) dRound((m_weight[0] * dMax(0.0, (red[i] - vOffset)) + m_weight[2] * dMax(0.0, (blue[i] - uOffset)) + m_weight[1] * dMax(0.0, (green[i] + gOffset))) * m_lumaWeight);
 
-        out->m_floatComp[0][i] = (float) ((double) yFinalRQ / m_lumaWeight);
-      }
+          out->m_floatComp[0][i] = (float) ((double) yFinalRQ / m_lumaWeight);
+        }
+      });
     }
     else { 
       // fixed precision, integer image data. 
@@ -58,6 +58,7 @@
 
 #include "Global.H"
 #include "ColorTransformClosedLoopRGB.H"
+#include "ThreadPool.H"
 
 //-----------------------------------------------------------------------------
 // Macros / Constants
@@ -457,7 +458,6 @@ void ColorTransformClosedLoopRGB::process ( Frame* out, const Frame *inp) {
   
   if (inp->m_compSize[Y_COMP] == out->m_compSize[Y_COMP] && inp->m_compSize[Y_COMP] == inp->m_compSize[U_COMP])  {
     if (inp->m_isFloat == TRUE && out->m_isFloat == TRUE)  {
-      double uComp, vComp;
       float *red   = inp->m_floatComp[0];
       float *green = inp->m_floatComp[1];
       float *blue  = inp->m_floatComp[2];
@@ -514,52 +514,49 @@ void ColorTransformClosedLoopRGB::process ( Frame* out, const Frame *inp) {
       double uScale  = (2.0 * (1 - m_transform0[2]));
       double vScale  = (2.0 * (1 - m_transform0[0]));
       
-      for (int i = 0; i < inp->m_compSize[0]; i++) {
-        uComp  = (double) m_invFrameStore->m_floatComp[1][i];
-        vComp  = (double) m_invFrameStore->m_floatComp[2][i];       
+      int width  = inp->m_width[Y_COMP];
+      int height = inp->m_height[Y_COMP];
+      int bands  = ThreadPool::getBandCount(height, 16);
+      ThreadPool::parallelFor(bands, [&](int band) {
+        int start = (int) ((int64) band * height / bands) * width;
+        int end   = (int) ((int64) (band + 1) * height / bands) * width;
+        for (int i = start; i < end; i++) {
+          double uComp  = (double) m_invFrameStore->m_floatComp[1][i];
+          double vComp  = (double) m_invFrameStore->m_floatComp[2][i];       
                 
-        double vOffset = vComp * vScale;
-        double uOffset = uComp * uScale;
-        double gOffset = ((uOffset * m_transform0[2] +  vOffset * m_transform0[0]) * uvDenom);
+          double vOffset = vComp * vScale;
+          double uOffset = uComp * uScale;
+          double gOffset = ((uOffset * m_transform0[2] +  vOffset * m_transform0[0]) * uvDenom);
         
-        double yValueR = (red  [i] - vOffset) * m_lumaWeight;
-        double yValueB = (blue [i] - uOffset) * m_lumaWeight;
-        double yValueG = (green[i] + gOffset) * m_lumaWeight;
+          double yValueR = (red  [i] - vOffset) * m_lumaWeight;
+          double yValueB = (blue [i] - uOffset) * m_lumaWeight;
+          double yValueG = (green[i] + gOffset) * m_lumaWeight;
         
-        int yValueRQ = (int) dRound(yValueR);
-        int yValueBQ = (int) dRound(yValueB);
-        int yValueGQ = (int) dRound(yValueG);
+          int yValueRQ = (int) dRound(yValueR);
+          int yValueBQ = (int) dRound(yValueB);
+          int yValueGQ = (int) dRound(yValueG);
 
-        if (yValueRQ == yValueBQ && yValueBQ == yValueGQ) {
-          out->m_floatComp[0][i] = (float) ((double) yValueRQ / m_lumaWeight);
-        }
-        else {
-          // First compute the linear value of the target Y (given original data)
-          //yLinear = (*this.*pt2Convert)((double)floatComp[0][i] * scale, (double) floatComp[1][i] * scale,(double) floatComp[2][i] * scale);
+          if (yValueRQ == yValueBQ && yValueBQ == yValueGQ) {
+            out->m_floatComp[0][i] = (float) ((double) yValueRQ / m_lumaWeight);
+          }
+          else {
+            // First compute the linear value of the target Y (given original data)
+            //yLinear = (*this.*pt2Convert)((double)floatComp[0][i] * scale, (double) floatComp[1][i] * scale,(double) floatComp[2][i] * scale);
           
           
-          // The conversion below basically puts us back to the original space.          
-          int yValueMin = iMin(yValueRQ, iMin(yValueBQ, yValueGQ));
-          int yValueMax = iMax(yValueRQ, iMax(yValueBQ, yValueGQ));
+            // The conversion below basically puts us back to the original space.          
+            int yValueMin = iMin(yValueRQ, iMin(yValueBQ, yValueGQ));
+            int yValueMax = iMax(yValueRQ, iMax(yValueBQ, yValueGQ));
           
-          int iYComp = yValueMin;
+            int iYComp = yValueMin;
                     
 #if 1
-         // if (iYCompMin != iYCompMax) {
-            double curError;
-            double minError = computeYDistortion(yValueR, yValueG , yValueB, (double) iYComp);
-            for (int j = iMax(0, yValueMin - 1); j <= iMin(yValueMax + 1, (int) m_lumaWeight); j++) {
-                        
-              curError = computeYDistortion(yValueR, yValueG , yValueB, (double) j);
-
-              if (curError < minError) {
-                minError = curError;
-                iYComp = j;
-              }
-            }
-          //}            
+           // if (iYCompMin != iYCompMax) {
+              double minError = computeYDistortion(yValueR, yValueG , yValueB, (double) iYComp);
+              iYComp = m_search.findBest(yValueR, yValueG, yValueB, iMax(0, yValueMin - 1), iMin(yValueMax + 1, (int) m_lumaWeight), iYComp, minError);
+            //}            
           
-          out->m_floatComp[0][i] = (float) ((double) iYComp / m_lumaWeight);
+            out->m_floatComp[0][i] = (float) ((double) iYComp / m_lumaWeight);
 #else
           //computeColorImpact(uComp, vComp, &rColor, &gColor, &bColor);          
           
@@ -669,8 +666,9 @@ void ColorTransformClosedLoopRGB::process ( Frame* out, const Frame *inp) {
           else
             out->m_floatComp[0][i] = (float) ((double) iYCompMax / m_lumaWeight);
 #endif
+          }
         }
-      }
+      });
     }
     else { 
       // fixed precision, integer image data. 
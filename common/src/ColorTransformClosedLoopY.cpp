@@ -58,6 +58,7 @@
 
 #include "Global.H"
 #include "ColorTransformClosedLoopY.H"
+#include "ThreadPool.H"
 
 //-----------------------------------------------------------------------------
 // Macros / Constants
@@ -186,6 +187,7 @@ ColorTransformClosedLoopY::ColorTransformClosedLoopY( ColorTransformParams *para
   m_weightRed   = 1.0; // m_transform0[0]; //1.0;
   m_weightGreen = 1.0; // m_transform0[1]; //2.0;
   m_weightBlue  = 1.0; // m_transform0[2]; //1.0;
+  m_search = ClosedLoopSearch(m_weightRed, m_weightGreen, m_weightBlue);
 
   // Transform coefficients for conversion to Y in XYZ
   m_transformRGBtoY = FWD_TRANSFORM[m_modeRGB2XYZ][1];
@@ -363,7 +365,6 @@ void ColorTransformClosedLoopY::process ( Frame* out, const Frame *inp) {
   
   if (inp->m_compSize[Y_COMP] == out->m_compSize[Y_COMP] && inp->m_compSize[Y_COMP] == inp->m_compSize[U_COMP])  {
     if (inp->m_isFloat == TRUE && out->m_isFloat == TRUE)  {
-      double uComp, vComp;
       float *red   = inp->m_floatComp[0];
       float *green = inp->m_floatComp[1];
       float *blue  = inp->m_floatComp[2];
@@ -420,46 +421,42 @@ void ColorTransformClosedLoopY::process ( Frame* out, const Frame *inp) {
       double uScale  = (2.0 * (1 - m_transform0[2]));
       double vScale  = (2.0 * (1 - m_transform0[0]));
       
-      for (int i = 0; i < inp->m_compSize[0]; i++) {
-        uComp  = (double) m_invFrameStore->m_floatComp[1][i];
-        vComp  = (double) m_invFrameStore->m_floatComp[2][i];       
+      int width  = inp->m_width[Y_COMP];
+      int height = inp->m_height[Y_COMP];
+      int bands  = ThreadPool::getBandCount(height, 16);
+      ThreadPool::parallelFor(bands, [&](int band) {
+        int start = (int) ((int64) band * height / bands) * width;
+        int end   = (int) ((int64) (band + 1) * height / bands) * width;
+        for (int i = start; i < end; i++) {
+          double uComp  = (double) m_invFrameStore->m_floatComp[1][i];
+          double vComp  = (double) m_invFrameStore->m_floatComp[2][i];       
                 
-        double vOffset = vComp * vScale;
-        double uOffset = uComp * uScale;
-        double gOffset = ((uOffset * m_transform0[2] +  vOffset * m_transform0[0]) * uvDenom);
+          double vOffset = vComp * vScale;
+          double uOffset = uComp * uScale;
+          double gOffset = ((uOffset * m_transform0[2] +  vOffset * m_transform0[0]) * uvDenom);
         
-        double yValueR = (red  [i] - vOffset) * m_lumaWeight;
-        double yValueB = (blue [i] - uOffset) * m_lumaWeight;
-        double yValueG = (green[i] + gOffset) * m_lumaWeight;
+          double yValueR = (red  [i] - vOffset) * m_lumaWeight;
+          double yValueB = (blue [i] - uOffset) * m_lumaWeight;
+          double yValueG = (green[i] + gOffset) * m_lumaWeight;
         
-        int yValueRQ = (int) dRound(yValueR);
-        int yValueBQ = (int) dRound(yValueB);
-        int yValueGQ = (int) dRound(yValueG);
+          int yValueRQ = (int) dRound(yValueR);
+          int yValueBQ = (int) dRound(yValueB);
+          int yValueGQ = (int) dRound(yValueG);
         
-        if (yValueRQ == yValueBQ && yValueBQ == yValueGQ) {
-          out->m_floatComp[0][i] = (float) ((double) yValueRQ / m_lumaWeight);
-        }
-        else {          
-          // The conversion below basically puts us back to the original space.          
-          int yValueMin = iMin(yValueRQ, iMin(yValueBQ, yValueGQ));
-          int yValueMax = iMax(yValueRQ, iMax(yValueBQ, yValueGQ));                          
-                    
-          double curError;
-          double bestError = 1e20;
-          int    bestYComp = yValueRQ;
-          for (int j = yValueMin; j < yValueMax; j++) {
-            
-            curError = computeYDistortion(yValueR, yValueG , yValueB, (double) j);
-
-            if (curError < bestError) {
-              bestError = curError;
-              bestYComp = j;
-            }
+          if (yValueRQ == yValueBQ && yValueBQ == yValueGQ) {
+            out->m_floatComp[0][i] = (float) ((double) yValueRQ / m_lumaWeight);
           }
+          else {          
+            // The conversion below basically puts us back to the original space.          
+            int yValueMin = iMin(yValueRQ, iMin(yValueBQ, yValueGQ));
+            int yValueMax = iMax(yValueRQ, iMax(yValueBQ, yValueGQ));                          
+                    
+            int    bestYComp = m_search.findBest(yValueR, yValueG, yValueB, yValueMin, yValueMax - 1, yValueRQ, 1e20);
           
-          out->m_floatComp[0][i] = (float) ((double) bestYComp / m_lumaWeight);
+            out->m_floatComp[0][i] = (float) ((double) bestYComp / m_lumaWeight);
+          }
         }
-      }
+      });
     }
     else { 
       // fixed precision, integer image data. 
@@ -55,6 +55,7 @@
 
 #include "Global.H"
 #include "ColorTransformGeneric.H"
+#include <float.h>
 
 //-----------------------------------------------------------------------------
 // Macros / Constants
@@ -489,6 +490,35 @@ void ColorTransformGeneric::setColorConversion(int colorPrimaries, const double
   *transform2 = FWD_TRANSFORM[mode][V_COMP];
 }
 
+bool ColorTransformGeneric::getAffineTransform(AffineTransform *affine) {
+  double matrix[9];
+  // Constant luminance conversions are not linear
+  if (m_mode == CTF_RGB2020_2_YUV2020CL)
+    return FALSE;
+  
+  for (int i = 0; i < 3; i++) {
+    matrix[    i] = m_transform0[i];
+    matrix[3 + i] = m_transform1[i];
+    matrix[6 + i] = m_transform2[i];
+  }
+  if (m_transformPrecision == TRUE) {
+    // Chroma computed from the B-Y and R-Y differences (see process())
+    for (int i = 0; i < 3; i++) {
+      matrix[3 + i] = ((i == B_COMP ? 1.0 : 0.0) - m_transform0[i]) / m_cbDivider;
+      matrix[6 + i] = ((i == R_COMP ? 1.0 : 0.0) - m_transform0[i]) / m_crDivider;
+    }
+  }
+  affine->setMatrix(matrix);
+  // Clipping is only done in the non precise mode (see process())
+  if (m_transformPrecision == FALSE) {
+    if (m_sClip == 1)
+      affine->setClip(m_min, m_max);
+    else if (m_sClip == 2)
+      affine->setClip(0.0f, FLT_MAX);
+  }
+  return TRUE;
+}
+
 
 void ColorTransformGeneric::process ( Frame* out, const Frame *inp) {
   out->m_frameNo = inp->m_frameNo;
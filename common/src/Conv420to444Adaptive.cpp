@@ -57,6 +57,8 @@
 #include "ColorTransformGeneric.H"
 #include "ConvFixedToFloat.H"
 #include "ConvFloatToFixed.H"
+#include "ThreadPool.H"
+#include "CPUFeatures.H"
 #include <string.h>
 
 //-----------------------------------------------------------------------------
@@ -64,6 +66,209 @@
 //-----------------------------------------------------------------------------
 #define TEST_FILTER 0
 
+//-----------------------------------------------------------------------------
+// Row kernels
+//-----------------------------------------------------------------------------
+
+// Filter count samples of one row; taps[t] points to the input of tap t for sample 0,
+// and consecutive samples use consecutive inputs.
+static void filterSamples(float *out, const float *const *taps, const ScaleFilter *filter, int start, int count, float minValue, float maxValue)
+{
+  for (int i = start; i < count; i++) {
+    float value = 0.0;
+    for (int t = 0; t < filter->m_numberOfTaps; t++)
+      value += filter->m_floatFilter[t] * taps[t][i];
+    if (filter->m_clip == TRUE)
+      out[i] = fClip((value + filter->m_floatOffset) * filter->m_floatScale, minValue, maxValue);
+    else
+      out[i] = (value + filter->m_floatOffset) * filter->m_floatScale;
+  }
+}
+
+template <typename T> static void filterSamples(int32 *out, const T *const *taps, const ScaleFilter *filter, int start, int count, int minValue, int maxValue)
+{
+  for (int i = start; i < count; i++) {
+    int value = 0;
+    for (int t = 0; t < filter->m_numberOfTaps; t++)
+      value += filter->m_i32Filter[t] * taps[t][i];
+    if (filter->m_clip == TRUE)
+      out[i] = iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
+    else
+      out[i] = (value + filter->m_i32Offset) >> filter->m_i32Shift;
+  }
+}
+
+//! Clip chroma samples to the range that keeps the red (or blue) component of the co-located luma samples in [0, 1]
+static void clipLumaBounds(float *row, const float *inpY, int yStride, int start, int count, double weight, double divisor)
+{
+  for (int i = start; i < count; i++) {
+    double yDouble = inpY[i * yStride];
+    double minCompFloat = (dMax(yDouble - 1.0 + weight, 0.0) - (weight * yDouble)) / divisor;
+    double maxCompFloat = (dMin(yDouble, weight) - (weight * yDouble)) / divisor;
+    row[i] = (float) dClip(row[i], minCompFloat, maxCompFloat);
+  }
+}
+
+//! Clip Cr samples to the range that keeps the color of the co-located Y and Cb samples valid
+static void clipChromaBounds(float *row, const float *inpY, int yStride, const float *inpCb, int start, int count, double wYR, double wYG, double wYB, double denom)
+{
+  for (int i = start; i < count; i++) {
+    double yDouble  = (double) inpY[i * yStride];
+    double cbDouble = (double) inpCb[i];
+    double minCompDouble = (dMax(0, yDouble - (wYG + wYB * (2 * (1 - wYB) * cbDouble + yDouble))) - wYR * yDouble) / denom;
+    double maxCompDouble = (dMin( wYR, yDouble - wYB * (2 * (1 - wYB) * cbDouble + yDouble)) -wYR * yDouble)/ denom;
+    row[i] = (float) dClip(row[i], minCompDouble, maxCompDouble);
+  }
+}
+
+#if ENABLE_SIMD_DISPATCH
+// AVX2 versions of the above, with the operation order of the scalar code (no fused
+// multiply-add) so that results are identical.
+SIMD_TARGET("avx2")
+static inline __m256i loadSamples(const int32  *inp) { return _mm256_loadu_si256((const __m256i *) inp); }
+SIMD_TARGET("avx2")
+static inline __m256i loadSamples(const uint16 *inp) { return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) inp)); }
+SIMD_TARGET("avx2")
+static inline __m256i loadSamples(const imgpel *inp) { return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) inp)); }
+
+SIMD_TARGET("avx2")
+static inline __m256d loadLuma(const float *inpY, int yStride)
+{
+  if (yStride == 1)
+    return _mm256_cvtps_pd(_mm_loadu_ps(inpY));
+  return _mm256_cvtps_pd(_mm_set_ps(inpY[3 * yStride], inpY[2 * yStride], inpY[yStride], inpY[0]));
+}
+
+SIMD_TARGET("avx2")
+static int filterSamplesAVX2(float *out, const float *const *taps, const ScaleFilter *filter, int count, float minValue, float maxValue)
+{
+  const __m256 offset = _mm256_set1_ps(filter->m_floatOffset);
+  const __m256 scale  = _mm256_set1_ps(filter->m_floatScale);
+  int i;
+  for (i = 0; i + 8 <= count; i += 8) {
+    __m256 value = _mm256_setzero_ps();
+    for (int t = 0; t < filter->m_numberOfTaps; t++)
+      value = _mm256_add_ps(value, _mm256_mul_ps(_mm256_set1_ps(filter->m_floatFilter[t]), _mm256_loadu_ps(taps[t] + i)));
+    value = _mm256_mul_ps(_mm256_add_ps(value, offset), scale);
+    if (filter->m_clip == TRUE)
+      value = _mm256_min_ps(_mm256_max_ps(value, _mm256_set1_ps(minValue)), _mm256_set1_ps(maxValue));
+    _mm256_storeu_ps(out + i, value);
+  }
+  return i;
+}
+
+template <typename T> SIMD_TARGET("avx2")
+static int filterSamplesAVX2(int32 *out, const T *const *taps, const ScaleFilter *filter, int count, int minValue, int maxValue)
+{
+  const __m256i offset = _mm256_set1_epi32(filter->m_i32Offset);
+  const __m128i shift  = _mm_cvtsi32_si128(filter->m_i32Shift);
+  int i;
+  for (i = 0; i + 8 <= count; i += 8) {
+    __m256i value = _mm256_setzero_si256();
+    for (int t = 0; t < filter->m_numberOfTaps; t++)
+      value = _mm256_add_epi32(value, _mm256_mullo_epi32(_mm256_set1_epi32(filter->m_i32Filter[t]), loadSamples(taps[t] + i)));
+    value = _mm256_sra_epi32(_mm256_add_epi32(value, offset), shift);
+    if (filter->m_clip == TRUE)
+      value = _mm256_min_epi32(_mm256_max_epi32(value, _mm256_set1_epi32(minValue)), _mm256_set1_epi32(maxValue));
+    _mm256_storeu_si256((__m256i *) (out + i), value);
+  }
+  return i;
+}
+
+SIMD_TARGET("avx2")
+static int clipLumaBoundsAVX2(float *row, const float *inpY, int yStride, int count, double weight, double divisor)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one  = _mm256_set1_pd(1.0);
+  const __m256d w    = _mm256_set1_pd(weight);
+  const __m256d div  = _mm256_set1_pd(divisor);
+  int i;
+  for (i = 0; i + 4 <= count; i += 4) {
+    __m256d y    = loadLuma(inpY + i * yStride, yStride);
+    __m256d wy   = _mm256_mul_pd(w, y);
+    __m256d minC = _mm256_div_pd(_mm256_sub_pd(_mm256_max_pd(_mm256_add_pd(_mm256_sub_pd(y, one), w), zero), wy), div);
+    __m256d maxC = _mm256_div_pd(_mm256_sub_pd(_mm256_min_pd(y, w), wy), div);
+    __m256d v    = _mm256_cvtps_pd(_mm_loadu_ps(row + i));
+    _mm_storeu_ps(row + i, _mm256_cvtpd_ps(_mm256_min_pd(_mm256_max_pd(v, minC), maxC)));
+  }
+  return i;
+}
+
+SIMD_TARGET("avx2")
+static int clipChromaBoundsAVX2(float *row, const float *inpY, int yStride, const float *inpCb, int count, double wYR, double wYG, double wYB, double denom)
+{
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d r    = _mm256_set1_pd(wYR);
+  const __m256d g    = _mm256_set1_pd(wYG);
+  const __m256d b    = _mm256_set1_pd(wYB);
+  const __m256d cbW  = _mm256_set1_pd(2 * (1 - wYB));
+  const __m256d div  = _mm256_set1_pd(denom);
+  int i;
+  for (i = 0; i + 4 <= count; i += 4) {
+    __m256d y    = loadLuma(inpY + i * yStride, yStride);
+    __m256d cb   = _mm256_cvtps_pd(_mm_loadu_ps(inpCb + i));
+    __m256d ry   = _mm256_mul_pd(r, y);
+    __m256d bs   = _mm256_mul_pd(b, _mm256_add_pd(_mm256_mul_pd(cbW, cb), y));
+    __m256d minC = _mm256_div_pd(_mm256_sub_pd(_mm256_max_pd(zero, _mm256_sub_pd(y, _mm256_add_pd(g, bs))), ry), div);
+    __m256d maxC = _mm256_div_pd(_mm256_sub_pd(_mm256_min_pd(r, _mm256_sub_pd(y, bs)), ry), div);
+    __m256d v    = _mm256_cvtps_pd(_mm_loadu_ps(row + i));
+    _mm_storeu_ps(row + i, _mm256_cvtpd_ps(_mm256_min_pd(_mm256_max_pd(v, minC), maxC)));
+  }
+  return i;
+}
+#endif
+
+static void filterRow(float *out, const float *const *taps, const ScaleFilter *filter, int count, float minValue, float maxValue)
+{
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = filterSamplesAVX2(out, taps, filter, count, minValue, maxValue);
+#endif
+  filterSamples(out, taps, filter, i, count, minValue, maxValue);
+}
+
+template <typename T> static void filterRow(int32 *out, const T *const *taps, const ScaleFilter *filter, int count, int minValue, int maxValue)
+{
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = filterSamplesAVX2(out, taps, filter, count, minValue, maxValue);
+#endif
+  filterSamples(out, taps, filter, i, count, minValue, maxValue);
+}
+
+static void clipLumaBoundsRow(float *row, const float *inpY, int yStride, int count, double weight, double divisor)
+{
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = clipLumaBoundsAVX2(row, inpY, yStride, count, weight, divisor);
+#endif
+  clipLumaBounds(row, inpY, yStride, i, count, weight, divisor);
+}
+
+static void clipChromaBoundsRow(float *row, const float *inpY, int yStride, const float *inpCb, int count, double wYR, double wYG, double wYB, double denom)
+{
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = clipChromaBoundsAVX2(row, inpY, yStride, inpCb, count, wYR, wYG, wYB, denom);
+#endif
+  clipChromaBounds(row, inpY, yStride, inpCb, i, count, wYR, wYG, wYB, denom);
+}
+
+//! Copy one row, replicating the edge samples pad times on each side
+template <typename T> static void padRow(T *dst, const T *src, int size, int pad)
+{
+  int i;
+  for (i = 0; i < pad; i++)
+    *dst++ = src[0];
+  for (i = 0; i < size; i++)
+    *dst++ = src[i];
+  for (i = 0; i < pad; i++)
+    *dst++ = src[size - 1];
+}
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
@@ -122,6 +327,12 @@ Conv420to444Adaptive::Conv420to444Adaptive(int width, int height, int method, Ch
   m_horFilter[0] = new ScaleFilter(method, 1, 2, offset, scale, &offset, &scale, hPhase[0]); //even
   m_verFilter[1] = new ScaleFilter(method, 1, 0,      0,     0, &offset, &scale, vPhase[1]); //odd
   m_horFilter[1] = new ScaleFilter(method, 1, 2, offset, scale, &offset, &scale, hPhase[1]); //odd
+  
+  m_maxTaps = iMax(m_verFilter[0]->m_numberOfTaps, m_verFilter[1]->m_numberOfTaps);
+  // the odd samples are filtered one position to the right
+  m_padding = 0;
+  for (int index = 0; index < 2; index++)
+    m_padding = iMax(m_padding, iMax(m_horFilter[index]->m_positionOffset, m_horFilter[index]->m_numberOfTaps - m_horFilter[index]->m_positionOffset));
 }
 
 Conv420to444Adaptive::~Conv420to444Adaptive() {
@@ -136,239 +347,114 @@ Conv420to444Adaptive::~Conv420to444Adaptive() {
 //-----------------------------------------------------------------------------
 // Private methods
 //-----------------------------------------------------------------------------
-float Conv420to444Adaptive::filterHorizontal(const float *inp, const ScaleFilter *filter, int pos_x, int width, float minValue, float maxValue) {
-  int i;
-  float value = 0.0;
-  for (i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_floatFilter[i] * inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return fClip((value + filter->m_floatOffset) * filter->m_floatScale, minValue, maxValue);
-  else
-    return (value + filter->m_floatOffset) * filter->m_floatScale;
-}
-
-
-int Conv420to444Adaptive::filterHorizontal(const uint16 *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int i;
-  int value = 0;
-  for (i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) * filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-int Conv420to444Adaptive::filterHorizontal(const int32 *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int i;
-  int value = 0;
-  for (i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) * filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-
-int Conv420to444Adaptive::filterHorizontal(const imgpel *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int i;
-  int value = 0;
-  for (i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-float Conv420to444Adaptive::filterVertical(const float *inp, const ScaleFilter *filter, int pos_y, int width, int height, float minValue, float maxValue) {
-  int i;
-  float value = 0.0;
-  for (i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_floatFilter[i] * inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return fClip((value + filter->m_floatOffset) * filter->m_floatScale, minValue, maxValue);
-  else
-    return (value + filter->m_floatOffset) * filter->m_floatScale;
-}
-
 
-int Conv420to444Adaptive::filterVertical(const int32 *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int i;
-  int value = 0;
-  for (i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-int Conv420to444Adaptive::filterVertical(const uint16 *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int i;
-  int value = 0;
-  for (i = 0; i < filter->m_numberOfTaps; i++) {
-    // printf("%d (%d) ", (iClip(pos_y + i - filter->m_positionOffset, 0, height) ), filter->m_i32Filter[i]);
-
-    value += filter->m_i32Filter[i] * inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-  }
-   // printf(" (%d)\n", pos_y);
+/*!
+ ************************************************************************
+ * \brief
+ *    Vertical upsampling of a inputWidth x inputHeight plane to twice its
+ *    height, in parallel over bands of output rows. bound(row, y) is then
+ *    applied to each output row y.
+ ************************************************************************
+ */
+template <typename T, typename D, typename B> void Conv420to444Adaptive::filterVertical(D *out, const T *inp, int inputWidth, int inputHeight, D minValue, D maxValue, B bound)
+{
+  int height = 2 * inputHeight;
+  int bands  = ThreadPool::getBandCount(height, 16);
   
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int yStart = (int) ((int64) band * height / bands);
+    int yEnd   = (int) ((int64) (band + 1) * height / bands);
+    vector<const T *> taps(m_maxTaps);
+    
+    for (int j = yStart; j < yEnd; j++) {
+      // even rows use the first filter at the input row position, odd rows the second one at the next position
+      const ScaleFilter *filter = m_verFilter[j & 1];
+      int pos = (j >> 1) + (j & 1) - filter->m_positionOffset;
+      for (int t = 0; t < filter->m_numberOfTaps; t++)
+        taps[t] = inp + (int64) iClip(pos + t, 0, inputHeight - 1) * inputWidth;
+      
+      D *row = out + (int64) j * inputWidth;
+      filterRow(row, &taps[0], filter, inputWidth, minValue, maxValue);
+      bound(row, j);
+    }
+  });
 }
 
-int Conv420to444Adaptive::filterVertical(const imgpel *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int i;
-  int value = 0;
-  for (i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-  }
+/*!
+ ************************************************************************
+ * \brief
+ *    Horizontal upsampling of height rows to width samples. The even and
+ *    odd output samples are filtered as two rows that are then interleaved,
+ *    after which bound(row, y) is applied to each output row y.
+ ************************************************************************
+ */
+template <typename D, typename O, typename B> void Conv420to444Adaptive::filterHorizontal(O *out, const D *inp, int width, int height, D minValue, D maxValue, B bound)
+{
+  int inputWidth = width >> 1;
+  int bands = ThreadPool::getBandCount(height, 16);
   
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) * filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int yStart = (int) ((int64) band * height / bands);
+    int yEnd   = (int) ((int64) (band + 1) * height / bands);
+    vector<D> padded(inputWidth + 2 * m_padding);
+    vector<D> even(inputWidth);
+    vector<D> odd (inputWidth);
+    vector<const D *> tapsEven(m_horFilter[0]->m_numberOfTaps);
+    vector<const D *> tapsOdd (m_horFilter[1]->m_numberOfTaps);
+    
+    for (int t = 0; t < m_horFilter[0]->m_numberOfTaps; t++)
+      tapsEven[t] = &padded[m_padding + t - m_horFilter[0]->m_positionOffset];
+    for (int t = 0; t < m_horFilter[1]->m_numberOfTaps; t++)
+      tapsOdd [t] = &padded[m_padding + 1 + t - m_horFilter[1]->m_positionOffset];
+    
+    for (int j = yStart; j < yEnd; j++) {
+      O *row = out + (int64) j * width;
+      padRow(&padded[0], inp + (int64) j * inputWidth, inputWidth, m_padding);
+      filterRow(&even[0], &tapsEven[0], m_horFilter[0], inputWidth, minValue, maxValue);
+      filterRow(&odd [0], &tapsOdd [0], m_horFilter[1], inputWidth, minValue, maxValue);
+      for (int i = 0; i < inputWidth; i++) {
+        row[2 * i    ] = (O) even[i];
+        row[2 * i + 1] = (O) odd [i];
+      }
+      bound(row, j);
+    }
+  });
 }
 
 void Conv420to444Adaptive::filter(float *out, const float *inp, const float *inpY, int conversionMatrix, int width, int height, float minValue, float maxValue)
 {
-  int i, j;
-  int inputWidth  = width >> 1;
-  int inputHeight = height >> 1;
-
-  for (j = 0; j < inputHeight; j++) {
-    for (i = 0; i < inputWidth; i++) {
-      m_floatData[ (2 * j    ) * inputWidth + i ] = filterVertical(&inp[i], m_verFilter[0], j    , inputWidth, inputHeight - 1, 0.0, 0.0);
-      m_floatData[ (2 * j + 1) * inputWidth + i ] = filterVertical(&inp[i], m_verFilter[1], j + 1, inputWidth, inputHeight - 1, 0.0, 0.0);
-    }
-  }
-
-  for (j = 0; j < height; j++) {
-    for (i = 0; i < inputWidth; i++) {
-      out[ j * width + 2 * i     ] = filterHorizontal(&m_floatData[ j * inputWidth], m_horFilter[0], i    , inputWidth - 1, minValue, maxValue);
-      out[ j * width + 2 * i + 1 ] = filterHorizontal(&m_floatData[ j * inputWidth], m_horFilter[1], i + 1, inputWidth - 1, minValue, maxValue);
-    }
-  }
+  auto noBound = [](float *, int) {};
+  
+  filterVertical  (&m_floatData[0], inp, width >> 1, height >> 1, 0.0f, 0.0f, noBound);
+  filterHorizontal(out, &m_floatData[0], width, height, minValue, maxValue, noBound);
 }
 
 
 void Conv420to444Adaptive::filter(float *out, const float *inp, const float *inpY, int conversionMatrix, int width, int height, float minValue, float maxValue, int component)
 {
-  int i, j;
   int inputWidth  = width >> 1;
   int inputHeight = height >> 1;
   
-  // it seems better if I convert the data from fixed precision to float precision first. 
-  // For now, lets keep the current structure, but unfortunately, this would be very suboptimal code :(.
-  
   const double *transformY  = FWD_TRANSFORM[conversionMatrix][Y_COMP];
   const double *transformCb = FWD_TRANSFORM[conversionMatrix][Cb_COMP];
   const double *transformCr = FWD_TRANSFORM[conversionMatrix][Cr_COMP];
-  double yDouble = 0.0;
   
-  double minCompFloat = 0.0;
-  double maxCompFloat = 0.0;
+  // the bounds depend on the luma weight of the color component that the chroma component is derived from
+  double weight  = (component == U_COMP) ? transformY[2] : transformY[0];
+  double denom   = (component == U_COMP) ? -transformY[0]/transformCb[0] : -transformY[2]/transformCr[2];
+  double divisor = weight * denom;
   
-  if (component == U_COMP) {
-    double denom = -transformY[0]/transformCb[0];
-    
-    for (j = 0; j < inputHeight; j++) {
-      for (i = 0; i < inputWidth; i++) {
-        
-        yDouble = inpY[ (2 * j    ) * width + 2 * i ]; 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[2], 0.0) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[2]) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        
-                
-        m_floatData[ (2 * j    ) * inputWidth + i ] = (float) dClip(filterVertical(&inp[i], m_verFilter[0], j    , inputWidth, inputHeight - 1, minValue, maxValue), minCompFloat, maxCompFloat);
-        
-        yDouble = inpY[ (2 * j + 1 ) * width + 2 * i ]; 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[2], 0.0) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[2]) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        m_floatData[ (2 * j + 1) * inputWidth + i ] = (float) dClip(filterVertical(&inp[i], m_verFilter[1], j + 1, inputWidth, inputHeight - 1, minValue, maxValue), minCompFloat, maxCompFloat);
-      }
-    }
-    
-    for (j = 0; j < height; j++) {
-      for (i = 0; i < inputWidth; i++) {
-      
-        yDouble = inpY[j * width + 2 * i]; 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[2], 0.0) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[2]) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-
-        out[ j * width + 2 * i     ] = (float) dClip(filterHorizontal(&m_floatData[ j * inputWidth], m_horFilter[0], i    , inputWidth - 1, minValue, maxValue), minCompFloat, maxCompFloat);
-        yDouble = inpY[j * width + 2 * i + 1]; 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[2], 0.0) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[2]) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        out[ j * width + 2 * i + 1 ] = (float) dClip(filterHorizontal(&m_floatData[ j * inputWidth], m_horFilter[1], i + 1, inputWidth - 1, minValue, maxValue), minCompFloat, maxCompFloat);
-      }
-    }
-  }
-  else {
-    double denom = -transformY[2]/transformCr[2];
-    
-    for (j = 0; j < inputHeight; j++) {
-      for (i = 0; i < inputWidth; i++) {
-        
-        yDouble = inpY[ (2 * j    ) * width + 2 * i ]; 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[0], 0.0) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[0]) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-                
-        
-        m_floatData[ (2 * j    ) * inputWidth + i ] = (float) dClip(filterVertical(&inp[i], m_verFilter[0], j    , inputWidth, inputHeight - 1, minValue, maxValue), minCompFloat, maxCompFloat);
-        
-        yDouble = inpY[ (2 * j + 1 ) * width + 2 * i ]; 
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[0], 0.0) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[0]) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-        
-        m_floatData[ (2 * j + 1) * inputWidth + i ] = (float) dClip(filterVertical(&inp[i], m_verFilter[1], j + 1, inputWidth, inputHeight - 1, minValue, maxValue), minCompFloat, maxCompFloat);
-      }
-    }
-    
-    for (j = 0; j < height; j++) {
-      for (i = 0; i < inputWidth; i++) {
-      
-        yDouble = inpY[ j * width + 2 * i     ]; 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[0], 0.0) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[0]) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-
-        out[ j * width + 2 * i     ] = (float) dClip(filterHorizontal(&m_floatData[ j * inputWidth], m_horFilter[0], i    , inputWidth - 1, minValue, maxValue), minCompFloat, maxCompFloat);
-        yDouble = inpY[j * width + 2 * i + 1]; 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[0], 0.0) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[0]) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-
-        out[ j * width + 2 * i + 1 ] = (float) dClip(filterHorizontal(&m_floatData[ j * inputWidth], m_horFilter[1], i + 1, inputWidth - 1, minValue, maxValue), minCompFloat, maxCompFloat);
-      }
-    }
-  }
+  // vertically upsampled rows use the luma samples co-located with their even samples
+  filterVertical  (&m_floatData[0], inp, inputWidth, inputHeight, minValue, maxValue, [&](float *row, int y) {
+    clipLumaBoundsRow(row, inpY + (int64) y * width, 2, inputWidth, weight, divisor);
+  });
+  filterHorizontal(out, &m_floatData[0], width, height, minValue, maxValue, [&](float *row, int y) {
+    clipLumaBoundsRow(row, inpY + (int64) y * width, 1, width, weight, divisor);
+  });
 }
 
 void Conv420to444Adaptive::filter(float *out, const float *inp, const float *inpY, const float *inpCb, int conversionMatrix, int width, int height, float minValue, float maxValue)
 {
-  int i, j;
   int inputWidth  = width >> 1;
   int inputHeight = height >> 1;
   
@@ -377,58 +463,21 @@ void Conv420to444Adaptive::filter(float *out, const float *inp, const float *inp
   const double wYR = FWD_TRANSFORM[conversionMatrix][Y_COMP][R_COMP];
   const double wYG = FWD_TRANSFORM[conversionMatrix][Y_COMP][G_COMP];
   const double wYB = FWD_TRANSFORM[conversionMatrix][Y_COMP][B_COMP];
-  double yDouble = 0.0;
-  double cbDouble = 0.0;
-  
-  double minCompDouble = 0.0;
-  double maxCompDouble = 0.0;
-  
   double denom = 2 * (1 - wYR) * wYR;
-  for (j = 0; j < inputHeight; j++) {
-    for (i = 0; i < inputWidth; i++) {
-      
-      yDouble  = (double) inpY[ (2 * j    ) * width + 2 * i ]; 
-      cbDouble = (double) inpCb[ (2 * j    ) * inputWidth + i  ]; 
-      
-      minCompDouble = (dMax(0, yDouble - (wYG + wYB * (2 * (1 - wYB) * cbDouble + yDouble))) - wYR * yDouble) / denom;
-      maxCompDouble = (dMin( wYR, yDouble - wYB * (2 * (1 - wYB) * cbDouble + yDouble)) -wYR * yDouble)/ denom;
-            
-      m_floatData[ (2 * j    ) * inputWidth + i ] = (float) dClip(filterVertical(&inp[i], m_verFilter[0], j    , inputWidth, inputHeight - 1, minValue, maxValue), minCompDouble, maxCompDouble);
-      
-      yDouble  = (double) inpY[ (2 * j + 1 ) * width + 2 * i ]; 
-      cbDouble = (double) inpCb[ (2 * j + 1) * inputWidth + i  ]; 
-
-      minCompDouble = (dMax(0, yDouble - (wYG + wYB * (2 * (1 - wYB) * cbDouble + yDouble))) - wYR * yDouble) / denom;
-      maxCompDouble = (dMin( wYR, yDouble - wYB * (2 * (1 - wYB) * cbDouble + yDouble)) -wYR * yDouble)/ denom;
-      
-      m_floatData[ (2 * j + 1) * inputWidth + i ] = (float) dClip(filterVertical(&inp[i], m_verFilter[1], j + 1, inputWidth, inputHeight - 1, minValue, maxValue), minCompDouble, maxCompDouble);
-    }
-  }
   
-  for (j = 0; j < height; j++) {
-    for (i = 0; i < inputWidth; i++) {
-      yDouble  = (double) inpY [ j * width + 2 * i ]; 
-      cbDouble = (double) inpCb[ j * width + 2 * i ]; 
-      
-      minCompDouble = (dMax(0, yDouble - (wYG + wYB * (2 * (1 - wYB) * cbDouble + yDouble))) - wYR * yDouble) / denom;
-      maxCompDouble = (dMin( wYR, yDouble - wYB * (2 * (1 - wYB) * cbDouble + yDouble)) -wYR * yDouble)/ denom;
-      out[ j * width + 2 * i     ] = (float) dClip(filterHorizontal(&m_floatData[ j * inputWidth], m_horFilter[0], i    , inputWidth - 1, minValue, maxValue), minCompDouble, maxCompDouble);
-      
-      yDouble  = (double) inpY [ j * width + 2 * i + 1]; 
-      cbDouble = (double) inpCb[ j * width + 2 * i + 1]; 
-      
-      minCompDouble = (dMax(0, yDouble - (wYG + wYB * (2 * (1 - wYB) * cbDouble + yDouble))) - wYR * yDouble) / denom;
-      maxCompDouble = (dMin( wYR, yDouble - wYB * (2 * (1 - wYB) * cbDouble + yDouble)) -wYR * yDouble)/ denom;
-      out[ j * width + 2 * i + 1 ] = (float) dClip(filterHorizontal(&m_floatData[ j * inputWidth], m_horFilter[1], i + 1, inputWidth - 1, minValue, maxValue), minCompDouble, maxCompDouble);
-    }
-  }
+  // note that the vertical pass addresses the (full resolution) Cb plane with the subsampled width
+  filterVertical  (&m_floatData[0], inp, inputWidth, inputHeight, minValue, maxValue, [&](float *row, int y) {
+    clipChromaBoundsRow(row, inpY + (int64) y * width, 2, inpCb + (int64) y * inputWidth, inputWidth, wYR, wYG, wYB, denom);
+  });
+  filterHorizontal(out, &m_floatData[0], width, height, minValue, maxValue, [&](float *row, int y) {
+    clipChromaBoundsRow(row, inpY + (int64) y * width, 1, inpCb + (int64) y * width, width, wYR, wYG, wYB, denom);
+  });
 }
 
 
 
 void Conv420to444Adaptive::filter(uint16 *out, const uint16 *inp, const uint16 *inpY, int conversionMatrix, int width, int height, int minValue, int maxValue, int component)
 {
-  int i, j;
   int inputWidth  = width >> 1;
   int inputHeight = height >> 1;
 
@@ -438,144 +487,33 @@ void Conv420to444Adaptive::filter(uint16 *out, const uint16 *inp, const uint16 *
   const double *transformY  = FWD_TRANSFORM[conversionMatrix][Y_COMP];
   const double *transformCb = FWD_TRANSFORM[conversionMatrix][Cb_COMP];
   const double *transformCr = FWD_TRANSFORM[conversionMatrix][Cr_COMP];
-  double yDouble = 0.0;
-  double compFloat = 0.0;
+  double weight  = (component == U_COMP) ? transformY[2] : transformY[0];
+  double denom   = (component == U_COMP) ? -transformY[0]/transformCb[0] : -transformY[2]/transformCr[2];
+  double divisor = weight * denom;
+  const FrameFormat *format = m_format;
   
-  double minCompFloat = 0.0;
-  double maxCompFloat = 0.0;
-
-  if (component == U_COMP) {
-    double denom = -transformY[0]/transformCb[0];
-    
-    for (j = 0; j < inputHeight; j++) {
-      for (i = 0; i < inputWidth; i++) {
-        
-        yDouble = ConvFixedToFloat::convertUi16CompValue(inpY[ (2 * j    ) * width + 2 * i ], m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[Y_COMP], Y_COMP); 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[2], 0.0) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[2]) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        
-        
-        
-        m_i32Data[ (2 * j    ) * inputWidth + i ] = filterVertical(&inp[i], m_verFilter[0], j    , inputWidth, inputHeight - 1, minValue, maxValue);
-        compFloat = ConvFixedToFloat::convertUi16CompValue((m_i32Data[ (2 * j    ) * inputWidth + i ] + 128) >> 8, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component); 
-        if (compFloat < minCompFloat || compFloat > maxCompFloat) {
-          //printf("value Cb %d %7.3f %7.3f %7.3f  %7.3f\n", inpY[ (2 * j    ) * width + 2 * i ], yFloat, minCompFloat, maxCompFloat, compFloat);
-          if (compFloat < minCompFloat) {
-            //printf("value %d %d\n", m_i32Data[ (2 * j    ) * inputWidth + i ], ConvFloatToFixed::convertUi16Value(minCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256);
-            m_i32Data[ (2 * j    ) * inputWidth + i ] = ConvFloatToFixed::convertUi16Value((float) minCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256;
-          }
-          else if (compFloat > maxCompFloat) {
-            //printf("value %d %d\n", m_i32Data[ (2 * j    ) * inputWidth + i ], ConvFloatToFixed::convertUi16Value(maxCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256);
-            m_i32Data[ (2 * j    ) * inputWidth + i ] = ConvFloatToFixed::convertUi16Value((float) maxCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256;
-          }
-        }
-        
-        yDouble = ConvFixedToFloat::convertUi16CompValue(inpY[ (2 * j + 1 ) * width + 2 * i ], m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[Y_COMP], Y_COMP); 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[2], 0.0) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[2]) - (transformY[2] * yDouble)) / (transformY[2] * denom);
-        m_i32Data[ (2 * j + 1) * inputWidth + i ] = filterVertical(&inp[i], m_verFilter[1], j + 1, inputWidth, inputHeight - 1, minValue, maxValue);
-        compFloat = ConvFixedToFloat::convertUi16CompValue((m_i32Data[ (2 * j + 1) * inputWidth + i ] + 128) >> 8, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component); 
-        if (compFloat < minCompFloat || compFloat > maxCompFloat) {
-         // printf("value Cb %d %7.3f %7.3f %7.3f %7.3f\n", inpY[ (2 * j + 1 ) * width + 2 * i ], yFloat, minCompFloat, maxCompFloat, compFloat);
-          if (compFloat < minCompFloat) {
-            //printf("value %d %d\n", m_i32Data[ (2 * j + 1) * inputWidth + i ], ConvFloatToFixed::convertUi16Value(minCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256);
-            m_i32Data[ (2 * j + 1) * inputWidth + i ]  = ConvFloatToFixed::convertUi16Value((float) minCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256;
-          }
-          else if (compFloat > maxCompFloat) {
-            //printf("value %d %d\n", m_i32Data[ (2 * j + 1) * inputWidth + i ] , ConvFloatToFixed::convertUi16Value(maxCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256);
-            m_i32Data[ (2 * j + 1) * inputWidth + i ] = ConvFloatToFixed::convertUi16Value((float) maxCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256;
-          }
-        }
-      }
-    }
-    
-    for (j = 0; j < height; j++) {
-      for (i = 0; i < inputWidth; i++) {
-        out[ j * width + 2 * i     ] = filterHorizontal(&m_i32Data[ j * inputWidth], m_horFilter[0], i    , inputWidth - 1, minValue, maxValue);
-        out[ j * width + 2 * i + 1 ] = filterHorizontal(&m_i32Data[ j * inputWidth], m_horFilter[1], i + 1, inputWidth - 1, minValue, maxValue);
-      }
-    }
-  }
-  else {
-    double denom = -transformY[2]/transformCr[2];
-    
-    for (j = 0; j < inputHeight; j++) {
-      for (i = 0; i < inputWidth; i++) {
-        
-        yDouble = ConvFixedToFloat::convertUi16CompValue(inpY[ (2 * j    ) * width + 2 * i ], m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[Y_COMP], Y_COMP); 
-        
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[0], 0.0) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[0]) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-        
-        //printf("value %d %7.3f %7.3f %7.3f \n", inpY[ (2 * j    ) * width + 2 * i ], yFloat, minCompFloat, maxCompFloat);
-        
-        
-        m_i32Data[ (2 * j    ) * inputWidth + i ] = filterVertical(&inp[i], m_verFilter[0], j    , inputWidth, inputHeight - 1, minValue, maxValue);
-        compFloat = ConvFixedToFloat::convertUi16CompValue((m_i32Data[ (2 * j    ) * inputWidth + i ] + 128) >> 8, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component); 
-        if (compFloat < minCompFloat || compFloat > maxCompFloat) {
-          //printf("value Cr %d %7.3f %7.3f %7.3f  %7.3f\n", inpY[ (2 * j    ) * width + 2 * i ], yFloat, minCompFloat, maxCompFloat, compFloat);
-          if (compFloat < minCompFloat) {
-            //printf("value %d %d\n", m_i32Data[ (2 * j    ) * inputWidth + i ], ConvFloatToFixed::convertUi16Value(minCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256);
-            m_i32Data[ (2 * j    ) * inputWidth + i ] = ConvFloatToFixed::convertUi16Value((float) minCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256;
-          }
-          else if (compFloat > maxCompFloat) {
-            //printf("value %d %d\n", m_i32Data[ (2 * j    ) * inputWidth + i ], ConvFloatToFixed::convertUi16Value(maxCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256);
-            m_i32Data[ (2 * j    ) * inputWidth + i ] = ConvFloatToFixed::convertUi16Value((float) maxCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256;
-          }
-        }
-        
-        yDouble = ConvFixedToFloat::convertUi16CompValue(inpY[ (2 * j + 1 ) * width + 2 * i ], m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[Y_COMP], Y_COMP); 
-        minCompFloat = (dMax(yDouble - 1.0 + transformY[0], 0.0) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-        maxCompFloat = (dMin(yDouble, transformY[0]) - (transformY[0] * yDouble)) / (transformY[0] * denom);
-
-        m_i32Data[ (2 * j + 1) * inputWidth + i ] = filterVertical(&inp[i], m_verFilter[1], j + 1, inputWidth, inputHeight - 1, minValue, maxValue);
-        compFloat = ConvFixedToFloat::convertUi16CompValue((m_i32Data[ (2 * j + 1) * inputWidth + i ] + 128) >> 8, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component); 
-        if (compFloat < minCompFloat || compFloat > maxCompFloat) {
-          //printf("value Cr %d %7.3f %7.3f %7.3f %7.3f\n", inpY[ (2 * j + 1 ) * width + 2 * i ], yFloat, minCompFloat, maxCompFloat, compFloat);
-          if (compFloat < minCompFloat) {
-            //printf("value %d %d\n", m_i32Data[ (2 * j + 1) * inputWidth + i ], ConvFloatToFixed::convertUi16Value(minCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256);
-            m_i32Data[ (2 * j + 1) * inputWidth + i ]  = ConvFloatToFixed::convertUi16Value((float) minCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256;
-          }
-          else if (compFloat > maxCompFloat) {
-            //printf("value %d %d\n", m_i32Data[ (2 * j + 1) * inputWidth + i ] , ConvFloatToFixed::convertUi16Value(maxCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256);
-            m_i32Data[ (2 * j + 1) * inputWidth + i ] = ConvFloatToFixed::convertUi16Value((float) maxCompFloat, m_format->m_sampleRange, m_format->m_colorSpace, m_format->m_bitDepthComp[component], component) * 256;
-          }
-        }
-      }
-    }
-    
-    for (j = 0; j < height; j++) {
-      for (i = 0; i < inputWidth; i++) {
-        out[ j * width + 2 * i     ] = filterHorizontal(&m_i32Data[ j * inputWidth], m_horFilter[0], i    , inputWidth - 1, minValue, maxValue);
-        out[ j * width + 2 * i + 1 ] = filterHorizontal(&m_i32Data[ j * inputWidth], m_horFilter[1], i + 1, inputWidth - 1, minValue, maxValue);
-      }
+  filterVertical(&m_i32Data[0], inp, inputWidth, inputHeight, minValue, maxValue, [&](int32 *row, int y) {
+    const uint16 *pInpY = inpY + (int64) y * width;
+    for (int i = 0; i < inputWidth; i++) {
+      double yDouble = ConvFixedToFloat::convertUi16CompValue(pInpY[2 * i], format->m_sampleRange, format->m_colorSpace, format->m_bitDepthComp[Y_COMP], Y_COMP); 
+      double minCompFloat = (dMax(yDouble - 1.0 + weight, 0.0) - (weight * yDouble)) / divisor;
+      double maxCompFloat = (dMin(yDouble, weight) - (weight * yDouble)) / divisor;
+      // samples carry 8 additional bits of precision after the vertical pass
+      double compFloat = ConvFixedToFloat::convertUi16CompValue((row[i] + 128) >> 8, format->m_sampleRange, format->m_colorSpace, format->m_bitDepthComp[component], component); 
+      if (compFloat < minCompFloat)
+        row[i] = ConvFloatToFixed::convertUi16Value((float) minCompFloat, format->m_sampleRange, format->m_colorSpace, format->m_bitDepthComp[component], component) * 256;
+      else if (compFloat > maxCompFloat)
+        row[i] = ConvFloatToFixed::convertUi16Value((float) maxCompFloat, format->m_sampleRange, format->m_colorSpace, format->m_bitDepthComp[component], component) * 256;
     }
-  }
+  });
+  filterHorizontal(out, &m_i32Data[0], width, height, minValue, maxValue, [](uint16 *, int) {});
 }
 
 void Conv420to444Adaptive::filter(imgpel *out, const imgpel *inp, const imgpel *inpY, int conversionMatrix, int width, int height, int minValue, int maxValue)
 {
-  int i, j;
-  int inputWidth  = width >> 1;
-  int inputHeight = height >> 1;
-  
-  for (j = 0; j < inputHeight; j++) {
-    for (i = 0; i < inputWidth; i++) {
-      m_i32Data[ (2 * j    ) * inputWidth + i ] = filterVertical(&inp[i], m_verFilter[0], j    , inputWidth, inputHeight - 1, minValue, maxValue);
-      m_i32Data[ (2 * j + 1) * inputWidth + i ] = filterVertical(&inp[i], m_verFilter[1], j + 1, inputWidth, inputHeight - 1, minValue, maxValue);
-    }
-  }
-  
-  for (j = 0; j < height; j++) {
-    for (i = 0; i < inputWidth; i++) {
-      out[ j * width + 2 * i     ] = filterHorizontal(&m_i32Data[ j * inputWidth], m_horFilter[0], i    , inputWidth - 1, minValue, maxValue);
-      out[ j * width + 2 * i + 1 ] = filterHorizontal(&m_i32Data[ j * inputWidth], m_horFilter[1], i + 1, inputWidth - 1, minValue, maxValue);
-    }
-  }
+  filterVertical  (&m_i32Data[0], inp, width >> 1, height >> 1, minValue, maxValue, [](int32 *, int) {});
+  filterHorizontal(out, &m_i32Data[0], width, height, minValue, maxValue, [](imgpel *, int) {});
 }
-
 //-----------------------------------------------------------------------------
 // Public methods
 //-----------------------------------------------------------------------------
@@ -54,12 +54,207 @@
 
 #include "Global.H"
 #include "Conv444to420CrBounds.H"
+#include "ThreadPool.H"
+#include "CPUFeatures.H"
 #include <string.h>
 
 //-----------------------------------------------------------------------------
 // Macros
 //-----------------------------------------------------------------------------
 #define DFSET 1
+#define DF_COUNT 5       // number of candidate filters
+
+//-----------------------------------------------------------------------------
+// Row kernels
+//-----------------------------------------------------------------------------
+
+// All kernels evaluate the DF_COUNT candidate filters for a run of samples of one row.
+// taps[k * maxTaps + t] points to the input of tap t of filter k for sample 0, and
+// consecutive samples use consecutive inputs. A sample takes the first filter whose
+// support does not span more than threshold, or the last filter if none qualifies.
+
+static void selectSamples(float *out, const float *const *taps, int maxTaps, ScaleFilter *const *filters, int start, int count, double threshold, float minValue, float maxValue)
+{
+  for (int i = start; i < count; i++) {
+    for (int k = 0; k < DF_COUNT; k++) {
+      const ScaleFilter  *filter = filters[k];
+      const float *const *kTaps  = taps + k * maxTaps;
+      double minRange =  1e37;
+      double maxRange = -1e37;
+      bool   isSmooth = TRUE;
+      int t;
+      
+      for (t = 0; t < filter->m_numberOfTaps; t++) {
+        double value = (double) kTaps[t][i];
+        if (value < minRange)
+          minRange = value;
+        if (value > maxRange)
+          maxRange = value;
+        if ((maxRange - minRange) > threshold) {
+          isSmooth = FALSE;
+          break;
+        }
+      }
+      
+      if (isSmooth == TRUE || k == DF_COUNT - 1) {
+        double value = 0.0;
+        for (t = 0; t < filter->m_numberOfTaps; t++)
+          value += (double) filter->m_floatFilter[t] * (double) kTaps[t][i];
+        if (filter->m_clip == TRUE)
+          out[i] = fClip((float) ((value + (double) filter->m_floatOffset) * (double) filter->m_floatScale), minValue, maxValue);
+        else
+          out[i] = (float) ((value + (double) filter->m_floatOffset) * (double) filter->m_floatScale);
+        break;
+      }
+    }
+  }
+}
+
+static void selectSamples(int32 *out, const int32 *const *taps, int maxTaps, ScaleFilter *const *filters, int start, int count, double threshold, int minValue, int maxValue)
+{
+  for (int i = start; i < count; i++) {
+    for (int k = 0; k < DF_COUNT; k++) {
+      const ScaleFilter  *filter = filters[k];
+      const int32 *const *kTaps  = taps + k * maxTaps;
+      int  minRange = INT_MAX;
+      int  maxRange = INT_MIN;
+      bool isSmooth = TRUE;
+      int t;
+      
+      for (t = 0; t < filter->m_numberOfTaps; t++) {
+        int value = kTaps[t][i];
+        if (value < minRange)
+          minRange = value;
+        if (value > maxRange)
+          maxRange = value;
+        if ((maxRange - minRange) > threshold) {
+          isSmooth = FALSE;
+          break;
+        }
+      }
+      
+      if (isSmooth == TRUE || k == DF_COUNT - 1) {
+        int value = 0;
+        for (t = 0; t < filter->m_numberOfTaps; t++)
+          value += filter->m_i32Filter[t] * kTaps[t][i];
+        if (filter->m_clip == TRUE)
+          out[i] = iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
+        else
+          out[i] = (value + filter->m_i32Offset) >> filter->m_i32Shift;
+        break;
+      }
+    }
+  }
+}
+
+#if ENABLE_SIMD_DISPATCH
+// AVX2 versions of the above. Every candidate filter is applied to the whole vector
+// and the results are blended from the last filter to the first, so that each lane
+// keeps the first filter whose support range passes the edge test. The operation
+// order is that of the scalar code (no fused multiply-add), so results are identical.
+SIMD_TARGET("avx2")
+static int selectSamplesAVX2(float *out, const float *const *taps, int maxTaps, ScaleFilter *const *filters, int count, double threshold, float minValue, float maxValue)
+{
+  const __m256d thr  = _mm256_set1_pd(threshold);
+  const __m128  minV = _mm_set1_ps(minValue);
+  const __m128  maxV = _mm_set1_ps(maxValue);
+  int i;
+  
+  for (i = 0; i + 4 <= count; i += 4) {
+    __m128 result = _mm_setzero_ps();
+    for (int k = DF_COUNT - 1; k >= 0; k--) {
+      const ScaleFilter  *filter = filters[k];
+      const float *const *kTaps  = taps + k * maxTaps;
+      __m256d minRange = _mm256_set1_pd( 1e37);
+      __m256d maxRange = _mm256_set1_pd(-1e37);
+      __m256d value    = _mm256_setzero_pd();
+      
+      for (int t = 0; t < filter->m_numberOfTaps; t++) {
+        __m256d x = _mm256_cvtps_pd(_mm_loadu_ps(kTaps[t] + i));
+        minRange = _mm256_min_pd(x, minRange);
+        maxRange = _mm256_max_pd(x, maxRange);
+        value    = _mm256_add_pd(value, _mm256_mul_pd(_mm256_set1_pd((double) filter->m_floatFilter[t]), x));
+      }
+      value = _mm256_mul_pd(_mm256_add_pd(value, _mm256_set1_pd((double) filter->m_floatOffset)), _mm256_set1_pd((double) filter->m_floatScale));
+      __m128 filtered = _mm256_cvtpd_ps(value);
+      if (filter->m_clip == TRUE)
+        filtered = _mm_min_ps(_mm_max_ps(filtered, minV), maxV);
+      
+      if (k == DF_COUNT - 1) {
+        result = filtered;
+      }
+      else {
+        // narrow the 64 bit edge mask to 32 bit lanes; edges keep the result of the later filters
+        __m256 edge = _mm256_castpd_ps(_mm256_cmp_pd(_mm256_sub_pd(maxRange, minRange), thr, _CMP_GT_OQ));
+        __m128 mask = _mm_shuffle_ps(_mm256_castps256_ps128(edge), _mm256_extractf128_ps(edge, 1), _MM_SHUFFLE(2, 0, 2, 0));
+        result = _mm_blendv_ps(filtered, result, mask);
+      }
+    }
+    _mm_storeu_ps(out + i, result);
+  }
+  return i;
+}
+
+SIMD_TARGET("avx2")
+static int selectSamplesAVX2(int32 *out, const int32 *const *taps, int maxTaps, ScaleFilter *const *filters, int count, double threshold, int minValue, int maxValue)
+{
+  // integer ranges exceed threshold exactly when they exceed its integer part
+  const __m256i thr  = _mm256_set1_epi32((int) floor(threshold));
+  const __m256i minV = _mm256_set1_epi32(minValue);
+  const __m256i maxV = _mm256_set1_epi32(maxValue);
+  int i;
+  
+  for (i = 0; i + 8 <= count; i += 8) {
+    __m256i result = _mm256_setzero_si256();
+    for (int k = DF_COUNT - 1; k >= 0; k--) {
+      const ScaleFilter  *filter = filters[k];
+      const int32 *const *kTaps  = taps + k * maxTaps;
+      __m256i minRange = _mm256_set1_epi32(INT_MAX);
+      __m256i maxRange = _mm256_set1_epi32(INT_MIN);
+      __m256i value    = _mm256_setzero_si256();
+      
+      for (int t = 0; t < filter->m_numberOfTaps; t++) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (kTaps[t] + i));
+        minRange = _mm256_min_epi32(x, minRange);
+        maxRange = _mm256_max_epi32(x, maxRange);
+        value    = _mm256_add_epi32(value, _mm256_mullo_epi32(_mm256_set1_epi32(filter->m_i32Filter[t]), x));
+      }
+      value = _mm256_sra_epi32(_mm256_add_epi32(value, _mm256_set1_epi32(filter->m_i32Offset)), _mm_cvtsi32_si128(filter->m_i32Shift));
+      if (filter->m_clip == TRUE)
+        value = _mm256_min_epi32(_mm256_max_epi32(value, minV), maxV);
+      
+      if (k == DF_COUNT - 1)
+        result = value;
+      else
+        result = _mm256_blendv_epi8(value, result, _mm256_cmpgt_epi32(_mm256_sub_epi32(maxRange, minRange), thr));
+    }
+    _mm256_storeu_si256((__m256i *) (out + i), result);
+  }
+  return i;
+}
+#endif
+
+template <typename T> static void selectRow(T *out, const T *const *taps, int maxTaps, ScaleFilter *const *filters, int count, double threshold, T minValue, T maxValue)
+{
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = selectSamplesAVX2(out, taps, maxTaps, filters, count, threshold, minValue, maxValue);
+#endif
+  selectSamples(out, taps, maxTaps, filters, i, count, threshold, minValue, maxValue);
+}
+
+//! Split one row, with pad replicated edge samples on each side, in its even and odd samples
+template <typename T, typename D> static void splitRow(D *even, D *odd, const T *src, int size, int pad)
+{
+  for (int q = 0; q < size + 2 * pad; q++) {
+    D value = (D) src[iClip(q - pad, 0, size - 1)];
+    if (q & 1)
+      odd [q >> 1] = value;
+    else
+      even[q >> 1] = value;
+  }
+}
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
@@ -126,6 +321,14 @@ Conv444to420CrBounds::Conv444to420CrBounds(int width, int height, int method, Ch
 #endif
 
   m_edgeClassifier = 0.15;
+  
+  // samples needed beyond the row edges by any of the candidate filters
+  m_maxTaps = 0;
+  m_padding = 0;
+  for (int index = 0; index < DF_COUNT; index++) {
+    m_maxTaps = iMax(m_maxTaps, iMax(m_horFilterDown[index]->m_numberOfTaps, m_verFilterDown[index]->m_numberOfTaps));
+    m_padding = iMax(m_padding, iMax(m_horFilterDown[index]->m_positionOffset, m_horFilterDown[index]->m_numberOfTaps - 1 - m_horFilterDown[index]->m_positionOffset));
+  }
 }
 
 Conv444to420CrBounds::~Conv444to420CrBounds() {
@@ -148,339 +351,86 @@ void Conv444to420CrBounds::setupFilter(int index, DownSamplingFilters filter, in
   m_verFilterDown[index] = new ScaleFilter(filter, 0,  2, offset, scale, &downOffset, &downScale, vPhase);
 }
 
-float Conv444to420CrBounds::filterHorizontal(const float *inp, const ScaleFilter *filter, int pos_x, int width, float minValue, float maxValue) {
-  double value = 0.0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value += (double) filter->m_floatFilter[i] * (double) inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return fClip((float) ((value + (double) filter->m_floatOffset) * (double) filter->m_floatScale), minValue, maxValue);
-  else
-    return (float) ((value + (double) filter->m_floatOffset) * (double) filter->m_floatScale);
-}
-
-int Conv444to420CrBounds::filterHorizontal(const uint16 *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-int Conv444to420CrBounds::filterHorizontal(const int32 *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-  }
-
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-int Conv444to420CrBounds::filterHorizontal(const imgpel *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-bool Conv444to420CrBounds::analyzeHorizontal(const float *inp, const ScaleFilter *filter, int pos_x, int width, float minValue, float maxValue) {
-  double minRange =  1e37;
-  double maxRange = -1e37;
-  
-  double value = 0.0;
-  // compute bounds
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value = (double) inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-    if (value < minRange)
-      minRange = value;
-    if (value > maxRange)
-      maxRange = value;
-    if ((maxRange - minRange) > m_edgeClassifier)
-      return 0;
-  }
-  
-    return 1;
-}
-
-bool Conv444to420CrBounds::analyzeHorizontal(const uint16 *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int minRange = INT_MAX;
-  int maxRange = INT_MIN;
-  
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value = inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-    if (value < minRange)
-      minRange = value;
-    if (value > maxRange)
-      maxRange = value;
-    if ((maxRange - minRange) > m_edgeClassifier)
-      return 0;
-  }
-  
-  return 1;
-}
-
-bool Conv444to420CrBounds::analyzeHorizontal(const int32 *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int minRange = INT_MAX;
-  int maxRange = INT_MIN;
-  
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value = inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-    if (value < minRange)
-      minRange = value;
-    if (value > maxRange)
-      maxRange = value;
-    if ((maxRange - minRange) > m_edgeClassifier)
-      return 0;
-  }
-  return 1;
-}
-
-bool Conv444to420CrBounds::analyzeHorizontal(const imgpel *inp, const ScaleFilter *filter, int pos_x, int width, int minValue, int maxValue) {
-  int minRange = INT_MAX;
-  int maxRange = INT_MIN;
-  
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value = inp[iClip(pos_x + i - filter->m_positionOffset, 0, width)];
-    if (value < minRange)
-      minRange = value;
-    if (value > maxRange)
-      maxRange = value;
-    if ((maxRange - minRange) > m_edgeClassifier)
-      return 0;
-  }
-  return 1;
-}
-
-float Conv444to420CrBounds::filterVertical(const float *inp, const ScaleFilter *filter, int pos_y, int width, int height, float minValue, float maxValue) {
-  double value = 0.0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value += (double) filter->m_floatFilter[i] * (double) inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return fClip((float) ((value + (double) filter->m_floatOffset) * (double) filter->m_floatScale), -0.5, 0.5);
-  else
-    return (float) ((value + (double) filter->m_floatOffset) * (double) filter->m_floatScale);
-}
-
-int Conv444to420CrBounds::filterVertical(const int32 *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-  }
-
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-int Conv444to420CrBounds::filterVertical(const uint16 *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-int Conv444to420CrBounds::filterVertical(const imgpel *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value += filter->m_i32Filter[i] * inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-  }
-  
-  if (filter->m_clip == TRUE)
-    return iClip((value + filter->m_i32Offset) >> filter->m_i32Shift, minValue, maxValue);
-  else
-    return (value + filter->m_i32Offset) >> filter->m_i32Shift;
-}
-
-bool Conv444to420CrBounds::analyzeVertical(const float *inp, const ScaleFilter *filter, int pos_y, int width, int height, float minValue, float maxValue) {
-  double minRange =  1e37;
-  double maxRange = -1e37;
-
-  double value = 0.0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value = (double) inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-
-    if (value < minRange)
-      minRange = value;
-    if (value > maxRange)
-      maxRange = value;
-    if ((maxRange - minRange) > m_edgeClassifier)
-      return 0;
-  }
-  
-  return 1;
-}
-
-bool Conv444to420CrBounds::analyzeVertical(const int32 *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int minRange = INT_MAX;
-  int maxRange = INT_MIN;
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value = inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-    if (value < minRange)
-      minRange = value;
-    if (value > maxRange)
-      maxRange = value;
-    if ((maxRange - minRange) > m_edgeClassifier)
-      return 0;
-  }
-
-  return 1;
-}
-
-bool Conv444to420CrBounds::analyzeVertical(const uint16 *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int minRange = INT_MAX;
-  int maxRange = INT_MIN;
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value = inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-    if (value < minRange)
-      minRange = value;
-    if (value > maxRange)
-      maxRange = value;
-    if ((maxRange - minRange) > m_edgeClassifier)
-      return 0;
-  }
-  
-  return 1;
-}
-
-bool Conv444to420CrBounds::analyzeVertical(const imgpel *inp, const ScaleFilter *filter, int pos_y, int width, int height, int minValue, int maxValue) {
-  int minRange = INT_MAX;
-  int maxRange = INT_MIN;
-  int value = 0;
-  for (int i = 0; i < filter->m_numberOfTaps; i++) {
-    value = inp[iClip(pos_y + i - filter->m_positionOffset, 0, height) * width];
-    if (value < minRange)
-      minRange = value;
-    if (value > maxRange)
-      maxRange = value;
-    if ((maxRange - minRange) > m_edgeClassifier)
-      return 0;
-  }
-  
-  return 1;
-}
-
 //-----------------------------------------------------------------------------
 // Private methods
 //-----------------------------------------------------------------------------
-void Conv444to420CrBounds::filter(float *out, const float *inp, int width, int height, float minValue, float maxValue)
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Horizontal downsampling of inputHeight rows of width 2 * width.
+ *    Each row is split in its even and odd samples, so that the taps of
+ *    all candidate filters, for all output samples, are plain pointers
+ *    in these two arrays.
+ ************************************************************************
+ */
+template <typename T, typename D> void Conv444to420CrBounds::filterHorizontal(D *out, const T *inp, int width, int inputHeight, D minValue, D maxValue)
 {
-  int i, j, index;
-  int inp_width  = 2 * width;
-  int inputHeight = 2 * height;
-  bool  testSamples;
+  int inputWidth = 2 * width;
+  int bands = ThreadPool::getBandCount(inputHeight, 16);
+  
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int yStart = (int) ((int64) band * inputHeight / bands);
+    int yEnd   = (int) ((int64) (band + 1) * inputHeight / bands);
+    vector<D> even((inputWidth + 2 * m_padding + 1) >> 1);
+    vector<D> odd ((inputWidth + 2 * m_padding) >> 1);
+    vector<const D *> taps(DF_COUNT * m_maxTaps);
     
-  for (j = 0; j < inputHeight; j++) {
-    for (i = 0; i < width; i++) {
-      for (index = 0; index < 5; index ++) {
-        testSamples = analyzeHorizontal(&inp[ j * inp_width], m_horFilterDown[index], 2 * i, inp_width - 1, 0.0, 0.0);
-        if (testSamples == TRUE || index == 4) {
-          m_floatData[ j * width + i ] = filterHorizontal(&inp[ j * inp_width], m_horFilterDown[index], 2 * i, inp_width - 1, 0.0, 0.0);
-          break;
-        }
+    for (int k = 0; k < DF_COUNT; k++) {
+      for (int t = 0; t < m_horFilterDown[k]->m_numberOfTaps; t++) {
+        int pos = t - m_horFilterDown[k]->m_positionOffset + m_padding;
+        taps[k * m_maxTaps + t] = ((pos & 1) ? &odd[0] : &even[0]) + (pos >> 1);
       }
     }
-  }    
-  for (j = 0; j < height; j++) {
-    for (i = 0; i < width; i++) {
-      for (index = 0; index < 5; index ++) {
-        testSamples = analyzeVertical(&m_floatData[i], m_verFilterDown[index], (2 * j), width, inputHeight - 1, minValue, maxValue);
-        if (testSamples == TRUE || index == 4) {
-        out[ j * width + i ] = filterVertical(&m_floatData[i], m_verFilterDown[index], (2 * j), width, inputHeight - 1, minValue, maxValue);
-          break;
-        }
-      }
+    
+    for (int j = yStart; j < yEnd; j++) {
+      splitRow(&even[0], &odd[0], inp + (int64) j * inputWidth, inputWidth, m_padding);
+      selectRow(out + (int64) j * width, &taps[0], m_maxTaps, m_horFilterDown, width, m_edgeClassifier, minValue, maxValue);
     }
-  }
+  });
 }
 
-void Conv444to420CrBounds::filter(uint16 *out, const uint16 *inp, int width, int height, int minValue, int maxValue)
+template <typename D, typename O> void Conv444to420CrBounds::filterVertical(O *out, const D *inp, int width, int height, D minValue, D maxValue)
 {
-  int i, j, index;
-  int inp_width  = 2 * width;
   int inputHeight = 2 * height;
-  bool  testSamples;
+  int bands = ThreadPool::getBandCount(height, 16);
   
-  for (j = 0; j < inputHeight; j++) {
-    for (i = 0; i < width; i++) {
-      for (index = 0; index < 5; index ++) {
-        testSamples = analyzeHorizontal(&inp[ j * inp_width], m_horFilterDown[index], 2 * i, inp_width - 1, minValue, maxValue);
-        if (testSamples == TRUE || index == 4) {
-          m_i32Data[ j * width + i ] = filterHorizontal(&inp[ j * inp_width], m_horFilterDown[index], 2 * i, inp_width - 1, minValue, maxValue);
-          break;
-        }
-      }
-    }
-  }    
-  for (j = 0; j < height; j++) {
-    for (i = 0; i < width; i++) {
-      for (index = 0; index < 5; index ++) {
-        testSamples = analyzeVertical(&m_i32Data[i], m_verFilterDown[index], (2 * j), width, inputHeight - 1, minValue, maxValue);
-        if (testSamples == TRUE || index == 4) {
-          out[ j * width + i ] = filterVertical(&m_i32Data[i], m_verFilterDown[index], (2 * j), width, inputHeight - 1, minValue, maxValue);
-          break;
-        }
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int yStart = (int) ((int64) band * height / bands);
+    int yEnd   = (int) ((int64) (band + 1) * height / bands);
+    vector<const D *> taps(DF_COUNT * m_maxTaps);
+    vector<D> row(width);
+    
+    for (int j = yStart; j < yEnd; j++) {
+      for (int k = 0; k < DF_COUNT; k++) {
+        for (int t = 0; t < m_verFilterDown[k]->m_numberOfTaps; t++)
+          taps[k * m_maxTaps + t] = inp + (int64) iClip(2 * j + t - m_verFilterDown[k]->m_positionOffset, 0, inputHeight - 1) * width;
       }
+      selectRow(&row[0], &taps[0], m_maxTaps, m_verFilterDown, width, m_edgeClassifier, minValue, maxValue);
+      for (int i = 0; i < width; i++)
+        out[(int64) j * width + i] = (O) row[i];
     }
-  }
+  });
 }
 
-void Conv444to420CrBounds::filter(imgpel *out, const imgpel *inp, int width, int height, int minValue, int maxValue)
+void Conv444to420CrBounds::filter(float *out, const float *inp, int width, int height, float minValue, float maxValue)
 {
-  int i, j, index;
-  int inp_width  = 2 * width;
-  int inputHeight = 2 * height;
-  bool  testSamples;
-  
-  for (j = 0; j < inputHeight; j++) {
-    for (i = 0; i < width; i++) {
-      for (index = 0; index < 5; index ++) {
-        testSamples = analyzeHorizontal(&inp[ j * inp_width], m_horFilterDown[index], 2 * i, inp_width - 1, minValue, maxValue);
-        if (testSamples == TRUE || index == 4) {
-          m_i32Data[ j * width + i ] = filterHorizontal(&inp[ j * inp_width], m_horFilterDown[index], 2 * i, inp_width - 1, minValue, maxValue);
-          break;
-        }
-      }
-    }
-  }    
-  for (j = 0; j < height; j++) {
-    for (i = 0; i < width; i++) {
-      for (index = 0; index < 5; index ++) {
-        testSamples = analyzeVertical(&m_i32Data[i], m_verFilterDown[index], (2 * j), width, inputHeight - 1, minValue, maxValue);
-        if (testSamples == TRUE || index == 4) {
-          out[ j * width + i ] = filterVertical(&m_i32Data[i], m_verFilterDown[index], (2 * j), width, inputHeight - 1, minValue, maxValue);
-          break;
-        }
-      }
-    }
-  }
+  filterHorizontal(&m_floatData[0], inp, width, 2 * height, 0.0f, 0.0f);
+  // the vertical filters clip the chroma samples to their nominal range
+  filterVertical(out, &m_floatData[0], width, height, -0.5f, 0.5f);
+}
+
+void Conv444to420CrBounds::filter(uint16 *out, const uint16 *inp, int width, int height, int minValue, int maxValue)
+{
+  filterHorizontal(&m_i32Data[0], inp, width, 2 * height, minValue, maxValue);
+  filterVertical(out, &m_i32Data[0], width, height, minValue, maxValue);
 }
 
+void Conv444to420CrBounds::filter(imgpel *out, const imgpel *inp, int width, int height, int minValue, int maxValue)
+{
+  filterHorizontal(&m_i32Data[0], inp, width, 2 * height, minValue, maxValue);
+  filterVertical(out, &m_i32Data[0], width, height, minValue, maxValue);
+}
 //-----------------------------------------------------------------------------
 // Public methods
 //-----------------------------------------------------------------------------
@@ -54,11 +54,88 @@
 
 #include "Global.H"
 #include "ConvFixedToFloat.H"
+#include "CPUFeatures.H"
 
 //-----------------------------------------------------------------------------
 // Macros
 //-----------------------------------------------------------------------------
 
+//-----------------------------------------------------------------------------
+// SIMD kernels
+//-----------------------------------------------------------------------------
+
+// All component conversions are of the form fClip((float) (weight * ((double) (x >> bitScale) - preOffset) - postOffset), minValue, maxValue),
+// with the offset that is not used set to zero. The double precision operations are kept in the
+// same order as in the scalar code so that results are identical. The kernels return the number 
+// of samples converted; the remainder is left to the scalar loops.
+#if ENABLE_SIMD_DISPATCH
+template <typename T>
+SIMD_TARGET("avx2")
+static int fixedToFloatAVX2 (const T *iComp, float *oComp, int compSize, int bitScale, double weight, double preOffset, double postOffset, float minValue, float maxValue)
+{
+  const __m256d vWeight = _mm256_set1_pd(weight);
+  const __m256d vPre    = _mm256_set1_pd(preOffset);
+  const __m256d vPost   = _mm256_set1_pd(postOffset);
+  const __m256  vMin    = _mm256_set1_ps(minValue);
+  const __m256  vMax    = _mm256_set1_ps(maxValue);
+  const __m128i shift   = _mm_cvtsi32_si128(bitScale);
+  int i = 0;
+  
+  for (; i + 8 <= compSize; i += 8) {
+    __m256i x;
+    if (sizeof(T) == 1)
+      x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) (iComp + i)));
+    else
+      x = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (iComp + i)));
+    x = _mm256_srl_epi32(x, shift);
+    __m256d lo = _mm256_sub_pd(_mm256_mul_pd(vWeight, _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)), vPre)), vPost);
+    __m256d hi = _mm256_sub_pd(_mm256_mul_pd(vWeight, _mm256_sub_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1)), vPre)), vPost);
+    __m256  v  = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+    _mm256_storeu_ps(oComp + i, _mm256_min_ps(_mm256_max_ps(v, vMin), vMax));
+  }
+  return i;
+}
+
+template <typename T>
+SIMD_TARGET("sse4.1")
+static int fixedToFloatSSE41 (const T *iComp, float *oComp, int compSize, int bitScale, double weight, double preOffset, double postOffset, float minValue, float maxValue)
+{
+  const __m128d vWeight = _mm_set1_pd(weight);
+  const __m128d vPre    = _mm_set1_pd(preOffset);
+  const __m128d vPost   = _mm_set1_pd(postOffset);
+  const __m128  vMin    = _mm_set1_ps(minValue);
+  const __m128  vMax    = _mm_set1_ps(maxValue);
+  const __m128i shift   = _mm_cvtsi32_si128(bitScale);
+  int i = 0;
+  
+  for (; i + 4 <= compSize; i += 4) {
+    __m128i x;
+    if (sizeof(T) == 1)
+      x = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int *) (iComp + i)));
+    else
+      x = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) (iComp + i)));
+    x = _mm_srl_epi32(x, shift);
+    __m128d lo = _mm_sub_pd(_mm_mul_pd(vWeight, _mm_sub_pd(_mm_cvtepi32_pd(x), vPre)), vPost);
+    __m128d hi = _mm_sub_pd(_mm_mul_pd(vWeight, _mm_sub_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(x, x)), vPre)), vPost);
+    __m128  v  = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+    _mm_storeu_ps(oComp + i, _mm_min_ps(_mm_max_ps(v, vMin), vMax));
+  }
+  return i;
+}
+#endif
+
+template <typename T>
+static int fixedToFloatSIMD (const T *iComp, float *oComp, int compSize, int bitScale, double weight, double preOffset, double postOffset, float minValue, float maxValue)
+{
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    return fixedToFloatAVX2(iComp, oComp, compSize, bitScale, weight, preOffset, postOffset, minValue, maxValue);
+  if (CPUFeatures::hasSSE41())
+    return fixedToFloatSSE41(iComp, oComp, compSize, bitScale, weight, preOffset, postOffset, minValue, maxValue);
+#endif
+  return 0;
+}
+
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
@@ -95,31 +172,46 @@ float ConvFixedToFloat::convertValue (const uint16 iComp, double weight, const u
 }
 
 void ConvFixedToFloat::convertComponent (const imgpel *iComp, float *oComp, int compSize, double weight, double offset, float minValue, float maxValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = fixedToFloatSIMD(iComp, oComp, compSize, 0, weight, 0.0, offset, minValue, maxValue);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = fClip((float) ((weight * (double) (*iComp++)) - offset), minValue, maxValue);
   }
 }
 
 void ConvFixedToFloat::convertComponent (const uint16 *iComp, float *oComp, int compSize, double weight, double offset, float minValue, float maxValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = fixedToFloatSIMD(iComp, oComp, compSize, 0, weight, 0.0, offset, minValue, maxValue);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = fClip((float) ((weight * (double) (*iComp++)) - offset), minValue, maxValue);
   }
 }
 
 void ConvFixedToFloat::convertComponent (const imgpel *iComp, float *oComp, int compSize, double weight, const uint16 offset, float minValue, float maxValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = fixedToFloatSIMD(iComp, oComp, compSize, 0, weight, (double) offset, 0.0, minValue, maxValue);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = fClip((float) ((weight * (double) (*iComp++ - offset))), minValue, maxValue);
   }
 }
 
 void ConvFixedToFloat::convertComponent (const uint16 *iComp, float *oComp, int compSize, double weight, const uint16 offset, float minValue, float maxValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = fixedToFloatSIMD(iComp, oComp, compSize, 0, weight, (double) offset, 0.0, minValue, maxValue);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = fClip((float) ((weight * (double) (*iComp++ - offset))), minValue, maxValue);
   }
 }
 
 void ConvFixedToFloat::convertComponent (const uint16 *iComp, float *oComp, int bitScale, int compSize, double weight, double offset, float minValue, float maxValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = fixedToFloatSIMD(iComp, oComp, compSize, bitScale, weight, offset, 0.0, minValue, maxValue);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = fClip((float) (weight * (((double) (*iComp++ >> bitScale)) - offset)), minValue, maxValue);
   }
 }
@@ -54,17 +54,324 @@
 
 #include "Global.H"
 #include "ConvFloatToFixed.H"
+#include "CPUFeatures.H"
+#include "ThreadPool.H"
+#include <string.h>
+#include <vector>
 
 //-----------------------------------------------------------------------------
 // Macros
 //-----------------------------------------------------------------------------
+#define BAYER_SIZE         8
+#define BLUENOISE_SIZE    64
+#define BLUENOISE_SIGMA  1.5
+#define BLUENOISE_RADIUS   8
+#define ERRORDIFF_ROWS    64   // Rows per independently diffused band. Fixed so that results do not depend on the thread count
+
+//-----------------------------------------------------------------------------
+// SIMD kernels
+//-----------------------------------------------------------------------------
+
+// These compute fClip(fRound((float) (weight * (double) x + offset)), minValue, maxValue)
+// (or fRoundLowBias, through roundOffset) with the same double precision operations as
+// the scalar code, followed by a saturating pack. They return the number of samples
+// converted; the remainder is left to the scalar loops.
+#if ENABLE_SIMD_DISPATCH
+// Only used when weight is exactly representable as a float: the product of two floats is
+// then exact in double, and the fused multiply-add rounds the same as multiply and add.
+template <typename T>
+SIMD_TARGET("avx2,fma")
+static int floatToFixedAVX2 (const float *iComp, T *oComp, int compSize, double weight, double offset, float roundOffset, float minValue, float maxValue, int bitScale)
+{
+  const __m256d vWeight   = _mm256_set1_pd(weight);
+  const __m256d vOffset   = _mm256_set1_pd(offset);
+  const __m256  vRound    = _mm256_set1_ps(roundOffset);
+  const __m256  vMin      = _mm256_set1_ps(minValue);
+  const __m256  vMax      = _mm256_set1_ps(maxValue);
+  const __m256  signMask  = _mm256_set1_ps(-0.0f);
+  const __m128i shift     = _mm_cvtsi32_si128(bitScale);
+  int i = 0;
+  
+  for (; i + 16 <= compSize; i += 16) {
+    __m256i value[2];
+    for (int k = 0; k < 2; k++) {
+      __m256 x  = _mm256_loadu_ps(iComp + i + 8 * k);
+      __m128 lo = _mm256_cvtpd_ps(_mm256_fmadd_pd(vWeight, _mm256_cvtps_pd(_mm256_castps256_ps128(x)), vOffset));
+      __m128 hi = _mm256_cvtpd_ps(_mm256_fmadd_pd(vWeight, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)), vOffset));
+      __m256 v  = _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+      // fRound: sign(v) * floor(|v| + 0.5)
+      __m256 r  = _mm256_floor_ps(_mm256_add_ps(_mm256_andnot_ps(signMask, v), vRound));
+      r = _mm256_xor_ps(r, _mm256_and_ps(_mm256_cmp_ps(v, _mm256_setzero_ps(), _CMP_LT_OQ), signMask));
+      r = _mm256_min_ps(_mm256_max_ps(r, vMin), vMax);
+      value[k] = _mm256_cvttps_epi32(r);
+    }
+    // packus works within 128 bit lanes, restore the sample order
+    __m256i packed = _mm256_sll_epi16(_mm256_permute4x64_epi64(_mm256_packus_epi32(value[0], value[1]), 0xD8), shift);
+    if (sizeof(T) == 1)
+      _mm_storeu_si128((__m128i *) (oComp + i), _mm_packus_epi16(_mm256_castsi256_si128(packed), _mm256_extracti128_si256(packed, 1)));
+    else
+      _mm256_storeu_si256((__m256i *) (oComp + i), packed);
+  }
+  return i;
+}
+
+template <typename T>
+SIMD_TARGET("sse4.1")
+static int floatToFixedSSE41 (const float *iComp, T *oComp, int compSize, double weight, double offset, float roundOffset, float minValue, float maxValue, int bitScale)
+{
+  const __m128d vWeight   = _mm_set1_pd(weight);
+  const __m128d vOffset   = _mm_set1_pd(offset);
+  const __m128  vRound    = _mm_set1_ps(roundOffset);
+  const __m128  vMin      = _mm_set1_ps(minValue);
+  const __m128  vMax      = _mm_set1_ps(maxValue);
+  const __m128  signMask  = _mm_set1_ps(-0.0f);
+  const __m128i shift     = _mm_cvtsi32_si128(bitScale);
+  int i = 0;
+  
+  for (; i + 8 <= compSize; i += 8) {
+    __m128i value[2];
+    for (int k = 0; k < 2; k++) {
+      __m128 x  = _mm_loadu_ps(iComp + i + 4 * k);
+      __m128 lo = _mm_cvtpd_ps(_mm_add_pd(_mm_mul_pd(vWeight, _mm_cvtps_pd(x)), vOffset));
+      __m128 hi = _mm_cvtpd_ps(_mm_add_pd(_mm_mul_pd(vWeight, _mm_cvtps_pd(_mm_movehl_ps(x, x))), vOffset));
+      __m128 v  = _mm_movelh_ps(lo, hi);
+      __m128 r  = _mm_floor_ps(_mm_add_ps(_mm_andnot_ps(signMask, v), vRound));
+      r = _mm_xor_ps(r, _mm_and_ps(_mm_cmplt_ps(v, _mm_setzero_ps()), signMask));
+      r = _mm_min_ps(_mm_max_ps(r, vMin), vMax);
+      value[k] = _mm_cvttps_epi32(r);
+    }
+    __m128i packed = _mm_sll_epi16(_mm_packus_epi32(value[0], value[1]), shift);
+    if (sizeof(T) == 1)
+      _mm_storel_epi64((__m128i *) (oComp + i), _mm_packus_epi16(packed, packed));
+    else
+      _mm_storeu_si128((__m128i *) (oComp + i), packed);
+  }
+  return i;
+}
+#endif
+
+template <typename T>
+static int floatToFixedSIMD (const float *iComp, T *oComp, int compSize, double weight, double offset, float roundOffset, float minValue, float maxValue, int bitScale)
+{
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2() && CPUFeatures::hasFMA() && weight == (double) (float) weight)
+    return floatToFixedAVX2(iComp, oComp, compSize, weight, offset, roundOffset, minValue, maxValue, bitScale);
+  if (CPUFeatures::hasSSE41())
+    return floatToFixedSSE41(iComp, oComp, compSize, weight, offset, roundOffset, minValue, maxValue, bitScale);
+#endif
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Dither matrices
+//-----------------------------------------------------------------------------
+
+// Threshold matrix with values (rank + 0.5) / (size * size), in (0, 1). Each row is stored
+// twice so that size consecutive thresholds can be read starting from any column.
+class DitherMatrix {
+public:
+  int                m_size;
+  std::vector<float> m_data;
+
+  DitherMatrix(int size, const std::vector<int> &rank) : m_size(size), m_data(2 * size * size) {
+    float scale = 1.0f / (float) (size * size);
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x < size; x++) {
+        m_data[2 * size * y + x] = m_data[2 * size * y + x + size] = ((float) rank[y * size + x] + 0.5f) * scale;
+      }
+    }
+  }
+  const float *row(int y) const { return &m_data[2 * m_size * (y & (m_size - 1))]; }
+};
+
+static std::vector<int> bayerRanks() {
+  std::vector<int> rank(1, 0);
+  for (int size = 1; size < BAYER_SIZE; size <<= 1) {
+    std::vector<int> next(4 * size * size);
+    for (int y = 0; y < 2 * size; y++) {
+      for (int x = 0; x < 2 * size; x++) {
+        static const int quadrant[4] = { 0, 2, 3, 1 };
+        next[y * 2 * size + x] = 4 * rank[(y % size) * size + (x % size)] + quadrant[((y / size) << 1) + (x / size)];
+      }
+    }
+    rank.swap(next);
+  }
+  return rank;
+}
+
+// Void-and-cluster (Ulichney) ranking, using a toroidal Gaussian energy that is updated
+// incrementally. A fixed LCG seeds the initial pattern so that the matrix is reproducible.
+static std::vector<int> blueNoiseRanks() {
+  const int size  = BLUENOISE_SIZE;
+  const int mask  = size - 1;
+  const int total = size * size;
+  std::vector<double> kernel((2 * BLUENOISE_RADIUS + 1) * (2 * BLUENOISE_RADIUS + 1));
+  for (int dy = -BLUENOISE_RADIUS; dy <= BLUENOISE_RADIUS; dy++)
+    for (int dx = -BLUENOISE_RADIUS; dx <= BLUENOISE_RADIUS; dx++)
+      kernel[(dy + BLUENOISE_RADIUS) * (2 * BLUENOISE_RADIUS + 1) + dx + BLUENOISE_RADIUS] = exp(-(dx * dx + dy * dy) / (2.0 * BLUENOISE_SIGMA * BLUENOISE_SIGMA));
+
+  std::vector<char>   pattern(total, 0);
+  std::vector<double> energy(total, 0.0);
+  auto toggle = [&](int pos, bool set) {
+    double sign = set ? 1.0 : -1.0;
+    int y = pos / size, x = pos % size;
+    pattern[pos] = set;
+    for (int dy = -BLUENOISE_RADIUS; dy <= BLUENOISE_RADIUS; dy++) {
+      const double *k = &kernel[(dy + BLUENOISE_RADIUS) * (2 * BLUENOISE_RADIUS + 1) + BLUENOISE_RADIUS];
+      double *e = &energy[((y + dy) & mask) * size];
+      for (int dx = -BLUENOISE_RADIUS; dx <= BLUENOISE_RADIUS; dx++)
+        e[(x + dx) & mask] += sign * k[dx];
+    }
+  };
+  // Tightest cluster (highest energy minority pixel) or largest void (lowest energy majority pixel)
+  auto find = [&](bool cluster) {
+    int best = -1;
+    for (int pos = 0; pos < total; pos++) {
+      if (pattern[pos] == cluster && (best < 0 || (cluster ? energy[pos] > energy[best] : energy[pos] < energy[best])))
+        best = pos;
+    }
+    return best;
+  };
+
+  // Initial binary pattern
+  uint32 seed = 1;
+  int ones = total / 10;
+  for (int i = 0; i < ones; ) {
+    seed = seed * 1664525u + 1013904223u;
+    int pos = (int) ((seed >> 8) % (uint32) total);
+    if (!pattern[pos]) {
+      toggle(pos, TRUE);
+      i++;
+    }
+  }
+  // Spread the minority pixels out until the tightest cluster is also the largest void
+  for (;;) {
+    int cluster = find(TRUE);
+    toggle(cluster, FALSE);
+    int vacancy = find(FALSE);
+    if (vacancy == cluster) {
+      toggle(cluster, TRUE);
+      break;
+    }
+    toggle(vacancy, TRUE);
+  }
+
+  std::vector<int>    rank(total);
+  std::vector<char>   prototype = pattern;
+  std::vector<double> protoEnergy = energy;
+  for (int r = ones - 1; r >= 0; r--) {
+    int pos = find(TRUE);
+    rank[pos] = r;
+    toggle(pos, FALSE);
+  }
+  pattern = prototype;
+  energy  = protoEnergy;
+  for (int r = ones; r < total; r++) {
+    int pos = find(FALSE);
+    rank[pos] = r;
+    toggle(pos, TRUE);
+  }
+  return rank;
+}
+
+static const DitherMatrix &getDitherMatrix(int mode) {
+  static const DitherMatrix bayer(BAYER_SIZE, bayerRanks());
+  if (mode == DM_ORDERED)
+    return bayer;
+  static const DitherMatrix blueNoise(BLUENOISE_SIZE, blueNoiseRanks());
+  return blueNoise;
+}
+
+// Quantize value + threshold, with the threshold in (0, 1). Clipping before the truncation gives the
+// same result as clipping the floor, and also maps NaN to zero like fClip does.
+template <typename T>
+static void ditherRowOrdered(const float *iRow, T *oRow, int width, const float *thresholds, int size, int xOffset, double weight, double offset, int bitScale, float maxValue)
+{
+  for (int x0 = 0; x0 < width; x0 += size) {
+    const float *d = thresholds + ((x0 + xOffset) & (size - 1));
+    int count = iMin(size, width - x0);
+    for (int i = 0; i < count; i++) {
+      float value = (float) (weight * (double) iRow[x0 + i] + offset);
+      oRow[x0 + i] = (T) (((int) fClip(value + d[i], 0.0f, maxValue)) << bitScale);
+    }
+  }
+}
+
+// Serpentine Floyd-Steinberg. The accumulated value is limited to half a code outside the
+// output range so that clipped areas do not build up unbounded error. The error pushed to
+// the next sample is kept in a register; errors for the next row are accumulated in next,
+// indexed with a one sample margin on either side.
+template <typename T>
+static inline float diffuseSample(float value, float *carry, T *out, int bitScale, int maxPel, float maxValue)
+{
+  value = fClip(value + *carry, -0.5f, maxValue + 0.5f);
+  int q = iMin((int) (value + 0.5f), maxPel);
+  float error = value - (float) q;
+  *out = (T) (q << bitScale);
+  *carry = error * (7.0f / 16.0f);
+  return error;
+}
+
+template <typename T>
+static void ditherBandErrorDiffusion(const float *iComp, T *oComp, int width, int yStart, int yEnd, double weight, double offset, int bitScale, float maxValue)
+{
+  std::vector<float> buffer(2 * (width + 2), 0.0f);
+  float *cur  = &buffer[0];
+  float *next = &buffer[width + 2];
+  int maxPel = (int) maxValue;
+
+  for (int y = yStart; y < yEnd; y++) {
+    const float *iRow = iComp + (int64) y * width;
+    T *oRow = oComp + (int64) y * width;
+    float carry = 0.0f;
+    if (((y - yStart) & 1) == 0) {
+      for (int x = 0; x < width; x++) {
+        float error = diffuseSample((float) (weight * (double) iRow[x] + offset) + cur[x + 1], &carry, &oRow[x], bitScale, maxPel, maxValue);
+        next[x    ] += error * (3.0f / 16.0f);
+        next[x + 1] += error * (5.0f / 16.0f);
+        next[x + 2]  = error * (1.0f / 16.0f);
+      }
+    }
+    else {
+      for (int x = width - 1; x >= 0; x--) {
+        float error = diffuseSample((float) (weight * (double) iRow[x] + offset) + cur[x + 1], &carry, &oRow[x], bitScale, maxPel, maxValue);
+        next[x + 2] += error * (3.0f / 16.0f);
+        next[x + 1] += error * (5.0f / 16.0f);
+        next[x    ]  = error * (1.0f / 16.0f);
+      }
+    }
+    float *temp = cur;
+    cur  = next;
+    next = temp;
+    // A sweep assigns each entry of next before accumulating into it, except for the two entries it starts at
+    next[0] = next[1] = 0.0f;
+    next[width] = next[width + 1] = 0.0f;
+  }
+}
 
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
 
-ConvFloatToFixed::ConvFloatToFixed() {
-  m_lowbias = FALSE;
+ConvFloatToFixed::ConvFloatToFixed(const ConvertParams *params) {
+  m_lowbias   = FALSE;
+  m_isDither  = FALSE;
+  m_useSkew   = FALSE;
+  m_hasOffset = FALSE;
+  for (int c = 0; c < 3; c++)
+    m_ditherMode[c] = DM_NULL;
+  
+  if (params != NULL && params->m_isDither == TRUE) {
+    m_isDither  = TRUE;
+    m_useSkew   = params->m_useSkew;
+    m_hasOffset = params->m_hasOffset;
+    for (int c = 0; c < 3; c++) {
+      m_ditherMode[c] = params->m_ditherMode[c];
+      // Build the matrices now rather than on the first frame
+      if (m_ditherMode[c] == DM_ORDERED || m_ditherMode[c] == DM_BLUENOISE)
+        getDitherMatrix(m_ditherMode[c]);
+    }
+  }
 }
 
 ConvFloatToFixed::~ConvFloatToFixed() {
@@ -84,7 +391,10 @@ uint16 ConvFloatToFixed::convertValue (const float iComp, int bitScale, double w
 
 
 void ConvFloatToFixed::convertComponent (const float *iComp, imgpel *oComp, int compSize, double weight, double offset, int maxPelValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = floatToFixedSIMD(iComp, oComp, compSize, weight, offset, 0.5f, 0.0f, (float) maxPelValue, 0);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = (imgpel) fClip(fRound((float) (weight * (double) *iComp++ + offset)), 0.0f, (float) maxPelValue);
   }
 }
@@ -93,20 +403,29 @@ void ConvFloatToFixed::convertComponent (const float *iComp, uint16 *oComp, int
 
 //KW-KYH Float to 10bits 
 
-  for (int i = 0; i < compSize; i++) {
+  int i = floatToFixedSIMD(iComp, oComp, compSize, weight, offset, 0.5f, 0.0f, (float) maxPelValue, 0);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = (uint16) fClip(fRound((float) (weight * (double) *iComp++ + offset)), 0.0f, (float) maxPelValue);
   }
 }
 
 void ConvFloatToFixed::convertComponentLowBias (const float *iComp, uint16 *oComp, int compSize, double weight, double offset, int maxPelValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = floatToFixedSIMD(iComp, oComp, compSize, weight, offset, 0.475f, 0.0f, (float) maxPelValue, 0);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = (uint16) fClip(fRoundLowBias ((float) (weight * (double) *iComp++ + offset)), 0.0f, (float) maxPelValue);
   }
 }
 
 // Function used for the SDI_SCALED case
 void ConvFloatToFixed::convertComponent (const float *iComp, uint16 *oComp, int bitScale, int compSize, double weight, double offset, int maxPelValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = floatToFixedSIMD(iComp, oComp, compSize, weight, offset, 0.5f, 0.0f, (float) maxPelValue, bitScale);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = ((uint16) fClip(fRound((float) (weight * (double) *iComp++ + offset)), 0.0f, (float) maxPelValue)) << bitScale;
   }
 }
@@ -114,7 +433,10 @@ void ConvFloatToFixed::convertComponent (const float *iComp, uint16 *oComp, int
 
 // Function used for the Sim2 Display
 void ConvFloatToFixed::convertComponent (const float *iComp, uint16 *oComp, int compSize, int minPelValue, int maxPelValue) {
-  for (int i = 0; i < compSize; i++) {
+  int i = floatToFixedSIMD(iComp, oComp, compSize, 1.0, 0.0, 0.5f, (float) minPelValue, (float) maxPelValue, 0);
+  iComp += i;
+  oComp += i;
+  for (; i < compSize; i++) {
     *oComp++ = (uint16) fClip(fRound((float) *iComp++ ), (float) minPelValue, (float) maxPelValue);
   }
 }
@@ -304,6 +626,95 @@ void ConvFloatToFixed::convertUi16CompData(Frame* out, const Frame *inp) {
   }
 }
 
+// Same weights and offsets as convertCompData (8 bit) and convertUi16CompData
+void ConvFloatToFixed::getQuantizationParams(const Frame *out, int component, double *weight, double *offset, int *bitScale) {
+  int  bitDepth = out->m_bitDepthComp[component];
+  bool isChroma = component != Y_COMP && (out->m_colorSpace == CM_YCbCr || out->m_colorSpace == CM_ICtCp);
+  SampleRange sampleRange = out->m_sampleRange;
+  
+  if (out->m_bitDepth == 8 && sampleRange != SR_FULL)
+    sampleRange = SR_STANDARD;
+  
+  *bitScale = 0;
+  switch (sampleRange) {
+    case SR_FULL:
+      *weight = (double) (1 << bitDepth) - 1.0;
+      *offset = isChroma ? (double) (1 << (bitDepth - 1)) : 0.0;
+      break;
+    case SR_STANDARD:
+    default:
+      *weight = (1 << (bitDepth - 8)) * (isChroma ? 224.0 : 219.0);
+      *offset = (1 << (bitDepth - 8)) * (isChroma ? 128.0 : 16.0);
+      break;
+    case SR_RESTRICTED:
+      *weight = (double) ((1 << bitDepth) - (1 << (bitDepth - 7)));
+      *offset = (double) (1 << (isChroma ? bitDepth - 1 : bitDepth - 8));
+      break;
+    case SR_SDI_SCALED:
+    case SR_SDI:
+      *weight = (isChroma ? 253.00 : 253.75) * (1 << (bitDepth - 8));
+      *offset = (double) (1 << (isChroma ? bitDepth - 1 : bitDepth - 8));
+      if (sampleRange == SR_SDI_SCALED)
+        *bitScale = 16 - bitDepth;
+      break;
+  }
+}
+
+template <typename T>
+void ConvFloatToFixed::ditherComponent(const float *iComp, T *oComp, int width, int height, int component, int frameNo, double weight, double offset, int bitScale, int maxPelValue) {
+  float maxValue = (float) maxPelValue;
+  
+  if (m_ditherMode[component] == DM_ERRORDIFF) {
+    int bands = (height + ERRORDIFF_ROWS - 1) / ERRORDIFF_ROWS;
+    ThreadPool::parallelFor(bands, [&](int band) {
+      ditherBandErrorDiffusion(iComp, oComp, width, band * ERRORDIFF_ROWS, iMin(height, (band + 1) * ERRORDIFF_ROWS), weight, offset, bitScale, maxValue);
+    });
+  }
+  else {
+    const DitherMatrix &matrix = getDitherMatrix(m_ditherMode[component]);
+    int size = matrix.m_size;
+    int xOffset = 0, yOffset = 0;
+    if (m_hasOffset == TRUE && component != Y_COMP) {
+      xOffset = component == U_COMP ? size / 2 : size / 4;
+      yOffset = component == U_COMP ? size / 2 : (3 * size) / 4;
+    }
+    if (m_useSkew == TRUE) {
+      xOffset += frameNo * 13;
+      yOffset += frameNo * 29;
+    }
+    int bands = ThreadPool::getBandCount(height, 16);
+    ThreadPool::parallelFor(bands, [&](int band) {
+      int yStart = (int) ((int64) band * height / bands);
+      int yEnd   = (int) ((int64) (band + 1) * height / bands);
+      for (int y = yStart; y < yEnd; y++)
+        ditherRowOrdered(iComp + (int64) y * width, oComp + (int64) y * width, width, matrix.row(y + yOffset), size, xOffset & (size - 1), weight, offset, bitScale, maxValue);
+    });
+  }
+}
+
+void ConvFloatToFixed::ditherCompData(Frame* out, const Frame *inp) {
+  for (int c = Y_COMP; c <= V_COMP; c++) {
+    double weight, offset;
+    int bitScale;
+    getQuantizationParams(out, c, &weight, &offset, &bitScale);
+    
+    if (m_ditherMode[c] == DM_NULL) {
+      if (out->m_bitDepth == 8)
+        convertComponent (inp->m_floatComp[c], out->m_comp[c], inp->m_compSize[c], weight, offset, out->m_maxPelValue[c]);
+      else if (bitScale != 0)
+        convertComponent (inp->m_floatComp[c], out->m_ui16Comp[c], bitScale, inp->m_compSize[c], weight, offset, out->m_maxPelValue[c]);
+      else if (m_lowbias == TRUE && c != Y_COMP && out->m_sampleRange == SR_STANDARD && (out->m_colorSpace == CM_YCbCr || out->m_colorSpace == CM_ICtCp))
+        convertComponentLowBias (inp->m_floatComp[c], out->m_ui16Comp[c], inp->m_compSize[c], weight, offset, out->m_maxPelValue[c]);
+      else
+        convertComponent (inp->m_floatComp[c], out->m_ui16Comp[c], inp->m_compSize[c], weight, offset, out->m_maxPelValue[c]);
+    }
+    else if (out->m_bitDepth == 8)
+      ditherComponent(inp->m_floatComp[c], out->m_comp[c], out->m_width[c], out->m_height[c], c, out->m_frameNo, weight, offset, bitScale, out->m_maxPelValue[c]);
+    else
+      ditherComponent(inp->m_floatComp[c], out->m_ui16Comp[c], out->m_width[c], out->m_height[c], c, out->m_frameNo, weight, offset, bitScale, out->m_maxPelValue[c]);
+  }
+}
+
 //-----------------------------------------------------------------------------
 // Public methods
 //-----------------------------------------------------------------------------
@@ -313,7 +724,13 @@ void ConvFloatToFixed::process ( Frame* out, const Frame *inp) {
   out->m_frameNo = inp->m_frameNo;
   out->m_isAvailable = TRUE;
   
-  if (out->m_bitDepth == 8)
+  if (m_isDither == TRUE
+#ifdef __SIM2_SUPPORT_ENABLED__
+      && out->m_format.m_pixelFormat != PF_SIM2
+#endif
+      )
+    ditherCompData(out, inp);
+  else if (out->m_bitDepth == 8)
     convertCompData(out, inp);
   else
     convertUi16CompData(out, inp);
@@ -81,7 +81,7 @@ Convert *Convert::create(const FrameFormat *iFormat, const FrameFormat *oFormat,
     else if (iFormat->m_isFloat == FALSE && oFormat->m_isFloat == FALSE)
       result = new ConvertBitDepth();
     else if (iFormat->m_isFloat == TRUE && oFormat->m_isFloat == FALSE)
-      result = new ConvFloatToFixed();
+      result = new ConvFloatToFixed(params);
     else {
       fprintf(stderr, "Unsupported Conversion %d %d (%d %d %d %d)\n", iFormat->m_chromaFormat, oFormat->m_chromaFormat, iFormat->m_width[Y_COMP], iFormat->m_height[Y_COMP], oFormat->m_width[Y_COMP], oFormat->m_height[Y_COMP]);
       exit(EXIT_FAILURE);
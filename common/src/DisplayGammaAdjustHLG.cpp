@@ -58,6 +58,27 @@
 #include "Global.H"
 #include "DisplayGammaAdjustHLG.H"
 #include "ColorTransformGeneric.H"
+#include "CPUFeatures.H"
+#include "ThreadPool.H"
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Macros
+//-----------------------------------------------------------------------------
+
+// The gain tables are indexed by the exponent and the GAIN_STEP_BITS most
+// significant mantissa bits of the float luminance, i.e. 512 linearly
+// interpolated entries per octave. They cover [2^-20, 2^8), which includes the
+// 0.000001 luminance floor, so the deep shadows need no special handling.
+// Luminances above the range (and NaNs) use the exact expression.
+#define GAIN_STEP_BITS    9
+#define GAIN_FRAC_BITS    (23 - GAIN_STEP_BITS)
+#define GAIN_MIN_EXPONENT (127 - 20)
+#define GAIN_MAX_EXPONENT (127 + 8)
+#define GAIN_BASE         (GAIN_MIN_EXPONENT << GAIN_STEP_BITS)
+#define GAIN_SIZE         (((GAIN_MAX_EXPONENT - GAIN_MIN_EXPONENT) << GAIN_STEP_BITS) + 1)
+#define GAIN_LIMIT        256.0f
+#define MIN_LUMINANCE     0.000001f
 
 //-----------------------------------------------------------------------------
 // Constructor / destructor implementation
@@ -69,6 +90,16 @@ DisplayGammaAdjustHLG::DisplayGammaAdjustHLG(double gamma, double scale)
   m_linScale = scale;
   m_gamma    = gamma;
   m_transformY = NULL;
+  
+  m_forwardGain.resize(GAIN_SIZE);
+  m_inverseGain.resize(GAIN_SIZE);
+  for (int i = 0; i < GAIN_SIZE; i++) {
+    uint32 bits = (uint32) (GAIN_BASE + i) << GAIN_FRAC_BITS;
+    float y;
+    memcpy(&y, &bits, sizeof(float));
+    m_forwardGain[i] = (float) exactGain(y, TRUE);
+    m_inverseGain[i] = (float) exactGain(y, FALSE);
+  }
 }
 
 DisplayGammaAdjustHLG::~DisplayGammaAdjustHLG()
@@ -80,6 +111,119 @@ void DisplayGammaAdjustHLG::setup(Frame *frame) {
   ColorTransformGeneric::setYConversion(frame->m_colorPrimaries, (const double **) &m_transformY);
 }
 
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+// Gain applied to the (linear) RGB components for luminance y
+double DisplayGammaAdjustHLG::exactGain(double y, bool isForward)
+{
+  if (isForward == TRUE)
+    return m_linScale * pow(y, m_gamma) / y;
+  else
+    return pow(y,(1.0 - m_gamma) / m_gamma);
+}
+
+static inline float lookupGain(const float *table, float y)
+{
+  uint32 bits;
+  memcpy(&bits, &y, sizeof(float));
+  int   index = (int) (bits >> GAIN_FRAC_BITS) - GAIN_BASE;
+  float frac  = (float) (bits & ((1 << GAIN_FRAC_BITS) - 1)) * (1.0f / (float) (1 << GAIN_FRAC_BITS));
+  return table[index] + frac * (table[index + 1] - table[index]);
+}
+
+#if ENABLE_SIMD_DISPATCH
+// Processes 8 pixels starting at pos with the same operation order as the scalar code.
+// Returns a bit mask of the pixels whose luminance is outside of the table range;
+// these are neither processed nor written.
+SIMD_TARGET("avx2")
+static int applyGainAVX2(float * const *out, const float * const *inp, int pos, const float *table, const float *weight, float scale, bool clampInput)
+{
+  __m256 v[3];
+  for (int c = 0; c < 3; c++) {
+    v[c] = _mm256_mul_ps(_mm256_loadu_ps(inp[c] + pos), _mm256_set1_ps(scale));
+    if (clampInput)
+      v[c] = _mm256_max_ps(_mm256_setzero_ps(), v[c]);
+  }
+  __m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(weight[R_COMP]), v[R_COMP]), _mm256_mul_ps(_mm256_set1_ps(weight[G_COMP]), v[G_COMP])), _mm256_mul_ps(_mm256_set1_ps(weight[B_COMP]), v[B_COMP]));
+  y = _mm256_max_ps(_mm256_set1_ps(MIN_LUMINANCE), y);
+  
+  __m256  inRange = _mm256_cmp_ps(y, _mm256_set1_ps(GAIN_LIMIT), _CMP_LT_OQ);
+  __m256i bits    = _mm256_castps_si256(y);
+  __m256i index   = _mm256_sub_epi32(_mm256_srli_epi32(bits, GAIN_FRAC_BITS), _mm256_set1_epi32(GAIN_BASE));
+  __m256  frac    = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(bits, _mm256_set1_epi32((1 << GAIN_FRAC_BITS) - 1))), _mm256_set1_ps(1.0f / (float) (1 << GAIN_FRAC_BITS)));
+  __m256  g0      = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), table,     index, inRange, 4);
+  __m256  g1      = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), table + 1, index, inRange, 4);
+  __m256  gain    = _mm256_add_ps(g0, _mm256_mul_ps(frac, _mm256_sub_ps(g1, g0)));
+  
+  // Out of range pixels are not stored, so that they can be redone in place
+  for (int c = 0; c < 3; c++)
+    _mm256_maskstore_ps(out[c] + pos, _mm256_castps_si256(inRange), _mm256_mul_ps(v[c], gain));
+  
+  return _mm256_movemask_ps(inRange) ^ 0xFF;
+}
+#endif
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Apply the forward (scene to display) or inverse system gamma to the
+ *    float RGB planes, in row bands on the thread pool. Input and output
+ *    may be the same planes.
+ ************************************************************************
+ */
+void DisplayGammaAdjustHLG::applyGain(float * const *out, const float * const *inp, int width, int height, const double *transformY, bool isForward)
+{
+  const float *table   = isForward == TRUE ? &m_forwardGain[0] : &m_inverseGain[0];
+  float weight[3]      = { (float) transformY[R_COMP], (float) transformY[G_COMP], (float) transformY[B_COMP] };
+  float scale          = isForward == TRUE ? 1.0f : (float) (1.0 / m_linScale);
+  bool  clampInput     = isForward == FALSE;
+  int   bands          = ThreadPool::getBandCount(height, 16);
+  
+  // Single pixel, with the exact gain outside of the table range
+  auto applyPixel = [&](int i) {
+    float v[3];
+    for (int c = 0; c < 3; c++) {
+      v[c] = inp[c][i] * scale;
+      if (clampInput)
+        v[c] = 0.0f > v[c] ? 0.0f : v[c];
+    }
+    float y = weight[R_COMP] * v[R_COMP] + weight[G_COMP] * v[G_COMP] + weight[B_COMP] * v[B_COMP];
+    y = MIN_LUMINANCE > y ? MIN_LUMINANCE : y;
+    float gain = y < GAIN_LIMIT ? lookupGain(table, y) : (float) exactGain(y, isForward);
+    for (int c = 0; c < 3; c++)
+      out[c][i] = v[c] * gain;
+  };
+  
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int start = (int) ((int64) band * height / bands) * width;
+    int end   = (int) ((int64) (band + 1) * height / bands) * width;
+    int i = start;
+    
+#if ENABLE_SIMD_DISPATCH
+    if (CPUFeatures::hasAVX2()) {
+      for (; i + 8 <= end; i += 8) {
+        int outOfRange = applyGainAVX2(out, inp, i, table, weight, scale, clampInput);
+        if (outOfRange != 0) {
+          for (int k = 0; k < 8; k++) {
+            if ((outOfRange >> k) & 1)
+              applyPixel(i + k);
+          }
+        }
+      }
+    }
+#endif
+    
+    for (; i < end; i++)
+      applyPixel(i);
+  });
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
 void DisplayGammaAdjustHLG::forward(double &comp0, double &comp1, double &comp2)
 {
   double vComp0, vComp1, vComp2;
@@ -166,24 +310,10 @@ void DisplayGammaAdjustHLG::forward(Frame *frame)
 {
   if (frame->m_isFloat == TRUE && frame->m_compSize[Y_COMP] == frame->m_compSize[Cb_COMP])  {
     if (frame->m_colorSpace == CM_RGB) {
-      double vComp[3];
       const double *transformY = NULL;
 
       ColorTransformGeneric::setYConversion(frame->m_colorPrimaries, &transformY);
-      
-      for (int index = 0; index < frame->m_compSize[Y_COMP]; index++) {
-        for(int component = 0; component < 3; component++)  {
-          //vComp[component] = frame->m_floatComp[component][index] / m_tfScale;
-          vComp[component] = frame->m_floatComp[component][index];
-        }
-        
-        double ySignal = dMax(0.000001, transformY[R_COMP] * vComp[R_COMP] + transformY[G_COMP] * vComp[G_COMP] + transformY[B_COMP] * vComp[B_COMP]);
-        double yDisplay = m_linScale * pow(ySignal, m_gamma) / ySignal;
-        
-        for(int component = 0; component < 3; component++)  {
-          frame->m_floatComp[component][index] = (float) (vComp[component] * yDisplay) ;
-        }  
-      }
+      applyGain(frame->m_floatComp, frame->m_floatComp, frame->m_width[Y_COMP], frame->m_height[Y_COMP], transformY, TRUE);
       // reset the pointer (just for safety
       transformY = NULL;
     }
@@ -194,24 +324,10 @@ void DisplayGammaAdjustHLG::forward(Frame *out, const Frame *inp)
 {
   if (inp->m_isFloat == TRUE && out->m_isFloat == TRUE && inp->m_size == out->m_size && inp->m_compSize[Y_COMP] == inp->m_compSize[Cb_COMP])  {    
     if (inp->m_colorSpace == CM_RGB && out->m_colorSpace == CM_RGB) {
-      double vComp[3];
       const double *transformY = NULL;
 
       ColorTransformGeneric::setYConversion(inp->m_colorPrimaries, &transformY);
-      
-      for (int index = 0; index < inp->m_compSize[Y_COMP]; index++) {
-        for(int component = 0; component < 3; component++)  {
-          //vComp[component] = inp->m_floatComp[component][index] / m_tfScale;
-          vComp[component] = inp->m_floatComp[component][index];
-        }
-        
-        double ySignal = dMax(0.000001, transformY[R_COMP] * vComp[R_COMP] + transformY[G_COMP] * vComp[G_COMP] + transformY[B_COMP] * vComp[B_COMP]);
-        double yDisplay = m_linScale * pow(ySignal, m_gamma) / ySignal;
-        
-        for(int component = 0; component < 3; component++)  {
-          out->m_floatComp[component][index] = (float) (vComp[component] * yDisplay) ;
-        }      
-      }
+      applyGain(out->m_floatComp, inp->m_floatComp, inp->m_width[Y_COMP], inp->m_height[Y_COMP], transformY, TRUE);
       // reset the pointer (just for safety
       transformY = NULL;
     }
@@ -232,24 +348,10 @@ void DisplayGammaAdjustHLG::inverse(Frame *frame)
   // Step 3 is not performed in this process, but instead it is done as part of the TransferFunction Class.
   if (frame->m_isFloat == TRUE && frame->m_compSize[Y_COMP] == frame->m_compSize[Cb_COMP])  {    
     if (frame->m_colorSpace == CM_RGB) {
-      double vComp[3];
       const double *transformY = NULL;
 
       ColorTransformGeneric::setYConversion(frame->m_colorPrimaries, &transformY);
-      
-      for (int index = 0; index < frame->m_compSize[Y_COMP]; index++) {
-        for(int component = 0; component < 3; component++) {
-          vComp[component] = dMax(0.0, (double) frame->m_floatComp[component][index] / m_linScale);
-        }
-                
-        double yDisplay = dMax(0.000001, transformY[R_COMP] * vComp[R_COMP] + transformY[G_COMP] * vComp[G_COMP] + transformY[B_COMP] * vComp[B_COMP]);
-        //double yDisplayGamma = m_tfScale * pow(yDisplay,(1.0 - m_gamma) / m_gamma);
-        double yDisplayGamma = pow(yDisplay,(1.0 - m_gamma) / m_gamma);
-        
-        for(int component = 0; component < 3; component++)  {
-          frame->m_floatComp[component][index] = (float) (vComp[component] * yDisplayGamma) ;
-        }
-      }
+      applyGain(frame->m_floatComp, frame->m_floatComp, frame->m_width[Y_COMP], frame->m_height[Y_COMP], transformY, FALSE);
       // reset the pointer (just for safety
       transformY = NULL;
     }
@@ -265,23 +367,9 @@ void DisplayGammaAdjustHLG::inverse(Frame *out, const Frame *inp)
   
   if (inp->m_isFloat == TRUE && out->m_isFloat == TRUE && inp->m_size == out->m_size && inp->m_compSize[Y_COMP] == inp->m_compSize[Cb_COMP])  {    
     if (inp->m_colorSpace == CM_RGB && out->m_colorSpace == CM_RGB) {
-      double vComp[3];
       const double *transformY = NULL;
       ColorTransformGeneric::setYConversion(inp->m_colorPrimaries, &transformY);
-      
-      for (int index = 0; index < inp->m_compSize[Y_COMP]; index++) {
-        for(int component = 0; component < 3; component++) {
-          vComp[component] = dMax(0.0, (double) inp->m_floatComp[component][index] / m_linScale);
-        }
-        
-        double yDisplay = dMax(0.000001, transformY[R_COMP] * vComp[R_COMP] + transformY[G_COMP] * vComp[G_COMP] + transformY[B_COMP] * vComp[B_COMP]);
-        //double yDisplayGamma = m_tfScale * pow(yDisplay,(1.0 - m_gamma) / m_gamma);
-        double yDisplayGamma = pow(yDisplay,(1.0 - m_gamma) / m_gamma);
-        
-        for(int component = 0; component < 3; component++)  {
-          out->m_floatComp[component][index] = (float) (vComp[component] * yDisplayGamma) ;
-        }
-      }
+      applyGain(out->m_floatComp, inp->m_floatComp, inp->m_width[Y_COMP], inp->m_height[Y_COMP], transformY, FALSE);
       // reset the pointer (just for safety
       transformY = NULL;
     }
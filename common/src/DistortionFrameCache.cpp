@@ -0,0 +1,352 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file DistortionFrameCache.cpp
+ *
+ * \brief
+ *    Per-frame cache of metric domain planes shared by TF domain metrics
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "DistortionFrameCache.H"
+#include "ColorTransformGeneric.H"
+
+//-----------------------------------------------------------------------------
+// Constructor/destructor
+//-----------------------------------------------------------------------------
+
+DistortionFrameCache::DistortionFrameCache(size_t maxMemory)
+{
+  m_maxMemory = maxMemory;
+}
+
+DistortionFrameCache::~DistortionFrameCache()
+{
+  for (int i = 0; i < (int) m_entries.size(); i++) {
+    delete m_entries[i];
+  }
+  m_entries.clear();
+
+  for (int i = 0; i < (int) m_transferFunctions.size(); i++) {
+    if (m_transferFunctions[i].m_transferFunction != NULL) {
+      delete m_transferFunctions[i].m_transferFunction;
+      m_transferFunctions[i].m_transferFunction = NULL;
+    }
+  }
+  m_transferFunctions.clear();
+}
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+DistortionFrameCache::CacheEntry *DistortionFrameCache::findEntry(const Frame *frame, int type, int component, int primaries, DistortionFunction tfMethod, bool tfLUTEnable, double maxValue)
+{
+  for (int i = 0; i < (int) m_entries.size(); i++) {
+    CacheEntry *entry = m_entries[i];
+    if (entry->m_valid == TRUE && entry->m_frame == frame && entry->m_type == type && entry->m_component == component && entry->m_primaries == primaries
+        && entry->m_tfMethod == tfMethod && entry->m_tfLUTEnable == tfLUTEnable && entry->m_maxValue == maxValue) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+size_t DistortionFrameCache::usedMemory()
+{
+  size_t used = 0;
+  for (int i = 0; i < (int) m_entries.size(); i++) {
+    used += m_entries[i]->m_data.capacity() * sizeof(double);
+  }
+  return used;
+}
+
+// Returns NULL if the plane cannot be kept without exceeding the memory bound
+DistortionFrameCache::CacheEntry *DistortionFrameCache::allocateEntry(const Frame *frame, int type, int component, int primaries, DistortionFunction tfMethod, bool tfLUTEnable, double maxValue)
+{
+  CacheEntry *entry = NULL;
+  size_t size = (size_t) frame->m_compSize[Y_COMP];
+  
+  // Reuse the memory of an invalidated entry if it is large enough
+  for (int i = 0; i < (int) m_entries.size(); i++) {
+    if (m_entries[i]->m_valid == FALSE && m_entries[i]->m_data.capacity() >= size) {
+      entry = m_entries[i];
+      break;
+    }
+  }
+  
+  if (entry == NULL) {
+    // Release the memory of invalidated entries until the new plane fits
+    for (int i = 0; i < (int) m_entries.size() && usedMemory() + size * sizeof(double) > m_maxMemory; i++) {
+      if (m_entries[i]->m_valid == FALSE)
+        vector<double>().swap(m_entries[i]->m_data);
+    }
+    if (usedMemory() + size * sizeof(double) > m_maxMemory)
+      return NULL;
+
+    for (int i = 0; i < (int) m_entries.size(); i++) {
+      if (m_entries[i]->m_valid == FALSE) {
+        entry = m_entries[i];
+        vector<double>().swap(entry->m_data);
+        break;
+      }
+    }
+    if (entry == NULL) {
+      entry = new CacheEntry;
+      m_entries.push_back(entry);
+    }
+  }
+  
+  entry->m_frame       = frame;
+  entry->m_type        = type;
+  entry->m_component   = component;
+  entry->m_primaries   = primaries;
+  entry->m_tfMethod    = tfMethod;
+  entry->m_tfLUTEnable = tfLUTEnable;
+  entry->m_maxValue    = maxValue;
+  entry->m_valid       = FALSE;
+  
+  if (entry->m_data.size() < size)
+    entry->m_data.resize(size);
+
+  return entry;
+}
+
+DistortionTransferFunction *DistortionFrameCache::getTransferFunction(DistortionFunction tfMethod, bool tfLUTEnable)
+{
+  for (int i = 0; i < (int) m_transferFunctions.size(); i++) {
+    if (m_transferFunctions[i].m_tfMethod == tfMethod && m_transferFunctions[i].m_tfLUTEnable == tfLUTEnable)
+      return m_transferFunctions[i].m_transferFunction;
+  }
+  
+  TFEntry entry;
+  entry.m_tfMethod         = tfMethod;
+  entry.m_tfLUTEnable      = tfLUTEnable;
+  entry.m_transferFunction = DistortionTransferFunction::create(tfMethod, tfLUTEnable);
+  m_transferFunctions.push_back(entry);
+  
+  return entry.m_transferFunction;
+}
+
+// The arithmetic below follows exactly the one originally used within the metrics (i.e. convertToXYZ()), 
+// so that the metric results remain unchanged. Each plane is derived directly from the frame samples so that
+// bands of a plane can be computed without the planes it depends on being resident.
+void DistortionFrameCache::computeXYZ(const Frame *frame, int component, double maxValue, int start, int end, double *out)
+{
+  const double *transform[3] = { NULL, NULL, NULL };
+  setColorConversion(frame->m_colorPrimaries, &transform[0], &transform[1], &transform[2]);
+  const double *transformC = transform[component];
+  
+  const float *rComp = frame->m_floatComp[R_COMP];
+  const float *gComp = frame->m_floatComp[G_COMP];
+  const float *bComp = frame->m_floatComp[B_COMP];
+  double rgbNormal[3];
+  
+  for (int i = start; i < end; i++) {
+    rgbNormal[R_COMP] = rComp[i] / maxValue;
+    rgbNormal[G_COMP] = gComp[i] / maxValue;
+    rgbNormal[B_COMP] = bComp[i] / maxValue;
+    *out++ = dClip( transformC[0] * rgbNormal[R_COMP] + transformC[1] * rgbNormal[G_COMP] + transformC[2] * rgbNormal[B_COMP], 0, 1);
+  }
+}
+
+void DistortionFrameCache::computeTFRGB(const Frame *frame, int component, DistortionTransferFunction *tf, double maxValue, int start, int end, double *out)
+{
+  const float *comp = frame->m_floatComp[component];
+  
+  for (int i = start; i < end; i++) {
+    *out++ = tf->performCompute( comp[i] / maxValue );
+  }
+}
+
+void DistortionFrameCache::computeTFXYZ(const Frame *frame, int component, DistortionTransferFunction *tf, double maxValue, int start, int end, double *out)
+{
+  computeXYZ(frame, component, maxValue, start, end, out);
+  for (int i = start; i < end; i++, out++) {
+    *out = tf->performCompute( *out );
+  }
+}
+
+// tfRGB holds the TF(RGB) planes if these are resident, otherwise NULL
+void DistortionFrameCache::computeTFYCbCr(const Frame *frame, int component, DistortionTransferFunction *tf, double maxValue, int primaries, const double **tfRGB, int start, int end, double *out)
+{
+  const double *transform[3] = { NULL, NULL, NULL };
+  setColorConversionYCbCr(primaries, &transform[0], &transform[1], &transform[2]);
+  const double *transformC = transform[component];
+  double rgb[3];
+  
+  for (int i = start; i < end; i++) {
+    for (int c = R_COMP; c <= B_COMP; c++) {
+      rgb[c] = (tfRGB[c] != NULL) ? tfRGB[c][i] : tf->performCompute( frame->m_floatComp[c][i] / maxValue );
+    }
+    *out++ = dClip( transformC[0] * rgb[R_COMP] + transformC[1] * rgb[G_COMP] + transformC[2] * rgb[B_COMP], 0, 1);
+  }
+}
+
+void DistortionFrameCache::computeBand(const Frame *frame, int type, int component, DistortionFunction tfMethod, bool tfLUTEnable, double maxValue, int primaries, int start, int end, double *out)
+{
+  switch (type) {
+    case MDP_XYZ:
+      computeXYZ(frame, component, maxValue, start, end, out);
+      break;
+    case MDP_TF_RGB:
+      computeTFRGB(frame, component, getTransferFunction(tfMethod, tfLUTEnable), maxValue, start, end, out);
+      break;
+    case MDP_TF_XYZ:
+      computeTFXYZ(frame, component, getTransferFunction(tfMethod, tfLUTEnable), maxValue, start, end, out);
+      break;
+    case MDP_TF_YCBCR:
+    default:
+    {
+      const double *tfRGB[3] = { NULL, NULL, NULL };
+      for (int c = R_COMP; c <= B_COMP; c++) {
+        CacheEntry *entry = findEntry(frame, MDP_TF_RGB, c, CP_UNKNOWN, tfMethod, tfLUTEnable, maxValue);
+        if (entry != NULL)
+          tfRGB[c] = &entry->m_data[0];
+      }
+      computeTFYCbCr(frame, component, getTransferFunction(tfMethod, tfLUTEnable), maxValue, primaries, tfRGB, start, end, out);
+      break;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+void DistortionFrameCache::setColorConversion(int colorPrimaries, const double **transform0, const double **transform1, const double **transform2) {
+  int mode = CTF_IDENTITY;
+  if (colorPrimaries == CP_709) {
+    mode = CTF_RGB709_2_XYZ;
+  }
+  else if (colorPrimaries == CP_601) {
+    mode = CTF_RGB601_2_XYZ;
+  }
+  else if (colorPrimaries == CP_2020) {
+    mode = CTF_RGB2020_2_XYZ;
+  }
+  else if (colorPrimaries == CP_P3D65) {
+    mode = CTF_RGBP3D65_2_XYZ;
+  }
+  
+  *transform0 = FWD_TRANSFORM[mode][Y_COMP];
+  *transform1 = FWD_TRANSFORM[mode][U_COMP];
+  *transform2 = FWD_TRANSFORM[mode][V_COMP];
+}
+
+void DistortionFrameCache::setColorConversionYCbCr(int colorPrimaries, const double **transform0, const double **transform1, const double **transform2) {
+  int mode = CTF_IDENTITY;
+  if (colorPrimaries == CP_709) {
+    mode = CTF_RGB709_2_YUV709;
+  }
+  else if (colorPrimaries == CP_2020) {
+    mode = CTF_RGB2020_2_YUV2020;
+  }
+  else if (colorPrimaries == CP_P3D65) {
+    mode = CTF_RGBP3D65_2_YUVP3D65;
+  }
+  else if (colorPrimaries == CP_601) {
+    mode = CTF_RGB601_2_YUV601;
+  }
+  
+  *transform0 = FWD_TRANSFORM[mode][Y_COMP];
+  *transform1 = FWD_TRANSFORM[mode][U_COMP];
+  *transform2 = FWD_TRANSFORM[mode][V_COMP];
+}
+
+void DistortionFrameCache::reset()
+{
+  for (int i = 0; i < (int) m_entries.size(); i++) {
+    m_entries[i]->m_valid = FALSE;
+    m_entries[i]->m_frame = NULL;
+  }
+}
+
+const double *DistortionFrameCache::getBand(const Frame *frame, MetricDomainPlane type, int component, DistortionFunction tfMethod, bool tfLUTEnable, double maxValue, int primaries, int firstRow, int rows, double *scratch)
+{
+  // Normalize the key so that parameters that do not affect a plane type do not result in duplicate entries
+  if (type == MDP_XYZ) {
+    tfMethod    = DIF_UNKNOWN;
+    tfLUTEnable = FALSE;
+    primaries   = frame->m_colorPrimaries;
+  }
+  else if (type == MDP_TF_RGB) {
+    primaries   = CP_UNKNOWN;
+  }
+  else if (type == MDP_TF_XYZ) {
+    primaries   = frame->m_colorPrimaries;
+  }
+  
+  int width = frame->m_width[Y_COMP];
+  CacheEntry *entry = findEntry(frame, type, component, primaries, tfMethod, tfLUTEnable, maxValue);
+  
+  if (entry == NULL) {
+    entry = allocateEntry(frame, type, component, primaries, tfMethod, tfLUTEnable, maxValue);
+    if (entry != NULL) {
+      computeBand(frame, type, component, tfMethod, tfLUTEnable, maxValue, primaries, 0, frame->m_compSize[Y_COMP], &entry->m_data[0]);
+      entry->m_valid = TRUE;
+    }
+  }
+  
+  if (entry != NULL)
+    return &entry->m_data[firstRow * width];
+  
+  // The plane does not fit within the memory bound; only compute the requested band
+  if (scratch != NULL)
+    computeBand(frame, type, component, tfMethod, tfLUTEnable, maxValue, primaries, firstRow * width, (firstRow + rows) * width, scratch);
+  
+  return scratch;
+}
+
+const double *DistortionFrameCache::getPlane(const Frame *frame, MetricDomainPlane type, int component, DistortionFunction tfMethod, bool tfLUTEnable, double maxValue, int primaries, double *scratch)
+{
+  return getBand(frame, type, component, tfMethod, tfLUTEnable, maxValue, primaries, 0, frame->m_height[Y_COMP], scratch);
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
@@ -139,7 +139,8 @@ DistortionMetric *DistortionMetric::create(const FrameFormat *format, int distor
     case DIST_TFPSNR:
       result = new DistortionMetricTFPSNR(format, 
                                           &distortionParameters->m_PSNR,
-                                          distortionParameters->m_maxSampleValue);
+                                          distortionParameters->m_maxSampleValue,
+                                          distortionParameters->m_frameCache);
       break;
     case DIST_DELTAE:
       result = new DistortionMetricDeltaE(format, 
@@ -159,7 +160,8 @@ DistortionMetric *DistortionMetric::create(const FrameFormat *format, int distor
     case DIST_TFMSSSIM:
       result = new DistortionMetricTFMSSSIM(format, 
                                             &distortionParameters->m_SSIM,
-                                            distortionParameters->m_maxSampleValue);
+                                            distortionParameters->m_maxSampleValue,
+                                            distortionParameters->m_frameCache);
       break;
     case DIST_RPSNR:
       result = new DistortionMetricRegionPSNR(format, 
@@ -169,7 +171,8 @@ DistortionMetric *DistortionMetric::create(const FrameFormat *format, int distor
     case DIST_RTFPSNR:
     result = new DistortionMetricRegionTFPSNR(format,
                                               &distortionParameters->m_PSNR,
-                                              distortionParameters->m_maxSampleValue);
+                                              distortionParameters->m_maxSampleValue,
+                                              distortionParameters->m_frameCache);
       break;
     case DIST_BLKJ341:
       result = new DistortionMetricBlockinessJ341(distortionParameters->m_maxSampleValue,
@@ -193,7 +196,8 @@ DistortionMetric *DistortionMetric::create(const FrameFormat *format, int distor
     case DIST_TFSSIM:
       result = new DistortionMetricTFSSIM(format,
                                             &distortionParameters->m_SSIM,
-                                            distortionParameters->m_maxSampleValue);
+                                            distortionParameters->m_maxSampleValue,
+                                            distortionParameters->m_frameCache);
       break;
   }
 
@@ -53,12 +53,125 @@
 //-----------------------------------------------------------------------------
 
 #include "DistortionMetricBlockinessJ341.H"
-
+#include "CPUFeatures.H"
+#include "ThreadPool.H"
+#include <string.h>
 
 //-----------------------------------------------------------------------------
 // Macros
 //-----------------------------------------------------------------------------
 
+//-----------------------------------------------------------------------------
+// Gradient terms
+//-----------------------------------------------------------------------------
+
+// log(1 + x) for x >= 0. The argument is split as 2^e * m with m in [sqrt(0.5), sqrt(2)) and
+// log(m) is evaluated through the atanh series, which is accurate to about 1e-15 in that range.
+// The rounding error of 1 + x is added back as a first order correction.
+// The AVX2 kernel below performs exactly the same operations, so both give identical results.
+static const double kLog1pCoef[8] = {
+  2.0 / 3.0, 2.0 / 5.0, 2.0 / 7.0, 2.0 / 9.0, 2.0 / 11.0, 2.0 / 13.0, 2.0 / 15.0, 2.0 / 17.0
+};
+static const double kLn2   = 0.693147180559945309417232121458;
+static const double kSqrt2 = 1.41421356237309504880168872421;
+
+static inline double fastLog1p(double x)
+{
+  double u = 1.0 + x;
+  double c = (x - (u - 1.0)) / u;
+  uint64 bits;
+  memcpy(&bits, &u, sizeof(bits));
+  uint64 expBits = (bits >> 52) | 0x4330000000000000ULL;
+  uint64 manBits = (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL;
+  double e, m;
+  memcpy(&e, &expBits, sizeof(e));
+  memcpy(&m, &manBits, sizeof(m));
+  e = (e - 4503599627370496.0) - 1023.0;
+  if (m > kSqrt2) {
+    m = m * 0.5;
+    e = e + 1.0;
+  }
+  double f = m - 1.0;
+  double s = f / (2.0 + f);
+  double z = s * s;
+  double p = kLog1pCoef[7];
+  for (int k = 6; k >= 0; k--)
+    p = p * z + kLog1pCoef[k];
+  return (s * (2.0 + z * p) + c) + e * kLn2;
+}
+
+// Blockiness contribution of a single gradient, log(1 + max(0, scale * |grad| - threshold))
+static inline double gradientTerm(double grad, double scale, double threshold)
+{
+  double x = scale * dAbs(grad) - threshold;
+  return fastLog1p(x > 0.0 ? x : 0.0);
+}
+
+// Computes the terms of count vertical (cur -> below) and horizontal (cur -> cur + 1) gradients.
+// Vertical terms are stored in rowTerms, horizontal ones are added to colSums. Returns the number
+// of samples processed.
+#if ENABLE_SIMD_DISPATCH
+SIMD_TARGET("avx2")
+static inline __m256d gradientTermAVX2(__m256d grad, __m256d scale, __m256d threshold)
+{
+  const __m256d zero  = _mm256_setzero_pd();
+  const __m256d one   = _mm256_set1_pd(1.0);
+  const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+  
+  __m256d x = _mm256_sub_pd(_mm256_mul_pd(scale, _mm256_and_pd(grad, absMask)), threshold);
+  x = _mm256_max_pd(x, zero);
+  
+  __m256d u = _mm256_add_pd(one, x);
+  __m256d c = _mm256_div_pd(_mm256_sub_pd(x, _mm256_sub_pd(u, one)), u);
+  __m256i bits = _mm256_castpd_si256(u);
+  __m256d e = _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_set1_epi64x(0x4330000000000000LL)));
+  __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)), _mm256_set1_epi64x(0x3FF0000000000000LL)));
+  e = _mm256_sub_pd(_mm256_sub_pd(e, _mm256_set1_pd(4503599627370496.0)), _mm256_set1_pd(1023.0));
+  __m256d big = _mm256_cmp_pd(m, _mm256_set1_pd(kSqrt2), _CMP_GT_OQ);
+  m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), big);
+  e = _mm256_blendv_pd(e, _mm256_add_pd(e, one), big);
+  
+  __m256d f = _mm256_sub_pd(m, one);
+  __m256d s = _mm256_div_pd(f, _mm256_add_pd(_mm256_set1_pd(2.0), f));
+  __m256d z = _mm256_mul_pd(s, s);
+  __m256d p = _mm256_set1_pd(kLog1pCoef[7]);
+  for (int k = 6; k >= 0; k--)
+    p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(kLog1pCoef[k]));
+  __m256d r = _mm256_add_pd(_mm256_mul_pd(s, _mm256_add_pd(_mm256_set1_pd(2.0), _mm256_mul_pd(z, p))), c);
+  return _mm256_add_pd(r, _mm256_mul_pd(e, _mm256_set1_pd(kLn2)));
+}
+
+SIMD_TARGET("avx2")
+static int gradientTermsAVX2(const double *cur, const double *below, int count, double scale, double threshold, double *rowTerms, double *colSums)
+{
+  const __m256d vScale     = _mm256_set1_pd(scale);
+  const __m256d vThreshold = _mm256_set1_pd(threshold);
+  int i = 0;
+  
+  for (; i + 4 <= count; i += 4) {
+    __m256d c = _mm256_loadu_pd(cur + i);
+    __m256d w = _mm256_sub_pd(_mm256_loadu_pd(below + i), c);
+    __m256d h = _mm256_sub_pd(_mm256_loadu_pd(cur + i + 1), c);
+    _mm256_storeu_pd(rowTerms + i, gradientTermAVX2(w, vScale, vThreshold));
+    _mm256_storeu_pd(colSums + i, _mm256_add_pd(_mm256_loadu_pd(colSums + i), gradientTermAVX2(h, vScale, vThreshold)));
+  }
+  return i;
+}
+#endif
+
+static void gradientTerms(const double *cur, const double *below, int count, double scale, double threshold, double *rowTerms, double *colSums)
+{
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = gradientTermsAVX2(cur, below, count, scale, threshold, rowTerms, colSums);
+#endif
+  for (; i < count; i++) {
+    rowTerms[i] = gradientTerm(below[i] - cur[i], scale, threshold);
+    colSums[i] += gradientTerm(cur[i + 1] - cur[i], scale, threshold);
+  }
+}
+
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
@@ -70,6 +183,7 @@ DistortionMetricBlockinessJ341::DistortionMetricBlockinessJ341(double maxSampleV
 
   m_memWidth = 0;
   m_memHeight = 0;
+  m_tfCodeMax = 0;
   
   for (int c = 0; c < T_COMP; c++) {
     m_metric[c] = 0.0;
@@ -80,6 +194,10 @@ DistortionMetricBlockinessJ341::DistortionMetricBlockinessJ341(double maxSampleV
 
 DistortionMetricBlockinessJ341::~DistortionMetricBlockinessJ341()
 {
+  if (m_transferFunction != NULL) {
+    delete m_transferFunction;
+    m_transferFunction = NULL;
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -120,86 +238,140 @@ double DistortionMetricBlockinessJ341::avgSubsample(double *data, int step, int
   return (sum / ((length - 1 - offset) / step));
 }
 
+// Gap between the strongest and weakest of the even/odd gradient sums. m_sumW holds one sum per
+// row and m_sumH one per column.
+double DistortionMetricBlockinessJ341::edgeDelta(int index, int height, int width, double *edgeMax)
+{
+  double dH0 = avgSubsample(&m_sumH[index][0], 2, 0, width);
+  double dH1 = avgSubsample(&m_sumH[index][0], 2, 1, width);
+  double dW0 = avgSubsample(&m_sumW[index][0], 2, 0, height);
+  double dW1 = avgSubsample(&m_sumW[index][0], 2, 1, height);
+  
+  double edgeMin = 0.5 * (dMin(dW0, dW1) + dMin(dH0, dH1));
+  *edgeMax = 0.5 * (dMax(dW0, dW1) + dMax(dH0, dH1));
+  return *edgeMax - edgeMin;
+}
 
-void DistortionMetricBlockinessJ341::computeGradients(float *inpData, int height, int width, int index, double maxValue)
+void DistortionMetricBlockinessJ341::allocateMemory(int width, int height)
 {
-  double w, h;
-  for (int j = 0; j < height - 1; j++) {
-    for (int i = 0; i < width - 1; i++) { 
-      //w = m_verGrad[index][ j * width + i ] = (inpData[(j + 1) * width + i] - inpData[j * width + i]) / maxValue;
-      //h = m_horGrad[index][ j * width + i ] = (inpData[ j * width + i + 1 ] - inpData[j * width + i]) / maxValue;
-      w = m_verGrad[index][ j * width + i ] = m_transferFunction->compute(inpData[(j + 1) * width + i] / maxValue) - m_transferFunction->compute(inpData[j * width + i] / maxValue);
-      h = m_horGrad[index][ j * width + i ] = m_transferFunction->compute(inpData[ j * width + i + 1 ] / maxValue) - m_transferFunction->compute(inpData[j * width + i] / maxValue);
-      m_sumW[index][j] += log(1.0 + dMax(0.0, maxValue * dAbs(w) - 2.0 * (maxValue / 255)));
-      m_sumH[index][i] += log(1.0 + dMax(0.0, maxValue * dAbs(h) - 2.0 * (maxValue / 255)));
+  if (width > m_memWidth || height > m_memHeight) {
+    m_memWidth  = iMax(width,  m_memWidth);
+    m_memHeight = iMax(height, m_memHeight);
+    for (int c = 0; c < 2; c++) {
+      m_plane   [c].resize ( m_memWidth * m_memHeight );
+      m_rowTerms[c].resize ( m_memWidth  );
+      m_sumW    [c].resize ( m_memHeight );
+      m_sumH    [c].resize ( m_memWidth  );
     }
   }
 }
 
+// Integer data are mapped to the transfer function domain like float data, with code values
+// normalized by maxCode. The table covers every value the sample container can hold, so that
+// the transfer function is evaluated once per code value instead of once per sample.
+void DistortionMetricBlockinessJ341::buildTFCodes(int maxCode, int tableSize)
+{
+  if (maxCode != m_tfCodeMax || tableSize != (int) m_tfCode.size()) {
+    m_tfCode.resize(tableSize);
+    for (int v = 0; v < tableSize; v++)
+      m_tfCode[v] = m_transferFunction->compute((double) v / maxCode);
+    m_tfCodeMax = maxCode;
+  }
+}
+
+// The row (m_sumW) and column (m_sumH) sums of the log gradient terms of the transfer function
+// domain plane (m_plane) are accumulated in a single pass.
+void DistortionMetricBlockinessJ341::planeGradients(int height, int width, int index, double maxValue)
+{
+  double *plane = &m_plane[index][0];
+  double *sumW  = &m_sumW[index][0];
+  double *sumH  = &m_sumH[index][0];
+  double *rowTerms = &m_rowTerms[index][0];
+  double threshold = 2.0 * (maxValue / 255);
+  
+  memset(sumW, 0, height * sizeof(double));
+  memset(sumH, 0, width  * sizeof(double));
+  for (int j = 0; j < height - 1; j++) {
+    gradientTerms(&plane[j * width], &plane[(j + 1) * width], width - 1, maxValue, threshold, rowTerms, sumH);
+    // keep the raster order of the additions
+    for (int i = 0; i < width - 1; i++)
+      sumW[j] += rowTerms[i];
+  }
+}
+
+void DistortionMetricBlockinessJ341::computeGradients(float *inpData, int height, int width, int index, double maxValue)
+{
+  double *plane = &m_plane[index][0];
+  
+  for (int i = 0; i < height * width; i++)
+    plane[i] = m_transferFunction->compute(inpData[i] / maxValue);
+  
+  planeGradients(height, width, index, maxValue);
+}
+
+void DistortionMetricBlockinessJ341::computeGradients(uint8 *inpData, int height, int width, int index, int maxCode)
+{
+  double *plane = &m_plane[index][0];
+  
+  for (int i = 0; i < height * width; i++)
+    plane[i] = m_tfCode[inpData[i]];
+  
+  planeGradients(height, width, index, (double) maxCode);
+}
+
+void DistortionMetricBlockinessJ341::computeGradients(uint16 *inpData, int height, int width, int index, int maxCode)
+{
+  double *plane = &m_plane[index][0];
+  
+  for (int i = 0; i < height * width; i++)
+    plane[i] = m_tfCode[inpData[i]];
+  
+  planeGradients(height, width, index, (double) maxCode);
+}
+
+void DistortionMetricBlockinessJ341::compute(Frame* inp0, Frame* inp1, int c)
+{
+  int height = inp0->m_height[c];
+  int width  = inp0->m_width[c];
+  double edgeMax[2], deltaEdge[2];
+  
+  allocateMemory(width, height);
+  int maxCode = (1 << inp0->m_bitDepthComp[c]) - 1;
+  if (inp0->m_isFloat == FALSE)
+    buildTFCodes(maxCode, (inp0->m_bitDepth == 8 && inp1->m_bitDepth == 8) ? 256 : 65536);
+  
+  // source (0) and test (1) gradients are independent
+  ThreadPool::parallelFor(2, [&](int index) {
+    Frame *inp = (index == 0) ? inp0 : inp1;
+    if (inp->m_isFloat == TRUE)
+      computeGradients(inp->m_floatComp[c], height, width, index, m_maxValue[c]);
+    else if (inp->m_bitDepth == 8)
+      computeGradients(inp->m_comp[c], height, width, index, maxCode);
+    else
+      computeGradients(inp->m_ui16Comp[c], height, width, index, maxCode);
+    deltaEdge[index] = edgeDelta(index, height, width, &edgeMax[index]);
+  });
+  
+  // note that this metric is not symmetric
+  // also note that although in the spec only distance of 2 is mentioned, in the provided
+  // code a distance of 3 is also tested. If distance of 3 has a larger gap than 2
+  // (between min/max) then the distance 3 values are used instead
+  double x = dMax( 0.0, deltaEdge[1] - deltaEdge[0]) / (1.0 + edgeMax[1]);
+  // as in the vquad code, use a sigoid function to convert the data
+  m_metric[c] = x; // sTransform(x, 0.2, 0.1, 2.0);
+  m_metricStats[c].updateStats(m_metric[c]);
+}
+
 //-----------------------------------------------------------------------------
 // Public methods
 //-----------------------------------------------------------------------------
 
 void DistortionMetricBlockinessJ341::computeMetric (Frame* inp0, Frame* inp1)
 {
-  
   // it is assumed here that the frames are of the same type
   if (inp0->equalType(inp1)) {
-  
-    if (inp0->m_width[0] > m_memWidth || inp0->m_height[0] > m_memHeight ) {
-      m_memWidth  = inp0->m_width[0];
-      m_memHeight = inp0->m_height[0];
-      for (int c = 0; c < 2; c++) {      
-        m_verGrad[c].resize ( m_memWidth * m_memHeight );
-        m_horGrad[c].resize ( m_memWidth * m_memHeight );
-        m_sumW   [c].resize ( m_memHeight );
-        m_sumH   [c].resize ( m_memWidth  );
-      }
-    }
-  
-    if (inp0->m_isFloat == TRUE) {    // floating point data
-      double dH0, dH1, dW0, dW1;
-      double edgeMax0, edgeMax1, edgeMin0, edgeMin1;
-      double deltaEdge0, deltaEdge1;
-      double x;
-      
-      for (int c = Y_COMP; c < inp0->m_noComponents; c++) {
-        // source image
-        computeGradients(inp0->m_floatComp[c], inp0->m_height[c], inp0->m_width[c], 0, m_maxValue[c]);
-        dH0 = avgSubsample(&m_sumH[0][0], 2, 0, inp0->m_height[c]);
-        dH1 = avgSubsample(&m_sumH[0][0], 2, 1, inp0->m_height[c]);
-        dW0 = avgSubsample(&m_sumW[0][0], 2, 0, inp0->m_width[c]);
-        dW1 = avgSubsample(&m_sumW[0][0], 2, 1, inp0->m_width[c]);
-        
-        edgeMax0 = 0.5 * (dMax(dW0, dW1) + dMax(dH0, dH1));
-        edgeMin0 = 0.5 * (dMin(dW0, dW1) + dMin(dH0, dH1));
-        deltaEdge0 = edgeMax0 - edgeMin0;
-        
-        
-        // test image
-        computeGradients(inp1->m_floatComp[c], inp1->m_height[c], inp1->m_width[c], 1, m_maxValue[c]);
-        dH0 = avgSubsample(&m_sumH[1][0], 2, 0, inp0->m_height[c]);
-        dH1 = avgSubsample(&m_sumH[1][0], 2, 1, inp0->m_height[c]);
-        dW0 = avgSubsample(&m_sumW[1][0], 2, 0, inp0->m_width[c]);
-        dW1 = avgSubsample(&m_sumW[1][0], 2, 1, inp0->m_width[c]);
-        
-        edgeMax1 = 0.5 * (dMax(dW0, dW1) + dMax(dH0, dH1));
-        edgeMin1 = 0.5 * (dMin(dW0, dW1) + dMin(dH0, dH1));
-        deltaEdge1 = edgeMax1 - edgeMin1;
-                
-        // note that this metric is not symmetric
-        // also note that although in the spec only distance of 2 is mentioned, in the provided
-        // code a distance of 3 is also tested. If distance of 3 has a larger gap than 2 
-        // (between min/max) then the distance 3 values are used instead
-        x = dMax( 0.0, deltaEdge1 - deltaEdge0) / (1.0 + edgeMax1);
-        // as in the vquad code, use a sigoid function to convert the data
-        m_metric[c] = x; // sTransform(x, 0.2, 0.1, 2.0);
-        m_metricStats[c].updateStats(m_metric[c]);
-      }
-    }
-    else if (inp0->m_bitDepth == 8) {   // 8 bit data
-    }
-    else { // 16 bit data
+    for (int c = Y_COMP; c < inp0->m_noComponents; c++) {
+      compute(inp0, inp1, c);
     }
   }
   else {
@@ -211,15 +383,8 @@ void DistortionMetricBlockinessJ341::computeMetric (Frame* inp0, Frame* inp1)
 void DistortionMetricBlockinessJ341::computeMetric (Frame* inp0, Frame* inp1, int component)
 {
   // it is assumed here that the frames are of the same type
-  // Currently no TF is applied on the data. However, we may wish to apply some TF, e.g. PQ or combination of PQ and PH.
-  
   if (inp0->equalType(inp1)) {
-    if (inp0->m_isFloat == TRUE) {    // floating point data
-    }
-    else if (inp0->m_bitDepth == 8) {   // 8 bit data
-    }
-    else { // 16 bit data
-    }
+    compute(inp0, inp1, component);
   }
   else {
     printf("Frames of different type being compared. Computation will not be performed for this frame.\n");
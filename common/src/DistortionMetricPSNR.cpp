@@ -53,11 +53,191 @@
 //-----------------------------------------------------------------------------
 
 #include "DistortionMetricPSNR.H"
+#include "CPUFeatures.H"
 
 //-----------------------------------------------------------------------------
 // Macros
 //-----------------------------------------------------------------------------
 
+//-----------------------------------------------------------------------------
+// SIMD kernels
+//-----------------------------------------------------------------------------
+
+// Sum of squared differences. Integer sums are exact, so the order of the additions does not matter.
+// 8 bit differences (and 16 bit ones whose inputs are below 32768) go through madd; larger 16 bit
+// values are squared in 64 bits. The kernels return the number of samples processed.
+#if ENABLE_SIMD_DISPATCH
+template <typename T>
+SIMD_TARGET("avx2")
+static int sseAVX2 (const T *iComp0, const T *iComp1, int size, uint64 *sum)
+{
+  const __m256i signMask = _mm256_set1_epi16((short) 0x8000);
+  __m256i acc64 = _mm256_setzero_si256();
+  __m256i acc32 = _mm256_setzero_si256();
+  int pending = 0;
+  int i = 0;
+  
+  for (; i + 16 <= size; i += 16) {
+    __m256i a, b;
+    if (sizeof(T) == 1) {
+      a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (iComp0 + i)));
+      b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (iComp1 + i)));
+    }
+    else {
+      a = _mm256_loadu_si256((const __m256i *) (iComp0 + i));
+      b = _mm256_loadu_si256((const __m256i *) (iComp1 + i));
+    }
+    if (sizeof(T) == 1 || _mm256_testz_si256(_mm256_or_si256(a, b), signMask)) {
+      __m256i d = _mm256_sub_epi16(a, b);
+      __m256i e = _mm256_madd_epi16(d, d);
+      if (sizeof(T) == 1) {
+        // each lane grows by at most 2 * 255^2 per pass
+        acc32 = _mm256_add_epi32(acc32, e);
+        if (++pending == 4096) {
+          acc64 = _mm256_add_epi64(acc64, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(acc32)));
+          acc64 = _mm256_add_epi64(acc64, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(acc32, 1)));
+          acc32 = _mm256_setzero_si256();
+          pending = 0;
+        }
+      }
+      else {
+        acc64 = _mm256_add_epi64(acc64, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(e)));
+        acc64 = _mm256_add_epi64(acc64, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(e, 1)));
+      }
+    }
+    else {
+      for (int k = 0; k < 2; k++) {
+        __m256i d = _mm256_sub_epi32(_mm256_cvtepu16_epi32(k == 0 ? _mm256_castsi256_si128(a) : _mm256_extracti128_si256(a, 1)),
+                                     _mm256_cvtepu16_epi32(k == 0 ? _mm256_castsi256_si128(b) : _mm256_extracti128_si256(b, 1)));
+        __m256i o = _mm256_srli_epi64(d, 32);
+        acc64 = _mm256_add_epi64(acc64, _mm256_mul_epi32(d, d));
+        acc64 = _mm256_add_epi64(acc64, _mm256_mul_epi32(o, o));
+      }
+    }
+  }
+  acc64 = _mm256_add_epi64(acc64, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(acc32)));
+  acc64 = _mm256_add_epi64(acc64, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(acc32, 1)));
+  
+  uint64 lanes[4];
+  _mm256_storeu_si256((__m256i *) lanes, acc64);
+  *sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return i;
+}
+
+template <typename T>
+SIMD_TARGET("sse4.1")
+static int sseSSE41 (const T *iComp0, const T *iComp1, int size, uint64 *sum)
+{
+  const __m128i signMask = _mm_set1_epi16((short) 0x8000);
+  __m128i acc64 = _mm_setzero_si128();
+  int i = 0;
+  
+  for (; i + 8 <= size; i += 8) {
+    __m128i a, b;
+    if (sizeof(T) == 1) {
+      a = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (iComp0 + i)));
+      b = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) (iComp1 + i)));
+    }
+    else {
+      a = _mm_loadu_si128((const __m128i *) (iComp0 + i));
+      b = _mm_loadu_si128((const __m128i *) (iComp1 + i));
+    }
+    if (sizeof(T) == 1 || _mm_testz_si128(_mm_or_si128(a, b), signMask)) {
+      __m128i d = _mm_sub_epi16(a, b);
+      __m128i e = _mm_madd_epi16(d, d);
+      acc64 = _mm_add_epi64(acc64, _mm_cvtepu32_epi64(e));
+      acc64 = _mm_add_epi64(acc64, _mm_cvtepu32_epi64(_mm_unpackhi_epi64(e, e)));
+    }
+    else {
+      for (int k = 0; k < 2; k++) {
+        __m128i d = _mm_sub_epi32(_mm_cvtepu16_epi32(k == 0 ? a : _mm_unpackhi_epi64(a, a)),
+                                  _mm_cvtepu16_epi32(k == 0 ? b : _mm_unpackhi_epi64(b, b)));
+        __m128i o = _mm_srli_epi64(d, 32);
+        acc64 = _mm_add_epi64(acc64, _mm_mul_epi32(d, d));
+        acc64 = _mm_add_epi64(acc64, _mm_mul_epi32(o, o));
+      }
+    }
+  }
+  
+  uint64 lanes[2];
+  _mm_storeu_si128((__m128i *) lanes, acc64);
+  *sum = lanes[0] + lanes[1];
+  return i;
+}
+
+// Weighted squared differences, plus (when chroma is not NULL) the chroma term of each sample:
+// out[i] = weight * (double) diff^2 + chroma[i >> shiftwidth], or out[i] += weight * (double) diff^2
+// when accumulate is set. Same double precision operations, in the same order, as the scalar loops.
+template <typename T>
+SIMD_TARGET("avx2")
+static int weightedErrorAVX2 (const T *iComp0, const T *iComp1, int size, double weight, const double *chroma, int shiftwidth, bool accumulate, double *out)
+{
+  const __m256d vWeight = _mm256_set1_pd(weight);
+  int i = 0;
+  
+  for (; i + 4 <= size; i += 4) {
+    __m128i a, b;
+    if (sizeof(T) == 1) {
+      a = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int *) (iComp0 + i)));
+      b = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int *) (iComp1 + i)));
+    }
+    else {
+      a = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) (iComp0 + i)));
+      b = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) (iComp1 + i)));
+    }
+    __m256d d = _mm256_cvtepi32_pd(_mm_sub_epi32(a, b));
+    __m256d e = _mm256_mul_pd(vWeight, _mm256_mul_pd(d, d));
+    if (chroma != NULL) {
+      __m256d c;
+      if (shiftwidth == 0)
+        c = _mm256_loadu_pd(chroma + i);
+      else
+        c = _mm256_permute4x64_pd(_mm256_castpd128_pd256(_mm_loadu_pd(chroma + (i >> 1))), 0x50);
+      e = _mm256_add_pd(e, c);
+    }
+    if (accumulate)
+      e = _mm256_add_pd(_mm256_loadu_pd(out + i), e);
+    _mm256_storeu_pd(out + i, e);
+  }
+  return i;
+}
+#endif
+
+template <typename T>
+static uint64 sumSquaredError (const T *iComp0, const T *iComp1, int size)
+{
+  uint64 sum = 0;
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = sseAVX2(iComp0, iComp1, size, &sum);
+  else if (CPUFeatures::hasSSE41())
+    i = sseSSE41(iComp0, iComp1, size, &sum);
+#endif
+  for (; i < size; i++) {
+    int64 diff = (int64) iComp0[i] - (int64) iComp1[i];
+    sum += (uint64) (diff * diff);
+  }
+  return sum;
+}
+
+template <typename T>
+static void weightedError (const T *iComp0, const T *iComp1, int size, double weight, const double *chroma, int shiftwidth, bool accumulate, double *out)
+{
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = weightedErrorAVX2(iComp0, iComp1, size, weight, chroma, shiftwidth, accumulate, out);
+#endif
+  for (; i < size; i++) {
+    int64 diff = (int64) iComp0[i] - (int64) iComp1[i];
+    double error = weight * (double) (diff * diff);
+    if (chroma != NULL)
+      error += chroma[i >> shiftwidth];
+    out[i] = accumulate ? out[i] + error : error;
+  }
+}
+
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
@@ -121,36 +301,34 @@ double DistortionMetricPSNR::computeLumaError(const float *iComp0, const float *
 
 uint64 DistortionMetricPSNR::computeLumaError(const uint16 *iComp0, const uint16 *iComp1, int width, int height, int shiftwidth, int shiftheight, double weight)
 {
-  int32 diff = 0;
-  uint64 sum = 0;
   m_oError = 0.0;
+  m_lumaTerms.resize(width);
   
-    for (int j = 0; j < height; j++) {
-      for (int i = 0; i < width; i++) {
-        diff = ((int32) iComp0[j * width + i] - (int32) iComp1[j * width + i]);
-        diff *= diff;
-        m_oError += weight * (double) diff + m_chromaError[(j >> shiftheight) * (width >> shiftwidth) + (i >> shiftwidth)];
-        sum += diff;
-      }
+  // The per sample terms are computed a row at a time, but still added to m_oError in raster order
+  // so that the (floating point) sum does not change.
+  for (int j = 0; j < height; j++) {
+    weightedError(&iComp0[j * width], &iComp1[j * width], width, weight, &m_chromaError[(j >> shiftheight) * (width >> shiftwidth)], shiftwidth, FALSE, &m_lumaTerms[0]);
+    for (int i = 0; i < width; i++) {
+      m_oError += m_lumaTerms[i];
     }
-  return sum;
+  }
+  return sumSquaredError(iComp0, iComp1, width * height);
 }
 
 uint64 DistortionMetricPSNR::computeLumaError(const uint8 *iComp0, const uint8 *iComp1, int width, int height, int shiftwidth, int shiftheight, double weight)
 {
-  int32 diff = 0;
-  uint64 sum = 0;
   m_oError = 0.0;
+  m_lumaTerms.resize(width);
   
-    for (int j = 0; j < height; j++) {
-      for (int i = 0; i < width; i++) {
-        diff = ((int32) iComp0[j * width + i] - (int32) iComp1[j * width + i]);
-        diff *= diff;
-        m_oError += weight * (double) diff + m_chromaError[(j >> shiftheight) * (width >> shiftwidth) + (i >> shiftwidth)];
-        sum += diff;
-      }
+  // The per sample terms are computed a row at a time, but still added to m_oError in raster order
+  // so that the (floating point) sum does not change.
+  for (int j = 0; j < height; j++) {
+    weightedError(&iComp0[j * width], &iComp1[j * width], width, weight, &m_chromaError[(j >> shiftheight) * (width >> shiftwidth)], shiftwidth, FALSE, &m_lumaTerms[0]);
+    for (int i = 0; i < width; i++) {
+      m_oError += m_lumaTerms[i];
     }
-  return sum;
+  }
+  return sumSquaredError(iComp0, iComp1, width * height);
 }
 
 
@@ -201,51 +379,17 @@ double DistortionMetricPSNR::computeChromaError(const float *iComp0, const float
 
 uint64 DistortionMetricPSNR::computeChromaError(const uint16 *iComp0, const uint16 *iComp1, int size, bool addError, double weight)
 {
-  int32 diff = 0;
-  uint64 sum = 0;
-  if (addError == FALSE) {
-    for (int i = 0; i < size; i++) {
-      diff = ((int32) iComp0[i] - (int32) iComp1[i]);
-      diff *= diff;
-      m_chromaError[i] = weight * (double) diff;
-      sum += diff;
-    }
-  }
-  else {
-    for (int i = 0; i < size; i++) {
-      diff = ((int32) iComp0[i] - (int32) iComp1[i]);
-      diff *= diff;
-      m_chromaError[i] += weight * (double) diff;
-      sum += diff;
-    }
-  }
+  weightedError(iComp0, iComp1, size, weight, (const double *) NULL, 0, addError, &m_chromaError[0]);
   
-  return sum;
+  return sumSquaredError(iComp0, iComp1, size);
 }
 
 
 uint64 DistortionMetricPSNR::computeChromaError(const uint8 *iComp0, const uint8 *iComp1, int size, bool addError, double weight)
 {
-  int32 diff = 0;
-  uint64 sum = 0;
-  if (addError == FALSE) {
-    for (int i = 0; i < size; i++) {
-      diff = ((int32) iComp0[i] - (int32) iComp1[i]);
-      diff *= diff;
-      m_chromaError[i] = weight * (double) diff;
-      sum += diff;
-    }
-  }
-  else {
-    for (int i = 0; i < size; i++) {
-      diff = ((int32) iComp0[i] - (int32) iComp1[i]);
-      diff *= diff;
-      m_chromaError[i] += weight * (double) diff;
-      sum += diff;
-    }
-  }
+  weightedError(iComp0, iComp1, size, weight, (const double *) NULL, 0, addError, &m_chromaError[0]);
   
-  return sum;
+  return sumSquaredError(iComp0, iComp1, size);
 }
 
 
@@ -270,24 +414,12 @@ double DistortionMetricPSNR::compute(const float *iComp0, const float *iComp1, i
 
 uint64 DistortionMetricPSNR::compute(const uint16 *iComp0, const uint16 *iComp1, int size)
 {
-  int32  diff = 0;
-  uint64 sum = 0;
-  for (int i = 0; i < size; i++) {
-    diff = ((int32) iComp0[i] - (int32) iComp1[i]);
-    sum += diff * diff;
-  }
-  return sum;
+  return sumSquaredError(iComp0, iComp1, size);
 }
 
 uint64 DistortionMetricPSNR::compute(const uint8 *iComp0, const uint8 *iComp1, int size)
 {
-  int32  diff = 0;
-  uint64  sum = 0;
-  for (int i = 0; i < size; i++) {
-    diff = ((int32) iComp0[i] - (int32) iComp1[i]);
-    sum += diff * diff;
-  }
-  return sum;
+  return sumSquaredError(iComp0, iComp1, size);
 }
 
 //-----------------------------------------------------------------------------
@@ -53,7 +53,6 @@
 //-----------------------------------------------------------------------------
 
 #include "DistortionMetricRegionTFPSNR.H"
-#include "ColorTransformGeneric.H"
 
 //-----------------------------------------------------------------------------
 // Macros
@@ -63,10 +62,14 @@
 // Constructor/destructor
 //-----------------------------------------------------------------------------
 
-DistortionMetricRegionTFPSNR::DistortionMetricRegionTFPSNR(const FrameFormat *format, PSNRParams *params, double maxSampleValue)
+DistortionMetricRegionTFPSNR::DistortionMetricRegionTFPSNR(const FrameFormat *format, PSNRParams *params, double maxSampleValue, DistortionFrameCache *frameCache)
  : DistortionMetric()
 {
-  m_transferFunction   = DistortionTransferFunction::create(params->m_tfDistortion, params->m_tfLUTEnable);
+  m_tfDistortion       = params->m_tfDistortion;
+  m_tfLUTEnable        = params->m_tfLUTEnable;
+  // Use the shared metric domain frame cache if one is provided, otherwise a private one
+  m_ownsFrameCache     = (frameCache == NULL) ? TRUE : FALSE;
+  m_frameCache         = (frameCache == NULL) ? new DistortionFrameCache() : frameCache;
   m_totalComponents    = TOTAL_COMPONENTS; // 3 for YCbCr, 3 for RGB, 3 for XYZ and three aggregators = 12
   
   m_blockWidth    = params->m_rPSNRBlockSizeX;
@@ -83,22 +86,13 @@ DistortionMetricRegionTFPSNR::DistortionMetricRegionTFPSNR(const FrameFormat *fo
   
   m_diffData.resize  ( m_width * m_height );
    
-  m_rgb0NormalData.resize  ( m_width * m_height * 3);
-  m_rgb1NormalData.resize  ( m_width * m_height * 3);
-  m_rgb0TFData.resize      ( m_width * m_height * 3);
-  m_rgb1TFData.resize      ( m_width * m_height * 3);
-  
   if (m_computePsnrInYCbCr == TRUE) {
     m_ycbcr0TFData.resize  ( m_width * m_height * 3);
     m_ycbcr1TFData.resize  ( m_width * m_height * 3);
   }
-  if (m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE) {
-    m_xyz0TFData.resize      ( m_width * m_height * 3);
-    m_xyz1TFData.resize      ( m_width * m_height * 3);
-  }
   if (m_computePsnrInYUpVp == TRUE) {
-    m_yupvp0Data.resize      ( m_width * m_height * 3);
-    m_yupvp1Data.resize      ( m_width * m_height * 3);
+    m_yupvp0Data.resize      ( m_width * m_height * 2);
+    m_yupvp1Data.resize      ( m_width * m_height * 2);
   }
 
   m_colorSpace    = format->m_colorSpace;
@@ -144,10 +138,10 @@ DistortionMetricRegionTFPSNR::DistortionMetricRegionTFPSNR(const FrameFormat *fo
 
 DistortionMetricRegionTFPSNR::~DistortionMetricRegionTFPSNR()
 {
-  if (m_transferFunction != NULL) {
-    delete m_transferFunction;
-    m_transferFunction = NULL;
+  if (m_ownsFrameCache == TRUE && m_frameCache != NULL) {
+    delete m_frameCache;
   }
+  m_frameCache = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -190,13 +184,6 @@ void DistortionMetricRegionTFPSNR::convertToXYZ(double r, double g, double b, do
   *x = dClip( 0.000000 * r + 0.028073 * g + 1.060985 * b, 0, 1);
 }
 
-void DistortionMetricRegionTFPSNR::convertToXYZ(double r, double g, double b, double *x, double *y, double *z, const double *transform0, const double *transform1, const double *transform2) {
-  
-  *x = dClip( transform0[0] * r + transform0[1] * g + transform0[2] * b, 0, 1);
-  *y = dClip( transform1[0] * r + transform1[1] * g + transform1[2] * b, 0, 1);
-  *z = dClip( transform2[0] * r + transform2[1] * g + transform2[2] * b, 0, 1);
-}
-
 void DistortionMetricRegionTFPSNR::convertToYCbCrBT2020(double *rgb, double *yCbCr) {
   /*  RGB to YUV BT.2020 (3)
    {  0.262700,   0.678000,   0.059300 },
@@ -222,36 +209,7 @@ void DistortionMetricRegionTFPSNR::convertToXYZ(double *rgb, double *xyz) {
   xyz[2] = dClip( 0.000000 * rgb[R_COMP] + 0.028073 * rgb[G_COMP] + 1.060985 * rgb[B_COMP], 0, 1);
 }
 
-void DistortionMetricRegionTFPSNR::convertToXYZ(double *rgb, double *xyz, const double *transform0, const double *transform1, const double *transform2) {
-  
-  xyz[0] = dClip( transform0[0] * rgb[R_COMP] + transform0[1] * rgb[G_COMP] + transform0[2] * rgb[B_COMP], 0, 1);
-  xyz[1] = dClip( transform1[0] * rgb[R_COMP] + transform1[1] * rgb[G_COMP] + transform1[2] * rgb[B_COMP], 0, 1);
-  xyz[2] = dClip( transform2[0] * rgb[R_COMP] + transform2[1] * rgb[G_COMP] + transform2[2] * rgb[B_COMP], 0, 1);
-}
-
-
-void DistortionMetricRegionTFPSNR::setColorConversion(int colorPrimaries, const double **transform0, const double **transform1, const double **transform2) {
-  int mode = CTF_IDENTITY;
-  if (colorPrimaries == CP_709) {
-    mode = CTF_RGB709_2_XYZ;
-  }
-  else if (colorPrimaries == CP_2020) {
-    mode = CTF_RGB2020_2_XYZ;
-  }
-  else if (colorPrimaries == CP_601) {
-    mode = CTF_RGB601_2_XYZ;
-  }
-  else if (colorPrimaries == CP_P3D65) {
-    mode = CTF_RGBP3D65_2_XYZ;
-  }
-  
-  *transform0 = FWD_TRANSFORM[mode][Y_COMP];
-  *transform1 = FWD_TRANSFORM[mode][U_COMP];
-  *transform2 = FWD_TRANSFORM[mode][V_COMP];
-}
-
-
-double DistortionMetricRegionTFPSNR::compute(double *iComp0, double *iComp1, int width, int height, int component, double maxValue)
+double DistortionMetricRegionTFPSNR::compute(const double *iComp0, const double *iComp1, int width, int height, int component, double maxValue)
 {
   double minSSE =  1e30;
   double maxSSE = -1e30;
@@ -343,74 +301,76 @@ uint64 DistortionMetricRegionTFPSNR::compute(const uint8 *iComp0, const uint8 *i
   return sum;
 }
 
-void DistortionMetricRegionTFPSNR::convert (Frame* inp, double *rgbNormalData,
-                                            double *rgbTFData,
-                                            double *xyzTFData,
+// Planes that do not fit in the frame cache are computed into planeData, which holds up to three planes
+const double *DistortionMetricRegionTFPSNR::getPlane(Frame* inp, MetricDomainPlane type, int component, vector<double> &planeData) {
+  double maxValue = m_maxValue[Y_COMP];
+  const double *plane = m_frameCache->getPlane(inp, type, component, m_tfDistortion, m_tfLUTEnable, maxValue, inp->m_colorPrimaries, NULL);
+  
+  if (plane == NULL) {
+    int planeSize = inp->m_compSize[Y_COMP];
+    if ((int) planeData.size() < 3 * planeSize)
+      planeData.resize(3 * planeSize);
+    plane = m_frameCache->getPlane(inp, type, component, m_tfDistortion, m_tfLUTEnable, maxValue, inp->m_colorPrimaries, &planeData[component * planeSize]);
+  }
+  return plane;
+}
+
+void DistortionMetricRegionTFPSNR::convert (Frame* inp,
+                                            const double **rgbTFData,
+                                            const double **xyzTFData,
                                             double *ycbcrTFData,
-                                            double *yupvpData) {
+                                            double *yupvpData,
+                                            vector<double> &rgbTFPlanes,
+                                            vector<double> &xyzTFPlanes,
+                                            vector<double> &xyzPlanes) {
   int planeSize = inp->m_compSize[Y_COMP];
   
-  double rgbNormal[3], xyzNormal[3];
-  double rgbDouble[3], yCbCrDouble[3], xyzDouble[3];
+  double rgbDouble[3], yCbCrDouble[3], xyzNormal[3];
   double YUpVpDouble[2];
-  const double *transform0 = NULL;
-  const double *transform1 = NULL;
-  const double *transform2 = NULL;
+  const double *xyzData[3] = { NULL, NULL, NULL };
 
-  if (m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE) {
-    setColorConversion(inp->m_colorPrimaries, &transform0, &transform1, &transform2);
+  // The TF encoded and XYZ planes come from the frame cache and are shared with any other TF domain metric
+  for (int c = 0; c < 3; c++) {
+    if (m_computePsnrInRgb == TRUE || m_computePsnrInYCbCr == TRUE) {
+      rgbTFData[c] = getPlane(inp, MDP_TF_RGB, c, rgbTFPlanes);
+    }
+    if ( m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE ) {
+      if (m_computePsnrInXYZ == TRUE || c == 1)
+        xyzTFData[c] = getPlane(inp, MDP_TF_XYZ, c, xyzTFPlanes);
+      if (m_computePsnrInYUpVp == TRUE)
+        xyzData[c]   = getPlane(inp, MDP_XYZ,    c, xyzPlanes);
+    }
   }
-
   
   for (int i = 0; i < planeSize; i++) {
-    rgbNormalData[planeSize * 0 + i] = rgbNormal[R_COMP] = inp->m_floatComp[R_COMP][i] / m_maxValue[R_COMP];
-    rgbNormalData[planeSize * 1 + i] = rgbNormal[G_COMP] = inp->m_floatComp[G_COMP][i] / m_maxValue[G_COMP];
-    rgbNormalData[planeSize * 2 + i] = rgbNormal[B_COMP] = inp->m_floatComp[B_COMP][i] / m_maxValue[B_COMP];
-    
-    if (m_computePsnrInRgb == TRUE || m_computePsnrInYCbCr == TRUE) {
-      rgbTFData[planeSize * 0 + i] = rgbDouble[R_COMP] = m_transferFunction->performCompute( rgbNormal[R_COMP] );
-      rgbTFData[planeSize * 1 + i] = rgbDouble[G_COMP] = m_transferFunction->performCompute( rgbNormal[G_COMP] );
-      rgbTFData[planeSize * 2 + i] = rgbDouble[B_COMP] = m_transferFunction->performCompute( rgbNormal[B_COMP] );
-    }
-    
     if (m_computePsnrInYCbCr == TRUE) {
       // Now convert to Y'CbCr (non-constant luminance)
+      rgbDouble[R_COMP] = rgbTFData[R_COMP][i];
+      rgbDouble[G_COMP] = rgbTFData[G_COMP][i];
+      rgbDouble[B_COMP] = rgbTFData[B_COMP][i];
       convertToYCbCrBT2020(rgbDouble, yCbCrDouble);
       ycbcrTFData[planeSize * 0 + i] = yCbCrDouble[0];
       ycbcrTFData[planeSize * 1 + i] = yCbCrDouble[1];
       ycbcrTFData[planeSize * 2 + i] = yCbCrDouble[2];
     }
     
-    // Finally convert to XYZ
-    if ( m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE )
-    {
-      convertToXYZ(rgbNormal, xyzNormal, transform0, transform1, transform2);
-      // Y Component
-      xyzDouble[1] = m_transferFunction->performCompute( xyzNormal[1] );
-      
-      if ( m_computePsnrInXYZ == TRUE ) {
-        xyzDouble[0] = m_transferFunction->performCompute( xyzNormal[0] );
-        xyzDouble[2] = m_transferFunction->performCompute( xyzNormal[2] );
-        xyzTFData[planeSize * 0 + i] = xyzDouble[0];
-        xyzTFData[planeSize * 1 + i] = xyzDouble[1];
-        xyzTFData[planeSize * 2 + i] = xyzDouble[2];
+    if ( m_computePsnrInYUpVp == TRUE ) {
+      xyzNormal[0] = xyzData[0][i];
+      xyzNormal[1] = xyzData[1][i];
+      xyzNormal[2] = xyzData[2][i];
+      double denom = (xyzNormal[0] + 15.0 * xyzNormal[1] + 3.0 * xyzNormal[2]);
+      if (denom == 0.0) {
+        YUpVpDouble[0] = 0.197830013378341; // u' 
+        YUpVpDouble[1] = 0.468319974939678; // v' 
       }
-      
-      if ( m_computePsnrInYUpVp == TRUE ) {
-        double denom = (xyzNormal[0] + 15.0 * xyzNormal[1] + 3.0 * xyzNormal[2]);
-        if (denom == 0.0) {
-          YUpVpDouble[0] = 0.197830013378341; // u' 
-          YUpVpDouble[1] = 0.468319974939678; // v' 
-        }
-        else {
-          double scale = 1.0 / denom;
-          YUpVpDouble[0] = dClip((4.0 * xyzNormal[0] * scale), 0.0, 1.0); // u' 
-          YUpVpDouble[1] = dClip((9.0 * xyzNormal[1] * scale), 0.0, 1.0); // v'           
-        }
-        yupvpData[planeSize * 0 + i] = xyzDouble[1];
-        yupvpData[planeSize * 1 + i] = YUpVpDouble[0];
-        yupvpData[planeSize * 2 + i] = YUpVpDouble[1];
+      else {
+        double scale = 1.0 / denom;
+        YUpVpDouble[0] = dClip((4.0 * xyzNormal[0] * scale), 0.0, 1.0); // u' 
+        YUpVpDouble[1] = dClip((9.0 * xyzNormal[1] * scale), 0.0, 1.0); // v'           
       }
+      // The Y plane of the Yu'v' representation is the TF(Y) plane
+      yupvpData[planeSize * 0 + i] = YUpVpDouble[0];
+      yupvpData[planeSize * 1 + i] = YUpVpDouble[1];
     }
   }
 }
@@ -430,35 +390,44 @@ void DistortionMetricRegionTFPSNR::computeMetric (Frame* inp0, Frame* inp1)
       int height = inp0->m_height[Y_COMP];
       int curComp;
       
+      const double *rgb0TFData[3] = { NULL, NULL, NULL };
+      const double *rgb1TFData[3] = { NULL, NULL, NULL };
+      const double *xyz0TFData[3] = { NULL, NULL, NULL };
+      const double *xyz1TFData[3] = { NULL, NULL, NULL };
+      const double *yupvp0Data[3] = { NULL, NULL, NULL };
+      const double *yupvp1Data[3] = { NULL, NULL, NULL };
+      
       // Prepare memory
       if ( width * height > m_width * m_height ) {
         m_width  = width;
         m_height = height;
         
-        m_rgb0NormalData.resize  ( m_width * m_height * 3);
-        m_rgb1NormalData.resize  ( m_width * m_height * 3);
-        m_rgb0TFData.resize      ( m_width * m_height * 3);
-        m_rgb1TFData.resize      ( m_width * m_height * 3);
-        
         if (m_computePsnrInYCbCr == TRUE) {
           m_ycbcr0TFData.resize  ( m_width * m_height * 3);
           m_ycbcr1TFData.resize  ( m_width * m_height * 3);
         }
-        if (m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE) {
-          m_xyz0TFData.resize      ( m_width * m_height * 3);
-          m_xyz1TFData.resize      ( m_width * m_height * 3);
-        }
         if (m_computePsnrInYUpVp == TRUE) {
-          m_yupvp0Data.resize      ( m_width * m_height * 3);
-          m_yupvp1Data.resize      ( m_width * m_height * 3);
+          m_yupvp0Data.resize      ( m_width * m_height * 2);
+          m_yupvp1Data.resize      ( m_width * m_height * 2);
         }
         
         m_diffData.resize  ( m_width * m_height );
       }
       
-            
-      convert (inp0, &m_rgb0NormalData[0], &m_rgb0TFData[0], &m_xyz0TFData[0], &m_ycbcr0TFData[0], &m_yupvp0Data[0]);
-      convert (inp1, &m_rgb1NormalData[0], &m_rgb1TFData[0], &m_xyz1TFData[0], &m_ycbcr1TFData[0], &m_yupvp1Data[0]);
+      if (m_ownsFrameCache == TRUE)
+        m_frameCache->reset();
+      
+      convert (inp0, rgb0TFData, xyz0TFData, m_computePsnrInYCbCr ? &m_ycbcr0TFData[0] : NULL, m_computePsnrInYUpVp ? &m_yupvp0Data[0] : NULL, m_rgb0TFData, m_xyz0TFData, m_xyz0Data);
+      convert (inp1, rgb1TFData, xyz1TFData, m_computePsnrInYCbCr ? &m_ycbcr1TFData[0] : NULL, m_computePsnrInYUpVp ? &m_yupvp1Data[0] : NULL, m_rgb1TFData, m_xyz1TFData, m_xyz1Data);
+      
+      if (m_computePsnrInYUpVp == TRUE) {
+        yupvp0Data[0] = xyz0TFData[1];
+        yupvp0Data[1] = &m_yupvp0Data[0];
+        yupvp0Data[2] = &m_yupvp0Data[width * height];
+        yupvp1Data[0] = xyz1TFData[1];
+        yupvp1Data[1] = &m_yupvp1Data[0];
+        yupvp1Data[2] = &m_yupvp1Data[width * height];
+      }
       
       if (m_computePsnrInYCbCr == TRUE) {
         for (int c = Y_COMP; c <= V_COMP; c++) {
@@ -471,7 +440,7 @@ void DistortionMetricRegionTFPSNR::computeMetric (Frame* inp0, Frame* inp1)
       if (m_computePsnrInRgb == TRUE) {
         for (int c = R_COMP; c <= G_COMP; c++) {
           curComp = c + 4;
-          m_mse        [curComp] = compute(&m_rgb0TFData[c * width * height], &m_rgb1TFData[c * width * height], width, height, curComp, 1.0);
+          m_mse        [curComp] = compute(rgb0TFData[c], rgb1TFData[c], width, height, curComp, 1.0);
           m_mseStats   [curComp].updateStats(m_mse[curComp]);
           m_psnr       [curComp] = psnr(1.0, 1, m_mse[curComp]);
           m_psnrStats  [curComp].updateStats(m_psnr[curComp]);
@@ -480,7 +449,7 @@ void DistortionMetricRegionTFPSNR::computeMetric (Frame* inp0, Frame* inp1)
       if (m_computePsnrInXYZ == TRUE) {
         for (int c = 0; c <= 2; c++) {
           curComp = c + 8;
-          m_mse        [curComp] = compute(&m_xyz0TFData[c * width * height], &m_xyz1TFData[c * width * height], width, height, curComp, 1.0);
+          m_mse        [curComp] = compute(xyz0TFData[c], xyz1TFData[c], width, height, curComp, 1.0);
           m_mseStats   [curComp].updateStats(m_mse[curComp]);
           m_psnr       [curComp] = psnr(1.0, 1, m_mse[curComp]);
           m_psnrStats  [curComp].updateStats(m_psnr[curComp]);
@@ -489,7 +458,7 @@ void DistortionMetricRegionTFPSNR::computeMetric (Frame* inp0, Frame* inp1)
       if (m_computePsnrInYUpVp == TRUE) {
         for (int c = 0; c <= 2; c++) {
           curComp = c + 12;
-          m_mse        [curComp] = compute(&m_yupvp0Data[c * width * height], &m_yupvp1Data[c * width * height], width, height, curComp, 1.0);
+          m_mse        [curComp] = compute(yupvp0Data[c], yupvp1Data[c], width, height, curComp, 1.0);
           m_mseStats   [curComp].updateStats(m_mse[curComp]);
           m_psnr       [curComp] = psnr(1.0, 1, m_mse[curComp]);
           m_psnrStats  [curComp].updateStats(m_psnr[curComp]);
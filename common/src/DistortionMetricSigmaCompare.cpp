@@ -338,61 +338,54 @@ int DistortionMetricSigmaCompare::binValue( float sample )
   if ( sample  < 0.0) {
     return(-1);
   }
+  else if (sample <= 1e-16f) {
+    return(0);
+  }
   else { /* col[c] >= 0 */
+    // sample = m * 2^e, 0.5 <= m < 1. Values above 1.0 go to stop e, values up to 1.0 to ceil(log2(sample))
+    int e;
+    double m = frexp((double) sample, &e);
     
-    float fltLog2 = (float) (log(fMax(1e-16f, sample))/ log(2.0));
-    
-    int j = (int) fltLog2; /* float to int */
-    
-    if (fltLog2 > 0.0) j = j + 1; /* must round one side of zero for continuity of integer j */
+    int j = (sample <= 1.0f && m == 0.5) ? e - 1 : e;
     
-    j = (int) fMin(NUMBER_OF_F16_STOPS - 1, fMax(0.0f, j + NUMBER_OF_F16_STOPS / 2.0f)); /* split NUMBER_OF_STOPS half above 1.0 and half below 1.0 */
-    return(j);
+    return iClip(j + NUMBER_OF_F16_STOPS / 2, 0, NUMBER_OF_F16_STOPS - 1); /* split NUMBER_OF_STOPS half above 1.0 and half below 1.0 */
   } /* col[c] < 0 or not */
 }
 
 int DistortionMetricSigmaCompare::binValue( unsigned short sample )
 {
-  if ( sample  < 0.0) {
-    return (-1);
-  }
-  else { /* col[c] >= 0 */
-    float fltLog2 = (float) (log(fMax(1e-16f, (float)sample)) / log(2.0));
-    int j = (int) fltLog2; /* float to int */
-    
-    //       if (fltLog2 > 0.0) j = j + 1; /* must round one side of zero for continuity of integer j */
-    
-    //       j = MIN(NUMBER_OF_U16_STOPS - 1, MAX(0, j + NUMBER_OF_U16_STOPS / 2)); /* split NUMBER_OF_STOPS half above 1.0 and half below 1.0 */
-    return (j);
-  } /* col[c] < 0 or not */
+  // floor(log2(sample)), with zero samples placed in the lowest stop
+  int e;
+  
+  if (sample == 0)
+    return (0);
+  
+  frexp((double) sample, &e);
+  return (e - 1);
 }
 
 int DistortionMetricSigmaCompare::binValue( imgpel sample )
 {
-  if ( sample  < 0.0) {
-    return (-1);
-  }
-  else { /* col[c] >= 0 */
-    float fltLog2 = (float) (log(fMax(1e-16f, (float)sample)) / log(2.0));
-    int j = (int) fltLog2; /* float to int */
-    
-    //       if (fltLog2 > 0.0) j = j + 1; /* must round one side of zero for continuity of integer j */
-    
-    //       j = MIN(NUMBER_OF_U16_STOPS - 1, MAX(0, j + NUMBER_OF_U16_STOPS / 2)); /* split NUMBER_OF_STOPS half above 1.0 and half below 1.0 */
-    return (j);
-  } /* col[c] < 0 or not */
+  int e;
+  
+  if (sample == 0)
+    return (0);
+  
+  frexp((double) sample, &e);
+  return (e - 1);
 }
 
 // SMPTE FCD ST 2084
 // non-linear to linear
 float DistortionMetricSigmaCompare::PQ10000_f( float V)
 {
-  float L;
+  static const float m1inv = 1.0f / 0.1593017578f;
+  static const float m2inv = 1.0f / 78.84375f;
   // Lw, Lb not used since absolute Luma used for PQ
   // formula outputs normalized Luma from 0-1
-  L = pow(fMax(pow(V, 1.0f/78.84375f) - 0.8359375f ,0.0f)/(18.8515625f - 18.6875f * pow(V, 1.0f/78.84375f)),1.0f/0.1593017578f);
+  float Vm = pow(V, m2inv);
   
-  return L;
+  return pow(fMax(Vm - 0.8359375f ,0.0f)/(18.8515625f - 18.6875f * Vm), m1inv);
 }
 
 // SMPTE FCD ST 2084
@@ -400,11 +393,11 @@ float DistortionMetricSigmaCompare::PQ10000_f( float V)
 //  encode   V = ((c1+c2*Y**n))/(1+c3*Y**n))**m
 float DistortionMetricSigmaCompare::PQ10000_r( float L)
 {
-  float V;
   // Lw, Lb not used since absolute Luma used for PQ
   // input assumes normalized luma 0-1
-  V = pow((0.8359375f + 18.8515625f * pow((L),0.1593017578f))/(1.0f + 18.6875f * pow((L),0.1593017578f)),78.84375f);
-  return V;
+  float Ln = pow(L, 0.1593017578f);
+  
+  return pow((0.8359375f + 18.8515625f * Ln)/(1.0f + 18.6875f * Ln), 78.84375f);
 }
 
 
@@ -413,10 +406,12 @@ float DistortionMetricSigmaCompare::bt1886_f( float V, float gamma, float Lw, fl
 {
   // The reference EOTF specified in Rec. ITU-R BT.1886
   // L = a(max[(V+b),0])^g
-  float a = pow( pow( Lw, 1.0f / gamma) - pow( Lb, 1.0f / gamma), gamma);
-  float b = pow( Lb, 1.0f / gamma) / ( pow( Lw, 1.0f / gamma) - pow( Lb, 1.0f / gamma));
-  float L = a * pow( fMax( V + b, 0.0f), gamma);
-  return L;
+  float LwG = pow( Lw, 1.0f / gamma);
+  float LbG = pow( Lb, 1.0f / gamma);
+  float a = pow( LwG - LbG, gamma);
+  float b = LbG / ( LwG - LbG);
+  
+  return a * pow( fMax( V + b, 0.0f), gamma);
 }
 
 
@@ -425,10 +420,12 @@ float DistortionMetricSigmaCompare::bt1886_r( float L, float gamma, float Lw, fl
 {
   // The reference EOTF specified in Rec. ITU-R BT.1886
   // L = a(max[(V+b),0])^g
-  float a = pow( pow( Lw, 1.0f / gamma) - pow( Lb, 1.0f / gamma), gamma);
-  float b = pow( Lb, 1.0f / gamma) / ( pow( Lw, 1.0f / gamma) - pow( Lb, 1.0f / gamma));
-  float V = pow( fMax( L / a, 0.0f), 1.0f / gamma) - b;
-  return V;
+  float LwG = pow( Lw, 1.0f / gamma);
+  float LbG = pow( Lb, 1.0f / gamma);
+  float a = pow( LwG - LbG, gamma);
+  float b = LbG / ( LwG - LbG);
+  
+  return pow( fMax( L / a, 0.0f), 1.0f / gamma) - b;
 }
 
 
@@ -587,7 +584,79 @@ void DistortionMetricSigmaCompare::initSigmaStats( u16_stats_t *stat )
   }
 }
 
-void DistortionMetricSigmaCompare::measureFrameSigmaPass1( f32_stats_t *sig,  float *src_pic, float *test_pic, int width, int height )
+// Histogram bin of a positive absolute difference, taken straight from its float bits
+int DistortionMetricSigmaCompare::difBin( float absDif )
+{
+  uint32 bits;
+  memcpy(&bits, &absDif, sizeof(uint32));
+  
+  int exponent = (int) ((bits >> 23) & 0xFF) - 127 + SIGMA_HIST_EXPONENTS / 2;
+  if (exponent < 0)
+    return 0;
+  if (exponent >= SIGMA_HIST_EXPONENTS)
+    return SIGMA_HIST_BINS - 1;
+  
+  return (exponent << SIGMA_HIST_MANTISSA_BITS) + (int) ((bits >> (23 - SIGMA_HIST_MANTISSA_BITS)) & ((1 << SIGMA_HIST_MANTISSA_BITS) - 1));
+}
+
+void DistortionMetricSigmaCompare::addDifSample( vector<sigma_hist_t> &hist, float absDif )
+{
+  if (hist.empty()) {
+    sigma_hist_t empty = { 0.0, 0.0 };
+    hist.resize(SIGMA_HIST_BINS, empty);
+  }
+  
+  sigma_hist_t *bin = &hist[difBin(absDif)];
+  bin->count  += 1.0;
+  bin->difSum += absDif;
+}
+
+// Number (and sum) of the absolute differences above threshold. Bins straddling the threshold
+// contribute proportionally to their overlap, counted in integer steps for integer data.
+void DistortionMetricSigmaCompare::countFromHistogram( vector<sigma_hist_t> &hist, double threshold, bool isInteger, double *count, double *sum )
+{
+  *count = 0.0;
+  *sum   = 0.0;
+  
+  if (hist.empty())
+    return;
+  
+  for (int i = SIGMA_HIST_BINS - 1; i >= 0; i--) {
+    if (hist[i].count == 0.0)
+      continue;
+    
+    int    exponent = (i >> SIGMA_HIST_MANTISSA_BITS) - SIGMA_HIST_EXPONENTS / 2;
+    int    mantissa = i & ((1 << SIGMA_HIST_MANTISSA_BITS) - 1);
+    double low  = (i == 0) ? 0.0 : ldexp(1.0 + (double) mantissa / (1 << SIGMA_HIST_MANTISSA_BITS), exponent);
+    double high = ldexp(1.0 + (double) (mantissa + 1) / (1 << SIGMA_HIST_MANTISSA_BITS), exponent);
+    
+    if (low > threshold) {
+      *count += hist[i].count;
+      *sum   += hist[i].difSum;
+    }
+    else if (high > threshold) {
+      double fraction, average;
+      if (isInteger) {
+        double first  = floor(threshold) + 1.0;
+        double last   = ceil(high) - 1.0;
+        double values = ceil(high) - ceil(low);
+        fraction = values > 0.0 ? dClip((last - first + 1.0) / values, 0.0, 1.0) : 0.0;
+        average  = (first + last) * 0.5;
+      }
+      else {
+        fraction = (high - threshold) / (high - low);
+        average  = (high + threshold) * 0.5;
+      }
+      *count += fraction * hist[i].count;
+      *sum   += fraction * hist[i].count * average;
+    }
+    else {
+      break;
+    }
+  }
+}
+
+void DistortionMetricSigmaCompare::measureFrameSigmaPass1( f32_stats_t *sig, vector<sigma_hist_t> *difHist, float *src_pic, float *test_pic, int width, int height )
 {
   for(int y=0; y< height; y++)  {
     for(int x=0; x< width; x++)    {
@@ -613,15 +682,11 @@ void DistortionMetricSigmaCompare::measureFrameSigmaPass1( f32_stats_t *sig,  fl
         sig->neg.fStopCount++;
       }
       else { /* col[c] >= 0 */
-        float fltLog2 = (float) (log(fMax (1e-16f, val)) / log(2.0));
-        j = (int) fltLog2; /* float to int */
-        if (fltLog2 > 0.0) j = j + 1; /* must round one side of zero for continuity of integer j */
-        
-        
-        j = (int) fMin(NUMBER_OF_F16_STOPS - 1.0f, fMax(0.0f, j + NUMBER_OF_F16_STOPS / 2.0f)); /* split NUMBER_OF_STOPS half above 1.0 and half below 1.0 */
+        j = binValue( val );
         
         if( dif != 0.0 ){
           sig->pos[j].squareSumError += dif * dif;
+          addDifSample( difHist[j], fAbs(dif) );
 #ifdef COMPUTE_LOCAL_SIGMA
           sig->lpos[k][j].squareSumError += dif * dif;
 #endif
@@ -641,7 +706,7 @@ void DistortionMetricSigmaCompare::measureFrameSigmaPass1( f32_stats_t *sig,  fl
   } /* y */
 }
 
-void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig,  uint16 *src_pic, uint16 *test_pic, int width, int height )
+void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig, vector<sigma_hist_t> *difHist, uint16 *src_pic, uint16 *test_pic, int width, int height )
 {
   int y, x, j;
   
@@ -699,8 +764,7 @@ void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig,  ui
       }
       else { /* col[c] >= 0 */
         
-        float fltLog2 = (float) (log(fMax(1e-16f, val)) / log(2.0));
-        j = (int) fltLog2; /* float to int */
+        j = binValue( val );
         
 #ifdef COMPUTE_LOCAL_SIGMA
         float sig_log2 = log2f(fMax(0, localSigma ));
@@ -708,6 +772,7 @@ void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig,  ui
 #endif
         if( dif != 0 ){
           sig->pos[j].squareSumError += dif * dif;
+          addDifSample( difHist[j], (float) iAbs(dif) );
 #ifdef COMPUTE_LOCAL_SIGMA
           sig->lpos[jd][j].squareSumError += dif * dif;
 #endif
@@ -729,7 +794,7 @@ void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig,  ui
   } /* y */
 }
 
-void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig,  imgpel *src_pic, imgpel *test_pic, int width, int height )
+void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig, vector<sigma_hist_t> *difHist, imgpel *src_pic, imgpel *test_pic, int width, int height )
 {
   for(int y=0; y< height; y++)  {
     for(int x=0; x< width; x++)    {
@@ -787,8 +852,7 @@ void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig,  im
       }
       else { /* col[c] >= 0 */
         
-        float fltLog2 = (float) (log(fMax(1e-16f, val)) / log(2.0));
-        int j = (int) fltLog2; /* float to int */
+        int j = binValue( val );
 
 #ifdef COMPUTE_LOCAL_SIGMA
         float sig_log2 = log2f(fMax(0, localSigma ));
@@ -796,6 +860,7 @@ void DistortionMetricSigmaCompare::measureFrameSigmaPass1( u16_stats_t *sig,  im
 #endif
         if( dif != 0 ){
           sig->pos[j].squareSumError += dif * dif;
+          addDifSample( difHist[j], (float) iAbs(dif) );
             
 #ifdef COMPUTE_LOCAL_SIGMA
           sig->lpos[jd][j].squareSumError += dif * dif;
@@ -953,6 +1018,60 @@ void DistortionMetricSigmaCompare::calcPass1Stats( )
 }
 
 
+// Derive the second pass outlier statistics from the first pass histograms
+void DistortionMetricSigmaCompare::calcPass2Stats( )
+{
+  double count, sum;
+  
+  for (int c=0; c<3; c++)  {
+    f32_stats_t*sig = &(m_f32SigmaStats[c]);
+    
+    for (int j=0; j<NUMBER_OF_F16_STOPS; j++)    {
+      if (sig->pos[j].fStopCount > 0)  {
+        for(int k=0; k < SIGMA_MULTIPLES; k++) {
+          countFromHistogram( m_f32DifHist[c][j], kMultiple(k) * sig->pos[j].sigma, FALSE, &count, &sum);
+          sig->pos[j].countMultipleSigma[k] = count;
+          if(k== (SIGMA_MULTIPLES-1))
+            sig->pos[j].furthestOutlierSum = sum;
+        }
+      }
+    }
+  }
+  
+  if (m_isFloat == FALSE) {
+    for (int c=0; c<3; c++)  {
+      u16_stats_t *sig = &(m_u16SigmaStats[c]);
+      
+      for (int j=0; j<NUMBER_OF_U16_STOPS; j++)    {
+        if (sig->pos[j].fStopCount > 0)  {
+          for(int k=0; k < SIGMA_MULTIPLES; k++) {
+            countFromHistogram( m_u16DifHist[c][j], kMultiple(k) * sig->pos[j].sigma, TRUE, &count, &sum);
+            sig->pos[j].countMultipleSigma[k] = (int64) dRound(count);
+            if(k== (SIGMA_MULTIPLES-1))
+              sig->pos[j].furthestOutlierSum = (int64) dRound(sum);
+          }
+        }
+      } /* j */
+    } /* c */
+  }
+}
+
+// Clear the outlier statistics so that an explicit second pass over the frames starts from zero
+void DistortionMetricSigmaCompare::resetPass2Stats( )
+{
+  for (int c=0; c<3; c++)  {
+    for (int j=0; j<NUMBER_OF_F16_STOPS; j++)    {
+      memset(m_f32SigmaStats[c].pos[j].countMultipleSigma, 0, SIGMA_MULTIPLES * sizeof(double));
+      m_f32SigmaStats[c].pos[j].furthestOutlierSum = 0.0;
+    }
+    for (int j=0; j<NUMBER_OF_U16_STOPS; j++)    {
+      memset(m_u16SigmaStats[c].pos[j].countMultipleSigma, 0, SIGMA_MULTIPLES * sizeof(int64));
+      m_u16SigmaStats[c].pos[j].furthestOutlierSum = 0;
+    }
+  }
+}
+
+
 void DistortionMetricSigmaCompare::printPass1Stats()
 {
     
@@ -1040,7 +1159,7 @@ void DistortionMetricSigmaCompare::printPass1Stats()
         
       } /* count_neg[c] > 0 */
       
-      for (int j=0; j<NUMBER_OF_F16_STOPS; j++)    {
+      for (int j=0; j<NUMBER_OF_U16_STOPS; j++)    {
         if (sig != NULL && sig->pos[j].fStopCount > 0)      {
           printf(" sigma_%s[%d] = %e selfRelative = %f (%f%%) at average value = %e for %lld pixels\n", c_name[c],
                  j, sig->pos[j].sigma, sig->pos[j].selfRelative, 100.0 * sig->pos[j].selfRelative, sig->pos[j].average, sig->pos[j].fStopCount);
@@ -1129,7 +1248,7 @@ void DistortionMetricSigmaCompare::computeMetric (Frame* inp0, Frame* inp1)
       
       for (int c = Y_COMP; c < inp0->m_noComponents; c++) {
         if (m_noPass == 0)
-          measureFrameSigmaPass1( &(m_f32SigmaStats[c]),  inp0->m_floatComp[c], inp1->m_floatComp[c], inp0->m_width[c], inp0->m_height[c] );
+          measureFrameSigmaPass1( &(m_f32SigmaStats[c]), m_f32DifHist[c], inp0->m_floatComp[c], inp1->m_floatComp[c], inp0->m_width[c], inp0->m_height[c] );
         else
           measureFrameSigmaPass2( &(m_f32SigmaStats[c]),  inp0->m_floatComp[c], inp1->m_floatComp[c], inp0->m_width[c], inp0->m_height[c] );
         //m_metric[c] = psnr(m_maxValue[c], inp0->m_compSize[c], m_sse[c]);
@@ -1142,7 +1261,7 @@ void DistortionMetricSigmaCompare::computeMetric (Frame* inp0, Frame* inp1)
         // convert inpX->m_comp[c] to inpX->m_floatComp[c]
         //measureFrameSigmaPass1( &(m_f32SigmaStats[c]),  inp0->m_floatComp[c], inp1->m_floatComp[c], inp0->m_width[c], inp0->m_height[c] );
         if (m_noPass == 0)
-          measureFrameSigmaPass1( &(m_u16SigmaStats[c]),  inp0->m_comp[c], inp1->m_comp[c], inp0->m_width[c], inp0->m_height[c] );
+          measureFrameSigmaPass1( &(m_u16SigmaStats[c]), m_u16DifHist[c], inp0->m_comp[c], inp1->m_comp[c], inp0->m_width[c], inp0->m_height[c] );
         else
           measureFrameSigmaPass2( &(m_u16SigmaStats[c]),  inp0->m_comp[c], inp1->m_comp[c], inp0->m_width[c], inp0->m_height[c] );
       }
@@ -1154,7 +1273,7 @@ void DistortionMetricSigmaCompare::computeMetric (Frame* inp0, Frame* inp1)
         // convert inpX->m_ui16Comp[c] to inpX->m_floatComp[c]
         //measureFrameSigmaPass1( &(m_f32SigmaStats[c]),  inp0->m_floatComp[c], inp1->m_floatComp[c], inp0->m_width[c], inp0->m_height[c] );
         if (m_noPass == 0)
-          measureFrameSigmaPass1( &(m_u16SigmaStats[c]),  inp0->m_ui16Comp[c], inp1->m_ui16Comp[c], inp0->m_width[c], inp0->m_height[c] );
+          measureFrameSigmaPass1( &(m_u16SigmaStats[c]), m_u16DifHist[c], inp0->m_ui16Comp[c], inp1->m_ui16Comp[c], inp0->m_width[c], inp0->m_height[c] );
         else
           measureFrameSigmaPass2( &(m_u16SigmaStats[c]),  inp0->m_ui16Comp[c], inp1->m_ui16Comp[c], inp0->m_width[c], inp0->m_height[c] );
       }
@@ -1190,6 +1309,10 @@ void DistortionMetricSigmaCompare::reportSummary  ()
   if (m_noPass == 0) {
     calcPass1Stats();
     printPass1Stats();
+    // second pass statistics come from the first pass histograms; no need to read the frames again
+    calcPass2Stats();
+    printPass2Stats();
+    resetPass2Stats();
     m_noPass = 1;
   }
   else {
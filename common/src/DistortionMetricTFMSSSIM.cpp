@@ -54,7 +54,6 @@
 //-----------------------------------------------------------------------------
 
 #include "DistortionMetricTFMSSSIM.H"
-#include "ColorTransformGeneric.H"
 
 #include <string.h>
 
@@ -80,10 +79,14 @@ static const double kMsSSIMBeta4 = 0.1333;
 // Constructor/destructor
 //-----------------------------------------------------------------------------
 
-DistortionMetricTFMSSSIM::DistortionMetricTFMSSSIM(const FrameFormat *format, SSIMParams *params, double maxSampleValue)
+DistortionMetricTFMSSSIM::DistortionMetricTFMSSSIM(const FrameFormat *format, SSIMParams *params, double maxSampleValue, DistortionFrameCache *frameCache)
 : DistortionMetric()
 {
-  m_transferFunction   = DistortionTransferFunction::create(params->m_tfDistortion, params->m_tfLUTEnable);
+  m_tfDistortion       = params->m_tfDistortion;
+  m_tfLUTEnable        = params->m_tfLUTEnable;
+  // Use the shared metric domain frame cache if one is provided, otherwise a private one
+  m_ownsFrameCache     = (frameCache == NULL) ? TRUE : FALSE;
+  m_frameCache         = (frameCache == NULL) ? new DistortionFrameCache() : frameCache;
 
   // Metric parameters
   m_K1 = params->m_K1;
@@ -142,10 +145,10 @@ DistortionMetricTFMSSSIM::DistortionMetricTFMSSSIM(const FrameFormat *format, SS
 
 DistortionMetricTFMSSSIM::~DistortionMetricTFMSSSIM()
 {
-  if (m_transferFunction != NULL) {
-    delete m_transferFunction;
-    m_transferFunction = NULL;
+  if (m_ownsFrameCache == TRUE && m_frameCache != NULL) {
+    delete m_frameCache;
   }
+  m_frameCache = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -450,35 +453,6 @@ void DistortionMetricTFMSSSIM::downsample(const float* src, float* out, int iWid
 }
 
 
-void DistortionMetricTFMSSSIM::setColorConversion(int colorPrimaries, const double **transform0, const double **transform1, const double **transform2) {
-  int mode = CTF_IDENTITY;
-  if (colorPrimaries == CP_709) {
-    mode = CTF_RGB709_2_XYZ;
-  }
-  else if (colorPrimaries == CP_601) {
-    mode = CTF_RGB601_2_XYZ;
-  }
-  else if (colorPrimaries == CP_2020) {
-    mode = CTF_RGB2020_2_XYZ;
-  }
-  else if (colorPrimaries == CP_P3D65) {
-    mode = CTF_RGBP3D65_2_XYZ;
-  }
-  
-  *transform0 = FWD_TRANSFORM[mode][Y_COMP];
-  *transform1 = FWD_TRANSFORM[mode][U_COMP];
-  *transform2 = FWD_TRANSFORM[mode][V_COMP];
-}
-
-
-void DistortionMetricTFMSSSIM::convertToXYZ(double *rgb, double *xyz, const double *transform0, const double *transform1, const double *transform2) {
-  
-  xyz[0] = dClip( transform0[0] * rgb[R_COMP] + transform0[1] * rgb[G_COMP] + transform0[2] * rgb[B_COMP], 0, 1);
-  xyz[1] = dClip( transform1[0] * rgb[R_COMP] + transform1[1] * rgb[G_COMP] + transform1[2] * rgb[B_COMP], 0, 1);
-  xyz[2] = dClip( transform2[0] * rgb[R_COMP] + transform2[1] * rgb[G_COMP] + transform2[2] * rgb[B_COMP], 0, 1);
-}
-
-
 float DistortionMetricTFMSSSIM::computePlane(float *inp0Data, float *inp1Data, int height, int width, float maxPixelValue)
 {
   float structural[MAX_SSIM_LEVELS];
@@ -521,19 +495,9 @@ float DistortionMetricTFMSSSIM::computePlane(float *inp0Data, float *inp1Data, i
 
 void DistortionMetricTFMSSSIM::compute(Frame* inp0, Frame* inp1)
 {
-  double rgb0Normal[3], xyz0Normal[3];
-  double rgb1Normal[3], xyz1Normal[3];
-  
-  const double *transform00 = NULL;
-  const double *transform01 = NULL;
-  const double *transform02 = NULL;
-  const double *transform10 = NULL;
-  const double *transform11 = NULL;
-  const double *transform12 = NULL;
+  if (m_ownsFrameCache == TRUE)
+    m_frameCache->reset();
 
-  setColorConversion(inp0->m_colorPrimaries, &transform00, &transform01, &transform02);
-  setColorConversion(inp1->m_colorPrimaries, &transform10, &transform11, &transform12);
-  
   // allocate memory for Y data if not already allocated
   if (inp0->m_width[0] > m_memWidth || inp0->m_height[0] > m_memHeight ) {
     m_memWidth  = inp0->m_width[0];
@@ -543,26 +507,27 @@ void DistortionMetricTFMSSSIM::compute(Frame* inp0, Frame* inp1)
     m_dataY1.resize ( m_memWidth * m_memHeight );
   }
     
-  for (int i = 0; i < inp0->m_compSize[Y_COMP]; i++) {
-    // TF inp0
-    rgb0Normal[R_COMP] = inp0->m_floatComp[R_COMP][i] / m_maxValue[R_COMP];
-    rgb0Normal[G_COMP] = inp0->m_floatComp[G_COMP][i] / m_maxValue[G_COMP];
-    rgb0Normal[B_COMP] = inp0->m_floatComp[B_COMP][i] / m_maxValue[B_COMP];
-    // TF inp1
-    rgb1Normal[R_COMP] = inp1->m_floatComp[R_COMP][i] / m_maxValue[R_COMP];
-    rgb1Normal[G_COMP] = inp1->m_floatComp[G_COMP][i] / m_maxValue[G_COMP];
-    rgb1Normal[B_COMP] = inp1->m_floatComp[B_COMP][i] / m_maxValue[B_COMP];
-        
+  // TF(Y) planes, shared through the frame cache with any other TF domain metric. These are fetched
+  // in bands so that only band sized scratch memory is needed if they do not fit in the cache
+  int width    = inp0->m_width[Y_COMP];
+  int height   = inp0->m_height[Y_COMP];
+  int bandSize = DFC_BAND_ROWS * width;
+  if ((int) m_bandData.size() < 2 * bandSize)
+    m_bandData.resize(2 * bandSize);
+
+  for (int y = 0; y < height; y += DFC_BAND_ROWS) {
+    int rows = iMin(DFC_BAND_ROWS, height - y);
+    const double *xyz0TF = m_frameCache->getBand(inp0, MDP_TF_XYZ, 1, m_tfDistortion, m_tfLUTEnable, m_maxValue[Y_COMP], inp0->m_colorPrimaries, y, rows, &m_bandData[0]);
+    const double *xyz1TF = m_frameCache->getBand(inp1, MDP_TF_XYZ, 1, m_tfDistortion, m_tfLUTEnable, m_maxValue[Y_COMP], inp1->m_colorPrimaries, y, rows, &m_bandData[bandSize]);
+    float *dataY0 = &m_dataY0[y * width];
+    float *dataY1 = &m_dataY1[y * width];
     
-    // Finally convert to XYZ
-    convertToXYZ(rgb0Normal, xyz0Normal, transform00, transform01, transform02);
-    convertToXYZ(rgb1Normal, xyz1Normal, transform10, transform11, transform12);
-    // Y Component
-    // TF inp0
-    m_dataY0[i] = (float) m_transferFunction->performCompute( xyz0Normal[1] );
-    // TF inp1
-    m_dataY1[i] = (float) m_transferFunction->performCompute( xyz1Normal[1] );
-  }  
+    for (int i = 0; i < rows * width; i++) {
+      dataY0[i] = (float) xyz0TF[i];
+      dataY1[i] = (float) xyz1TF[i];
+    }
+  }
+
   
   m_metric[0] = (double) computePlane(&m_dataY0[0], &m_dataY1[0], inp0->m_height[0], inp0->m_width[0], 1.0);
   m_metricStats[0].updateStats(m_metric[0]);
@@ -53,7 +53,6 @@
 //-----------------------------------------------------------------------------
 
 #include "DistortionMetricTFPSNR.H"
-#include "ColorTransformGeneric.H"
 
 //-----------------------------------------------------------------------------
 // Macros
@@ -63,10 +62,14 @@
 // Constructor/destructor
 //-----------------------------------------------------------------------------
 
-DistortionMetricTFPSNR::DistortionMetricTFPSNR(const FrameFormat *format, PSNRParams *params, double maxSampleValue)
+DistortionMetricTFPSNR::DistortionMetricTFPSNR(const FrameFormat *format, PSNRParams *params, double maxSampleValue, DistortionFrameCache *frameCache)
 : DistortionMetric()
 {
-  m_transferFunction   = DistortionTransferFunction::create(params->m_tfDistortion, params->m_tfLUTEnable);
+  m_tfDistortion       = params->m_tfDistortion;
+  m_tfLUTEnable        = params->m_tfLUTEnable;
+  // Use the shared metric domain frame cache if one is provided, otherwise a private one
+  m_ownsFrameCache     = (frameCache == NULL) ? TRUE : FALSE;
+  m_frameCache         = (frameCache == NULL) ? new DistortionFrameCache() : frameCache;
   m_totalComponents    = TOTAL_COMPONENTS; // 3 for YCbCr, 3 for RGB, 3 for XYZ and three aggregators = 12
   m_colorSpace         = format->m_colorSpace;
   m_enableShowMSE      = params->m_enableShowMSE;
@@ -102,10 +105,10 @@ DistortionMetricTFPSNR::DistortionMetricTFPSNR(const FrameFormat *format, PSNRPa
 
 DistortionMetricTFPSNR::~DistortionMetricTFPSNR()
 {
-  if (m_transferFunction != NULL) {
-    delete m_transferFunction;
-    m_transferFunction = NULL;
+  if (m_ownsFrameCache == TRUE && m_frameCache != NULL) {
+    delete m_frameCache;
   }
+  m_frameCache = NULL;
 }
 
 //-----------------------------------------------------------------------------
@@ -113,228 +116,148 @@ DistortionMetricTFPSNR::~DistortionMetricTFPSNR()
 //-----------------------------------------------------------------------------
 
 
-void DistortionMetricTFPSNR::convertToYCbCrBT2020(double *rgb, double *yCbCr) {
-  // This should be replaced by native YCbCr diff 
-  yCbCr[Y_COMP] = dClip( 0.262700 * rgb[R_COMP] + 0.678000 * rgb[G_COMP] + 0.059300 * rgb[B_COMP]      , 0, 1);
-  // 0.5 needs to be added to chroma to bring them within the [0, 1] range
-  yCbCr[U_COMP] = dClip(-0.139630 * rgb[R_COMP] - 0.360370 * rgb[G_COMP] + 0.500000 * rgb[B_COMP] + 0.5, 0, 1);
-  yCbCr[V_COMP] = dClip( 0.500000 * rgb[R_COMP] - 0.459786 * rgb[G_COMP] - 0.040214 * rgb[B_COMP] + 0.5, 0, 1);
-}
-
-void DistortionMetricTFPSNR::convertToYCbCr(double *rgb, double *yCbCr, const double *transform0, const double *transform1, const double *transform2) {
-  
-  yCbCr[Y_COMP] = dClip( transform0[0] * rgb[R_COMP] + transform0[1] * rgb[G_COMP] + transform0[2] * rgb[B_COMP], 0, 1);
-  yCbCr[U_COMP] = dClip( transform1[0] * rgb[R_COMP] + transform1[1] * rgb[G_COMP] + transform1[2] * rgb[B_COMP] + 0.5, 0, 1);
-  yCbCr[V_COMP] = dClip( transform2[0] * rgb[R_COMP] + transform2[1] * rgb[G_COMP] + transform2[2] * rgb[B_COMP] + 0.5, 0, 1);
-}
-
-
-void DistortionMetricTFPSNR::convertToXYZ(double *rgb, double *xyz, const double *transform0, const double *transform1, const double *transform2) {
-
-  xyz[0] = dClip( transform0[0] * rgb[R_COMP] + transform0[1] * rgb[G_COMP] + transform0[2] * rgb[B_COMP], 0, 1);
-  xyz[1] = dClip( transform1[0] * rgb[R_COMP] + transform1[1] * rgb[G_COMP] + transform1[2] * rgb[B_COMP], 0, 1);
-  xyz[2] = dClip( transform2[0] * rgb[R_COMP] + transform2[1] * rgb[G_COMP] + transform2[2] * rgb[B_COMP], 0, 1);
-}
-
-void DistortionMetricTFPSNR::setColorConversion(int colorPrimaries, const double **transform0, const double **transform1, const double **transform2) {
-  int mode = CTF_IDENTITY;
-  if (colorPrimaries == CP_709) {
-    mode = CTF_RGB709_2_XYZ;
-  }
-  else if (colorPrimaries == CP_601) {
-    mode = CTF_RGB601_2_XYZ;
-  }
-  else if (colorPrimaries == CP_2020) {
-    mode = CTF_RGB2020_2_XYZ;
-  }
-  else if (colorPrimaries == CP_P3D65) {
-    mode = CTF_RGBP3D65_2_XYZ;
-  }
-  
-  *transform0 = FWD_TRANSFORM[mode][Y_COMP];
-  *transform1 = FWD_TRANSFORM[mode][U_COMP];
-  *transform2 = FWD_TRANSFORM[mode][V_COMP];
-}
-
-void DistortionMetricTFPSNR::setColorConversionYCbCr(int colorPrimaries, const double **transform0, const double **transform1, const double **transform2) {
-  int mode = CTF_IDENTITY;
-  if (colorPrimaries == CP_709) {
-    mode = CTF_RGB709_2_YUV709;
-  }
-  else if (colorPrimaries == CP_2020) {
-    mode = CTF_RGB2020_2_YUV2020;
-  }
-  else if (colorPrimaries == CP_P3D65) {
-    mode = CTF_RGBP3D65_2_YUVP3D65;
-  }
-  else if (colorPrimaries == CP_601) {
-    mode = CTF_RGB601_2_YUV601;
-  }
-  
-  *transform0 = FWD_TRANSFORM[mode][Y_COMP];
-  *transform1 = FWD_TRANSFORM[mode][U_COMP];
-  *transform2 = FWD_TRANSFORM[mode][V_COMP];
-}
-
 void DistortionMetricTFPSNR::compute(Frame* inp0, Frame* inp1)
 {
-  double rgb0Normal[3], xyz0Normal[3];
-  double rgb1Normal[3], xyz1Normal[3];
-  double rgb0Double[3], yCbCr0Double[3], xyz0Double[3];
-  double rgb1Double[3], yCbCr1Double[3], xyz1Double[3];
+  double xyz0Normal[3], xyz1Normal[3];
   double YUpVp0Double[2], YUpVp1Double[2];
   double diff, diff2, diff2sum;
   
-  const double *transform00 = NULL;
-  const double *transform01 = NULL;
-  const double *transform02 = NULL;
-  const double *transform10 = NULL;
-  const double *transform11 = NULL;
-  const double *transform12 = NULL;
-  const double *transformNCL0 = NULL;
-  const double *transformNCL1 = NULL;
-  const double *transformNCL2 = NULL;
-
-  if (m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE) {
-    setColorConversion(inp0->m_colorPrimaries, &transform00, &transform01, &transform02);
-    setColorConversion(inp1->m_colorPrimaries, &transform10, &transform11, &transform12);
-  }
-  if (m_computePsnrInYCbCr == TRUE) {
-  // It is assumed that both inputs use the same primaries. Otherwise this would not make much sense
-    setColorConversionYCbCr(inp0->m_colorPrimaries, &transformNCL0, &transformNCL1, &transformNCL2);
-  }
+  // Metric domain planes. These are shared (through the frame cache) with any other TF domain metric
+  const double *rgb0TF[3]   = { NULL, NULL, NULL };
+  const double *rgb1TF[3]   = { NULL, NULL, NULL };
+  const double *yCbCr0TF[3] = { NULL, NULL, NULL };
+  const double *yCbCr1TF[3] = { NULL, NULL, NULL };
+  const double *xyz0[3]     = { NULL, NULL, NULL };
+  const double *xyz1[3]     = { NULL, NULL, NULL };
+  const double *xyz0TF[3]   = { NULL, NULL, NULL };
+  const double *xyz1TF[3]   = { NULL, NULL, NULL };
+  double maxValue = m_maxValue[Y_COMP];
+  
+  if (m_ownsFrameCache == TRUE)
+    m_frameCache->reset();
 
   for (int c = 0; c < m_totalComponents; c++) {
     m_sse[c] = 0.0;
   }
   //printf("\n");
 
-  for (int i = 0; i < inp0->m_compSize[Y_COMP]; i++) {
-#if 0
-    // TF inp0
-    rgb0Normal[R_COMP] = dClip(inp0->m_floatComp[R_COMP][i] / m_maxValue[R_COMP], 0.0, 1.0);
-    rgb0Normal[G_COMP] = dClip(inp0->m_floatComp[G_COMP][i] / m_maxValue[G_COMP], 0.0, 1.0);
-    rgb0Normal[B_COMP] = dClip(inp0->m_floatComp[B_COMP][i] / m_maxValue[B_COMP], 0.0, 1.0);
-    // TF inp1
-    rgb1Normal[R_COMP] = dClip(inp1->m_floatComp[R_COMP][i] / m_maxValue[R_COMP], 0.0, 1.0);
-    rgb1Normal[G_COMP] = dClip(inp1->m_floatComp[G_COMP][i] / m_maxValue[G_COMP], 0.0, 1.0);
-    rgb1Normal[B_COMP] = dClip(inp1->m_floatComp[B_COMP][i] / m_maxValue[B_COMP], 0.0, 1.0);
-#else
-    // TF inp0
-    rgb0Normal[R_COMP] = inp0->m_floatComp[R_COMP][i] / m_maxValue[R_COMP];
-    rgb0Normal[G_COMP] = inp0->m_floatComp[G_COMP][i] / m_maxValue[G_COMP];
-    rgb0Normal[B_COMP] = inp0->m_floatComp[B_COMP][i] / m_maxValue[B_COMP];
-    // TF inp1
-    rgb1Normal[R_COMP] = inp1->m_floatComp[R_COMP][i] / m_maxValue[R_COMP];
-    rgb1Normal[G_COMP] = inp1->m_floatComp[G_COMP][i] / m_maxValue[G_COMP];
-    rgb1Normal[B_COMP] = inp1->m_floatComp[B_COMP][i] / m_maxValue[B_COMP];
-#endif    
+  // Process the frame in bands so that planes that do not fit in the frame cache only need band sized scratch memory
+  int width    = inp0->m_width[Y_COMP];
+  int height   = inp0->m_height[Y_COMP];
+  int bandSize = DFC_BAND_ROWS * width;
+  if ((int) m_bandData.size() < 24 * bandSize)
+    m_bandData.resize(24 * bandSize);
 
-    if (m_computePsnrInRgb == TRUE || m_computePsnrInYCbCr == TRUE) {
-      rgb0Double[R_COMP] = m_transferFunction->performCompute( rgb0Normal[R_COMP] );
-      rgb0Double[G_COMP] = m_transferFunction->performCompute( rgb0Normal[G_COMP] );
-      rgb0Double[B_COMP] = m_transferFunction->performCompute( rgb0Normal[B_COMP] );
-      // TF inp1
-      rgb1Double[R_COMP] = m_transferFunction->performCompute( rgb1Normal[R_COMP] );
-      rgb1Double[G_COMP] = m_transferFunction->performCompute( rgb1Normal[G_COMP] );
-      rgb1Double[B_COMP] = m_transferFunction->performCompute( rgb1Normal[B_COMP] );
-    }
+  for (int y = 0; y < height; y += DFC_BAND_ROWS) {
+    int rows = iMin(DFC_BAND_ROWS, height - y);
     
-    if (m_computePsnrInRgb == TRUE) {
-      // compute RGB TF error
-      diff = (rgb0Double[R_COMP] - rgb1Double[R_COMP]);
-      m_sse[R_COMP + 4] += diff * diff;
-      diff = (rgb0Double[G_COMP] - rgb1Double[G_COMP]);
-      m_sse[G_COMP + 4] += diff * diff;
-      diff = (rgb0Double[B_COMP] - rgb1Double[B_COMP]);
-      m_sse[B_COMP + 4] += diff * diff;
+    for (int c = R_COMP; c <= B_COMP; c++) {
+      if (m_computePsnrInRgb == TRUE) {
+        rgb0TF[c]   = m_frameCache->getBand(inp0, MDP_TF_RGB, c, m_tfDistortion, m_tfLUTEnable, maxValue, inp0->m_colorPrimaries, y, rows, &m_bandData[(0 + c) * bandSize]);
+        rgb1TF[c]   = m_frameCache->getBand(inp1, MDP_TF_RGB, c, m_tfDistortion, m_tfLUTEnable, maxValue, inp1->m_colorPrimaries, y, rows, &m_bandData[(3 + c) * bandSize]);
+      }
+      if (m_computePsnrInYCbCr == TRUE) {
+        // It is assumed that both inputs use the same primaries. Otherwise this would not make much sense
+        yCbCr0TF[c] = m_frameCache->getBand(inp0, MDP_TF_YCBCR, c, m_tfDistortion, m_tfLUTEnable, maxValue, inp0->m_colorPrimaries, y, rows, &m_bandData[(6 + c) * bandSize]);
+        yCbCr1TF[c] = m_frameCache->getBand(inp1, MDP_TF_YCBCR, c, m_tfDistortion, m_tfLUTEnable, maxValue, inp0->m_colorPrimaries, y, rows, &m_bandData[(9 + c) * bandSize]);
+      }
+      if (m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE) {
+        xyz0[c] = m_frameCache->getBand(inp0, MDP_XYZ, c, m_tfDistortion, m_tfLUTEnable, maxValue, inp0->m_colorPrimaries, y, rows, &m_bandData[(12 + c) * bandSize]);
+        xyz1[c] = m_frameCache->getBand(inp1, MDP_XYZ, c, m_tfDistortion, m_tfLUTEnable, maxValue, inp1->m_colorPrimaries, y, rows, &m_bandData[(15 + c) * bandSize]);
+        if (m_computePsnrInXYZ == TRUE || c == 1) {
+          xyz0TF[c] = m_frameCache->getBand(inp0, MDP_TF_XYZ, c, m_tfDistortion, m_tfLUTEnable, maxValue, inp0->m_colorPrimaries, y, rows, &m_bandData[(18 + c) * bandSize]);
+          xyz1TF[c] = m_frameCache->getBand(inp1, MDP_TF_XYZ, c, m_tfDistortion, m_tfLUTEnable, maxValue, inp1->m_colorPrimaries, y, rows, &m_bandData[(21 + c) * bandSize]);
+        }
+      }
     }
+
+    for (int i = 0; i < rows * width; i++) {
+      if (m_computePsnrInRgb == TRUE) {
+        // compute RGB TF error
+        diff = (rgb0TF[R_COMP][i] - rgb1TF[R_COMP][i]);
+        m_sse[R_COMP + 4] += diff * diff;
+        diff = (rgb0TF[G_COMP][i] - rgb1TF[G_COMP][i]);
+        m_sse[G_COMP + 4] += diff * diff;
+        diff = (rgb0TF[B_COMP][i] - rgb1TF[B_COMP][i]);
+        m_sse[B_COMP + 4] += diff * diff;
+      }
     
-    if (m_computePsnrInYCbCr == TRUE) {
-      // Now convert to Y'CbCr (non-constant luminance)
-      //convertToYCbCrBT2020(rgb0Double, yCbCr0Double);
-      //convertToYCbCrBT2020(rgb1Double, yCbCr1Double);
-      convertToXYZ(rgb0Double, yCbCr0Double, transformNCL0, transformNCL1, transformNCL2);
-      convertToXYZ(rgb1Double, yCbCr1Double, transformNCL0, transformNCL1, transformNCL2);
-      
-      diff = (yCbCr0Double[Y_COMP] - yCbCr1Double[Y_COMP]);
-      m_sse[Y_COMP] += diff * diff;
-      diff = (yCbCr0Double[U_COMP] - yCbCr1Double[U_COMP]);
-      m_sse[U_COMP] += diff * diff;
-      diff = (yCbCr0Double[V_COMP] - yCbCr1Double[V_COMP]);
-      m_sse[V_COMP] += diff * diff;
-    }
+      if (m_computePsnrInYCbCr == TRUE) {
+        // Y'CbCr (non-constant luminance) error
+        //convertToYCbCrBT2020(rgb0Double, yCbCr0Double);
+        //convertToYCbCrBT2020(rgb1Double, yCbCr1Double);
+        diff = (yCbCr0TF[Y_COMP][i] - yCbCr1TF[Y_COMP][i]);
+        m_sse[Y_COMP] += diff * diff;
+        diff = (yCbCr0TF[U_COMP][i] - yCbCr1TF[U_COMP][i]);
+        m_sse[U_COMP] += diff * diff;
+        diff = (yCbCr0TF[V_COMP][i] - yCbCr1TF[V_COMP][i]);
+        m_sse[V_COMP] += diff * diff;
+      }
     
-    // Finally convert to XYZ
-    if ( m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE )
-    {
-      convertToXYZ(rgb0Normal, xyz0Normal, transform00, transform01, transform02);
-      convertToXYZ(rgb1Normal, xyz1Normal, transform10, transform11, transform12);
-      // Y Component
-      // TF inp0
-      xyz0Double[1] = m_transferFunction->performCompute( xyz0Normal[1] );
-      // TF inp1
-      xyz1Double[1] = m_transferFunction->performCompute( xyz1Normal[1] );
-      
-      // Y component
-      diff = (xyz0Double[1] - xyz1Double[1]);
-      diff2 = diff * diff;
-      diff2sum = diff2;
-      m_sse[9] += diff2;
-      
-      if ( m_computePsnrInXYZ == TRUE ) {
-        // TF inp0
-        xyz0Double[0] = m_transferFunction->performCompute( xyz0Normal[0] );
-        xyz0Double[2] = m_transferFunction->performCompute( xyz0Normal[2] );
-        // TF inp1
-        xyz1Double[0] = m_transferFunction->performCompute( xyz1Normal[0] );
-        xyz1Double[2] = m_transferFunction->performCompute( xyz1Normal[2] );
-        // X component
-        diff = (xyz0Double[0] - xyz1Double[0]);
+      // Finally the XYZ domain
+      if ( m_computePsnrInXYZ == TRUE || m_computePsnrInYUpVp == TRUE )
+      {
+        // Y component
+        diff = (xyz0TF[1][i] - xyz1TF[1][i]);
         diff2 = diff * diff;
-        diff2sum += diff2;
-        m_sse[8] += diff2;
-        
-        // Z component
-        diff = (xyz0Double[2] - xyz1Double[2]);
-        diff2 = diff * diff;
-        diff2sum += diff2;
-        m_sse[10] += diff2;
-        m_sse[16] += sqrt(diff2sum);
-      }
+        diff2sum = diff2;
+        m_sse[9] += diff2;
       
-      if ( m_computePsnrInYUpVp == TRUE ) {
-        double denom0 = (xyz0Normal[0] + 15.0 * xyz0Normal[1] + 3.0 * xyz0Normal[2]);
-        if (denom0 == 0.0) {
-          YUpVp0Double[0] = 0.197830013378341; // u' 
-          YUpVp0Double[1] = 0.468319974939678; // v' 
+        if ( m_computePsnrInXYZ == TRUE ) {
+          // X component
+          diff = (xyz0TF[0][i] - xyz1TF[0][i]);
+          diff2 = diff * diff;
+          diff2sum += diff2;
+          m_sse[8] += diff2;
+        
+          // Z component
+          diff = (xyz0TF[2][i] - xyz1TF[2][i]);
+          diff2 = diff * diff;
+          diff2sum += diff2;
+          m_sse[10] += diff2;
+          m_sse[16] += sqrt(diff2sum);
         }
-        else {
-          double scale0 = 1.0 / denom0;
-          YUpVp0Double[0] = dClip((4.0 * xyz0Normal[0] * scale0), 0.0, 1.0); // u' 
-          YUpVp0Double[1] = dClip((9.0 * xyz0Normal[1] * scale0), 0.0, 1.0); // v' 
+      
+        if ( m_computePsnrInYUpVp == TRUE ) {
+          xyz0Normal[0] = xyz0[0][i];
+          xyz0Normal[1] = xyz0[1][i];
+          xyz0Normal[2] = xyz0[2][i];
+          xyz1Normal[0] = xyz1[0][i];
+          xyz1Normal[1] = xyz1[1][i];
+          xyz1Normal[2] = xyz1[2][i];
+
+          double denom0 = (xyz0Normal[0] + 15.0 * xyz0Normal[1] + 3.0 * xyz0Normal[2]);
+          if (denom0 == 0.0) {
+            YUpVp0Double[0] = 0.197830013378341; // u' 
+            YUpVp0Double[1] = 0.468319974939678; // v' 
+          }
+          else {
+            double scale0 = 1.0 / denom0;
+            YUpVp0Double[0] = dClip((4.0 * xyz0Normal[0] * scale0), 0.0, 1.0); // u' 
+            YUpVp0Double[1] = dClip((9.0 * xyz0Normal[1] * scale0), 0.0, 1.0); // v' 
           
-        }
-        double denom1 = (xyz1Normal[0] + 15.0 * xyz1Normal[1] + 3.0 * xyz1Normal[2]);
+          }
+          double denom1 = (xyz1Normal[0] + 15.0 * xyz1Normal[1] + 3.0 * xyz1Normal[2]);
       
-        if (denom1 == 0.0) {
-          YUpVp1Double[0] = 0.197830013378341; // u'
-          YUpVp1Double[1] = 0.468319974939678; // v' 
-        }
-        else {
-          double scale1 = 1.0 / denom1;    
+          if (denom1 == 0.0) {
+            YUpVp1Double[0] = 0.197830013378341; // u'
+            YUpVp1Double[1] = 0.468319974939678; // v' 
+          }
+          else {
+            double scale1 = 1.0 / denom1;    
           
-          YUpVp1Double[0] = dClip((4.0 * xyz1Normal[0] * scale1), 0.0, 1.0); // u'
-          YUpVp1Double[1] = dClip((9.0 * xyz1Normal[1] * scale1), 0.0, 1.0); // v' 
-        }
+            YUpVp1Double[0] = dClip((4.0 * xyz1Normal[0] * scale1), 0.0, 1.0); // u'
+            YUpVp1Double[1] = dClip((9.0 * xyz1Normal[1] * scale1), 0.0, 1.0); // v' 
+          }
 
-        diff = (YUpVp0Double[0] - YUpVp1Double[0]);
-        //printf("denom %10.6f %10.6f %10.6f %10.6f %10.6f", denom0, denom1, diff, YUpVp0Double[0], YUpVp1Double[0]);
-        m_sse[12] += diff * diff;
-        diff = (YUpVp0Double[1] - YUpVp1Double[1]);
-        //printf(" %10.6f %10.6f %10.6f\n", diff, YUpVp0Double[0], YUpVp1Double[0]);
+          diff = (YUpVp0Double[0] - YUpVp1Double[0]);
+          //printf("denom %10.6f %10.6f %10.6f %10.6f %10.6f", denom0, denom1, diff, YUpVp0Double[0], YUpVp1Double[0]);
+          m_sse[12] += diff * diff;
+          diff = (YUpVp0Double[1] - YUpVp1Double[1]);
+          //printf(" %10.6f %10.6f %10.6f\n", diff, YUpVp0Double[0], YUpVp1Double[0]);
 
-        m_sse[13] += diff * diff;
+          m_sse[13] += diff * diff;
+        }
       }
     }
   }
@@ -123,6 +123,9 @@ DistortionMetricVQM::DistortionMetricVQM(const FrameFormat *format, VQMParams *v
 	m_numberOfFramesFixate = iMin( m_numberOfFrames, (int)ceil(vqmParams->m_frameRate * vqmParams->m_fixationTime));
 
 	m_displayAdapt = vqmParams->m_displayAdapt;
+	m_streaming    = vqmParams->m_streaming;
+	m_windowCnt    = 0;
+	m_sketchScale  = 0.0;
 	
 	float bSizeTemp = (float) ((tan(PI_VQM / 90.0 ) * (double) vqmParams->m_viewingDistance * sqrt(((double) vqmParams->m_rowsDisplay * (double) vqmParams->m_colsDisplay)/ (double) vqmParams->m_displayArea)) / 2.0);
   
@@ -142,10 +145,19 @@ DistortionMetricVQM::DistortionMetricVQM(const FrameFormat *format, VQMParams *v
 		m_subBandError[i].resize(m_resizeSize);
 	}
 
-	int tPoolSize = (int) (ceil((double) m_resizeHeight / m_bSize) * ceil((double)m_resizeWidth / m_bSize) * (m_numberOfFrames / m_numberOfFramesFixate));
+	// In streaming mode only the tubes of the current fixation window are kept
+	int tPoolSize = (int) (ceil((double) m_resizeHeight / m_bSize) * ceil((double)m_resizeWidth / m_bSize) * (m_streaming ? 1 : (m_numberOfFrames / m_numberOfFramesFixate)));
 
 	m_poolError.resize(tPoolSize);
 	
+	if (m_streaming) {
+	  m_windowScores.resize(VQM_SKETCH_SIZE);
+	  m_sketchCount.resize(VQM_SKETCH_BINS, 0);
+	  m_sketchSum.resize(VQM_SKETCH_BINS, 0.0);
+	  // bin 0 holds all values up to VQM_SKETCH_MIN, the remaining bins are log spaced
+	  m_sketchScale = (double) (VQM_SKETCH_BINS - 2) / log(VQM_SKETCH_MAX / VQM_SKETCH_MIN);
+	}
+	
 	m_rszIn0.resize(m_resizeSize);
 	m_rszIn1.resize(m_resizeSize);
 
@@ -513,7 +525,7 @@ void DistortionMetricVQM::spatioTemporalPooling()
   float * frameSubBandError = NULL;
   double tMean = 0.0, tStdSum = 0.0;
   int tidx, i = 0;
-  int stTubeIdx = (int)(m_stTubeCnt * ceil((double) m_resizeHeight / m_bSize) * m_resizeWidth / m_bSize);
+  int stTubeIdx = m_streaming ? 0 : (int)(m_stTubeCnt * ceil((double) m_resizeHeight / m_bSize) * m_resizeWidth / m_bSize);
 
   
   for(int row = 0; row < m_resizeHeight; row += m_bSize) {
@@ -547,37 +559,128 @@ void DistortionMetricVQM::spatioTemporalPooling()
       i = 0;
     }
   }
+  
+  if (m_streaming) {
+    addWindowScore(poolTubes(&m_poolError[0], ceilDivide(m_resizeHeight, m_bSize) * ceilDivide(m_resizeWidth, m_bSize)));
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Short term pooling of the tubes of one fixation window. Averages
+ *    the lowest m_sortPerc fraction of the tube errors.
+ ************************************************************************
+ */
+float DistortionMetricVQM::poolTubes(float *tubes, int size)
+{
+  int tSize1 = vqmRound((size - 1) * m_sortPerc) + 1;
+  float score = 0.0f;
+  
+  std::sort(tubes, tubes + size, std::less<float>());
+  for( int kkk = 0; kkk < tSize1; kkk++) {
+    score = (float) ((double) score + (double) tubes[kkk]);
+  }
+  return (float) ((double) score / (double) tSize1);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Long term pooling. Averages the lowest m_sortPerc fraction of the
+ *    window scores.
+ ************************************************************************
+ */
+float DistortionMetricVQM::poolWindows(float *scores, int count)
+{
+  int tMax = vqmRound((double) (count - 1) * (double) m_sortPerc) + 1;
+  float score = 0.0f;
+  
+  std::sort(scores, scores + count, std::less<float>());
+  for(int i = 0; i < tMax; i++)	{
+    score = (float) ((double) score + (double) scores[i]);
+  }
+  return (float) ((double) score / (double) tMax);
+}
+
+void DistortionMetricVQM::addWindowScore(float score)
+{
+  if (m_windowCnt < VQM_SKETCH_SIZE) {
+    m_windowScores[m_windowCnt] = score;
+  }
+  else {
+    // The buffer is full, continue with the sketch only
+    if (m_windowCnt == VQM_SKETCH_SIZE) {
+      for (int i = 0; i < VQM_SKETCH_SIZE; i++)
+        addToSketch(m_windowScores[i]);
+    }
+    addToSketch(score);
+  }
+  m_windowCnt++;
+}
+
+void DistortionMetricVQM::addToSketch(float score)
+{
+  int bin = 0;
+  if ((double) score > VQM_SKETCH_MIN)
+    bin = iMin(VQM_SKETCH_BINS - 1, 1 + (int) (log((double) score / VQM_SKETCH_MIN) * m_sketchScale));
+  
+  m_sketchCount[bin]++;
+  m_sketchSum[bin] += (double) score;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Long term pooling from the quantile sketch. Bins are consumed in
+ *    increasing order; the last, partially used, bin contributes its mean
+ *    value, so the error is bounded by the relative width of a bin.
+ ************************************************************************
+ */
+float DistortionMetricVQM::poolSketch()
+{
+  int    tMax      = vqmRound((double) (m_windowCnt - 1) * (double) m_sortPerc) + 1;
+  int    remaining = tMax;
+  double score     = 0.0;
+  
+  for (int bin = 0; bin < VQM_SKETCH_BINS && remaining > 0; bin++) {
+    if (m_sketchCount[bin] <= remaining) {
+      score     += m_sketchSum[bin];
+      remaining -= m_sketchCount[bin];
+    }
+    else {
+      score     += m_sketchSum[bin] * (double) remaining / (double) m_sketchCount[bin];
+      remaining  = 0;
+    }
+  }
+  return (float) (score / (double) tMax);
 }
 
 void DistortionMetricVQM::longTermPooling()
 {
+  if (m_streaming) {
+    // the window scores were already computed as each fixation window completed
+    if (m_windowCnt <= VQM_SKETCH_SIZE)
+      m_vqmScore = poolWindows(&m_windowScores[0], m_windowCnt);
+    else
+      m_vqmScore = poolSketch();
+    return;
+  }
+  
   int tRows = ceilDivide(m_resizeHeight, m_bSize); // (int)ceil((double)m_resizeHeight / (double) m_bSize);
   int tCols = ceilDivide(m_resizeWidth, m_bSize);  // (int)ceil((double)m_resizeWidth  / (double) m_bSize);
   
   int tMax = m_numberOfFrames/m_numberOfFramesFixate;
   
   int tSize = tRows * tCols;
-  int tSize1 = vqmRound((tSize-1) * m_sortPerc) + 1;
   
-  // Add one to avoid problem with the subsequent tMax computation
-  vector<float> tArr(tMax + 1);
-
-  memset(&tArr[0], 0, sizeof(float)*(tMax + 1));
+  vector<float> tArr(tMax);
   
   for(int i = 0; i < tMax; i++)	{
-    std::sort(&m_poolError[i*tSize], &m_poolError[i*tSize+tSize], std::less<float>());
-    for( int kkk = 0; kkk < tSize1; kkk++) {
-      tArr[i] =  (float) ((double) tArr[i] + (double) m_poolError[i*tSize+kkk]);
-    }
-    tArr[i] = (float) ((double) tArr[i] / (double) tSize1);
+    tArr[i] = poolTubes(&m_poolError[i*tSize], tSize);
   }
   
-  std::sort(&tArr[0], &tArr[tMax], std::less<float>());
-  tMax = vqmRound((double) (tMax - 1) * (double) m_sortPerc) + 1;
-  for(int i = 0; i < tMax; i++)	{
-    m_vqmScore = (float) ((double) m_vqmScore + (double) tArr[i]);
-  }
-  m_vqmScore =  (float) ((double) m_vqmScore / (double) tMax);
+  m_vqmScore = poolWindows(&tArr[0], tMax);
   
   //printf("longTermPooling %f\n", m_vqmScore);
   //if(m_vqmScore != 0)
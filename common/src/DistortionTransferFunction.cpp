@@ -91,6 +91,7 @@ DistortionTransferFunction *DistortionTransferFunction::create(DistortionFunctio
       break;
   }
   result->m_enableLUT = enableLUT;
+  result->m_method = method;
     
   result->initLUT();
 
@@ -104,27 +105,26 @@ void DistortionTransferFunction::initLUT() {
   }
   else {
     printf("Initializing LUTs for TF metric computations\n");
-    uint32 i, j;
+    uint32 i;
     m_binsLUT = 10;
     m_elementsLUT.resize   (m_binsLUT);
     m_multiplierLUT.resize (m_binsLUT);
     m_boundLUT.resize      (m_binsLUT + 1);
-    m_computeLUT.resize    (m_binsLUT);
     m_boundLUT[0] = 0.0;
     for (i = 0; i < m_binsLUT; i++) {
       m_elementsLUT[i] = 10000; // Size of each bin. 
                                 // Could be different for each bin, but for now lets set this to be the same.
       m_boundLUT[i + 1] = 1 / pow( 10.0 , (double) (m_binsLUT - i - 1)); // upper bin boundary
-      double stepSize = (m_boundLUT[i + 1] -  m_boundLUT[i]) / (m_elementsLUT[i] - 1);
       m_multiplierLUT[i] = (double) (m_elementsLUT[i] - 1) / (m_boundLUT[i + 1] -  m_boundLUT[i]);
-      
-      // Now allocate memory given the specified size
-      m_computeLUT[i].resize(m_elementsLUT[i]);
-      for (j = 0; j < m_elementsLUT[i] ; j++) {
-        double curValue = m_boundLUT[i] + (double) j * stepSize;
-        m_computeLUT[i][j] = compute(curValue);
-      }
     }
+    
+    // Shared by all instances of the same method
+    char key[MAX_LINE_LEN];
+    snprintf(key, MAX_LINE_LEN, "DTF %d", m_method);
+    m_computeLUT = LUTCache::acquire(key, m_binsLUT, 10000, [this](uint32 i, uint32 j) {
+      double stepSize = (m_boundLUT[i + 1] -  m_boundLUT[i]) / (m_elementsLUT[i] - 1);
+      return compute(m_boundLUT[i] + (double) j * stepSize);
+    });
   }
 }
 
@@ -224,10 +224,10 @@ double DistortionTransferFunction::computePH10K(double value) {
 
 double DistortionTransferFunction::computeLUT(double value) {
   if (value <= 0.0)
-    return m_computeLUT[0][0];
+    return (*m_computeLUT)[0][0];
   else if (value >= 1.0) {
     // top value, most likely 1.0
-    return m_computeLUT[m_binsLUT - 1][m_elementsLUT[m_binsLUT - 1] - 1];
+    return (*m_computeLUT)[m_binsLUT - 1][m_elementsLUT[m_binsLUT - 1] - 1];
   }
   else { // now search for value in the table
     for (uint32 i = 0; i < m_binsLUT; i++) {
@@ -235,7 +235,7 @@ double DistortionTransferFunction::computeLUT(double value) {
         double satValue = (value - m_boundLUT[i]) * m_multiplierLUT[i];
         int    valuePlus     = (int) dCeil(satValue) ;
         double distancePlus  = (double) valuePlus - satValue;
-        return (m_computeLUT[i][valuePlus - 1] * distancePlus + m_computeLUT[i][valuePlus] * (1.0 - distancePlus));
+        return ((*m_computeLUT)[i][valuePlus - 1] * distancePlus + (*m_computeLUT)[i][valuePlus] * (1.0 - distancePlus));
       }
     }
   }
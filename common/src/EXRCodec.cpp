@@ -0,0 +1,591 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file EXRCodec.cpp
+ *
+ * \brief
+ *    OpenEXR RLE, ZIP(S) and PIZ chunk compressors
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "EXRCodec.H"
+#include <string.h>
+#include <algorithm>
+
+#ifdef USEZLIB
+#include <zlib.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Macros/Defines
+//-----------------------------------------------------------------------------
+
+#define RLE_MIN_RUN_LENGTH    3
+#define RLE_MAX_RUN_LENGTH  127
+
+#define USHORT_RANGE        (1 << 16)
+#define BITMAP_SIZE         (USHORT_RANGE >> 3)
+
+#define HUF_ENCBITS         16                            // literal (value) bit length
+#define HUF_ENCSIZE         ((1 << HUF_ENCBITS) + 1)      // encoding table size
+#define HUF_MAX_LENGTH      58                            // longest code supported by the decoders
+
+#define SHORT_ZEROCODE_RUN  59
+#define LONG_ZEROCODE_RUN   63
+#define SHORTEST_LONG_RUN   (2 + LONG_ZEROCODE_RUN - SHORT_ZEROCODE_RUN)
+#define LONGEST_LONG_RUN    (255 + SHORTEST_LONG_RUN)
+
+//-----------------------------------------------------------------------------
+// Local classes
+//-----------------------------------------------------------------------------
+
+//! MSB first bit packer used by the Huffman coder
+class HufBitWriter {
+public:
+  uint8  *m_out;
+  uint64  m_bits;
+  int     m_count;
+  
+  HufBitWriter(uint8 *out) : m_out(out), m_bits(0), m_count(0) {}
+  
+  inline void put(int nBits, uint64 bits) {
+    if (nBits > 32) {
+      // keep the pending bits within the accumulator
+      put(nBits - 32, bits >> 32);
+      nBits = 32;
+      bits &= 0xffffffff;
+    }
+    m_bits   = (m_bits << nBits) | bits;
+    m_count += nBits;
+    while (m_count >= 8) {
+      m_count -= 8;
+      *m_out++ = (uint8) (m_bits >> m_count);
+    }
+  }
+  // codes hold their length in the 6 lsbs
+  inline void putCode(uint64 code) {
+    put((int) (code & 63), code >> 6);
+  }
+  inline void flush() {
+    if (m_count > 0)
+      *m_out++ = (uint8) (m_bits << (8 - m_count));
+    m_count = 0;
+  }
+};
+
+//-----------------------------------------------------------------------------
+// Local functions
+//-----------------------------------------------------------------------------
+
+static inline void writeUInt16(uint8 *dst, uint32 value) {
+  dst[0] = (uint8) (value     );
+  dst[1] = (uint8) (value >> 8);
+}
+
+static inline void writeUInt32(uint8 *dst, uint32 value) {
+  dst[0] = (uint8) (value      );
+  dst[1] = (uint8) (value >>  8);
+  dst[2] = (uint8) (value >> 16);
+  dst[3] = (uint8) (value >> 24);
+}
+
+// Split the bytes in two halves (even and odd bytes) and replace them by their differences.
+// This is the preprocessing shared by the RLE and ZIP compressors.
+static void reorderAndPredict(const uint8 *src, int64 size, uint8 *dst)
+{
+  uint8 *t1 = dst;
+  uint8 *t2 = dst + (size + 1) / 2;
+  
+  for (int64 i = 0; i < size; i += 2) {
+    *t1++ = src[i];
+    if (i + 1 < size)
+      *t2++ = src[i + 1];
+  }
+  
+  for (int64 i = size - 1; i > 0; i--)
+    dst[i] = (uint8) (dst[i] - dst[i - 1] + 128);
+}
+
+//-----------------------------------------------------------------------------
+// PIZ wavelet
+//-----------------------------------------------------------------------------
+
+// Haar wavelet step for values of 14 bits or less
+static inline void wenc14(uint16 a, uint16 b, uint16 &l, uint16 &h)
+{
+  int16 as = (int16) a;
+  int16 bs = (int16) b;
+  
+  l = (uint16) (int16) ((as + bs) >> 1);
+  h = (uint16) (int16) (as - bs);
+}
+
+// Haar wavelet step modulo 2^16
+static inline void wenc16(uint16 a, uint16 b, uint16 &l, uint16 &h)
+{
+  int ao = (a + 0x8000) & 0xffff;
+  int m  = (ao + b) >> 1;
+  int d  = ao - b;
+  
+  if (d < 0)
+    m = (m + 0x8000) & 0xffff;
+  
+  l = (uint16) m;
+  h = (uint16) (d & 0xffff);
+}
+
+// 2D wavelet transform of the nx x ny samples at in (with x stride ox and y stride oy), in place
+static void wav2Encode(uint16 *in, int nx, int ox, int ny, int oy, uint16 mx)
+{
+  bool w14 = (mx < (1 << 14));
+  int  n   = (nx > ny) ? ny : nx;
+  int  p   = 1;   // 1 << level
+  int  p2  = 2;   // 1 << (level + 1)
+  uint16 i00, i01, i10, i11;
+  
+  while (p2 <= n) {
+    uint16 *py  = in;
+    uint16 *ey  = in + oy * (ny - p2);
+    int     oy1 = oy * p;
+    int     oy2 = oy * p2;
+    int     ox1 = ox * p;
+    int     ox2 = ox * p2;
+    
+    for (; py <= ey; py += oy2) {
+      uint16 *px = py;
+      uint16 *ex = py + ox * (nx - p2);
+      
+      for (; px <= ex; px += ox2) {
+        uint16 *p01 = px  + ox1;
+        uint16 *p10 = px  + oy1;
+        uint16 *p11 = p10 + ox1;
+        
+        if (w14) {
+          wenc14 (*px,  *p01, i00, i01);
+          wenc14 (*p10, *p11, i10, i11);
+          wenc14 (i00, i10, *px,  *p10);
+          wenc14 (i01, i11, *p01, *p11);
+        }
+        else {
+          wenc16 (*px,  *p01, i00, i01);
+          wenc16 (*p10, *p11, i10, i11);
+          wenc16 (i00, i10, *px,  *p10);
+          wenc16 (i01, i11, *p01, *p11);
+        }
+      }
+      
+      // odd column
+      if (nx & p) {
+        uint16 *p10 = px + oy1;
+        
+        if (w14)
+          wenc14 (*px, *p10, i00, *p10);
+        else
+          wenc16 (*px, *p10, i00, *p10);
+        *px = i00;
+      }
+    }
+    
+    // odd line
+    if (ny & p) {
+      uint16 *px = py;
+      uint16 *ex = py + ox * (nx - p2);
+      
+      for (; px <= ex; px += ox2) {
+        uint16 *p01 = px + ox1;
+        
+        if (w14)
+          wenc14 (*px, *p01, i00, *p01);
+        else
+          wenc16 (*px, *p01, i00, *p01);
+        *px = i00;
+      }
+    }
+    
+    p  = p2;
+    p2 <<= 1;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// PIZ Huffman coder
+//-----------------------------------------------------------------------------
+
+// Replace the code lengths in hcode by canonical (code << 6 | length) codes
+static void hufCanonicalCodeTable(int64 *hcode)
+{
+  int64 n[HUF_MAX_LENGTH + 1];
+  int64 c = 0;
+  
+  memset(n, 0, sizeof(n));
+  for (int i = 0; i < HUF_ENCSIZE; i++)
+    n[hcode[i]] += 1;
+  
+  for (int i = HUF_MAX_LENGTH; i > 0; i--) {
+    int64 nc = (c + n[i]) >> 1;
+    n[i] = c;
+    c = nc;
+  }
+  
+  for (int i = 0; i < HUF_ENCSIZE; i++) {
+    int l = (int) hcode[i];
+    if (l > 0)
+      hcode[i] = l | (n[l]++ << 6);
+  }
+}
+
+struct FreqHeapCompare {
+  bool operator () (int64 *a, int64 *b) const { return *a > *b; }
+};
+
+// Build the Huffman code of the frequencies in frq (which are replaced by the codes). im and iM
+// are set to the first and last coded symbols. Symbol iM is a pseudo symbol used for runs.
+static void hufBuildEncTable(int64 *frq, int *im, int *iM)
+{
+  static thread_local vector<int>     hlink;
+  static thread_local vector<int64 *> fHeap;
+  static thread_local vector<int64>   scode;
+  int nf = 0;
+  
+  hlink.resize(HUF_ENCSIZE);
+  fHeap.resize(HUF_ENCSIZE);
+  scode.assign(HUF_ENCSIZE, 0);
+  
+  *im = 0;
+  while (!frq[*im])
+    (*im)++;
+  
+  for (int i = *im; i < HUF_ENCSIZE; i++) {
+    hlink[i] = i;
+    if (frq[i]) {
+      fHeap[nf++] = &frq[i];
+      *iM = i;
+    }
+  }
+  
+  // pseudo symbol for run length encoding
+  (*iM)++;
+  frq[*iM] = 1;
+  fHeap[nf++] = &frq[*iM];
+  
+  std::make_heap(&fHeap[0], &fHeap[0] + nf, FreqHeapCompare());
+  
+  while (nf > 1) {
+    // merge the two least frequent entries mm and m into m
+    int mm = (int) (fHeap[0] - frq);
+    std::pop_heap(&fHeap[0], &fHeap[0] + nf, FreqHeapCompare());
+    --nf;
+    
+    int m = (int) (fHeap[0] - frq);
+    std::pop_heap(&fHeap[0], &fHeap[0] + nf, FreqHeapCompare());
+    
+    frq[m] += frq[mm];
+    std::push_heap(&fHeap[0], &fHeap[0] + nf, FreqHeapCompare());
+    
+    // all codes of both lists get one bit longer, and the lists are joined
+    for (int j = m; ; j = hlink[j]) {
+      scode[j]++;
+      if (hlink[j] == j) {
+        hlink[j] = mm;
+        break;
+      }
+    }
+    for (int j = mm; ; j = hlink[j]) {
+      scode[j]++;
+      if (hlink[j] == j)
+        break;
+    }
+  }
+  
+  hufCanonicalCodeTable(&scode[0]);
+  memcpy(frq, &scode[0], sizeof(int64) * HUF_ENCSIZE);
+}
+
+// Store the code lengths of symbols im to iM (6 bits each, with runs of unused symbols)
+static uint8 *hufPackEncTable(const int64 *hcode, int im, int iM, uint8 *out)
+{
+  HufBitWriter bits(out);
+  
+  for (; im <= iM; im++) {
+    int l = (int) (hcode[im] & 63);
+    
+    if (l == 0) {
+      int zerun = 1;
+      
+      while ((im < iM) && (zerun < LONGEST_LONG_RUN)) {
+        if ((hcode[im + 1] & 63) > 0)
+          break;
+        im++;
+        zerun++;
+      }
+      
+      if (zerun >= 2) {
+        if (zerun >= SHORTEST_LONG_RUN) {
+          bits.put(6, LONG_ZEROCODE_RUN);
+          bits.put(8, zerun - SHORTEST_LONG_RUN);
+        }
+        else {
+          bits.put(6, SHORT_ZEROCODE_RUN + zerun - 2);
+        }
+        continue;
+      }
+    }
+    bits.put(6, l);
+  }
+  bits.flush();
+  
+  return bits.m_out;
+}
+
+// Output runCount + 1 instances of the symbol with code sCode, as a run if that is shorter
+static inline void hufSendCode(int64 sCode, int runCount, int64 runCode, HufBitWriter &bits)
+{
+  if ((sCode & 63) + (runCode & 63) + 8 < (sCode & 63) * runCount) {
+    bits.putCode(sCode);
+    bits.putCode(runCode);
+    bits.put(8, runCount);
+  }
+  else {
+    while (runCount-- >= 0)
+      bits.putCode(sCode);
+  }
+}
+
+// Huffman encode nRaw values, appending the tables and data to dst. Returns the bytes appended.
+static int64 hufCompress(const uint16 *raw, int64 nRaw, vector<uint8> &dst)
+{
+  static thread_local vector<int64> freq;
+  static thread_local vector<int64> count;
+  int im = 0, iM = 0;
+  
+  freq.assign(HUF_ENCSIZE, 0);
+  for (int64 i = 0; i < nRaw; i++)
+    freq[raw[i]]++;
+  count = freq;
+  
+  hufBuildEncTable(&freq[0], &im, &iM);
+  
+  // Runs are only used when shorter, so sending every value on its own is the worst case
+  int64 nBitsMax = 0;
+  for (int i = im; i < iM; i++)
+    nBitsMax += count[i] * (freq[i] & 63);
+  
+  int64 start = (int64) dst.size();
+  dst.resize(start + 20 + (6 * (iM - im + 1) + 7) / 8 + (nBitsMax + 7) / 8 + 8);
+  
+  uint8 *tableStart = &dst[start] + 20;
+  uint8 *tableEnd   = hufPackEncTable(&freq[0], im, iM, tableStart);
+  HufBitWriter bits(tableEnd);
+  
+  int s  = raw[0];
+  int cs = 0;
+  for (int64 i = 1; i < nRaw; i++) {
+    if (s == raw[i] && cs < 255) {
+      cs++;
+    }
+    else {
+      hufSendCode(freq[s], cs, freq[iM], bits);
+      cs = 0;
+    }
+    s = raw[i];
+  }
+  hufSendCode(freq[s], cs, freq[iM], bits);
+  
+  int64 nBits = (int64) (bits.m_out - tableEnd) * 8 + bits.m_count;
+  bits.flush();
+  
+  writeUInt32(&dst[start]     , (uint32) im);
+  writeUInt32(&dst[start] +  4, (uint32) iM);
+  writeUInt32(&dst[start] +  8, (uint32) (tableEnd - tableStart));
+  writeUInt32(&dst[start] + 12, (uint32) nBits);
+  writeUInt32(&dst[start] + 16, 0);
+  
+  dst.resize(bits.m_out - &dst[0]);
+  
+  return (int64) dst.size() - start;
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+int64 EXRCodec::rleCompress(const uint8 *src, int64 srcSize, vector<uint8> &dst)
+{
+  static thread_local vector<uint8> tmp;
+  
+  tmp.resize(srcSize);
+  reorderAndPredict(src, srcSize, &tmp[0]);
+  
+  // every run of up to 127 bytes costs one extra byte at most
+  int64 start = (int64) dst.size();
+  dst.resize(start + srcSize + (srcSize + RLE_MAX_RUN_LENGTH - 1) / RLE_MAX_RUN_LENGTH + 1);
+  
+  const uint8 *in       = &tmp[0];
+  const uint8 *inEnd    = in + srcSize;
+  const uint8 *runStart = in;
+  const uint8 *runEnd   = in + 1;
+  uint8       *out      = &dst[start];
+  
+  while (runStart < inEnd) {
+    while (runEnd < inEnd && *runStart == *runEnd && runEnd - runStart - 1 < RLE_MAX_RUN_LENGTH)
+      ++runEnd;
+    
+    if (runEnd - runStart >= RLE_MIN_RUN_LENGTH) {
+      // run of identical bytes
+      *out++ = (uint8) ((runEnd - runStart) - 1);
+      *out++ = *runStart;
+      runStart = runEnd;
+    }
+    else {
+      // literal bytes, up to the next run of three
+      while (runEnd < inEnd &&
+             ((runEnd + 1 >= inEnd || *runEnd != *(runEnd + 1)) ||
+              (runEnd + 2 >= inEnd || *(runEnd + 1) != *(runEnd + 2))) &&
+             runEnd - runStart < RLE_MAX_RUN_LENGTH) {
+        ++runEnd;
+      }
+      *out++ = (uint8) (runStart - runEnd);
+      while (runStart < runEnd)
+        *out++ = *runStart++;
+    }
+    ++runEnd;
+  }
+  
+  dst.resize(out - &dst[0]);
+  
+  return (int64) dst.size() - start;
+}
+
+#ifdef USEZLIB
+int64 EXRCodec::zipCompress(const uint8 *src, int64 srcSize, vector<uint8> &dst)
+{
+  static thread_local vector<uint8> tmp;
+  
+  tmp.resize(srcSize);
+  reorderAndPredict(src, srcSize, &tmp[0]);
+  
+  int64 start = (int64) dst.size();
+  uLongf size = compressBound((uLong) srcSize);
+  
+  dst.resize(start + size);
+  if (compress(&dst[start], &size, &tmp[0], (uLong) srcSize) != Z_OK) {
+    dst.resize(start);
+    return 0;
+  }
+  dst.resize(start + size);
+  
+  return (int64) size;
+}
+#endif
+
+int64 EXRCodec::pizCompress(const uint8 *src, int nx, int ny, int channels, int sampleSize, vector<uint8> &dst)
+{
+  static thread_local vector<uint16> tmp;
+  static thread_local vector<uint16> lut;
+  uint8  bitmap[BITMAP_SIZE];
+  int64  lineWords  = (int64) nx * sampleSize;
+  int64  planeWords = lineWords * ny;
+  int64  n          = planeWords * channels;
+  
+  // Gather the samples of each channel in its own plane
+  tmp.resize(n);
+  for (int y = 0; y < ny; y++) {
+    for (int c = 0; c < channels; c++) {
+      memcpy(&tmp[c * planeWords + y * lineWords], src, lineWords * sizeof(uint16));
+      src += lineWords * sizeof(uint16);
+    }
+  }
+  
+  // Bitmap of the values present (zero is always assumed to be)
+  memset(bitmap, 0, BITMAP_SIZE);
+  for (int64 i = 0; i < n; i++)
+    bitmap[tmp[i] >> 3] |= (uint8) (1 << (tmp[i] & 7));
+  bitmap[0] &= ~1;
+  
+  int minNonZero = BITMAP_SIZE - 1;
+  int maxNonZero = 0;
+  for (int i = 0; i < BITMAP_SIZE; i++) {
+    if (bitmap[i]) {
+      minNonZero = (minNonZero > i) ? i : minNonZero;
+      maxNonZero = (maxNonZero < i) ? i : maxNonZero;
+    }
+  }
+  
+  // Map the values present to 0 ... maxValue
+  int k = 0;
+  lut.resize(USHORT_RANGE);
+  for (int i = 0; i < USHORT_RANGE; i++)
+    lut[i] = (i == 0 || (bitmap[i >> 3] & (1 << (i & 7)))) ? (uint16) k++ : 0;
+  uint16 maxValue = (uint16) (k - 1);
+  
+  for (int64 i = 0; i < n; i++)
+    tmp[i] = lut[tmp[i]];
+  
+  for (int c = 0; c < channels; c++) {
+    for (int j = 0; j < sampleSize; j++)
+      wav2Encode(&tmp[c * planeWords + j], nx, sampleSize, ny, (int) lineWords, maxValue);
+  }
+  
+  // min/max, bitmap, Huffman data size and Huffman data
+  int64 start  = (int64) dst.size();
+  int   bitmapSize = (minNonZero <= maxNonZero) ? maxNonZero - minNonZero + 1 : 0;
+  
+  dst.resize(start + 4 + bitmapSize + 4);
+  writeUInt16(&dst[start]    , minNonZero);
+  writeUInt16(&dst[start] + 2, maxNonZero);
+  if (bitmapSize > 0)
+    memcpy(&dst[start] + 4, &bitmap[minNonZero], bitmapSize);
+  
+  int64 length = hufCompress(&tmp[0], n, dst);
+  writeUInt32(&dst[start] + 4 + bitmapSize, (uint32) length);
+  
+  return (int64) dst.size() - start;
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
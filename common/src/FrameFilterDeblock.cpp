@@ -47,142 +47,354 @@
  *
  *************************************************************************************
  */
-
 //-----------------------------------------------------------------------------
 // Include headers
 //-----------------------------------------------------------------------------
 
 #include "Global.H"
 #include "FrameFilterDeblock.H"
+#include "ThreadPool.H"
+#include "CPUFeatures.H"
+#include <math.h>
 
 //-----------------------------------------------------------------------------
 // Macros
 //-----------------------------------------------------------------------------
+#define DEBLOCK_TC0    0.2     // clipping level, in 1/1000 of the sample range, of edges with no smooth side
+#define DEBLOCK_BETA   0.002   // largest variation, relative to the sample range, of a smooth edge side
 
 //-----------------------------------------------------------------------------
-// Constructor/destructor
+// Local classes
 //-----------------------------------------------------------------------------
 
-FrameFilterDeblock::FrameFilterDeblock(int width, int height, int blockSizeX, int blockSizeY) {  
-  m_blockSizeX = blockSizeX;
-  m_blockSizeY = blockSizeY;
-}
-
-FrameFilterDeblock::~FrameFilterDeblock() {
-}
+//! Deblocking thresholds of integer data, scaled to the sample range
+class DeblockParams {
+public:
+  int m_beta;        //!< a side is smooth if its variation is smaller than this value
+  int m_tc[3];       //!< clipping level, in 1/8 sample units, for 0, 1 or 2 smooth sides (at least one sample)
+  int m_minValue;
+  int m_maxValue;
+  
+  DeblockParams(int minValue, int maxValue) {
+    double range = (double) (maxValue - minValue);
+    m_beta = (int) ceil(DEBLOCK_BETA * range);
+    for (int k = 0; k < 3; k++) {
+      m_tc[k] = (int) (8.0 * (DEBLOCK_TC0 + k) / 1000.0 * range + 0.5);
+      // At low bit depths the scaled level can round to less than one sample, which would
+      // disable the filter; keep at least one sample step if the strength is non zero.
+      if (range > 0.0 && DEBLOCK_TC0 + k > 0.0)
+        m_tc[k] = iMax(m_tc[k], 8);
+    }
+    m_minValue = minValue;
+    m_maxValue = maxValue;
+  }
+};
 
 //-----------------------------------------------------------------------------
-// Private methods
+// Edge kernels
 //-----------------------------------------------------------------------------
 
-void FrameFilterDeblock::filter(float *imgData, int width, int height, float minValue, float maxValue)
+// Each kernel filters count consecutive positions of one block edge. pImg points to
+// the first sample after the edge (q0) for the first position, step is the distance
+// between samples across the edge and stride the distance between edge positions.
+
+static inline void filterEdgeSample(float *pImg, int step)
 {
-  int i, j;
-  float *pImg;
   double q0, q1, q2, p0, p1, p2;
   double ap, aq;
   double tc, delta;
-  double const tc0 = 0.2;
-  double const b = 0.002;
+  double const tc0 = DEBLOCK_TC0;
+  double const b = DEBLOCK_BETA;
   
-  for (j = m_blockSizeY; j < height; j += m_blockSizeY) {
-    for (i = 0; i < width; i ++) {
-      pImg = &imgData[ j * width + i];
-      q0 = (double) *pImg;
-      q1 = (double) *(pImg + width);
-      q2 = (double) *(pImg + 2 * width);
-      p0 = (double) *(pImg - width);
-      p1 = (double) *(pImg - 2 * width);
-      p2 = (double) *(pImg - 3 * width);
-      ap = dAbs( p2 - p0 );
-      aq = dAbs( q2 - q0 );
-      tc = (tc0 + (ap < b) + (aq < b)) / 1000.0;
-      //tc = (tc0 + (ap < b && ap != 0.0) + (aq < b && aq != 0.0)) / 1000.0;
-      delta= dMax(-tc, dMin(tc,((4.0 * (q0 - p0) + (p1 - q1)) / 8.0)));
-      
-      *pImg           = (float) (q0 - delta);
-      *(pImg - width) = (float) (p0 + delta);
-      
-      if (ap < b) {
-        delta= dMax(-tc, dMin(tc,(p2 + ((p0 + q0) / 2.0) - 2.0 * p1) / 2.0));
-        *(pImg - 2 * width) = (float) (p1 + delta);
-      }
-      if (aq < b) {
-        delta= dMax(-tc, dMin(tc,(q2 + ((q0 + p0) / 2.0) - 2.0 * q1) / 2.0));
-        *(pImg + width) = (float) (q1 + delta);
-      }
-    }
-  }
+  q0 = (double) *pImg;
+  q1 = (double) *(pImg + step);
+  q2 = (double) *(pImg + 2 * step);
+  p0 = (double) *(pImg - step);
+  p1 = (double) *(pImg - 2 * step);
+  p2 = (double) *(pImg - 3 * step);
+  ap = dAbs( p2 - p0 );
+  aq = dAbs( q2 - q0 );
+  tc = (tc0 + (ap < b) + (aq < b)) / 1000.0;
+  //tc = (tc0 + (ap < b && ap != 0.0) + (aq < b && aq != 0.0)) / 1000.0;
+  delta= dMax(-tc, dMin(tc,((4.0 * (q0 - p0) + (p1 - q1)) / 8.0)));
   
-  for (i = m_blockSizeX; i < width; i += m_blockSizeX) {
-    for (j = 0; j < height; j ++) {
-      pImg = &imgData[ j * width + i];
-      q0 = (double) *pImg;
-      q1 = (double) *(pImg + 1);
-      q2 = (double) *(pImg + 2);
-      p0 = (double) *(pImg - 1);
-      p1 = (double) *(pImg - 2);
-      p2 = (double) *(pImg - 3);
-      ap = dAbs( p2 - p0 );
-      aq = dAbs( q2 - q0 );
-      tc = (tc0 + (ap < b) + (aq < b)) / 1000.0;
-      //tc = (tc0 + (ap < b && ap != 0.0) + (aq < b && aq != 0.0)) / 1000.0;
-      delta= dMax(-tc, dMin(tc,((4.0 * (q0 - p0) + (p1 - q1)) / 8.0)));
-      
-      *pImg       = (float) (q0 - delta);
-      *(pImg - 1) = (float) (p0 + delta);
-      
-      if (ap < b) {
-        delta= dMax(-tc, dMin(tc,(p2 + ((p0 + q0) / 2.0) - 2.0 * p1) / 2.0));
-        *(pImg - 2) = (float) (p1 + delta);
-      }
-      if (aq < b) {
-        delta= dMax(-tc, dMin(tc,(q2 + ((q0 + p0) / 2.0) - 2.0 * q1) / 2.0));
-        *(pImg + 1) = (float) (q1 + delta);
-      }
-    }
+  *pImg          = (float) (q0 - delta);
+  *(pImg - step) = (float) (p0 + delta);
+  
+  if (ap < b) {
+    delta= dMax(-tc, dMin(tc,(p2 + ((p0 + q0) / 2.0) - 2.0 * p1) / 2.0));
+    *(pImg - 2 * step) = (float) (p1 + delta);
+  }
+  if (aq < b) {
+    delta= dMax(-tc, dMin(tc,(q2 + ((q0 + p0) / 2.0) - 2.0 * q1) / 2.0));
+    *(pImg + step) = (float) (q1 + delta);
   }
 }
 
+//! Round a value in 1/8 sample units to the nearest sample, with halves rounded away from zero
+static inline int roundEighths(int value)
+{
+  return (value < 0) ? -((4 - value) >> 3) : ((value + 4) >> 3);
+}
 
-void FrameFilterDeblock::filter(uint16 *out, const uint16 *inp, int width, int height, int minValue, int maxValue)
+//! Integer version of the above; the filter offsets are computed in 1/8 sample units and rounded
+//! symmetrically, so that positive and negative offsets are treated alike
+template <typename T> static inline void filterEdgeSample(T *pImg, int step, const DeblockParams &params)
 {
-  int i, j;
-  int blockWidth  = width  / m_blockSizeX;
-  int blockHeight = height / m_blockSizeY;
+  int q0 = pImg[0];
+  int q1 = pImg[step];
+  int q2 = pImg[2 * step];
+  int p0 = pImg[-step];
+  int p1 = pImg[-2 * step];
+  int p2 = pImg[-3 * step];
+  bool smoothP = iAbs(p2 - p0) < params.m_beta;
+  bool smoothQ = iAbs(q2 - q0) < params.m_beta;
+  int  tc = params.m_tc[(int) smoothP + (int) smoothQ];
+  int  delta = roundEighths(iClip(4 * (q0 - p0) + (p1 - q1), -tc, tc));
   
-  for (j = 0; j < blockHeight; j++) {
-    for (i = 0; i < blockWidth; i++) {
-    
+  pImg[0]     = (T) iClip(q0 - delta, params.m_minValue, params.m_maxValue);
+  pImg[-step] = (T) iClip(p0 + delta, params.m_minValue, params.m_maxValue);
+  
+  if (smoothP) {
+    delta = roundEighths(iClip(2 * (2 * p2 + p0 + q0 - 4 * p1), -tc, tc));
+    pImg[-2 * step] = (T) iClip(p1 + delta, params.m_minValue, params.m_maxValue);
+  }
+  if (smoothQ) {
+    delta = roundEighths(iClip(2 * (2 * q2 + q0 + p0 - 4 * q1), -tc, tc));
+    pImg[step] = (T) iClip(q1 + delta, params.m_minValue, params.m_maxValue);
+  }
+}
 
-      //m_i32Data[ j * width + i ] = filterHorizontal(&inp[ j * inp_width], m_horFilter, 2 * i, inp_width - 1, minValue, maxValue);
-    }
+static void filterEdgeSamples(float *pImg, int step, int stride, int start, int count, const DeblockParams &)
+{
+  for (int k = start; k < count; k++)
+    filterEdgeSample(pImg + (int64) k * stride, step);
+}
+
+template <typename T> static void filterEdgeSamples(T *pImg, int step, int stride, int start, int count, const DeblockParams &params)
+{
+  for (int k = start; k < count; k++)
+    filterEdgeSample(pImg + (int64) k * stride, step, params);
+}
+
+#if ENABLE_SIMD_DISPATCH
+// AVX2 versions of the above, filtering 4 (float) or 8 (integer) positions of an edge at a
+// time. Horizontal edges load rows of samples, vertical edges gather them. The floating
+// point kernel follows the operation order of the scalar code, so results are identical.
+SIMD_TARGET("avx2")
+static inline __m128 loadSamples(const float *pImg, int stride)
+{
+  if (stride == 1)
+    return _mm_loadu_ps(pImg);
+  return _mm_setr_ps(pImg[0], pImg[stride], pImg[2 * stride], pImg[3 * stride]);
+}
+
+SIMD_TARGET("avx2")
+static inline void storeSamples(float *pImg, int stride, __m128 value)
+{
+  if (stride == 1) {
+    _mm_storeu_ps(pImg, value);
   }
-  
-  for (j = 0; j < blockHeight; j++) {
-    for (i = 0; i < blockWidth; i++) {
-      //out[ j * width + i ] = filterVertical(&m_i32Data[i], m_verFilter, (2 * j), width, inputHeight - 1, minValue, maxValue);
-    }
+  else {
+    float samples[4];
+    _mm_storeu_ps(samples, value);
+    for (int k = 0; k < 4; k++)
+      pImg[k * stride] = samples[k];
+  }
+}
+
+template <typename T> SIMD_TARGET("avx2")
+static inline __m256i loadSamples(const T *pImg, int stride)
+{
+  if (stride == 1) {
+    if (sizeof(T) == 1)
+      return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) pImg));
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) pImg));
+  }
+  return _mm256_setr_epi32(pImg[0], pImg[stride], pImg[2 * stride], pImg[3 * stride], pImg[4 * stride], pImg[5 * stride], pImg[6 * stride], pImg[7 * stride]);
+}
+
+template <typename T> SIMD_TARGET("avx2")
+static inline void storeSamples(T *pImg, int stride, __m256i value)
+{
+  // samples are within [minValue, maxValue], so saturating packs are exact
+  __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+  if (stride == 1) {
+    if (sizeof(T) == 1)
+      _mm_storel_epi64((__m128i *) pImg, _mm_packus_epi16(packed, packed));
+    else
+      _mm_storeu_si128((__m128i *) pImg, packed);
+  }
+  else {
+    uint16 samples[8];
+    _mm_storeu_si128((__m128i *) samples, packed);
+    for (int k = 0; k < 8; k++)
+      pImg[k * stride] = (T) samples[k];
   }
 }
 
-void FrameFilterDeblock::filter(imgpel *out, const imgpel *inp, int width, int height, int minValue, int maxValue)
+SIMD_TARGET("avx2")
+static int filterEdgeSamplesAVX2(float *pImg, int step, int stride, int count, const DeblockParams &)
 {
-  int i, j;
-  int blockWidth  = width  / m_blockSizeX;
-  int blockHeight = height / m_blockSizeY;
+  const __m256d sign     = _mm256_set1_pd(-0.0);
+  const __m256d one      = _mm256_set1_pd(1.0);
+  const __m256d two      = _mm256_set1_pd(2.0);
+  const __m256d four     = _mm256_set1_pd(4.0);
+  const __m256d eight    = _mm256_set1_pd(8.0);
+  const __m256d thousand = _mm256_set1_pd(1000.0);
+  const __m256d tc0      = _mm256_set1_pd(DEBLOCK_TC0);
+  const __m256d b        = _mm256_set1_pd(DEBLOCK_BETA);
+  int k;
   
-  for (j = 0; j < blockHeight; j++) {
-    for (i = 0; i < blockWidth; i++) {
-      //m_i32Data[ j * width + i ] = filterHorizontal(&inp[ j * inp_width], m_horFilter, 2 * i, inp_width - 1, 0, 0);
-    }
+  for (k = 0; k + 4 <= count; k += 4) {
+    float *p = pImg + (int64) k * stride;
+    __m128  p1f = loadSamples(p - 2 * step, stride);
+    __m128  q1f = loadSamples(p + step, stride);
+    __m256d q0 = _mm256_cvtps_pd(loadSamples(p, stride));
+    __m256d q1 = _mm256_cvtps_pd(q1f);
+    __m256d q2 = _mm256_cvtps_pd(loadSamples(p + 2 * step, stride));
+    __m256d p0 = _mm256_cvtps_pd(loadSamples(p - step, stride));
+    __m256d p1 = _mm256_cvtps_pd(p1f);
+    __m256d p2 = _mm256_cvtps_pd(loadSamples(p - 3 * step, stride));
+    __m256d smoothP = _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(p2, p0)), b, _CMP_LT_OQ);
+    __m256d smoothQ = _mm256_cmp_pd(_mm256_andnot_pd(sign, _mm256_sub_pd(q2, q0)), b, _CMP_LT_OQ);
+    __m256d tc  = _mm256_div_pd(_mm256_add_pd(_mm256_add_pd(tc0, _mm256_and_pd(smoothP, one)), _mm256_and_pd(smoothQ, one)), thousand);
+    __m256d ntc = _mm256_xor_pd(tc, sign);
+    __m256d delta = _mm256_max_pd(ntc, _mm256_min_pd(tc, _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(four, _mm256_sub_pd(q0, p0)), _mm256_sub_pd(p1, q1)), eight)));
+    __m256d half  = _mm256_div_pd(_mm256_add_pd(p0, q0), two);
+    __m256d deltaP = _mm256_max_pd(ntc, _mm256_min_pd(tc, _mm256_div_pd(_mm256_sub_pd(_mm256_add_pd(p2, half), _mm256_mul_pd(two, p1)), two)));
+    __m256d deltaQ = _mm256_max_pd(ntc, _mm256_min_pd(tc, _mm256_div_pd(_mm256_sub_pd(_mm256_add_pd(q2, half), _mm256_mul_pd(two, q1)), two)));
+    // narrow the 64 bit masks to 32 bit lanes
+    __m256 maskP = _mm256_castpd_ps(smoothP);
+    __m256 maskQ = _mm256_castpd_ps(smoothQ);
+    
+    storeSamples(p,            stride, _mm256_cvtpd_ps(_mm256_sub_pd(q0, delta)));
+    storeSamples(p - step,     stride, _mm256_cvtpd_ps(_mm256_add_pd(p0, delta)));
+    storeSamples(p - 2 * step, stride, _mm_blendv_ps(p1f, _mm256_cvtpd_ps(_mm256_add_pd(p1, deltaP)), _mm_shuffle_ps(_mm256_castps256_ps128(maskP), _mm256_extractf128_ps(maskP, 1), _MM_SHUFFLE(2, 0, 2, 0))));
+    storeSamples(p + step,     stride, _mm_blendv_ps(q1f, _mm256_cvtpd_ps(_mm256_add_pd(q1, deltaQ)), _mm_shuffle_ps(_mm256_castps256_ps128(maskQ), _mm256_extractf128_ps(maskQ, 1), _MM_SHUFFLE(2, 0, 2, 0))));
   }
+  return k;
+}
+
+SIMD_TARGET("avx2")
+static inline __m256i roundEighths(__m256i value)
+{
+  // round the magnitude and restore the sign, as the scalar roundEighths()
+  __m256i magnitude = _mm256_srai_epi32(_mm256_add_epi32(_mm256_abs_epi32(value), _mm256_set1_epi32(4)), 3);
+  return _mm256_sign_epi32(magnitude, value);
+}
+
+template <typename T> SIMD_TARGET("avx2")
+static int filterEdgeSamplesAVX2(T *pImg, int step, int stride, int count, const DeblockParams &params)
+{
+  const __m256i beta = _mm256_set1_epi32(params.m_beta);
+  const __m256i tc0  = _mm256_set1_epi32(params.m_tc[0]);
+  const __m256i tc1  = _mm256_set1_epi32(params.m_tc[1]);
+  const __m256i tc2  = _mm256_set1_epi32(params.m_tc[2]);
+  const __m256i minV = _mm256_set1_epi32(params.m_minValue);
+  const __m256i maxV = _mm256_set1_epi32(params.m_maxValue);
+  int k;
   
-  for (j = 0; j < blockHeight; j++) {
-    for (i = 0; i < blockWidth; i++) {
-      //out[ j * width + i ] = filterVertical(&m_i32Data[i], m_verFilter, (2 * j), width, inputHeight - 1, minValue, maxValue);
-    }
+  for (k = 0; k + 8 <= count; k += 8) {
+    T *p = pImg + (int64) k * stride;
+    __m256i q0 = loadSamples(p, stride);
+    __m256i q1 = loadSamples(p + step, stride);
+    __m256i q2 = loadSamples(p + 2 * step, stride);
+    __m256i p0 = loadSamples(p - step, stride);
+    __m256i p1 = loadSamples(p - 2 * step, stride);
+    __m256i p2 = loadSamples(p - 3 * step, stride);
+    __m256i smoothP = _mm256_cmpgt_epi32(beta, _mm256_abs_epi32(_mm256_sub_epi32(p2, p0)));
+    __m256i smoothQ = _mm256_cmpgt_epi32(beta, _mm256_abs_epi32(_mm256_sub_epi32(q2, q0)));
+    __m256i tc  = _mm256_blendv_epi8(_mm256_blendv_epi8(tc0, tc1, _mm256_xor_si256(smoothP, smoothQ)), tc2, _mm256_and_si256(smoothP, smoothQ));
+    __m256i ntc = _mm256_sub_epi32(_mm256_setzero_si256(), tc);
+    __m256i sum = _mm256_add_epi32(p0, q0);
+    __m256i delta  = _mm256_add_epi32(_mm256_slli_epi32(_mm256_sub_epi32(q0, p0), 2), _mm256_sub_epi32(p1, q1));
+    __m256i deltaP = _mm256_slli_epi32(_mm256_sub_epi32(_mm256_add_epi32(_mm256_slli_epi32(p2, 1), sum), _mm256_slli_epi32(p1, 2)), 1);
+    __m256i deltaQ = _mm256_slli_epi32(_mm256_sub_epi32(_mm256_add_epi32(_mm256_slli_epi32(q2, 1), sum), _mm256_slli_epi32(q1, 2)), 1);
+    delta  = roundEighths(_mm256_min_epi32(_mm256_max_epi32(delta,  ntc), tc));
+    deltaP = roundEighths(_mm256_min_epi32(_mm256_max_epi32(deltaP, ntc), tc));
+    deltaQ = roundEighths(_mm256_min_epi32(_mm256_max_epi32(deltaQ, ntc), tc));
+    
+    storeSamples(p,            stride, _mm256_min_epi32(_mm256_max_epi32(_mm256_sub_epi32(q0, delta), minV), maxV));
+    storeSamples(p - step,     stride, _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(p0, delta), minV), maxV));
+    storeSamples(p - 2 * step, stride, _mm256_blendv_epi8(p1, _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(p1, deltaP), minV), maxV), smoothP));
+    storeSamples(p + step,     stride, _mm256_blendv_epi8(q1, _mm256_min_epi32(_mm256_max_epi32(_mm256_add_epi32(q1, deltaQ), minV), maxV), smoothQ));
   }
+  return k;
+}
+#endif
+
+template <typename T> static void filterEdge(T *pImg, int step, int stride, int count, const DeblockParams &params)
+{
+  int k = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    k = filterEdgeSamplesAVX2(pImg, step, stride, count, params);
+#endif
+  filterEdgeSamples(pImg, step, stride, k, count, params);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Deblock one plane: all horizontal block edges first, and then all
+ *    vertical ones. Consecutive edges of a column (or row) overlap and are
+ *    filtered in order, but columns (or rows) are independent, so the
+ *    horizontal edges are split in bands of columns and the vertical edges
+ *    in bands of rows that are filtered in parallel.
+ *    Edges need three samples on each side, so edges closer than that to
+ *    the bottom (or right) border of the plane are not filtered.
+ ************************************************************************
+ */
+template <typename T> static void deblockPlane(T *imgData, int width, int height, int blockSizeX, int blockSizeY, const DeblockParams &params)
+{
+  int bands = ThreadPool::getBandCount(width, 64);
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int xStart = (int) ((int64) band * width / bands);
+    int xEnd   = (int) ((int64) (band + 1) * width / bands);
+    for (int j = blockSizeY; j + 2 < height; j += blockSizeY)
+      filterEdge(imgData + (int64) j * width + xStart, width, 1, xEnd - xStart, params);
+  });
+  
+  bands = ThreadPool::getBandCount(height, 16);
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int yStart = (int) ((int64) band * height / bands);
+    int yEnd   = (int) ((int64) (band + 1) * height / bands);
+    for (int i = blockSizeX; i + 2 < width; i += blockSizeX)
+      filterEdge(imgData + (int64) yStart * width + i, 1, width, yEnd - yStart, params);
+  });
+}
+
+//-----------------------------------------------------------------------------
+// Constructor/destructor
+//-----------------------------------------------------------------------------
+
+FrameFilterDeblock::FrameFilterDeblock(int width, int height, int blockSizeX, int blockSizeY) {  
+  m_blockSizeX = blockSizeX;
+  m_blockSizeY = blockSizeY;
+}
+
+FrameFilterDeblock::~FrameFilterDeblock() {
+}
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+void FrameFilterDeblock::filter(float *imgData, int width, int height, float minValue, float maxValue)
+{
+  // floating point data are normalized, the thresholds are used as is
+  deblockPlane(imgData, width, height, m_blockSizeX, m_blockSizeY, DeblockParams(0, 0));
+}
+
+void FrameFilterDeblock::filter(uint16 *imgData, int width, int height, int minValue, int maxValue)
+{
+  deblockPlane(imgData, width, height, m_blockSizeX, m_blockSizeY, DeblockParams(minValue, maxValue));
+}
+
+void FrameFilterDeblock::filter(imgpel *imgData, int width, int height, int minValue, int maxValue)
+{
+  deblockPlane(imgData, width, height, m_blockSizeX, m_blockSizeY, DeblockParams(minValue, maxValue));
 }
 
 //-----------------------------------------------------------------------------
@@ -209,23 +421,29 @@ void FrameFilterDeblock::process ( Frame* out, const Frame *inp, bool compY, boo
   else if (out->m_bitDepth == 8) {   // 8 bit data
     if (compY == TRUE) {
       out->copy((Frame *) inp, Y_COMP);
+      filter(out->m_comp[Y_COMP], out->m_width[Y_COMP], out->m_height[Y_COMP], out->m_minPelValue[Y_COMP], out->m_maxPelValue[Y_COMP] );
     }
     if (compCb == TRUE) {
       out->copy((Frame *) inp, U_COMP);
+      filter(out->m_comp[U_COMP], out->m_width[U_COMP], out->m_height[U_COMP], out->m_minPelValue[U_COMP], out->m_maxPelValue[U_COMP] );
     }
     if (compCr == TRUE) {
       out->copy((Frame *) inp, V_COMP);
+      filter(out->m_comp[V_COMP], out->m_width[V_COMP], out->m_height[V_COMP], out->m_minPelValue[V_COMP], out->m_maxPelValue[V_COMP] );
     }
   }
   else { // 16 bit data
     if (compY == TRUE) {
       out->copy((Frame *) inp, Y_COMP);
+      filter(out->m_ui16Comp[Y_COMP], out->m_width[Y_COMP], out->m_height[Y_COMP], out->m_minPelValue[Y_COMP], out->m_maxPelValue[Y_COMP] );
     }
     if (compCb == TRUE) {
       out->copy((Frame *) inp, U_COMP);
+      filter(out->m_ui16Comp[U_COMP], out->m_width[U_COMP], out->m_height[U_COMP], out->m_minPelValue[U_COMP], out->m_maxPelValue[U_COMP] );
     }
     if (compCr == TRUE) {
       out->copy((Frame *) inp, V_COMP);
+      filter(out->m_ui16Comp[V_COMP], out->m_width[V_COMP], out->m_height[V_COMP], out->m_minPelValue[V_COMP], out->m_maxPelValue[V_COMP] );
     }
   }
 }
@@ -241,8 +459,20 @@ void FrameFilterDeblock::process ( Frame* pFrame, bool compY, bool compCb, bool
       filter(pFrame->m_floatComp[V_COMP], pFrame->m_width[V_COMP], pFrame->m_height[V_COMP], (float) pFrame->m_minPelValue[V_COMP], (float) pFrame->m_maxPelValue[V_COMP] );
   }
   else if (pFrame->m_bitDepth == 8) {   // 8 bit data
+    if (compY == TRUE)
+      filter(pFrame->m_comp[Y_COMP], pFrame->m_width[Y_COMP], pFrame->m_height[Y_COMP], pFrame->m_minPelValue[Y_COMP], pFrame->m_maxPelValue[Y_COMP] );
+    if (compCb == TRUE)
+      filter(pFrame->m_comp[U_COMP], pFrame->m_width[U_COMP], pFrame->m_height[U_COMP], pFrame->m_minPelValue[U_COMP], pFrame->m_maxPelValue[U_COMP] );
+    if (compCr == TRUE)
+      filter(pFrame->m_comp[V_COMP], pFrame->m_width[V_COMP], pFrame->m_height[V_COMP], pFrame->m_minPelValue[V_COMP], pFrame->m_maxPelValue[V_COMP] );
   }
   else { // 16 bit data
+    if (compY == TRUE)
+      filter(pFrame->m_ui16Comp[Y_COMP], pFrame->m_width[Y_COMP], pFrame->m_height[Y_COMP], pFrame->m_minPelValue[Y_COMP], pFrame->m_maxPelValue[Y_COMP] );
+    if (compCb == TRUE)
+      filter(pFrame->m_ui16Comp[U_COMP], pFrame->m_width[U_COMP], pFrame->m_height[U_COMP], pFrame->m_minPelValue[U_COMP], pFrame->m_maxPelValue[U_COMP] );
+    if (compCr == TRUE)
+      filter(pFrame->m_ui16Comp[V_COMP], pFrame->m_width[V_COMP], pFrame->m_height[V_COMP], pFrame->m_minPelValue[V_COMP], pFrame->m_maxPelValue[V_COMP] );
   }
 }
 
@@ -250,3 +480,4 @@ void FrameFilterDeblock::process ( Frame* pFrame, bool compY, bool compCb, bool
 //-----------------------------------------------------------------------------
 // End of file
 //-----------------------------------------------------------------------------
+
@@ -60,6 +60,9 @@
 #include "FrameScaleBilinear.H"
 #include "FrameScaleBiCubic.H"
 #include "FrameScaleLanczos.H"
+#include "ThreadPool.H"
+#include "CPUFeatures.H"
+#include <algorithm>
 
 //-----------------------------------------------------------------------------
 // Private methods
@@ -163,153 +166,213 @@ FrameScale *FrameScale::create(int iWidth, int iHeight, int oWidth, int oHeight,
 }
 
 
-imgpel FrameScale::filter( imgpel *input, double *filterX, double *filterY, int posX, int posY, int iSizeX, int vMin, int vMax)
+//-----------------------------------------------------------------------------
+// Separable band filtering
+//-----------------------------------------------------------------------------
+
+//! Copy one input row to a double precision buffer, replicating the edge samples pad times on each side
+template <typename T> static void padRow( double *dst, const T *src, int size, int pad )
 {
-  double result = 0.0;
-  int i, j, yPos;
-  double *pFilterX = NULL, *pFilterY = filterY;
+  int i;
+  for (i = 0; i < pad; i++)
+    *dst++ = (double) src[0];
+  for (i = 0; i < size; i++)
+    *dst++ = (double) src[i];
+  for (i = 0; i < pad; i++)
+    *dst++ = (double) src[size - 1];
+}
 
-  //imgpel *tempIn = input + iSizeX * (posY - ((m_filterTapsY - 1 )>> 1)) + posX - ((m_filterTapsX - 1)>> 1);
-  
-  // the process below generates the filtered sample in place and without the use of any
-  // additional memory.
-  for ( j = 0; j < m_filterTapsY; j++, pFilterY++ ) {
-    pFilterX = filterX;
-    yPos = iSizeX * iClip(posY + m_filterOffsetsY[j], 0, m_iMaxY);
-    for ( i = 0; i < m_filterTapsX; i++ ) {
-      result += (*pFilterY) * (*pFilterX++) * (double) input[ yPos + iClip(posX + m_filterOffsetsX[i], 0, m_iMaxX)];
-    }
-    //tempIn += iSizeX - m_filterTapsX;
+//! Horizontal pass of one row. row points to the first unpadded sample, coeffs are tap major.
+static void filterRow( double *out, const double *row, const int *start, const double *coeffs, int taps, int oSize )
+{
+  for (int x = 0; x < oSize; x++) {
+    const double *pRow = row + start[x];
+    double result = 0.0;
+    for (int t = 0; t < taps; t++)
+      result += coeffs[t * oSize + x] * pRow[t];
+    out[x] = result;
   }
-  
-  return (imgpel) (iClip((int) (result + 0.5), vMin, vMax));
 }
 
-uint16 FrameScale::filter( uint16 *input, double *filterX, double *filterY, int posX, int posY, int iSizeX, int vMin, int vMax)
+static void accumulateRow( double *acc, const double *row, double coeff, int size )
 {
-  double result = 0.0;
-  int i, j, yPos;
-  double *pFilterX = NULL, *pFilterY = filterY;
+  for (int x = 0; x < size; x++)
+    acc[x] += coeff * row[x];
+}
 
-  //uint16 *tempIn = input + iSizeX * (posY - ((m_filterTapsY - 1 )>> 1)) + posX - ((m_filterTapsX - 1)>> 1);
-  
-  // the process below generates the filtered sample in place and without the use of any
-  // additional memory.
-  for ( j = 0; j < m_filterTapsY; j++, pFilterY++ ) {
-    pFilterX = filterX;
-    yPos = iSizeX * iClip(posY + m_filterOffsetsY[j], 0, m_iMaxY);
-    for ( i = 0; i < m_filterTapsX; i++ ) {
-      result += (*pFilterY) * (*pFilterX++) * (double) input[ yPos + iClip(posX + m_filterOffsetsX[i], 0, m_iMaxX)];
-    }
-  //  tempIn += iSizeX - m_filterTapsX;
+#if ENABLE_SIMD_DISPATCH
+// AVX2 versions of the above; four output samples per iteration with the same
+// operation order (no fused multiply-add), so results match the scalar code.
+SIMD_TARGET("avx2")
+static void filterRowAVX2( double *out, const double *row, const int *start, const double *coeffs, int taps, int oSize )
+{
+  const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+  int x;
+  for (x = 0; x + 4 <= oSize; x += 4) {
+    __m128i index  = _mm_loadu_si128((const __m128i *) (start + x));
+    __m256d result = _mm256_setzero_pd();
+    for (int t = 0; t < taps; t++)
+      result = _mm256_add_pd(result, _mm256_mul_pd(_mm256_loadu_pd(coeffs + t * oSize + x), _mm256_mask_i32gather_pd(_mm256_setzero_pd(), row + t, index, all, 8)));
+    _mm256_storeu_pd(out + x, result);
+  }
+  for (; x < oSize; x++) {
+    const double *pRow = row + start[x];
+    double result = 0.0;
+    for (int t = 0; t < taps; t++)
+      result += coeffs[t * oSize + x] * pRow[t];
+    out[x] = result;
   }
-  
-  return (uint16) (iClip((int) (result + 0.5), vMin, vMax));
 }
 
-float FrameScale::filter( float *input, double *filterX, double *filterY, int posX, int posY, int iSizeX, double vMin, double vMax)
+SIMD_TARGET("avx2")
+static void accumulateRowAVX2( double *acc, const double *row, double coeff, int size )
 {
-  double result = 0.0;
-  int i, j, yPos;
-  double *pFilterX = NULL, *pFilterY = filterY;
+  __m256d c = _mm256_set1_pd(coeff);
+  int x;
+  for (x = 0; x + 4 <= size; x += 4)
+    _mm256_storeu_pd(acc + x, _mm256_add_pd(_mm256_loadu_pd(acc + x), _mm256_mul_pd(c, _mm256_loadu_pd(row + x))));
+  for (; x < size; x++)
+    acc[x] += coeff * row[x];
+}
+#endif
 
-  // the process below generates the filtered sample in place and without the use of any
-  // additional memory.
+const FrameScale::FilterBank &FrameScale::getFilterBank( vector<FilterBank> &banks, int iSize, int oSize, double factor, double offset, int filterTaps, const vector<double> &filterCoeffs, const vector<int> &filterOffsets )
+{
+  for (size_t i = 0; i < banks.size(); i++) {
+    if (banks[i].m_iSize == iSize && banks[i].m_oSize == oSize && banks[i].m_offset == offset)
+      return banks[i];
+  }
   
-  /* interpolate point - we assume symmetric filter in each direction */
-  for ( j = 0; j < m_filterTapsY; j++, pFilterY++ ) {
-    pFilterX = filterX;
-    yPos = iSizeX * iClip(posY + m_filterOffsetsY[j], 0, m_iMaxY);
-    for ( i = 0; i < m_filterTapsX; i++ ) {
-    //printf("filtertaps %d %d %10.7f %10.7f\n", j, i, *pFilterY, *pFilterX);
-  //printf("filtering %d %d %10.7f %10.7f %10.7f\n", j, i, *pFilterY, *pFilterX, input[ yPos + iClip(posX + m_filterOffsetsX[i], 0, m_iMaxX)]);
-      result += (*pFilterY) * (*pFilterX++) * (double) input[ yPos + iClip(posX + m_filterOffsetsX[i], 0, m_iMaxX)];
-    }
-    //tempIn += iSizeX - m_filterTapsX;
+  FilterBank bank;
+  bank.m_iSize  = iSize;
+  bank.m_oSize  = oSize;
+  bank.m_offset = offset;
+  bank.m_pad    = 0;
+  bank.m_start.resize(oSize);
+  bank.m_coeffs.resize(oSize * filterTaps);
+  
+  for (int x = 0; x < oSize; x++) {
+    // project x to old coordinates
+    int start = (int) (x * factor + offset) + filterOffsets[0];
+    bank.m_start[x] = start;
+    bank.m_pad = iMax(bank.m_pad, iMax(-start, start + filterTaps - iSize));
+    for (int t = 0; t < filterTaps; t++)
+      bank.m_coeffs[t * oSize + x] = filterCoeffs[x * filterTaps + t];
   }
-  //if (result < 0)
-  //printf("result %10.7f %10.7f\n", result, input[ yPos + iClip(posX + m_filterOffsetsX[0], 0, m_iMaxX)]);
   
-  return (float) result; //(dClip(result, vMin, vMax));
+  banks.push_back(bank);
+  return banks.back();
 }
 
-void FrameScale::filter( imgpel *input, imgpel *output, int iSizeX, int iSizeY, int oSizeX, int oSizeY, int vMin, int vMax )
+/*!
+ ************************************************************************
+ * \brief
+ *    Scale one component with separable horizontal and vertical passes.
+ *    Output rows are split in bands that are processed in parallel; each
+ *    band horizontally filters only the input rows it references into a
+ *    band sized buffer, and then filters that buffer vertically.
+ *
+ *    Compared to evaluating the full 2D tap window per output sample, the
+ *    separable passes sum the same products in a different order. Results
+ *    can therefore differ by one ulp of the double precision sum, i.e. by
+ *    at most one ulp of float outputs, or by one code value for integer
+ *    outputs that land within that error of a rounding boundary.
+ ************************************************************************
+ */
+template <typename T> void FrameScale::filterBands( const T *input, T *output, int iSizeX, int iSizeY, int oSizeX, int oSizeY, double offsetX, double offsetY, double vMin, double vMax, bool isFloat )
 {
-  /* we assume the input and output images are stored in raster scan mode */
-  int x, y, filterX, filterY = 0;
+  const FilterBank &bankX = getFilterBank(m_banksX, iSizeX, oSizeX, m_factorX, offsetX, m_filterTapsX, m_filterCoeffsX, m_filterOffsetsX);
+  const FilterBank &bankY = getFilterBank(m_banksY, iSizeY, oSizeY, m_factorY, offsetY, m_filterTapsY, m_filterCoeffsY, m_filterOffsetsY);
+  int tapsX = m_filterTapsX;
+  int tapsY = m_filterTapsY;
+  int iMinValue = (int) vMin;
+  int iMaxValue = (int) vMax;
+  int bands = ThreadPool::getBandCount(oSizeY, 16);
+  void (*pFilterRow)     ( double *, const double *, const int *, const double *, int, int ) = filterRow;
+  void (*pAccumulateRow) ( double *, const double *, double, int ) = accumulateRow;
   
-  int origY, origX;
-  imgpel *pOutput = output;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2()) {
+    pFilterRow     = filterRowAVX2;
+    pAccumulateRow = accumulateRowAVX2;
+  }
+#endif
   
   m_iMaxX = iSizeX - 1;
   m_iMaxY = iSizeY - 1;
   
-  for ( y = 0; y < oSizeY; y++) {
-    // project y to old coordinates
-    origY = (int)(y * m_factorY);
-    filterX = 0;
-    for ( x = 0; x < oSizeX; x++) {
-      // project x to old coordinates
-      origX = (int)(x * m_factorX);
-      pOutput = output + oSizeX * y + x;
-      *pOutput = filter( input, &m_filterCoeffsX[filterX], &m_filterCoeffsY[filterY], origX, origY, iSizeX,  vMin, vMax);
-      filterX += m_filterTapsX;
-    }
-    filterY += m_filterTapsY;
+  // Size the band scratch memory before going parallel; it is only reallocated if it has to grow
+  if ((int) m_bandScratch.size() < bands)
+    m_bandScratch.resize(bands);
+  for (int band = 0; band < bands; band++) {
+    int yStart = (int) ((int64) band * oSizeY / bands);
+    int yEnd   = (int) ((int64) (band + 1) * oSizeY / bands);
+    if (yStart >= yEnd)
+      continue;
+    int rowMin = iClip(bankY.m_start[yStart], 0, iSizeY - 1);
+    int rowMax = iClip(bankY.m_start[yEnd - 1] + tapsY - 1, 0, iSizeY - 1);
+    BandScratch &scratch = m_bandScratch[band];
+    if ((int) scratch.m_padded.size() < iSizeX + 2 * bankX.m_pad)
+      scratch.m_padded.resize(iSizeX + 2 * bankX.m_pad);
+    if ((int) scratch.m_rows.size() < (rowMax - rowMin + 1) * oSizeX)
+      scratch.m_rows.resize((rowMax - rowMin + 1) * oSizeX);
+    if ((int) scratch.m_acc.size() < oSizeX)
+      scratch.m_acc.resize(oSizeX);
   }
+  
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int yStart = (int) ((int64) band * oSizeY / bands);
+    int yEnd   = (int) ((int64) (band + 1) * oSizeY / bands);
+    if (yStart >= yEnd)
+      return;
+    
+    int rowMin = iClip(bankY.m_start[yStart], 0, iSizeY - 1);
+    int rowMax = iClip(bankY.m_start[yEnd - 1] + tapsY - 1, 0, iSizeY - 1);
+    double *padded = &m_bandScratch[band].m_padded[0];
+    double *rows   = &m_bandScratch[band].m_rows[0];
+    double *acc    = &m_bandScratch[band].m_acc[0];
+    
+    for (int r = rowMin; r <= rowMax; r++) {
+      padRow(padded, input + (int64) r * iSizeX, iSizeX, bankX.m_pad);
+      pFilterRow(&rows[(r - rowMin) * oSizeX], &padded[bankX.m_pad], &bankX.m_start[0], &bankX.m_coeffs[0], tapsX, oSizeX);
+    }
+    
+    for (int y = yStart; y < yEnd; y++) {
+      T *pOutput = output + (int64) y * oSizeX;
+      std::fill(acc, acc + oSizeX, 0.0);
+      for (int j = 0; j < tapsY; j++) {
+        int r = iClip(bankY.m_start[y] + j, 0, iSizeY - 1);
+        pAccumulateRow(acc, &rows[(r - rowMin) * oSizeX], bankY.m_coeffs[j * oSizeY + y], oSizeX);
+      }
+      if (isFloat) {
+        for (int x = 0; x < oSizeX; x++)
+          pOutput[x] = (T) acc[x];
+      }
+      else {
+        for (int x = 0; x < oSizeX; x++)
+          pOutput[x] = (T) iClip((int) (acc[x] + 0.5), iMinValue, iMaxValue);
+      }
+    }
+  });
+}
+
+void FrameScale::filter( imgpel *input, imgpel *output, int iSizeX, int iSizeY, int oSizeX, int oSizeY, int vMin, int vMax )
+{
+  /* we assume the input and output images are stored in raster scan mode */
+  filterBands(input, output, iSizeX, iSizeY, oSizeX, oSizeY, 0.0, 0.0, (double) vMin, (double) vMax, FALSE);
 }
 
 void FrameScale::filter( uint16 *input, uint16 *output, int iSizeX, int iSizeY, int oSizeX, int oSizeY, int vMin, int vMax )
 {
   /* we assume the input and output images are stored in raster scan mode */
-  int x, y, filterX, filterY = 0;
-  
-  int origY, origX;
-  uint16 *pOutput = output;
-  
-  m_iMaxX = iSizeX - 1;
-  m_iMaxY = iSizeY - 1;
-  
-  for ( y = 0; y < oSizeY; y++) {
-    // project y to old coordinates
-    origY = (int)(y * m_factorY);
-    filterX = 0;
-    for ( x = 0; x < oSizeX; x++) {
-      // project x to old coordinates
-      origX = (int)(x * m_factorX);
-      pOutput = output + oSizeX * y + x;
-      *pOutput = filter( input, &m_filterCoeffsX[filterX], &m_filterCoeffsY[filterY], origX, origY, iSizeX,  vMin, vMax);
-      filterX += m_filterTapsX;
-    }
-    filterY += m_filterTapsY;
-  }
+  filterBands(input, output, iSizeX, iSizeY, oSizeX, oSizeY, 0.0, 0.0, (double) vMin, (double) vMax, FALSE);
 }
 
 void FrameScale::filter( float *input, float *output, int iSizeX, int iSizeY, int oSizeX, int oSizeY, double vMin, double vMax )
 {
   /* we assume the input and output images are stored in raster scan mode */
-  int x, y, filterX, filterY = 0;
-  
-  int origY, origX;
-  float *pOutput = output;
-  
-  m_iMaxX = iSizeX - 1;
-  m_iMaxY = iSizeY - 1;
-  
-  for ( y = 0; y < oSizeY; y++) {
-    // project y to old coordinates
-    origY = (int)(y * m_factorY + m_offsetY);
-    filterX = 0;
-    for ( x = 0; x < oSizeX; x++) {
-      // project x to old coordinates
-      origX = (int)(x * m_factorX + m_offsetX);
-      //printf("Pos %d %d\n", origY, origX);
-      pOutput = output + oSizeX * y + x;
-      *pOutput = filter( input, &m_filterCoeffsX[filterX], &m_filterCoeffsY[filterY], origX, origY, iSizeX,  vMin, vMax);
-      filterX += m_filterTapsX;
-    }
-    filterY += m_filterTapsY;
-  }
+  // Unlike the integer paths, floating point data are projected with the filter offset
+  filterBands(input, output, iSizeX, iSizeY, oSizeX, oSizeY, m_offsetX, m_offsetY, vMin, vMax, TRUE);
 }
 
 //-----------------------------------------------------------------------------
@@ -60,6 +60,7 @@
 #include "InputY4M.H"
 #include "InputYUV.H"
 #include "Global.H"
+#include "CPUFeatures.H"
 
 #include <stdlib.h>
 #include <string.h>
@@ -103,6 +104,176 @@ static uint16 getSwappedU16 (const char *& buf)
   return in;
 }
 
+#if ENABLE_SIMD_DISPATCH
+//-----------------------------------------------------------------------------
+// SIMD unpack kernels for the packed 10 and 16 bit formats. Each kernel
+// handles a leading part of the picture and returns how many samples (or
+// blocks) it consumed; the scalar loops below finish the remainder.
+//-----------------------------------------------------------------------------
+
+/*!
+ ************************************************************************
+ * \brief
+ *   Scatter one V210 style block (4 words, 12 samples) to the Y/Cb/Cr
+ *   planes. a, b and c hold the first, second and third 10 bit field of
+ *   each word in V210 order. The stores run a few samples past the block,
+ *   so this must never be used for the last block of a picture.
+ ************************************************************************
+ */
+SIMD_TARGET("ssse3")
+static inline void storeV210Block (__m128i a, __m128i b, __m128i c, uint16 *y, uint16 *cb, uint16 *cr)
+{
+  __m128i p = _mm_packs_epi32(a, b);   // a0 a1 a2 a3 b0 b1 b2 b3
+  __m128i q = _mm_packs_epi32(c, c);   // c0 c1 c2 c3 c0 c1 c2 c3
+  // Y0 = b0, Y1 = a1, Y2 = c1, Y3 = b2, Y4 = a3, Y5 = c3
+  __m128i luma   = _mm_or_si128(_mm_shuffle_epi8(p, _mm_setr_epi8(8, 9, 2, 3, -1, -1, 12, 13, 6, 7, -1, -1, -1, -1, -1, -1)),
+                                _mm_shuffle_epi8(q, _mm_setr_epi8(-1, -1, -1, -1, 2, 3, -1, -1, -1, -1, 6, 7, -1, -1, -1, -1)));
+  // Cb0 = a0, Cb1 = b1, Cb2 = c2 in the low half, Cr0 = c0, Cr1 = a2, Cr2 = b3 in the high half
+  __m128i chroma = _mm_or_si128(_mm_shuffle_epi8(p, _mm_setr_epi8(0, 1, 10, 11, -1, -1, -1, -1, -1, -1, 4, 5, 14, 15, -1, -1)),
+                                _mm_shuffle_epi8(q, _mm_setr_epi8(-1, -1, -1, -1, 4, 5, -1, -1, 0, 1, -1, -1, -1, -1, -1, -1)));
+  _mm_storeu_si128((__m128i *) y, luma);
+  _mm_storel_epi64((__m128i *) cb, chroma);
+  _mm_storel_epi64((__m128i *) cr, _mm_unpackhi_epi64(chroma, chroma));
+}
+
+SIMD_TARGET("ssse3")
+static void unpackV210SSSE3 (const uint8 *src, uint16 *y, uint16 *cb, uint16 *cr, int blocks)
+{
+  const __m128i mask = _mm_set1_epi32(0x3FF);
+  
+  for (int k = 0; k < blocks; k++, src += 16, y += 6, cb += 3, cr += 3) {
+    __m128i w = _mm_loadu_si128((const __m128i *) src);
+    storeV210Block(_mm_and_si128(w, mask), _mm_and_si128(_mm_srli_epi32(w, 10), mask), _mm_and_si128(_mm_srli_epi32(w, 20), mask), y, cb, cr);
+  }
+}
+
+SIMD_TARGET("ssse3")
+static void unpackUYVY10SSSE3 (const uint8 *src, uint16 *y, uint16 *u, uint16 *v, int blocks)
+{
+  const __m128i mask = _mm_set1_epi32(0x3FF);
+  const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  
+  // Same sample order as V210, with big endian words and the fields stored from the top down
+  for (int k = 0; k < blocks; k++, src += 16, y += 6, u += 3, v += 3) {
+    __m128i w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) src), swap);
+    storeV210Block(_mm_srli_epi32(w, 22), _mm_and_si128(_mm_srli_epi32(w, 12), mask), _mm_and_si128(_mm_srli_epi32(w, 2), mask), y, u, v);
+  }
+}
+
+SIMD_TARGET("ssse3")
+static int unpackR10KSSSE3 (const uint32 *src, uint16 *comp0, uint16 *comp1, uint16 *comp2, int size)
+{
+  const __m128i mask = _mm_set1_epi32(0x3FF);
+  int i;
+  
+  for (i = 0; i + 8 <= size; i += 8) {
+    __m128i w0 = _mm_loadu_si128((const __m128i *) (src + i    ));
+    __m128i w1 = _mm_loadu_si128((const __m128i *) (src + i + 4));
+    _mm_storeu_si128((__m128i *) (comp1 + i), _mm_packs_epi32(_mm_and_si128(w0, mask), _mm_and_si128(w1, mask)));
+    _mm_storeu_si128((__m128i *) (comp2 + i), _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(w0, 10), mask), _mm_and_si128(_mm_srli_epi32(w1, 10), mask)));
+    _mm_storeu_si128((__m128i *) (comp0 + i), _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(w0, 20), mask), _mm_and_si128(_mm_srli_epi32(w1, 20), mask)));
+  }
+  return i;
+}
+
+//! Narrow two vectors of 32 bit samples to one vector of 16 bit samples, keeping their order
+SIMD_TARGET("avx2")
+static inline __m256i packWordsAVX2 (__m256i lo, __m256i hi)
+{
+  return _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+}
+
+SIMD_TARGET("avx2")
+static int unpackR10KAVX2 (const uint32 *src, uint16 *comp0, uint16 *comp1, uint16 *comp2, int size)
+{
+  const __m256i mask = _mm256_set1_epi32(0x3FF);
+  int i;
+  
+  for (i = 0; i + 16 <= size; i += 16) {
+    __m256i w0 = _mm256_loadu_si256((const __m256i *) (src + i    ));
+    __m256i w1 = _mm256_loadu_si256((const __m256i *) (src + i + 8));
+    _mm256_storeu_si256((__m256i *) (comp1 + i), packWordsAVX2(_mm256_and_si256(w0, mask), _mm256_and_si256(w1, mask)));
+    _mm256_storeu_si256((__m256i *) (comp2 + i), packWordsAVX2(_mm256_and_si256(_mm256_srli_epi32(w0, 10), mask), _mm256_and_si256(_mm256_srli_epi32(w1, 10), mask)));
+    _mm256_storeu_si256((__m256i *) (comp0 + i), packWordsAVX2(_mm256_and_si256(_mm256_srli_epi32(w0, 20), mask), _mm256_and_si256(_mm256_srli_epi32(w1, 20), mask)));
+  }
+  return i;
+}
+
+SIMD_TARGET("ssse3")
+static int unpackR210SSSE3 (const uint32 *src, uint16 *comp0, uint16 *comp1, uint16 *comp2, int size)
+{
+  const __m128i m003F = _mm_set1_epi32(0x003F), m000F = _mm_set1_epi32(0x000F);
+  const __m128i m0300 = _mm_set1_epi32(0x0300), m03F0 = _mm_set1_epi32(0x03F0), m03C0 = _mm_set1_epi32(0x03C0);
+  int i;
+  
+  for (i = 0; i + 8 <= size; i += 8) {
+    __m128i w[2], b[2], r[2], g[2];
+    w[0] = _mm_loadu_si128((const __m128i *) (src + i    ));
+    w[1] = _mm_loadu_si128((const __m128i *) (src + i + 4));
+    for (int k = 0; k < 2; k++) {
+      b[k] = _mm_or_si128(_mm_srli_epi32(w[k], 24), _mm_and_si128(_mm_srli_epi32(w[k], 8), m0300));
+      r[k] = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(w[k], 12), m000F), _mm_and_si128(_mm_slli_epi32(w[k], 4), m03F0));
+      g[k] = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(w[k], 18), m003F), _mm_and_si128(_mm_srli_epi32(w[k], 2), m03C0));
+    }
+    _mm_storeu_si128((__m128i *) (comp0 + i), _mm_packs_epi32(b[0], b[1]));
+    _mm_storeu_si128((__m128i *) (comp1 + i), _mm_packs_epi32(r[0], r[1]));
+    _mm_storeu_si128((__m128i *) (comp2 + i), _mm_packs_epi32(g[0], g[1]));
+  }
+  return i;
+}
+
+SIMD_TARGET("avx2")
+static int unpackR210AVX2 (const uint32 *src, uint16 *comp0, uint16 *comp1, uint16 *comp2, int size)
+{
+  const __m256i m003F = _mm256_set1_epi32(0x003F), m000F = _mm256_set1_epi32(0x000F);
+  const __m256i m0300 = _mm256_set1_epi32(0x0300), m03F0 = _mm256_set1_epi32(0x03F0), m03C0 = _mm256_set1_epi32(0x03C0);
+  int i;
+  
+  for (i = 0; i + 16 <= size; i += 16) {
+    __m256i w[2], b[2], r[2], g[2];
+    w[0] = _mm256_loadu_si256((const __m256i *) (src + i    ));
+    w[1] = _mm256_loadu_si256((const __m256i *) (src + i + 8));
+    for (int k = 0; k < 2; k++) {
+      b[k] = _mm256_or_si256(_mm256_srli_epi32(w[k], 24), _mm256_and_si256(_mm256_srli_epi32(w[k], 8), m0300));
+      r[k] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(w[k], 12), m000F), _mm256_and_si256(_mm256_slli_epi32(w[k], 4), m03F0));
+      g[k] = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(w[k], 18), m003F), _mm256_and_si256(_mm256_srli_epi32(w[k], 2), m03C0));
+    }
+    _mm256_storeu_si256((__m256i *) (comp0 + i), packWordsAVX2(b[0], b[1]));
+    _mm256_storeu_si256((__m256i *) (comp1 + i), packWordsAVX2(r[0], r[1]));
+    _mm256_storeu_si256((__m256i *) (comp2 + i), packWordsAVX2(g[0], g[1]));
+  }
+  return i;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *   Unpack big endian b64a pixels (A, R, G, B 16 bit words), 8 pixels
+ *   per iteration, matching the component order of deInterleaveB64A.
+ ************************************************************************
+ */
+SIMD_TARGET("ssse3")
+static int unpackB64ASSSE3 (const uint8 *src, uint16 *comp0, uint16 *comp1, uint16 *comp2, int size)
+{
+  // Gather the byte swapped 1st, 2nd and 3rd color words of the two pixels in a register into dwords 0, 1 and 2
+  const __m128i gather = _mm_setr_epi8(3, 2, 11, 10, 5, 4, 13, 12, 7, 6, 15, 14, -1, -1, -1, -1);
+  int i;
+  
+  for (i = 0; i + 8 <= size; i += 8, src += 64) {
+    __m128i t0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src     )), gather);
+    __m128i t1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 16)), gather);
+    __m128i t2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 32)), gather);
+    __m128i t3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (src + 48)), gather);
+    __m128i lo = _mm_unpacklo_epi32(t0, t1);
+    __m128i hi = _mm_unpacklo_epi32(t2, t3);
+    _mm_storeu_si128((__m128i *) (comp1 + i), _mm_unpacklo_epi64(lo, hi));
+    _mm_storeu_si128((__m128i *) (comp0 + i), _mm_unpackhi_epi64(lo, hi));
+    _mm_storeu_si128((__m128i *) (comp2 + i), _mm_unpacklo_epi64(_mm_unpackhi_epi32(t0, t1), _mm_unpackhi_epi32(t2, t3)));
+  }
+  return i;
+}
+#endif
+
 
 void Input::deInterleaveYUV420( 
   uint8** input,         //!< input buffer
@@ -316,7 +487,21 @@ void Input::deInterleaveV210 (
   uint16 *ui16cmp1 = ui16cmp0 + source->m_compSize[Y_COMP];
   uint16 *ui16cmp2 = ui16cmp1 + source->m_compSize[U_COMP];
   
-  for (i = 0; i < source->m_compSize[Y_COMP]; i+= 6) {
+  i = 0;
+#if ENABLE_SIMD_DISPATCH
+  // The last block is always left to the scalar loop since the SIMD stores overrun their block
+  int blocks = (source->m_compSize[Y_COMP] + 5) / 6 - 1;
+  if (blocks > 0 && CPUFeatures::hasSSSE3()) {
+    unpackV210SSSE3((const uint8 *) ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, blocks);
+    ui32cmp  += 4 * blocks;
+    ui16cmp0 += 6 * blocks;
+    ui16cmp1 += 3 * blocks;
+    ui16cmp2 += 3 * blocks;
+    i = 6 * blocks;
+  }
+#endif
+  
+  for (; i < source->m_compSize[Y_COMP]; i+= 6) {
     // Byte 3          Byte 2          Byte 1          Byte 0
     // Cr 0                Y 0                 Cb 0
     // X X 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0
@@ -403,7 +588,19 @@ void Input::deInterleaveR10K (
   uint16 *ui16cmp1 = ui16cmp0 + source->m_compSize[Y_COMP];
   uint16 *ui16cmp2 = ui16cmp1 + source->m_compSize[U_COMP];
   
-  for (i = 0; i < source->m_compSize[Y_COMP]; i++) {
+  i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = unpackR10KAVX2(ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+  else if (CPUFeatures::hasSSSE3())
+    i = unpackR10KSSSE3(ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+  ui32cmp  += i;
+  ui16cmp0 += i;
+  ui16cmp1 += i;
+  ui16cmp2 += i;
+#endif
+  
+  for (; i < source->m_compSize[Y_COMP]; i++) {
     // Byte 3          Byte 2          Byte 1          Byte 0
     // R                   G                   B 
     // 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 X X
@@ -436,7 +633,18 @@ void Input::deInterleaveB64A (
   uint16 *ui16cmp1 = ui16cmp0 + source->m_compSize[Y_COMP];
   uint16 *ui16cmp2 = ui16cmp1 + source->m_compSize[U_COMP];
   
-  for (i = 0; i < source->m_compSize[Y_COMP]; i++) {
+  i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (mGetU16 == getSwappedU16 && CPUFeatures::hasSSSE3()) {
+    i = unpackB64ASSSE3((const uint8 *) ui8cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+    ui8cmp   += 8 * i;
+    ui16cmp0 += i;
+    ui16cmp1 += i;
+    ui16cmp2 += i;
+  }
+#endif
+  
+  for (; i < source->m_compSize[Y_COMP]; i++) {
     ui8cmp+=2;
     *ui16cmp1++ = mGetU16(ui8cmp);
     *ui16cmp0++ = mGetU16(ui8cmp);
@@ -465,15 +673,27 @@ void Input::deInterleaveR210 (
   uint16 *ui16cmp1 = ui16cmp0 + source->m_compSize[Y_COMP];
   uint16 *ui16cmp2 = ui16cmp1 + source->m_compSize[U_COMP];
 
-  for (i = 0; i < source->m_compSize[Y_COMP]; i++) {
+  i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = unpackR210AVX2(ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+  else if (CPUFeatures::hasSSSE3())
+    i = unpackR210SSSE3(ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+  ui32cmp  += i;
+  ui16cmp0 += i;
+  ui16cmp1 += i;
+  ui16cmp2 += i;
+#endif
+
+  for (; i < source->m_compSize[Y_COMP]; i++) {
     // Byte 3          Byte 2          Byte 1          Byte 0
     // Blo             Glo         Bhi Rlo     Ghi     X X Rhi
     // 7 6 5 4 3 2 1 0 5 4 3 2 1 0 9 8 3 2 1 0 9 8 7 6 x x 9 8 7 6 5 4
-    *ui16cmp0++ = ((*ui32cmp & 0xFF000000) >> 24) & ((*ui32cmp & 0x00030000)<< 8);
-    *ui16cmp1++ = ((*ui32cmp & 0x00FC0000) >> 18) & ((*ui32cmp & 0x00000F00) << 4);
-    *ui16cmp2++ = ((*ui32cmp & 0x0000F000) >> 12) & ((*ui32cmp & 0x0000003F) << 4);
+    *ui16cmp0++ = (uint16) (((*ui32cmp & 0xFF000000) >> 24) | ((*ui32cmp & 0x00030000) >>  8));  // B
+    *ui16cmp1++ = (uint16) (((*ui32cmp & 0x0000F000) >> 12) | ((*ui32cmp & 0x0000003F) <<  4));  // R
+    *ui16cmp2++ = (uint16) (((*ui32cmp & 0x00FC0000) >> 18) | ((*ui32cmp & 0x00000F00) >>  2));  // G
 
-      ui32cmp++;
+    ui32cmp++;
   }
   
   // flip buffers
@@ -498,7 +718,21 @@ void Input::deInterleaveUYVY10 (
     uint8 *ocmp1 = ocmp0 + symbolSizeInBytes * source->m_compSize[Y_COMP];
     uint8 *ocmp2 = ocmp1 + symbolSizeInBytes * source->m_compSize[U_COMP];
   
-    for (i = 0; i < source->m_compSize[Y_COMP]; i+=6) {
+    i = 0;
+#if ENABLE_SIMD_DISPATCH
+    // The last block is always left to the scalar loop since the SIMD stores overrun their block
+    int blocks = (source->m_compSize[Y_COMP] + 5) / 6 - 1;
+    if (blocks > 0 && symbolSizeInBytes == 2 && CPUFeatures::hasSSSE3()) {
+      unpackUYVY10SSSE3(icmp, (uint16 *) ocmp0, (uint16 *) ocmp1, (uint16 *) ocmp2, blocks);
+      icmp  += 16 * blocks;
+      ocmp0 += 12 * blocks;
+      ocmp1 +=  6 * blocks;
+      ocmp2 +=  6 * blocks;
+      i = 6 * blocks;
+    }
+#endif
+  
+    for (; i < source->m_compSize[Y_COMP]; i+=6) {
         // Read four 32-bit words containing 12 10-bit packed samples, fix endianness
         uint32 word0 = icmp[3]  | (icmp[2]  << 8) | (icmp[1]  << 16) | (icmp[0]  << 24);
         uint32 word1 = icmp[7]  | (icmp[6]  << 8) | (icmp[5]  << 16) | (icmp[4]  << 24);
@@ -654,7 +888,7 @@ void Input::copyFrame(Frame *frm) {
         memcpy(frm->m_comp[Y_COMP], m_comp[Y_COMP], (int) m_compSize[Y_COMP] * sizeof(imgpel));
       }
       else {
-        memcpy(frm->m_ui16Comp[Y_COMP], m_ui16Comp[Y_COMP], (int) m_compSize[Y_COMP] * sizeof(imgpel));
+        memcpy(frm->m_ui16Comp[Y_COMP], m_ui16Comp[Y_COMP], (int) m_compSize[Y_COMP] * sizeof(uint16));
       }
     }
   }
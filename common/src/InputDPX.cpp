@@ -57,6 +57,8 @@
 #include "InputDPX.H"
 #include "Global.H"
 #include "IOFunctions.H"
+#include "CPUFeatures.H"
+#include "ThreadPool.H"
 
 //-----------------------------------------------------------------------------
 // Macros/Defines
@@ -74,6 +76,7 @@ InputDPX::InputDPX(IOVideo *videoFile, FrameFormat *format) {
   m_frameRate       = format->m_frameRate;
   
   m_memoryAllocated = FALSE;
+  m_isUnpacked      = FALSE;
   m_size      = 0;
   m_prevSize  = -1;
   
@@ -241,6 +244,139 @@ static void getCharString (char *in, DPXFileData * t, int count)
   t->m_mp += count;
 }
 
+/*!
+ ************************************************************************
+ * \brief
+ *   Filled (Method A/B) 10 and 12 bit unpacking. Rows start on 32 bit
+ *   boundaries. 10 bit data holds three samples per 32 bit word, with the
+ *   first sample in the most significant bits; 12 bit data holds one
+ *   sample per 16 bit word. Method A leaves the padding bits at the
+ *   bottom of the word (shift), Method B at the top.
+ *
+ ************************************************************************
+ */
+static inline uint32 readDPXWord32 (const uint8 *src, bool swap)
+{
+  uint32 word;
+  memcpy(&word, src, sizeof(uint32));
+  if (swap)
+    word = (word >> 24) | ((word >> 8) & 0xFF00) | ((word << 8) & 0xFF0000) | (word << 24);
+  return word;
+}
+
+static inline uint16 readDPXWord16 (const uint8 *src, bool swap)
+{
+  uint16 word;
+  memcpy(&word, src, sizeof(uint16));
+  if (swap)
+    word = (uint16) ((word >> 8) | (word << 8));
+  return word;
+}
+
+// Samples of pixels start ... width - 1 of one row
+static void unpackRow10 (const uint8 *src, uint16 * const *dst, int start, int width, int components, bool swap, int shift)
+{
+  for (int k = start * components; k < width * components; k++) {
+    uint32 word = readDPXWord32(src + (k / 3) * 4, swap);
+    dst[k % components][k / components] = (uint16) ((word >> (shift + 10 * (2 - k % 3))) & 0x3FF);
+  }
+}
+
+static void unpackRow12 (const uint8 *src, uint16 * const *dst, int start, int width, int components, bool swap, int shift)
+{
+  for (int k = start * components; k < width * components; k++) {
+    dst[k % components][k / components] = (uint16) ((readDPXWord16(src + k * 2, swap) >> shift) & 0xFFF);
+  }
+}
+
+#if ENABLE_SIMD_DISPATCH
+// RGB rows; return the number of pixels done, the remainder is left to the scalar code
+SIMD_TARGET("ssse3")
+static int unpackRow10SSSE3 (const uint8 *src, uint16 * const *dst, int width, bool swap, int shift)
+{
+  const __m128i swap32 = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const __m128i mask   = _mm_set1_epi32(0x3FF);
+  int x = 0;
+  
+  for (; x + 8 <= width; x += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i *) (src + x * 4));
+    __m128i b = _mm_loadu_si128((const __m128i *) (src + x * 4 + 16));
+    if (swap) {
+      a = _mm_shuffle_epi8(a, swap32);
+      b = _mm_shuffle_epi8(b, swap32);
+    }
+    for (int c = 0; c < 3; c++) {
+      __m128i count = _mm_cvtsi32_si128(shift + 10 * (2 - c));
+      __m128i ca = _mm_and_si128(_mm_srl_epi32(a, count), mask);
+      __m128i cb = _mm_and_si128(_mm_srl_epi32(b, count), mask);
+      _mm_storeu_si128((__m128i *) (dst[c] + x), _mm_packs_epi32(ca, cb));
+    }
+  }
+  return x;
+}
+
+SIMD_TARGET("avx2")
+static int unpackRow10AVX2 (const uint8 *src, uint16 * const *dst, int width, bool swap, int shift)
+{
+  const __m256i swap32 = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                          3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const __m256i mask   = _mm256_set1_epi32(0x3FF);
+  int x = 0;
+  
+  for (; x + 16 <= width; x += 16) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) (src + x * 4));
+    __m256i b = _mm256_loadu_si256((const __m256i *) (src + x * 4 + 32));
+    if (swap) {
+      a = _mm256_shuffle_epi8(a, swap32);
+      b = _mm256_shuffle_epi8(b, swap32);
+    }
+    for (int c = 0; c < 3; c++) {
+      __m128i count = _mm_cvtsi32_si128(shift + 10 * (2 - c));
+      __m256i ca = _mm256_and_si256(_mm256_srl_epi32(a, count), mask);
+      __m256i cb = _mm256_and_si256(_mm256_srl_epi32(b, count), mask);
+      // packs works within 128 bit lanes, restore the sample order
+      _mm256_storeu_si256((__m256i *) (dst[c] + x), _mm256_permute4x64_epi64(_mm256_packs_epi32(ca, cb), 0xD8));
+    }
+  }
+  return x;
+}
+
+SIMD_TARGET("ssse3")
+static int unpackRow12SSSE3 (const uint8 *src, uint16 * const *dst, int width, bool swap, int shift)
+{
+  // shuffle[c][v] picks the words of component c held by source vector v; the
+  // byte order within the words is swapped as needed
+  __m128i shuffle[3][3];
+  for (int c = 0; c < 3; c++) {
+    for (int v = 0; v < 3; v++) {
+      char bytes[16];
+      for (int j = 0; j < 8; j++) {
+        int word = 3 * j + c;
+        bool inVector = (word >> 3) == v;
+        bytes[2 * j    ] = inVector ? (char) (2 * (word & 7) + (swap ? 1 : 0)) : (char) 0x80;
+        bytes[2 * j + 1] = inVector ? (char) (2 * (word & 7) + (swap ? 0 : 1)) : (char) 0x80;
+      }
+      shuffle[c][v] = _mm_loadu_si128((const __m128i *) bytes);
+    }
+  }
+  
+  const __m128i mask  = _mm_set1_epi16(0xFFF);
+  const __m128i count = _mm_cvtsi32_si128(shift);
+  int x = 0;
+  
+  for (; x + 8 <= width; x += 8) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *) (src + x * 6));
+    __m128i v1 = _mm_loadu_si128((const __m128i *) (src + x * 6 + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i *) (src + x * 6 + 32));
+    for (int c = 0; c < 3; c++) {
+      __m128i words = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(v0, shuffle[c][0]), _mm_shuffle_epi8(v1, shuffle[c][1])), _mm_shuffle_epi8(v2, shuffle[c][2]));
+      _mm_storeu_si128((__m128i *) (dst[c] + x), _mm_and_si128(_mm_srl_epi16(words, count), mask));
+    }
+  }
+  return x;
+}
+#endif
+
 void InputDPX::printHeader(DPXFileData * dpx) {
   printf("magic %d\n",        dpx->m_fileFormat.m_fileHeader.m_magic);
   printf("offset %d\n",       dpx->m_fileFormat.m_fileHeader.m_imageOffset);
@@ -462,6 +598,8 @@ int InputDPX::readImageData (DPXFileData * t)
   byte   bitSize = t->m_fileFormat.m_imageHeader.m_imageElement[0].m_bitSize;
   uint32 width  = t->m_fileFormat.m_imageHeader.m_pixelsPerLine;
   uint32 height = t->m_fileFormat.m_imageHeader.m_linesPerElement;
+  
+  m_isUnpacked = FALSE;
   if (isPacked) {
     int    bitCount  = 0;
     int    dataCount = 0;
@@ -511,8 +649,6 @@ int InputDPX::readImageData (DPXFileData * t)
   else {    
     uint32 samplesPerDWord = 32 / bitSize;
     uint32 size = ((width * height * 4) * m_components + samplesPerDWord - 1) / samplesPerDWord;
-    uint32 sizeDWord = (size + 3) / 4;
-    uint32 curDWord;
 
     switch (bitSize) {
       case 8:
@@ -524,30 +660,9 @@ int InputDPX::readImageData (DPXFileData * t)
         }
         break;
       case 10:
-        t->m_img.resize(size * 3);
-        mp = t->m_mp;                       // save memory pointer
-        p = (uint16 *) &t->m_img[0];
-        t->m_mp = (uint8 *) &t->m_buffer[imageOffset];
-        for (j = 0; j < (int) sizeDWord; ++j) {
-          curDWord = t->getU32( t) >> 2;
-          *p++ = (uint16) ((curDWord >> 20) & 0x3FF);
-          *p++ = (uint16) ((curDWord >> 10) & 0x3FF);
-          *p++ = (uint16) ((curDWord >>  0) & 0x3FF);
-        }
-        t->m_mp = mp;                       // restore memory pointer
-        break;
       case 12:
-        t->m_img.resize(size * 2);
-        mp = t->m_mp;                       // save memory pointer
-        p = (uint16 *) &t->m_img[0];
-        t->m_mp = (uint8 *) &t->m_buffer[imageOffset];
-        for (j = 0; j < (int) sizeDWord; ++j) {
-          curDWord = t->getU32( t) >> 4;
-          *p++ = (uint16) ((curDWord >> 16) & 0xFFF);
-          *p++ = (uint16) ((curDWord >>  0) & 0xFFF);
-        }
-        t->m_mp = mp;                       // restore memory pointer
-        break;
+        // Unpacked straight into the component planes
+        return unpackFilledData(t);
       case 16:
         t->m_img.resize(size);
         mp = t->m_mp;                       // save memory pointer
@@ -568,6 +683,66 @@ int InputDPX::readImageData (DPXFileData * t)
 
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Unpack filled 10 or 12 bit data straight into the component planes,
+ *    in row bands on the thread pool.
+ *
+ ************************************************************************
+ */
+int InputDPX::unpackFilledData (DPXFileData * t)
+{
+  int    endian = 1;
+  bool   swap      = t->m_le != ((*( (char *)(&endian) ) == 1) ? 1 : 0);
+  uint32 imageOffset = t->m_fileFormat.m_fileHeader.m_imageOffset;
+  int    bitSize   = t->m_fileFormat.m_imageHeader.m_imageElement[0].m_bitSize;
+  int    shift     = t->m_fileFormat.m_imageHeader.m_imageElement[0].m_packing == 1 ? (bitSize == 10 ? 2 : 4) : 0;
+  int    width     = (int) t->m_fileFormat.m_imageHeader.m_pixelsPerLine;
+  int    height    = (int) t->m_fileFormat.m_imageHeader.m_linesPerElement;
+  int    components = m_components;
+  int    samplesPerWord = bitSize == 10 ? 3 : 2;
+  int64  rowBytes  = (((int64) width * components + samplesPerWord - 1) / samplesPerWord) * 4;
+  
+  if (components != 1 && components != 3) {
+    printf("Unsupported number of components (%d) for %d bit DPX data\n", components, bitSize);
+    return 1;
+  }
+  if ((int64) imageOffset + rowBytes * height > (int64) t->m_buffer.size()) {
+    printf("DPX image data exceeds the file size\n");
+    return 1;
+  }
+  
+  int (*unpackRowSIMD) (const uint8 *, uint16 * const *, int, bool, int) = NULL;
+#if ENABLE_SIMD_DISPATCH
+  if (components == 3) {
+    if (bitSize == 10)
+      unpackRowSIMD = CPUFeatures::hasAVX2() ? unpackRow10AVX2 : (CPUFeatures::hasSSSE3() ? unpackRow10SSSE3 : NULL);
+    else if (CPUFeatures::hasSSSE3())
+      unpackRowSIMD = unpackRow12SSSE3;
+  }
+#endif
+  void (*unpackRow) (const uint8 *, uint16 * const *, int, int, int, bool, int) = bitSize == 10 ? unpackRow10 : unpackRow12;
+  
+  const uint8 *image = (const uint8 *) &t->m_buffer[imageOffset];
+  int bands = ThreadPool::getBandCount(height, 16);
+  
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int yStart = (int) ((int64) band * height / bands);
+    int yEnd   = (int) ((int64) (band + 1) * height / bands);
+    
+    for (int y = yStart; y < yEnd; y++) {
+      const uint8 *src = image + rowBytes * y;
+      uint16 *dst[3] = { m_ui16Comp[Y_COMP] + y * width, m_ui16Comp[U_COMP] + y * width, m_ui16Comp[V_COMP] + y * width };
+      int start = unpackRowSIMD != NULL ? unpackRowSIMD(src, dst, width, swap, shift) : 0;
+      unpackRow(src, dst, start, width, components, swap, shift);
+    }
+  });
+  
+  m_isUnpacked = TRUE;
+  return 0;
+}
+
 /*!
  *****************************************************************************
  * \brief
@@ -799,7 +974,8 @@ int InputDPX::readOneFrame (IOVideo *inputFile, int frameNumber, int fileHeader,
   if (openFrameFile( inputFile, frameNumber + frameSkip) != -1) {
     
     fileRead = readDPX( source, vfile);
-    reformatData ();
+    if (fileRead == 1 && m_isUnpacked == FALSE)
+      reformatData ();
     
     if (*vfile != -1) {
       close(*vfile);
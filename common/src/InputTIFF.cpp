@@ -57,9 +57,22 @@
 
 #include <string.h>
 #include <assert.h>
+#include <atomic>
+#include <algorithm>
 #include "InputTIFF.H"
 #include "Global.H"
 #include "IOFunctions.H"
+#include "ThreadPool.H"
+#include "CPUFeatures.H"
+#include "TIFFCodec.H"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+#ifdef USEZLIB
+#include <zlib.h>
+#endif
 
 //-----------------------------------------------------------------------------
 // Macros/Defines
@@ -78,9 +91,14 @@ InputTIFF::InputTIFF(IOVideo *videoFile, FrameFormat *format) {
   m_frameRate       = format->m_frameRate;
   
   m_memoryAllocated = FALSE;
+  m_dataDecoded     = FALSE;
   m_size      = 0;
   m_prevSize  = -1;
   
+  m_tiff.fileData = NULL;
+  m_tiff.fileSize = 0;
+  m_tiff.isMapped = FALSE;
+  
   m_buf       = NULL;
   
   m_floatComp[Y_COMP] = NULL;
@@ -105,6 +123,7 @@ InputTIFF::InputTIFF(IOVideo *videoFile, FrameFormat *format) {
 
 InputTIFF::~InputTIFF() {
   
+  releaseFile( &m_tiff );
   freeMemory();
   
   clear();
@@ -192,6 +211,154 @@ static uint32 getSwappedU32 (Tiff * t)
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *   Decode a PackBits (compression 32773) strip.
+ *
+ * \return
+ *   number of bytes written to dst
+ ************************************************************************
+ */
+static int64 unpackBits (const uint8 *src, int64 srcSize, uint8 *dst, int64 dstSize)
+{
+  const uint8 *srcEnd = src + srcSize;
+  uint8       *dstPtr = dst;
+  uint8       *dstEnd = dst + dstSize;
+  
+  while (src < srcEnd && dstPtr < dstEnd) {
+    int n = (int) ((signed char) *src++);
+    if (n >= 0) {                       // copy the next n + 1 bytes literally
+      int64 count = n + 1;
+      count = (count < srcEnd - src) ? count : (int64) (srcEnd - src);
+      count = (count < dstEnd - dstPtr) ? count : (int64) (dstEnd - dstPtr);
+      memcpy(dstPtr, src, (size_t) count);
+      src    += n + 1;
+      dstPtr += count;
+    }
+    else if (n != -128 && src < srcEnd) { // repeat the next byte 1 - n times
+      int64 count = 1 - n;
+      count = (count < dstEnd - dstPtr) ? count : (int64) (dstEnd - dstPtr);
+      memset(dstPtr, *src++, (size_t) count);
+      dstPtr += count;
+    }
+  }
+  return (int64) (dstPtr - dst);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *   De-interleave one row of 8 bit RGB samples.
+ ************************************************************************
+ */
+static void unpackRow8 (const uint8 *src, imgpel *comp0, imgpel *comp1, imgpel *comp2, int width)
+{
+  for (int i = 0; i < width; i++) {
+    *comp0++ = *src++;
+    *comp1++ = *src++;
+    *comp2++ = *src++;
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *   De-interleave one row of 16 bit RGB samples, swapping bytes if the
+ *   file endianness does not match the machine.
+ ************************************************************************
+ */
+static void unpackRow16 (const uint8 *src, uint16 *comp0, uint16 *comp1, uint16 *comp2, int width, bool swap)
+{
+  uint16 *comp[3] = { comp0, comp1, comp2 };
+  uint16 value;
+  
+  for (int i = 0; i < width; i++) {
+    for (int c = 0; c < 3; c++) {
+      memcpy(&value, src, sizeof(uint16));
+      src += 2;
+      *comp[c]++ = swap ? (uint16) ((value >> 8) | (value << 8)) : value;
+    }
+  }
+}
+
+#if ENABLE_SIMD_DISPATCH
+//! pshufb masks gathering one component out of three consecutive 16 byte registers of interleaved RGB data
+class UnpackMasks {
+public:
+  uint8 m_mask8 [3][3][16];    //!< [component][register][byte], 8 bit samples
+  uint8 m_mask16[2][3][3][16]; //!< [swap][component][register][byte], 16 bit samples
+  
+  UnpackMasks() {
+    for (int c = 0; c < 3; c++) {
+      for (int r = 0; r < 3; r++) {
+        for (int k = 0; k < 16; k++) {
+          int pos = 3 * k + c - 16 * r;
+          m_mask8[c][r][k] = (uint8) ((pos >= 0 && pos < 16) ? pos : 0x80);
+          for (int swap = 0; swap < 2; swap++) {
+            pos = 6 * (k >> 1) + 2 * c + (swap ? 1 - (k & 1) : (k & 1)) - 16 * r;
+            m_mask16[swap][c][r][k] = (uint8) ((pos >= 0 && pos < 16) ? pos : 0x80);
+          }
+        }
+      }
+    }
+  }
+};
+
+static const UnpackMasks &getUnpackMasks() {
+  static const UnpackMasks masks;
+  return masks;
+}
+
+SIMD_TARGET("ssse3")
+static void unpackRow8SSSE3 (const uint8 *src, imgpel *comp0, imgpel *comp1, imgpel *comp2, int width)
+{
+  const UnpackMasks &masks = getUnpackMasks();
+  imgpel *comp[3] = { comp0, comp1, comp2 };
+  __m128i mask[3][3];
+  int i;
+  
+  for (int c = 0; c < 3; c++)
+    for (int r = 0; r < 3; r++)
+      mask[c][r] = _mm_loadu_si128((const __m128i *) masks.m_mask8[c][r]);
+  
+  for (i = 0; i + 16 <= width; i += 16, src += 48) {
+    __m128i in0 = _mm_loadu_si128((const __m128i *) (src     ));
+    __m128i in1 = _mm_loadu_si128((const __m128i *) (src + 16));
+    __m128i in2 = _mm_loadu_si128((const __m128i *) (src + 32));
+    for (int c = 0; c < 3; c++) {
+      __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in0, mask[c][0]), _mm_shuffle_epi8(in1, mask[c][1])), _mm_shuffle_epi8(in2, mask[c][2]));
+      _mm_storeu_si128((__m128i *) (comp[c] + i), out);
+    }
+  }
+  unpackRow8(src, comp0 + i, comp1 + i, comp2 + i, width - i);
+}
+
+SIMD_TARGET("ssse3")
+static void unpackRow16SSSE3 (const uint8 *src, uint16 *comp0, uint16 *comp1, uint16 *comp2, int width, bool swap)
+{
+  const UnpackMasks &masks = getUnpackMasks();
+  uint16 *comp[3] = { comp0, comp1, comp2 };
+  __m128i mask[3][3];
+  int i;
+  
+  for (int c = 0; c < 3; c++)
+    for (int r = 0; r < 3; r++)
+      mask[c][r] = _mm_loadu_si128((const __m128i *) masks.m_mask16[swap ? 1 : 0][c][r]);
+  
+  for (i = 0; i + 8 <= width; i += 8, src += 48) {
+    __m128i in0 = _mm_loadu_si128((const __m128i *) (src     ));
+    __m128i in1 = _mm_loadu_si128((const __m128i *) (src + 16));
+    __m128i in2 = _mm_loadu_si128((const __m128i *) (src + 32));
+    for (int c = 0; c < 3; c++) {
+      __m128i out = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(in0, mask[c][0]), _mm_shuffle_epi8(in1, mask[c][1])), _mm_shuffle_epi8(in2, mask[c][2]));
+      _mm_storeu_si128((__m128i *) (comp[c] + i), out);
+    }
+  }
+  unpackRow16(src, comp0 + i, comp1 + i, comp2 + i, width - i, swap);
+}
+#endif
+
 /*!
  ************************************************************************
  * \brief
@@ -204,7 +371,7 @@ void InputTIFF::getIntArray (Tiff * t, uint32 offset, TiffType type, uint32 a[],
   int    i;
   uint8  *mp = t->mp;                           // save memory pointer
   
-  t->mp = (uint8 *) &t->fileInMemory[offset];
+  t->mp = t->fileData + offset;
   
   switch (type)  {
     case T_SHORT:
@@ -296,15 +463,23 @@ int InputTIFF::readDirectoryEntry (Tiff * t)
         return 1;
       }
       break;
-    case 259:                           // Compression SHORT 1 or 32773
+    case 259:                           // Compression SHORT 1, 5, 8, 32773 or 32946
       assert( count == 1);
 #ifdef  __PRINT_INPUT_TIFF__
       printf( "259:  Compression         = %u\n", offsetData);
 #endif
-      if (offsetData != 1) {
-        fprintf( stderr, "Only uncompressed TIFF files supported. Format %d\n", offsetData );
+      t->Compression = (uint16) offsetData;
+#ifdef USEZLIB
+      if (offsetData != 1 && offsetData != 5 && offsetData != 32773 && offsetData != 8 && offsetData != 32946) {
+        fprintf( stderr, "Only uncompressed, LZW, PackBits or Deflate TIFF files supported. Format %d\n", offsetData );
+        return 1;
+      }
+#else
+      if (offsetData != 1 && offsetData != 5 && offsetData != 32773) {
+        fprintf( stderr, "Only uncompressed, LZW or PackBits TIFF files supported. Format %d\n", offsetData );
         return 1;
       }
+#endif
       break;
     case 262:                           // PhotometricInterpretation SHORT 2
       assert( count == 1);
@@ -314,6 +489,10 @@ int InputTIFF::readDirectoryEntry (Tiff * t)
       assert( offsetData == 2);
       break;
     case 273:                           // StripOffsets  SHORT or LONG
+      if (count > YRES) {
+        fprintf( stderr, "readDirectoryEntry:  StripOffsets (%d) exceeds builtin maximum of %d\n", count, YRES);
+        return 1;
+      }
       if (count == 1)
         t->StripOffsets[0] = offsetData;
       else
@@ -352,6 +531,10 @@ int InputTIFF::readDirectoryEntry (Tiff * t)
 #ifdef  __PRINT_INPUT_TIFF__
       printf( "279:  StripByteCounts[%u] = %u %d\n", count, offsetData, type);
 #endif
+      if (count > YRES) {
+        fprintf( stderr, "readDirectoryEntry:  StripByteCounts (%d) exceeds builtin maximum of %d\n", count, YRES);
+        return 1;
+      }
       if (count == 1)
         t->StripByteCounts[0] = offsetData;
       else
@@ -386,8 +569,19 @@ int InputTIFF::readDirectoryEntry (Tiff * t)
       break;
     case 305:                           // Software  ASCII
 #ifdef  __PRINT_INPUT_TIFF__
-      printf( "305:  Software            = %s\n", &t->fileInMemory[offset]);
+      printf( "305:  Software            = %s\n", t->fileData + offset);
+#endif
+      break;
+    case 317:                           // Predictor  SHORT 1 or 2
+      assert( count == 1);
+#ifdef  __PRINT_INPUT_TIFF__
+      printf( "317:  Predictor           = %u\n", offsetData);
 #endif
+      t->Predictor = (uint16) offsetData;
+      if (offsetData != 1 && offsetData != 2) {
+        fprintf( stderr, "Only Predictor 1 (none) or 2 (horizontal differencing) is supported. Predictor %d\n", offsetData );
+        return 1;
+      }
       break;
     case 339:                           // SampleFormat  SHORT 1
     default:
@@ -403,7 +597,8 @@ int InputTIFF::readDirectoryEntry (Tiff * t)
 /*!
  ************************************************************************
  * \brief
- *   Read file named 'path' into memory buffer 't->fileInMemory'.
+ *   Map the file into memory ('t->fileData'). If mapping is not available
+ *   the file is read into 't->fileInMemory' instead.
  *
  * \return
  *   0 if successful
@@ -411,41 +606,47 @@ int InputTIFF::readDirectoryEntry (Tiff * t)
  */
 int InputTIFF::readFileIntoMemory (Tiff * t, int *fd)
 {
-  long cnt, result;
+  int64 cnt;
   uint16 byteOrder;
   int endian = 1;
   int machineLittleEndian = (*( (char *)(&endian) ) == 1) ? 1 : 0;
   
   assert( t);
   
-  cnt = (long) lseek( *fd, 0, SEEK_END); // TIFF files by definition cannot exceed 2^32
-  if (cnt == -1L)
-    return 1;
+  releaseFile( t );
   
-  if (lseek( *fd, 0, SEEK_SET) == -1L)   // reposition file at beginning
+  cnt = (int64) lseek( *fd, 0, SEEK_END); // TIFF files by definition cannot exceed 2^32
+  if (cnt < 8)
     return 1;
   
-  t->fileInMemory.resize(cnt);
-  
-  // The following will never happen. So we can comment out this code
-  //if (&t->fileInMemory[0] == 0) {
-  //  if (*fd != -1) {
-  //    close( *fd);
-  //    *fd = -1;
-  //  }
-  //  return 1;
-  //}
-  
-  result = (long) mm_read( *fd, (char *) &t->fileInMemory[0], cnt);
-  if (result != cnt) {
-    if (*fd != - 1) {
-      close( *fd);
-      *fd = -1;
+#ifndef WIN32
+  void *mapping = mmap( NULL, (size_t) cnt, PROT_READ, MAP_PRIVATE, *fd, 0);
+  if (mapping != MAP_FAILED) {
+    madvise( mapping, (size_t) cnt, MADV_WILLNEED);
+    t->fileData = (uint8 *) mapping;
+    t->isMapped = TRUE;
+  }
+  else
+#endif
+  {
+    if (lseek( *fd, 0, SEEK_SET) == -1L)   // reposition file at beginning
+      return 1;
+    
+    t->fileInMemory.resize((size_t) cnt);
+    
+    if ((int64) mm_read( *fd, (char *) &t->fileInMemory[0], (unsigned int) cnt) != cnt) {
+      if (*fd != - 1) {
+        close( *fd);
+        *fd = -1;
+      }
+      return 1;
     }
-    return 1;
+    t->fileData = &t->fileInMemory[0];
+    t->isMapped = FALSE;
   }
+  t->fileSize = cnt;
   
-  byteOrder = (t->fileInMemory[0] << 8) | t->fileInMemory[1];
+  byteOrder = (t->fileData[0] << 8) | t->fileData[1];
   switch (byteOrder) {
     case 0x4949:                        // little endian file
       t->le = 1;
@@ -467,53 +668,166 @@ int InputTIFF::readFileIntoMemory (Tiff * t, int *fd)
     t->getU16 = getSwappedU16;
     t->getU32 = getSwappedU32;
   }
-  t->mp = (uint8 *) &t->fileInMemory[0];
+  t->mp = t->fileData;
   return 0;
 }
 
 /*!
  ************************************************************************
  * \brief
- *    Read image data into 't->img'.
+ *    Release the file mapping (or the in memory copy of the file).
+ ************************************************************************
+ */
+void InputTIFF::releaseFile (Tiff * t)
+{
+#ifndef WIN32
+  if (t->isMapped == TRUE && t->fileData != NULL)
+    munmap( t->fileData, (size_t) t->fileSize);
+#endif
+  t->fileData = NULL;
+  t->fileSize = 0;
+  t->isMapped = FALSE;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Check that the strip layout covers the image and lies within the file.
  *
+ * \return
+ *    0 if successful
  ************************************************************************
  */
-int InputTIFF::readImageData (Tiff * t)
+int InputTIFF::checkStrips (Tiff * t)
 {
-  int     i, j, n;
-  uint8  *mp, *s;
-  uint16 *p;
-  uint32  size;
-  
-  assert( t);
-  
-  size = t->ImageWidth * t->ImageLength * 3 * sizeof(uint16);
+  int rowsPerStrip = (t->RowsPerStrip == 0 || t->RowsPerStrip > t->ImageLength) ? (int) t->ImageLength : (int) t->RowsPerStrip;
+  int stripsNeeded = rowsPerStrip > 0 ? ((int) t->ImageLength + rowsPerStrip - 1) / rowsPerStrip : 0;
   
-  t->img.resize(size);
+  if (t->ImageWidth == 0 || t->ImageLength == 0 || t->nStrips < stripsNeeded) {
+    fprintf( stderr, "Invalid TIFF strip layout (%d strips for %d rows)\n", t->nStrips, t->ImageLength);
+    return 1;
+  }
+  for (int i = 0; i < stripsNeeded; ++i) {
+    if ((int64) t->StripOffsets[i] + (int64) t->StripByteCounts[i] > t->fileSize) {
+      fprintf( stderr, "TIFF strip %d exceeds the file size\n", i);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Decode all strips straight into planar component buffers (comp for
+ *    8 bit data, ui16Comp for 16 bit data), one strip per job.
+ *
+ * \return
+ *    0 if successful
+ ************************************************************************
+ */
+int InputTIFF::decodeStrips (Tiff * t, imgpel **comp, uint16 **ui16Comp)
+{
+  int   width          = (int) t->ImageWidth;
+  int   height         = (int) t->ImageLength;
+  int   bytesPerSample = (t->BitsPerSample[0] > 8) ? 2 : 1;
+  int64 rowBytes       = (int64) width * 3 * bytesPerSample;
+  int   rowsPerStrip   = (t->RowsPerStrip == 0 || t->RowsPerStrip > t->ImageLength) ? height : (int) t->RowsPerStrip;
+  int   nStrips        = (height + rowsPerStrip - 1) / rowsPerStrip;
+  bool  swap           = (t->getU16 != getU16) ? TRUE : FALSE;
+#if ENABLE_SIMD_DISPATCH
+  bool  useSSSE3       = CPUFeatures::hasSSSE3();
+#endif
+  std::atomic<int> damagedStrips(0);
+  
+  ThreadPool::parallelFor(nStrips, [&](int strip) {
+    static thread_local vector<uint8> scratch;
+    int   firstRow = strip * rowsPerStrip;
+    int   rows     = iMin(rowsPerStrip, height - firstRow);
+    int64 expected = rows * rowBytes;
+    int64 srcSize  = t->StripByteCounts[strip];
+    const uint8 *src = t->fileData + t->StripOffsets[strip];
+    int64 decoded = 0;
     
-  switch (t->BitsPerSample[0]) {
-    case 8:
-      p = (uint16 *) &t->img[0];
-      for (i=0; i < t->nStrips; ++i) {
-        n = t->StripByteCounts[i];
-        s = (uint8 *) &t->fileInMemory[t->StripOffsets[i]];
-        for (j=0; j < n; ++j) {
-          *p++ = *s++;
-        }
+    switch (t->Compression) {
+      case 5:
+        scratch.resize((size_t) expected);
+        decoded = TIFFCodec::lzwDecode(src, srcSize, &scratch[0], expected);
+        decoded = (decoded < 0) ? 0 : decoded;
+        src = &scratch[0];
+        break;
+      case 32773:
+        scratch.resize((size_t) expected);
+        decoded = unpackBits(src, srcSize, &scratch[0], expected);
+        src = &scratch[0];
+        break;
+#ifdef USEZLIB
+      case 8:
+      case 32946: {
+        uLongf length = (uLongf) expected;
+        scratch.resize((size_t) expected);
+        int result = uncompress(&scratch[0], &length, src, (uLong) srcSize);
+        decoded = (result == Z_OK || result == Z_BUF_ERROR) ? (int64) length : 0;
+        src = &scratch[0];
+        break;
       }
-      break;
-    case 16:
-      mp = t->mp;                       // save memory pointer
-      p = (uint16 *) &t->img[0];
-      for (i=0; i < t->nStrips; ++i) {
-        n = t->StripByteCounts[i] / 2;
-        t->mp = (uint8 *) &t->fileInMemory[t->StripOffsets[i]];
-        for (j=0; j < n; ++j) {
-          *p++ = (uint16) t->getU16( t);
+#endif
+      default:
+        decoded = (srcSize < expected) ? srcSize : expected;
+        break;
+    }
+    
+    int decodedRows = (int) (decoded / rowBytes);
+    if (decodedRows < rows)
+      damagedStrips++;
+    
+    bool swapRow = swap;
+    if (t->Predictor == 2 && decodedRows > 0) {
+      // undo the horizontal differencing on the sample values, leaving them in machine byte order
+      if (src != &scratch[0]) {
+        scratch.assign(src, src + decodedRows * rowBytes);
+        src = &scratch[0];
+      }
+      if (bytesPerSample == 2 && swap) {
+        for (int64 i = 0; i < decodedRows * rowBytes; i += 2)
+          std::swap(scratch[(size_t) i], scratch[(size_t) i + 1]);
+      }
+      TIFFCodec::removePredictor(&scratch[0], decodedRows, width, 3, bytesPerSample);
+      swapRow = FALSE;
+    }
+    
+    for (int y = firstRow; y < firstRow + rows; y++, src += rowBytes) {
+      int64 offset = (int64) y * width;
+      if (y - firstRow >= decodedRows) {
+        for (int c = 0; c < 3; c++) {
+          if (bytesPerSample == 1)
+            memset(comp[c] + offset, 0, width * sizeof(imgpel));
+          else
+            memset(ui16Comp[c] + offset, 0, width * sizeof(uint16));
         }
       }
-      t->mp = mp;                       // restore memory pointer
-      break;
+      else if (bytesPerSample == 1) {
+#if ENABLE_SIMD_DISPATCH
+        if (useSSSE3)
+          unpackRow8SSSE3(src, comp[0] + offset, comp[1] + offset, comp[2] + offset, width);
+        else
+#endif
+          unpackRow8(src, comp[0] + offset, comp[1] + offset, comp[2] + offset, width);
+      }
+      else {
+#if ENABLE_SIMD_DISPATCH
+        if (useSSSE3)
+          unpackRow16SSSE3(src, ui16Comp[0] + offset, ui16Comp[1] + offset, ui16Comp[2] + offset, width, swapRow);
+        else
+#endif
+          unpackRow16(src, ui16Comp[0] + offset, ui16Comp[1] + offset, ui16Comp[2] + offset, width, swapRow);
+      }
+    }
+  });
+  
+  if (damagedStrips > 0) {
+    fprintf( stderr, "Warning: %d TIFF strips could not be fully decoded. Missing rows were set to zero.\n", (int) damagedStrips);
+    return 1;
   }
   return 0;
 }
@@ -532,7 +846,8 @@ int InputTIFF::readImageFileDirectory (Tiff * t)
   uint16 nEntries = t->getU16( t);
   
   for (i=0; i < nEntries; ++i) {
-    readDirectoryEntry( t);
+    if (readDirectoryEntry( t))
+      return 1;
   }
   return 0;
 }
@@ -555,7 +870,7 @@ int InputTIFF::readImageFileHeader (Tiff * t)
     fprintf( stderr, "ImageFileHeader.arbitrary (%d) != 42\n", t->ifh.arbitraryNumber);
     return 1;
   }
-  t->mp = &t->fileInMemory[t->ifh.offset];
+  t->mp = t->fileData + t->ifh.offset;
   return 0;
 }
 
@@ -569,6 +884,12 @@ int InputTIFF::readImageFileHeader (Tiff * t)
 int InputTIFF::readTiff (FrameFormat *format, int *fd) {
   assert( &m_tiff);
   
+  // Tags that may be absent from the file take their default values
+  m_tiff.Compression  = 1;
+  m_tiff.Predictor    = 1;
+  m_tiff.RowsPerStrip = 0;
+  m_tiff.nStrips      = 0;
+  
   if (readFileIntoMemory( &m_tiff, fd))
     goto Error;
   
@@ -578,10 +899,13 @@ int InputTIFF::readTiff (FrameFormat *format, int *fd) {
   if (readImageFileDirectory( &m_tiff))
     goto Error;
   
+  if (checkStrips( &m_tiff))
+    goto Error;
+  
   allocateMemory(format);
   
-  if (readImageData( &m_tiff))
-    goto Error;
+  // Strips are decoded when the frame is copied, directly into the target frame if possible
+  m_dataDecoded = FALSE;
   
   return 1;
   
@@ -750,49 +1074,17 @@ int InputTIFF::readData (int vfile,  FrameFormat *source, uint8 *buf) {
   return 1;
 }
 
-int InputTIFF::reformatData () {
-  int i, k;
-  
-  if (m_tiff.BitsPerSample[0] == 8) {
-    imgpel *comp0 = NULL;
-    imgpel *comp1 = NULL;
-    imgpel *comp2 = NULL;
-    
-    uint16 *curBuf = (uint16 *) &m_tiff.img[0];
-    
-    // Unpack the data appropriately (interleaving is done at the row level).
-    for (k = 0; k < m_height[Y_COMP]; k++) {
-      comp0   = &m_comp[0][k * m_width[0]];
-      comp1   = &m_comp[1][k * m_width[1]];
-      comp2   = &m_comp[2][k * m_width[2]];
-      for (i = 0; i < m_width[0]; i++) {
-        *comp0++ = (imgpel) *curBuf++;
-        *comp1++ = (imgpel) *curBuf++;
-        *comp2++ = (imgpel) *curBuf++;
-      }
-    }
-  }
-  else {
-    uint16 *comp0 = NULL;
-    uint16 *comp1 = NULL;
-    uint16 *comp2 = NULL;
-    
-    uint16 *curBuf = (uint16 *) &m_tiff.img[0];
-    
-    // Unpack the data appropriately (interleaving is done at the row level).
-    for (k = 0; k < m_height[Y_COMP]; k++) {
-      comp0   = &m_ui16Comp[0][k * m_width[0]];
-      comp1   = &m_ui16Comp[1][k * m_width[1]];
-      comp2   = &m_ui16Comp[2][k * m_width[2]];
-      for (i = 0; i < m_width[0]; i++) {
-        *comp0++ = *curBuf++;
-        *comp1++ = *curBuf++;
-        *comp2++ = *curBuf++;
-      }
-    }
+/*!
+ ************************************************************************
+ * \brief
+ *    Decode the strips into the input buffers, if not already done.
+ ************************************************************************
+ */
+void InputTIFF::decodeData () {
+  if (m_dataDecoded == FALSE && m_tiff.fileData != NULL) {
+    decodeStrips( &m_tiff, m_comp, m_ui16Comp);
+    m_dataDecoded = TRUE;
   }
-  
-  return 1;
 }
 
 
@@ -823,8 +1115,8 @@ int InputTIFF::readOneFrame (IOVideo *inputFile, int frameNumber, int fileHeader
   if (openFrameFile( inputFile, frameNumber + frameSkip) != -1) {
     
     fileRead = readTiff( source, vfile);
-    reformatData ();
     
+    // the file mapping stays valid after the file is closed
     if (*vfile != -1) {
       close(*vfile);
       *vfile = -1;
@@ -835,6 +1127,29 @@ int InputTIFF::readOneFrame (IOVideo *inputFile, int frameNumber, int fileHeader
   else
     return 0;
 }
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Copy the current frame into frm. When frm is a 4:4:4 frame of the same
+ *    size and bit depth, the strips are decoded straight into its planes.
+ *    In that case the input buffers (m_comp/m_ui16Comp) are not written
+ *    and do not hold the current frame. m_dataDecoded stays FALSE, so any
+ *    later copy that needs them decodes the strips into them first.
+ ************************************************************************
+ */
+void InputTIFF::copyFrame (Frame *frm) {
+  bool direct = (m_dataDecoded == FALSE && m_tiff.fileData != NULL && frm->m_isFloat == FALSE && frm->m_chromaFormat == CF_444
+                 && frm->m_bitDepth == m_bitDepthComp[Y_COMP] && frm->m_width[Y_COMP] == m_width[Y_COMP] && frm->m_height[Y_COMP] == m_height[Y_COMP]) ? TRUE : FALSE;
+  
+  if (direct == TRUE) {
+    decodeStrips( &m_tiff, frm->m_comp, frm->m_ui16Comp);
+  }
+  else {
+    decodeData();
+    Input::copyFrame(frm);
+  }
+}
 //-----------------------------------------------------------------------------
 // End of file
 //-----------------------------------------------------------------------------
@@ -61,6 +61,9 @@
 // Macros/Defines
 //-----------------------------------------------------------------------------
 
+// Header lines are read in blocks of this many bytes
+#define Y4M_HEADER_BLOCK 256
+
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
@@ -70,8 +73,9 @@ InputY4M::InputY4M(IOVideo *inputFile, FrameFormat *format) {
   m_isFloat                   = FALSE;
   format->m_isFloat           = m_isFloat;
 
-  m_streamHeader.resize(256);
-  m_streamHeaderSize = 256;
+  m_streamHeader.resize(Y4M_HEADER_BLOCK + 1);
+  m_streamHeaderSize = Y4M_HEADER_BLOCK + 1;
+  m_indexBase = -1;
   readStreamHeader (inputFile,  format);
 
   m_colorSpace                = format->m_colorSpace;
@@ -389,91 +393,105 @@ void InputY4M::parseRatio (int *value0, int *value1,  char *taggedField) {
   }
 }
 
-int InputY4M::readStreamHeader (IOVideo *inputFile,  FrameFormat *format) {
-  int  vfile = inputFile->m_fileNum;
-  int  cCount = 0;
-  int  nCount = 0;
-  bool foundEOL = FALSE;
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads the header line starting at offset into m_streamHeader, a block
+ *    at a time. The terminating newline is replaced by a null character.
+ *
+ * \return
+ *    Size of the line in the file, including the newline, or 0 on failure
+ ************************************************************************
+ */
+int InputY4M::readHeaderLine (int vfile, int64 offset, const char *caller) {
+  int length = 0;
+  
+  if (lseek (vfile, offset, SEEK_SET) == -1)  {
+    printf ("%s: cannot lseek to header in input file\n", caller);
+    return 0;
+  }
+  
   while (1) {
-    if (foundEOL == TRUE) {
-      // end of reading
-      break;
-    }
-
-    cCount = 0;
-    nCount ++;
-    // read attribute name
-    while (1) {
-      if (mm_read(vfile, &m_streamHeader[cCount], sizeof(char)) != sizeof(char)) {
-        printf ("InputY4M::readStreamHeader: Unexpected end of file reached. Cannot read further!\n");
-        return 0;
-      }
-      else {
-        cCount++;
-        if (cCount > m_streamHeaderSize) {
-          m_streamHeaderSize += 256;
-          m_streamHeader.resize(m_streamHeaderSize);
-        }
-
-        if (m_streamHeader[cCount - 1] == '\n') {
-        // end of reading
-          inputFile->m_fileHeader = (int) tell((int) vfile);
-          foundEOL = TRUE;
-          break;
-        }
-
-        if (m_streamHeader[cCount - 1] == ' ') {
-          break;
-        }        
-      }
+    if (length + Y4M_HEADER_BLOCK + 1 > m_streamHeaderSize) {
+      m_streamHeaderSize += Y4M_HEADER_BLOCK;
+      m_streamHeader.resize(m_streamHeaderSize);
     }
     
-    if (cCount == 1) {
-      break;
-    }
-    if (nCount == 1 && strncmp(&m_streamHeader[0], "YUV4MPEG2", 9) != 0) {
-      printf("Magic String not found in stream header. Invalid file.\n");
+    int bytes = (int) mm_read(vfile, &m_streamHeader[length], Y4M_HEADER_BLOCK);
+    if (bytes <= 0) {
+      printf ("%s: Unexpected end of file reached. Cannot read further!\n", caller);
       return 0;
     }
-        
-    // Tagged field
+    
+    char *eol = (char *) memchr(&m_streamHeader[length], '\n', bytes);
+    if (eol != NULL) {
+      *eol = '\0';
+      return (int) (eol - &m_streamHeader[0]) + 1;
+    }
+    length += bytes;
+  }
+}
+
+int InputY4M::readStreamHeader (IOVideo *inputFile,  FrameFormat *format) {
+  int   vfile = inputFile->m_fileNum;
+  int64 start = tell((int) vfile);
+  int   headerSize = readHeaderLine(vfile, start, "InputY4M::readStreamHeader");
+  
+  if (headerSize == 0)
+    return 0;
+  
+  inputFile->m_fileHeader = (int) (start + headerSize);
+  
+  if (strncmp(&m_streamHeader[0], "YUV4MPEG2", 9) != 0) {
+    printf("Magic String not found in stream header. Invalid file.\n");
+    return 0;
+  }
+  
+  // Parameters are separated by single spaces
+  char *next = &m_streamHeader[0];
+  while (next != NULL) {
+    char *taggedField = next;
+    next = strchr(taggedField, ' ');
+    if (next != NULL)
+      *next++ = '\0';
+    
     // Width
-    if (strncmp(&m_streamHeader[0], "W", 1) == 0) {
-      format->m_width[Y_COMP] = atoi(&m_streamHeader[1]);
+    if (strncmp(taggedField, "W", 1) == 0) {
+      format->m_width[Y_COMP] = atoi(&taggedField[1]);
       continue;
     }
     // Height
-    if (strncmp(&m_streamHeader[0], "H", 1) == 0) {
-      format->m_height[Y_COMP] = atoi(&m_streamHeader[1]);
+    if (strncmp(taggedField, "H", 1) == 0) {
+      format->m_height[Y_COMP] = atoi(&taggedField[1]);
       continue;
     }
     // Chroma Subsampling
-    if (strncmp(&m_streamHeader[0], "C", 1) == 0) {
-      parseChromaSubsampling(format, &m_streamHeader[1]);
+    if (strncmp(taggedField, "C", 1) == 0) {
+      parseChromaSubsampling(format, &taggedField[1]);
       continue;
     }
     // Frame Rate
-    if (strncmp(&m_streamHeader[0], "F", 1) == 0) {
+    if (strncmp(taggedField, "F", 1) == 0) {
       int fps0, fps1;
-      parseRatio(&fps0, &fps1, &m_streamHeader[1]);
+      parseRatio(&fps0, &fps1, &taggedField[1]);
       format->m_frameRate = (float) (double(fps0) / double(fps1));
       continue;
     }
     // Aspect Ratio
-    if (strncmp(&m_streamHeader[0], "A", 1) == 0) {
+    if (strncmp(taggedField, "A", 1) == 0) {
       int asp0, asp1;
-      parseRatio(&asp0, &asp1, &m_streamHeader[1]);
+      parseRatio(&asp0, &asp1, &taggedField[1]);
       //printf("ratio %d:%d\n", asp0, asp1);
       continue;
     }
     // Interlace specification
-    if (strncmp(&m_streamHeader[0], "I", 1) == 0) {
-      parseInterlaceSpec(format, &m_streamHeader[1]);
+    if (strncmp(taggedField, "I", 1) == 0) {
+      parseInterlaceSpec(format, &taggedField[1]);
       continue;
     }
-
+    
     // Metadata
-    if (strncmp(&m_streamHeader[0], "X", 1) == 0) {
+    if (strncmp(taggedField, "X", 1) == 0) {
       continue;
     }
   }
@@ -481,66 +499,50 @@ int InputY4M::readStreamHeader (IOVideo *inputFile,  FrameFormat *format) {
   return 1;
 }
 
-int InputY4M::readFrameHeader (int vfile,  FrameFormat *format) {
-  int  cCount = 0;
-  int  nCount = 0;
-  bool foundEOL = FALSE;
-  while (1) {
-    if (foundEOL == TRUE) {
-      // end of reading
-      break;
-    }
-    
-    cCount = 0;
-    nCount ++;
-    // read attribute name
-    while (1) {
-      if (mm_read(vfile, &m_streamHeader[cCount], sizeof(char)) != sizeof(char)) {
-        printf ("InputY4M::readFrameHeader: Unexpected end of file reached. Cannot read further!\n");
-        return 0;
-      }
-      else {
-        cCount++;
-        if (cCount > m_streamHeaderSize) {
-          m_streamHeaderSize += 256;
-          m_streamHeader.resize(m_streamHeaderSize);
-        }
-        
-        if (m_streamHeader[cCount - 1] == '\n') {
-          // end of reading
-          
-          foundEOL = TRUE;
-          break;
-        }
-        
-        if (m_streamHeader[cCount - 1] == ' ') {
-          break;
-        }        
-      }
-    }
-    
-    if (cCount == 1) {
-      break;
-    }
-    if (nCount == 1 && strncmp(&m_streamHeader[0], "FRAME", 5) != 0) {
-      printf("Magic String not found in frame header. Invalid file.\n");
-      return 0;
-    }
-    
-    // Tagged field
-    // Interlace specification
-    if (strncmp(&m_streamHeader[0], "I", 1) == 0) {
-      // currently ignored
-      continue;
-    }
+/*!
+ ************************************************************************
+ * \brief
+ *    Reads the frame header starting at offset. Frame parameters (I, X)
+ *    are currently ignored.
+ *
+ * \return
+ *    Size of the frame header in bytes, or 0 on failure
+ ************************************************************************
+ */
+int InputY4M::readFrameHeader (int vfile, int64 offset) {
+  int headerSize = readHeaderLine(vfile, offset, "InputY4M::readFrameHeader");
+  
+  if (headerSize == 0)
+    return 0;
+  
+  if (strncmp(&m_streamHeader[0], "FRAME", 5) != 0 || (m_streamHeader[5] != '\0' && m_streamHeader[5] != ' ')) {
+    printf("Magic String not found in frame header. Invalid file.\n");
+    return 0;
+  }
+  
+  return headerSize;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Returns the file offset of the data of the given frame, or -1 if
+ *    the frame could not be found. Frame headers may differ in size, so
+ *    frames not yet in the index are located by walking the headers from
+ *    the last indexed frame.
+ ************************************************************************
+ */
+int64 InputY4M::findFrame (int vfile, int frame, int64 framesizeInBytes) {
+  while ((int) m_frameOffsets.size() <= frame) {
+    int64 headerOffset = m_frameOffsets.empty() ? m_indexBase : m_frameOffsets.back() + framesizeInBytes;
+    int headerSize = readFrameHeader (vfile, headerOffset);
     
-    // Metadata
-    if (strncmp(&m_streamHeader[0], "X", 1) == 0) {
-      continue;
-    }
+    if (headerSize == 0)
+      return -1;
+    m_frameOffsets.push_back(headerOffset + headerSize);
   }
   
-  return 1;
+  return m_frameOffsets[frame];
 }
 
 int InputY4M::readData (int vfile,  FrameFormat *source, uint8 *buf) {
@@ -672,15 +674,22 @@ int InputY4M::readOneFrame (IOVideo *inputFile, int frameNumber, int fileHeader,
   const int64 framesizeInBytes = getFrameSizeInBytes(format, inputFile->m_isInterleaved);
   bool isBytePacked = (bool) (inputFile->m_isInterleaved && (format->m_pixelFormat == PF_V210 || format->m_pixelFormat == PF_UYVY10)) ? TRUE : FALSE;
 
-  int frameHeader = 6;
+  // The index is relative to the first frame header
+  if (m_indexBase != fileHeader) {
+    m_indexBase = fileHeader;
+    m_frameOffsets.clear();
+  }
+  
+  int64 frameOffset = findFrame(vfile, frameNumber + frameSkip, framesizeInBytes);
+  if (frameOffset < 0)
+    return 0;
 
   // Let us seek directly to the current frame
-  if (lseek (vfile, fileHeader + (framesizeInBytes + frameHeader) * (frameNumber + frameSkip), SEEK_SET) == -1)  {
+  if (lseek (vfile, frameOffset, SEEK_SET) == -1)  {
     fprintf(stderr, "readOneFrame: cannot lseek to (Header size) in input file\n");
     exit(EXIT_FAILURE);
   }
   
-  readFrameHeader (vfile,  format);
   // Here we are at the correct position for the source frame in the file.  
   // Now read it.
 
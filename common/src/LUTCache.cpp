@@ -0,0 +1,325 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file LUTCache.cpp
+ *
+ * \brief
+ *    Process wide, reference counted, cache of sampled function tables, with optional
+ *    persistence in a cache file
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "LUTCache.H"
+#include <mutex>
+#include <string.h>
+#ifdef WIN32
+# define NOMINMAX
+# include <windows.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Macros
+//-----------------------------------------------------------------------------
+#define LUTCACHE_MAGIC      "HDRTLUT"
+#define LUTCACHE_VERSION    1
+#define LUTCACHE_ENDIAN     0x01020304
+#define LUTCACHE_MAX_KEY    4096
+#define LUTCACHE_MAX_SIZE   (1 << 24)   // Samples per table
+
+//-----------------------------------------------------------------------------
+// Local classes
+//-----------------------------------------------------------------------------
+
+struct LUTCacheEntry {
+  string          m_key;
+  uint32          m_bins;
+  uint32          m_elements;
+  LUTCache::Table m_table;
+  int             m_refCount;
+};
+
+struct LUTCacheState {
+  std::mutex              m_mutex;
+  vector<LUTCacheEntry *> m_entries;
+  string                  m_fileName;
+  bool                    m_dirty;
+  bool                    m_saveAtExit;
+  
+  LUTCacheState() : m_dirty(FALSE), m_saveAtExit(FALSE) {}
+  ~LUTCacheState() {
+    for (size_t i = 0; i < m_entries.size(); i++)
+      delete m_entries[i];
+  }
+};
+
+//-----------------------------------------------------------------------------
+// Local functions
+//-----------------------------------------------------------------------------
+
+static LUTCacheState &getState() {
+  static LUTCacheState state;
+  return state;
+}
+
+// 64 bit FNV-1a
+static void updateChecksum(uint64 *checksum, const void *data, size_t size) {
+  const uint8 *bytes = (const uint8 *) data;
+  for (size_t i = 0; i < size; i++) {
+    *checksum ^= bytes[i];
+    *checksum *= 0x100000001b3ULL;
+  }
+}
+
+static uint64 computeChecksum(const LUTCacheEntry *entry) {
+  uint64 checksum = 0xcbf29ce484222325ULL;
+  updateChecksum(&checksum, entry->m_key.data(), entry->m_key.size());
+  updateChecksum(&checksum, &entry->m_bins, sizeof(uint32));
+  updateChecksum(&checksum, &entry->m_elements, sizeof(uint32));
+  for (uint32 i = 0; i < entry->m_bins; i++)
+    updateChecksum(&checksum, &entry->m_table[i][0], entry->m_elements * sizeof(double));
+  return checksum;
+}
+
+// Compare a few samples of each bin (first, middle and last) with freshly generated ones. This
+// catches stale cache files, and keys that do not capture all the parameters of the function.
+static bool spotCheck(const LUTCacheEntry *entry, const LUTCache::Generator &generator) {
+  uint32 index[3] = { 0, entry->m_elements / 2, entry->m_elements - 1 };
+  for (uint32 i = 0; i < entry->m_bins; i++) {
+    for (int k = 0; k < 3; k++) {
+      double value = generator(i, index[k]);
+      if (memcmp(&value, &entry->m_table[i][index[k]], sizeof(double)) != 0)
+        return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+static bool readEntries(FILE *f, vector<LUTCacheEntry *> *entries) {
+  char   magic[8];
+  uint32 header[3];
+  if (fread(magic, 1, 8, f) != 8 || memcmp(magic, LUTCACHE_MAGIC, 8) != 0)
+    return FALSE;
+  if (fread(header, sizeof(uint32), 3, f) != 3 || header[0] != LUTCACHE_VERSION || header[1] != LUTCACHE_ENDIAN)
+    return FALSE;
+  
+  for (uint32 n = 0; n < header[2]; n++) {
+    uint32 keySize, dims[2];
+    uint64 checksum;
+    char   key[LUTCACHE_MAX_KEY];
+    if (fread(&keySize, sizeof(uint32), 1, f) != 1 || keySize > LUTCACHE_MAX_KEY || fread(key, 1, keySize, f) != keySize)
+      return FALSE;
+    if (fread(dims, sizeof(uint32), 2, f) != 2 || dims[0] == 0 || dims[1] == 0 || (uint64) dims[0] * dims[1] > LUTCACHE_MAX_SIZE)
+      return FALSE;
+    
+    LUTCacheEntry *entry = new LUTCacheEntry;
+    entries->push_back(entry);
+    entry->m_key.assign(key, keySize);
+    entry->m_bins     = dims[0];
+    entry->m_elements = dims[1];
+    entry->m_refCount = 0;
+    entry->m_table.resize(entry->m_bins);
+    for (uint32 i = 0; i < entry->m_bins; i++) {
+      entry->m_table[i].resize(entry->m_elements);
+      if (fread(&entry->m_table[i][0], sizeof(double), entry->m_elements, f) != entry->m_elements)
+        return FALSE;
+    }
+    if (fread(&checksum, sizeof(uint64), 1, f) != 1 || checksum != computeChecksum(entry))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static bool writeEntries(FILE *f, const vector<LUTCacheEntry *> &entries) {
+  uint32 header[3] = { LUTCACHE_VERSION, LUTCACHE_ENDIAN, (uint32) entries.size() };
+  bool   result = fwrite(LUTCACHE_MAGIC, 1, 8, f) == 8 && fwrite(header, sizeof(uint32), 3, f) == 3;
+  
+  for (size_t n = 0; n < entries.size() && result == TRUE; n++) {
+    const LUTCacheEntry *entry = entries[n];
+    uint32 keySize = (uint32) entry->m_key.size();
+    uint32 dims[2] = { entry->m_bins, entry->m_elements };
+    uint64 checksum = computeChecksum(entry);
+    result = fwrite(&keySize, sizeof(uint32), 1, f) == 1 && fwrite(entry->m_key.data(), 1, keySize, f) == keySize && fwrite(dims, sizeof(uint32), 2, f) == 2;
+    for (uint32 i = 0; i < entry->m_bins && result == TRUE; i++)
+      result = fwrite(&entry->m_table[i][0], sizeof(double), entry->m_elements, f) == entry->m_elements;
+    result = result && fwrite(&checksum, sizeof(uint64), 1, f) == 1;
+  }
+  return result;
+}
+
+// rename() does not replace an existing file on Windows, so use MoveFileEx() there
+static bool replaceFile(const string &source, const string &target) {
+#ifdef WIN32
+  return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  return rename(source.c_str(), target.c_str()) == 0;
+#endif
+}
+
+static void saveAtExit() {
+  LUTCache::save();
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+const LUTCache::Table *LUTCache::acquire(const string &key, uint32 bins, uint32 elements, const Generator &generator) {
+  LUTCacheState &state = getState();
+  std::lock_guard<std::mutex> lock(state.m_mutex);
+  
+  for (size_t n = 0; n < state.m_entries.size(); n++) {
+    LUTCacheEntry *entry = state.m_entries[n];
+    if (entry->m_key != key || entry->m_bins != bins || entry->m_elements != elements)
+      continue;
+    if (spotCheck(entry, generator) == TRUE) {
+      entry->m_refCount++;
+      return &entry->m_table;
+    }
+    if (entry->m_refCount == 0) {
+      // Stale (e.g. from a cache file written by a different version). Replace it.
+      delete entry;
+      state.m_entries.erase(state.m_entries.begin() + n);
+      state.m_dirty = TRUE;
+      n--;
+    }
+  }
+  
+  LUTCacheEntry *entry = new LUTCacheEntry;
+  entry->m_key      = key;
+  entry->m_bins     = bins;
+  entry->m_elements = elements;
+  entry->m_refCount = 1;
+  entry->m_table.resize(bins);
+  for (uint32 i = 0; i < bins; i++) {
+    entry->m_table[i].resize(elements);
+    for (uint32 j = 0; j < elements; j++)
+      entry->m_table[i][j] = generator(i, j);
+  }
+  state.m_entries.push_back(entry);
+  if (!state.m_fileName.empty())
+    state.m_dirty = TRUE;
+  
+  return &entry->m_table;
+}
+
+void LUTCache::release(const Table *table) {
+  LUTCacheState &state = getState();
+  std::lock_guard<std::mutex> lock(state.m_mutex);
+  
+  for (size_t n = 0; n < state.m_entries.size(); n++) {
+    LUTCacheEntry *entry = state.m_entries[n];
+    if (&entry->m_table == table) {
+      entry->m_refCount--;
+      // Unused tables are kept if they may still be saved
+      if (entry->m_refCount <= 0 && state.m_fileName.empty()) {
+        delete entry;
+        state.m_entries.erase(state.m_entries.begin() + n);
+      }
+      return;
+    }
+  }
+}
+
+void LUTCache::setCacheFile(const char *fileName) {
+  LUTCacheState &state = getState();
+  std::lock_guard<std::mutex> lock(state.m_mutex);
+  
+  state.m_fileName = fileName;
+  
+  FILE *f = fopen(fileName, "rb");
+  if (f != NULL) {
+    vector<LUTCacheEntry *> entries;
+    if (readEntries(f, &entries) == TRUE) {
+      state.m_entries.insert(state.m_entries.end(), entries.begin(), entries.end());
+    }
+    else {
+      fprintf(stderr, "Warning: Ignoring invalid LUT cache file %s.\n", fileName);
+      for (size_t n = 0; n < entries.size(); n++)
+        delete entries[n];
+      state.m_dirty = TRUE;
+    }
+    fclose(f);
+  }
+  
+  if (state.m_saveAtExit == FALSE) {
+    state.m_saveAtExit = TRUE;
+    atexit(saveAtExit);
+  }
+}
+
+bool LUTCache::save() {
+  LUTCacheState &state = getState();
+  std::lock_guard<std::mutex> lock(state.m_mutex);
+  
+  if (state.m_fileName.empty() || state.m_dirty == FALSE)
+    return TRUE;
+  
+  // Write to a temporary file first, so that concurrent runs never see a partial file.
+  // The name includes the process id, so that concurrent runs never share a temporary file.
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", (int) getpid());
+  string tempName = state.m_fileName + suffix;
+  FILE  *f = fopen(tempName.c_str(), "wb");
+  bool   result = (f != NULL) && writeEntries(f, state.m_entries);
+  if (f != NULL)
+    result = (fclose(f) == 0) && result;
+  if (result == TRUE)
+    result = replaceFile(tempName, state.m_fileName);
+  
+  if (result == FALSE) {
+    fprintf(stderr, "Warning: Could not write LUT cache file %s.\n", state.m_fileName.c_str());
+    remove(tempName.c_str());
+  }
+  else {
+    state.m_dirty = FALSE;
+  }
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
@@ -60,6 +60,7 @@
 #include "OutputY4M.H"
 #include "OutputYUV.H"
 #include "Global.H"
+#include "CPUFeatures.H"
 
 #include <stdlib.h>
 #include <string.h>
@@ -100,6 +101,149 @@ static uint32 setSwappedU16 (const char *&buf, uint16 in)
   return 2;
 }
 
+#if ENABLE_SIMD_DISPATCH
+//-----------------------------------------------------------------------------
+// SIMD pack kernels for the packed 10 and 16 bit formats. Each kernel
+// handles a leading part of the picture and returns how many samples (or
+// blocks) it consumed; the scalar loops below finish the remainder.
+//-----------------------------------------------------------------------------
+
+/*!
+ ************************************************************************
+ * \brief
+ *   Pack V210 blocks (6 luma and 3+3 chroma samples into 4 words). The
+ *   loads run a few samples past the block, so the last block of a
+ *   picture must be left to the scalar code.
+ ************************************************************************
+ */
+SIMD_TARGET("ssse3")
+static void packV210SSSE3 (uint8 *dst, const uint16 *y, const uint16 *cb, const uint16 *cr, int blocks)
+{
+  const __m128i mask = _mm_set1_epi32(0x3FF);
+  // Word fields, low to high: (Cb0, Y0, Cr0) (Y1, Cb1, Y2) (Cr1, Y3, Cb2) (Y4, Cr2, Y5)
+  const __m128i aLuma   = _mm_setr_epi8(-1, -1, -1, -1,  2,  3, -1, -1, -1, -1, -1, -1,  8,  9, -1, -1);
+  const __m128i aChroma = _mm_setr_epi8( 0,  1, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1, -1, -1, -1, -1);
+  const __m128i bLuma   = _mm_setr_epi8( 0,  1, -1, -1, -1, -1, -1, -1,  6,  7, -1, -1, -1, -1, -1, -1);
+  const __m128i bChroma = _mm_setr_epi8(-1, -1, -1, -1,  2,  3, -1, -1, -1, -1, -1, -1, 12, 13, -1, -1);
+  const __m128i cLuma   = _mm_setr_epi8(-1, -1, -1, -1,  4,  5, -1, -1, -1, -1, -1, -1, 10, 11, -1, -1);
+  const __m128i cChroma = _mm_setr_epi8( 8,  9, -1, -1, -1, -1, -1, -1,  4,  5, -1, -1, -1, -1, -1, -1);
+  
+  for (int k = 0; k < blocks; k++, dst += 16, y += 6, cb += 3, cr += 3) {
+    __m128i luma   = _mm_loadu_si128((const __m128i *) y);
+    __m128i chroma = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) cb), _mm_loadl_epi64((const __m128i *) cr));
+    __m128i a = _mm_and_si128(_mm_or_si128(_mm_shuffle_epi8(luma, aLuma), _mm_shuffle_epi8(chroma, aChroma)), mask);
+    __m128i b = _mm_and_si128(_mm_or_si128(_mm_shuffle_epi8(luma, bLuma), _mm_shuffle_epi8(chroma, bChroma)), mask);
+    __m128i c = _mm_and_si128(_mm_or_si128(_mm_shuffle_epi8(luma, cLuma), _mm_shuffle_epi8(chroma, cChroma)), mask);
+    _mm_storeu_si128((__m128i *) dst, _mm_or_si128(_mm_or_si128(a, _mm_slli_epi32(b, 10)), _mm_slli_epi32(c, 20)));
+  }
+}
+
+SIMD_TARGET("ssse3")
+static int packR10KSSSE3 (uint32 *dst, const uint16 *comp0, const uint16 *comp1, const uint16 *comp2, int size)
+{
+  const __m128i mask = _mm_set1_epi16(0x3FF);
+  const __m128i zero = _mm_setzero_si128();
+  int i;
+  
+  for (i = 0; i + 8 <= size; i += 8) {
+    __m128i c0 = _mm_and_si128(_mm_loadu_si128((const __m128i *) (comp0 + i)), mask);
+    __m128i c1 = _mm_and_si128(_mm_loadu_si128((const __m128i *) (comp1 + i)), mask);
+    __m128i c2 = _mm_and_si128(_mm_loadu_si128((const __m128i *) (comp2 + i)), mask);
+    __m128i lo = _mm_or_si128(_mm_or_si128(_mm_unpacklo_epi16(c1, zero), _mm_slli_epi32(_mm_unpacklo_epi16(c2, zero), 10)), _mm_slli_epi32(_mm_unpacklo_epi16(c0, zero), 20));
+    __m128i hi = _mm_or_si128(_mm_or_si128(_mm_unpackhi_epi16(c1, zero), _mm_slli_epi32(_mm_unpackhi_epi16(c2, zero), 10)), _mm_slli_epi32(_mm_unpackhi_epi16(c0, zero), 20));
+    _mm_storeu_si128((__m128i *) (dst + i    ), lo);
+    _mm_storeu_si128((__m128i *) (dst + i + 4), hi);
+  }
+  return i;
+}
+
+SIMD_TARGET("avx2")
+static int packR10KAVX2 (uint32 *dst, const uint16 *comp0, const uint16 *comp1, const uint16 *comp2, int size)
+{
+  const __m256i mask = _mm256_set1_epi32(0x3FF);
+  int i;
+  
+  for (i = 0; i + 8 <= size; i += 8) {
+    __m256i c0 = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (comp0 + i))), mask);
+    __m256i c1 = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (comp1 + i))), mask);
+    __m256i c2 = _mm256_and_si256(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (comp2 + i))), mask);
+    _mm256_storeu_si256((__m256i *) (dst + i), _mm256_or_si256(_mm256_or_si256(c1, _mm256_slli_epi32(c2, 10)), _mm256_slli_epi32(c0, 20)));
+  }
+  return i;
+}
+
+SIMD_TARGET("ssse3")
+static inline __m128i packR210Word (__m128i b, __m128i r, __m128i g)
+{
+  __m128i w = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(b, _mm_set1_epi32(0x0FF)), 24), _mm_slli_epi32(_mm_and_si128(g, _mm_set1_epi32(0x03F)), 18));
+  w = _mm_or_si128(w, _mm_or_si128(_mm_slli_epi32(_mm_and_si128(b, _mm_set1_epi32(0x300)),  8), _mm_slli_epi32(_mm_and_si128(r, _mm_set1_epi32(0x00F)), 12)));
+  return _mm_or_si128(w, _mm_or_si128(_mm_slli_epi32(_mm_and_si128(g, _mm_set1_epi32(0x3C0)),  2), _mm_srli_epi32(_mm_and_si128(r, _mm_set1_epi32(0x3F0)),  4)));
+}
+
+SIMD_TARGET("ssse3")
+static int packR210SSSE3 (uint32 *dst, const uint16 *comp0, const uint16 *comp1, const uint16 *comp2, int size)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int i;
+  
+  for (i = 0; i + 8 <= size; i += 8) {
+    __m128i c0 = _mm_loadu_si128((const __m128i *) (comp0 + i));
+    __m128i c1 = _mm_loadu_si128((const __m128i *) (comp1 + i));
+    __m128i c2 = _mm_loadu_si128((const __m128i *) (comp2 + i));
+    _mm_storeu_si128((__m128i *) (dst + i    ), packR210Word(_mm_unpacklo_epi16(c0, zero), _mm_unpacklo_epi16(c1, zero), _mm_unpacklo_epi16(c2, zero)));
+    _mm_storeu_si128((__m128i *) (dst + i + 4), packR210Word(_mm_unpackhi_epi16(c0, zero), _mm_unpackhi_epi16(c1, zero), _mm_unpackhi_epi16(c2, zero)));
+  }
+  return i;
+}
+
+SIMD_TARGET("avx2")
+static int packR210AVX2 (uint32 *dst, const uint16 *comp0, const uint16 *comp1, const uint16 *comp2, int size)
+{
+  int i;
+  
+  for (i = 0; i + 8 <= size; i += 8) {
+    __m256i b = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (comp0 + i)));
+    __m256i r = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (comp1 + i)));
+    __m256i g = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (comp2 + i)));
+    __m256i w = _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b, _mm256_set1_epi32(0x0FF)), 24), _mm256_slli_epi32(_mm256_and_si256(g, _mm256_set1_epi32(0x03F)), 18));
+    w = _mm256_or_si256(w, _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(b, _mm256_set1_epi32(0x300)),  8), _mm256_slli_epi32(_mm256_and_si256(r, _mm256_set1_epi32(0x00F)), 12)));
+    w = _mm256_or_si256(w, _mm256_or_si256(_mm256_slli_epi32(_mm256_and_si256(g, _mm256_set1_epi32(0x3C0)),  2), _mm256_srli_epi32(_mm256_and_si256(r, _mm256_set1_epi32(0x3F0)),  4)));
+    _mm256_storeu_si256((__m256i *) (dst + i), w);
+  }
+  return i;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *   Pack big endian b64a pixels (zero alpha, R = comp1, G = comp2,
+ *   B = comp0), 8 pixels per iteration.
+ ************************************************************************
+ */
+SIMD_TARGET("ssse3")
+static int packB64ASSSE3 (uint8 *dst, const uint16 *comp0, const uint16 *comp1, const uint16 *comp2, int size)
+{
+  const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  const __m128i zero = _mm_setzero_si128();
+  int i;
+  
+  for (i = 0; i + 8 <= size; i += 8, dst += 64) {
+    __m128i b  = _mm_loadu_si128((const __m128i *) (comp0 + i));
+    __m128i r  = _mm_loadu_si128((const __m128i *) (comp1 + i));
+    __m128i g  = _mm_loadu_si128((const __m128i *) (comp2 + i));
+    __m128i ar = _mm_unpacklo_epi16(zero, r);   // 0 R0 0 R1 0 R2 0 R3
+    __m128i gb = _mm_unpacklo_epi16(g, b);      // G0 B0 G1 B1 G2 B2 G3 B3
+    _mm_storeu_si128((__m128i *) (dst     ), _mm_shuffle_epi8(_mm_unpacklo_epi32(ar, gb), swap));
+    _mm_storeu_si128((__m128i *) (dst + 16), _mm_shuffle_epi8(_mm_unpackhi_epi32(ar, gb), swap));
+    ar = _mm_unpackhi_epi16(zero, r);
+    gb = _mm_unpackhi_epi16(g, b);
+    _mm_storeu_si128((__m128i *) (dst + 32), _mm_shuffle_epi8(_mm_unpacklo_epi32(ar, gb), swap));
+    _mm_storeu_si128((__m128i *) (dst + 48), _mm_shuffle_epi8(_mm_unpackhi_epi32(ar, gb), swap));
+  }
+  return i;
+}
+#endif
+
 
 void Output::reinterleaveYUV420(
   uint8** input,         //!< input buffer
@@ -311,7 +455,21 @@ void Output::reinterleaveV210(uint8** input,       //!< input buffer
   uint16 *ui16cmp1 = ui16cmp0 + source->m_compSize[Y_COMP];
   uint16 *ui16cmp2 = ui16cmp1 + source->m_compSize[U_COMP];
   
-  for (i = 0; i < source->m_compSize[Y_COMP]; i+= 6) {
+  i = 0;
+#if ENABLE_SIMD_DISPATCH
+  // The last block is always left to the scalar loop since the SIMD loads overrun their block
+  int blocks = (source->m_compSize[Y_COMP] + 5) / 6 - 1;
+  if (blocks > 0 && CPUFeatures::hasSSSE3()) {
+    packV210SSSE3((uint8 *) ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, blocks);
+    ui32cmp  += 4 * blocks;
+    ui16cmp0 += 6 * blocks;
+    ui16cmp1 += 3 * blocks;
+    ui16cmp2 += 3 * blocks;
+    i = 6 * blocks;
+  }
+#endif
+  
+  for (; i < source->m_compSize[Y_COMP]; i+= 6) {
     // Byte 3          Byte 2          Byte 1          Byte 0
     // Cr 0                Y 0                 Cb 0
     // X X 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0
@@ -386,7 +544,19 @@ void Output::reinterleaveR10K(uint8** input,       //!< input buffer
   uint16 *ui16cmp1 = ui16cmp0 + source->m_compSize[Y_COMP];
   uint16 *ui16cmp2 = ui16cmp1 + source->m_compSize[U_COMP];
   
-  for (i = 0; i < source->m_compSize[Y_COMP]; i++) {
+  i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = packR10KAVX2(ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+  else if (CPUFeatures::hasSSSE3())
+    i = packR10KSSSE3(ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+  ui32cmp  += i;
+  ui16cmp0 += i;
+  ui16cmp1 += i;
+  ui16cmp2 += i;
+#endif
+  
+  for (; i < source->m_compSize[Y_COMP]; i++) {
     // Byte 3          Byte 2          Byte 1          Byte 0
     // R                   G                   B 
     // 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 X X
@@ -427,7 +597,18 @@ void Output::reinterleaveB64A(uint8** input,       //!< input buffer
   uint16 *ui16cmp1 = ui16cmp0 + source->m_compSize[Y_COMP];
   uint16 *ui16cmp2 = ui16cmp1 + source->m_compSize[U_COMP];
   
-  for (i = 0; i < source->m_compSize[Y_COMP]; i++) {
+  i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (mSetU16 == setSwappedU16 && CPUFeatures::hasSSSE3()) {
+    i = packB64ASSSE3((uint8 *) ui8cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+    ui8cmp   += 8 * i;
+    ui16cmp0 += i;
+    ui16cmp1 += i;
+    ui16cmp2 += i;
+  }
+#endif
+  
+  for (; i < source->m_compSize[Y_COMP]; i++) {
     *((char *)ui8cmp++) = 0;
     *((char *)ui8cmp++) = 0;            // A
     mSetU16(ui8cmp, *ui16cmp1++);       // R
@@ -457,7 +638,19 @@ void Output::reinterleaveR210(uint8** input,       //!< input buffer
   uint16 *ui16cmp1 = ui16cmp0 + source->m_compSize[Y_COMP];
   uint16 *ui16cmp2 = ui16cmp1 + source->m_compSize[U_COMP];
   
-  for (i = 0; i < source->m_compSize[Y_COMP]; i++) {
+  i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = packR210AVX2(ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+  else if (CPUFeatures::hasSSSE3())
+    i = packR210SSSE3(ui32cmp, ui16cmp0, ui16cmp1, ui16cmp2, source->m_compSize[Y_COMP]);
+  ui32cmp  += i;
+  ui16cmp0 += i;
+  ui16cmp1 += i;
+  ui16cmp2 += i;
+#endif
+  
+  for (; i < source->m_compSize[Y_COMP]; i++) {
     // Byte 3          Byte 2          Byte 1          Byte 0
     // Blo             Glo         Bhi Rlo     Ghi     X X Rhi
     // 7 6 5 4 3 2 1 0 5 4 3 2 1 0 9 8 3 2 1 0 9 8 7 6 x x 9 8 7 6 5 4
@@ -59,6 +59,11 @@
 #include "OutputAVI.H"
 #include "Global.H"
 #include "IOFunctions.H"
+#include "ImgToBufBasic.H"
+
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
 
 //#define INFO_LIST
 //-----------------------------------------------------------------------------
@@ -66,6 +71,10 @@
 //-----------------------------------------------------------------------------
 #define PAD_EVEN(x) ( ((x)+1) & ~1 )
 
+static inline uint8 *alignBuffer(uint8 *buffer) {
+  return (uint8 *) (((size_t) buffer + AVI_BUFFER_ALIGNMENT - 1) & ~((size_t) AVI_BUFFER_ALIGNMENT - 1));
+}
+
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
@@ -131,11 +140,13 @@ OutputAVI::OutputAVI(IOVideo *outputFile, FrameFormat *format) {
 
   m_size = m_compSize[Y_COMP] + m_compSize[U_COMP] + m_compSize[V_COMP];
 
-  m_iBuffer.resize(3 * (unsigned int) m_size * m_picUnitSizeShift3);
-  m_buffer.resize (3 * (unsigned int) m_size * m_picUnitSizeShift3);
+  // Frames are formatted straight into these buffers and written out from there. Every frame
+  // overwrites the whole payload, so they only need to be cleared once, here.
+  m_iBuffer.resize(3 * (unsigned int) m_size * m_picUnitSizeShift3 + AVI_BUFFER_ALIGNMENT);
+  m_buffer.resize (3 * (unsigned int) m_size * m_picUnitSizeShift3 + AVI_BUFFER_ALIGNMENT);
   
-  m_iBuf = &m_iBuffer[0];
-  m_buf  = &m_buffer[0];
+  m_iBuf = alignBuffer(&m_iBuffer[0]);
+  m_buf  = alignBuffer(&m_buffer[0]);
 
   if (m_picUnitSizeShift3 > 1) {
     m_ui16Data.resize((unsigned int) m_size);
@@ -172,6 +183,19 @@ OutputAVI::OutputAVI(IOVideo *outputFile, FrameFormat *format) {
     return;
   }
   
+  // Size the idx1 and OpenDML standard indices for the frames of a full RIFF chunk (or of the
+  // whole sequence if shorter), so that they do not need to grow while writing.
+  m_numFrames    = iMax(outputFile->m_numFrames, 1);
+  int framesPerRiff = (int) (NEW_RIFF_THRES / (PAD_EVEN(getFrameSizeInBytes(format, m_isInterleaved)) + 8 + 8)) + 1;
+  m_indexEntries = (uint32) iMin(m_numFrames, framesPerRiff);
+  
+  m_avi->m_index = (aviIndexEntries *) malloc(m_indexEntries * sizeof(aviIndexEntries));
+  if (m_avi->m_index == NULL) {
+    m_errorNumber = AVI_ERR_NO_MEM;
+    return;
+  }
+  m_avi->m_maxIndex = m_indexEntries;
+  
   if(format->m_pixelFormat == PF_R210 || format->m_pixelFormat == PF_R10K || format->m_pixelFormat == PF_V410)
     m_headerBytes = (1 + format->m_width[Y_COMP]) * 4;
   else if (format->m_pixelFormat == PF_V210)
@@ -1332,18 +1356,32 @@ int OutputAVI::addChunk(unsigned char *tag, unsigned char *data, int length)
   unsigned char c[32];
   char p=0;
   
-  /* Copy tag and length into c, so that we need only 1 write system call
-   for these two values */
+  /* Copy tag and length into c */
   memcpy(c,tag,4);
   int32ToChar((char *) c + 4,length);
   
-  /* Output tag, length and data, restore previous position
-   if the write fails */
-
-  if( aviWrite(m_avi->m_fileNum,(char *)c, 8) != 8 ||
-      aviWrite(m_avi->m_fileNum,(char *)data, length) != length ||
-     aviWrite(m_avi->m_fileNum,&p,length&1) != (length&1)) // if len is uneven, write a pad byte
-  {
+  /* Output tag, length and data (and a pad byte if len is uneven) with a
+   single write system call, restore previous position if the write fails */
+#ifdef WIN32
+  bool failed = ( aviWrite(m_avi->m_fileNum,(char *)c, 8) != 8 ||
+                  aviWrite(m_avi->m_fileNum,(char *)data, length) != length ||
+                  aviWrite(m_avi->m_fileNum,&p,length&1) != (length&1)); // if len is uneven, write a pad byte
+#else
+  struct iovec iov[3];
+  
+  iov[0].iov_base = c;
+  iov[0].iov_len  = 8;
+  iov[1].iov_base = data;
+  iov[1].iov_len  = length;
+  iov[2].iov_base = &p;
+  iov[2].iov_len  = length & 1;
+  
+  bool failed = (writev(m_avi->m_fileNum, iov, (length & 1) ? 3 : 2) != (ssize_t) (8 + PAD_EVEN(length)));
+  if (failed)
+    printf ("addChunk: cannot write %d bytes to output file, unexpected error!\n", 8 + PAD_EVEN(length));
+#endif
+  
+  if (failed) {
     lseek(m_avi->m_fileNum, m_avi->m_pos,SEEK_SET);
     m_errorNumber = AVI_ERR_WRITE;
     return -1;
@@ -1414,7 +1452,8 @@ int OutputAVI::ixnnEntry(AVIStandardIndexChunk *ch, AVISuperIndexEntry *en)
 int OutputAVI::addStandardIndex(unsigned char *idxtag, unsigned char *strtag, AVIStandardIndexChunk *stdil)
 {
   memcpy (stdil->fcc, idxtag, 4);
-  stdil->dwSize = 4096;
+  // Room for the frames of a full RIFF chunk, or for the remaining ones if fewer
+  stdil->dwSize = (uint32) iMax(iMin((int) m_indexEntries, m_numFrames - m_avi->m_totalFrames), 1);
   stdil->wLongsPerEntry = 2;
   stdil->bIndexSubType = 0;
   stdil->bIndexType = AVI_INDEX_OF_CHUNKS;
@@ -1423,7 +1462,27 @@ int OutputAVI::addStandardIndex(unsigned char *idxtag, unsigned char *strtag, AV
   // cp 00db ChunkId
   memcpy(stdil->dwChunkId, strtag, 4);
   
-  stdil->m_aIndex = new AVIStandardIndexEntry[stdil->dwSize * stdil->wLongsPerEntry] ;
+  if (stdil->m_aIndex != NULL)
+    delete [] stdil->m_aIndex;
+  stdil->m_aIndex = new AVIStandardIndexEntry[stdil->dwSize];
+  
+  return 0;
+}
+
+// doubles the capacity of a standard index, keeping its entries
+int OutputAVI::growStandardIndex(AVIStandardIndexChunk *si)
+{
+  AVIStandardIndexEntry *aIndex = new AVIStandardIndexEntry[2 * si->dwSize];
+  
+  if (aIndex == NULL) {
+    m_errorNumber = AVI_ERR_NO_MEM;
+    return -1;
+  }
+  memcpy(aIndex, si->m_aIndex, si->dwSize * sizeof(AVIStandardIndexEntry));
+  delete [] si->m_aIndex;
+  
+  si->m_aIndex = aIndex;
+  si->dwSize  *= 2;
   
   return 0;
 }
@@ -1436,14 +1495,9 @@ int OutputAVI::addOdmlIndexEntryCore(long flags, int64_t pos, unsigned long len,
   si->nEntriesInUse++;
   cur_chunk_idx = si->nEntriesInUse-1;
   
-  // need to fetch more memory
-  if (cur_chunk_idx >= (int) si->dwSize) {
-    si->dwSize += 4096;
-    
-    if (si->m_aIndex != NULL)
-      delete si->m_aIndex;
-    si->m_aIndex = new  AVIStandardIndexEntry[ si->dwSize * si->wLongsPerEntry];
-  }
+  // need to fetch more memory (only if more frames than expected are written)
+  if (cur_chunk_idx >= (int) si->dwSize && growStandardIndex(si) < 0)
+    return -1;
   
   if(len > m_avi->m_maxLength)
     m_avi->m_maxLength = len;
@@ -1612,14 +1666,16 @@ int OutputAVI::addIndexEntry(unsigned char *tag, long flags, unsigned long pos,
 {
   void *ptr;
   
+  // The index is preallocated for the expected frames, grow it (by doubling) only if more are written
   if(m_avi->m_noIndex >= m_avi->m_maxIndex) {
-    ptr = realloc((void *)m_avi->m_index, (m_avi->m_maxIndex + 4096) * sizeof(aviIndexEntries));
+    long maxIndex = iMax(2 * m_avi->m_maxIndex, 4096);
+    ptr = realloc((void *)m_avi->m_index, maxIndex * sizeof(aviIndexEntries));
    
     if(ptr == 0) {
       m_errorNumber = AVI_ERR_NO_MEM;
       return -1;
     }
-    m_avi->m_maxIndex += 4096;
+    m_avi->m_maxIndex = maxIndex;
     m_avi->m_index = (aviIndexEntries *) ptr;
   }
   
@@ -1774,20 +1830,29 @@ int OutputAVI::writeOneFrame (IOVideo *outputFile, int frameNumber, int fileHead
   // Here we are at the correct position for the source frame in the file.
   // Now write it.
   
-  memset(m_buf, 0, (size_t) framesizeInBytes);
-  
   if ((format->m_picUnitSizeOnDisk & 0x07) == 0)  {
-    if (m_bitDepthComp[Y_COMP] == 8)
-      imageReformat ( m_buf, &m_data[0], format, m_picUnitSizeShift3 );
-    else
-      imageReformatUInt16 ( m_buf, format, m_picUnitSizeShift3 );
+    uint8 *frameData = NULL;
+    uint8 *iBuf = m_iBuf;
+    bool is8Bit = (m_bitDepthComp[Y_COMP] == 8);
+    
+    // Planar YCbCr data that are stored on disk as they are in memory do not need to be
+    // reformatted. They are interleaved or written straight from the frame planes.
+    if ((m_colorSpace != CM_RGB || m_chromaFormat != CF_444) && dynamic_cast<ImgToBufBasic *>(m_imgToBuf) != NULL &&
+        m_picUnitSizeShift3 == (is8Bit ? (int) sizeof(imgpel) : (int) sizeof(uint16))) {
+      frameData = is8Bit ? (uint8 *) &m_data[0] : (uint8 *) &m_ui16Data[0];
+    }
+    else {
+      if (is8Bit)
+        imageReformat ( m_buf, &m_data[0], format, m_picUnitSizeShift3 );
+      else
+        imageReformatUInt16 ( m_buf, format, m_picUnitSizeShift3 );
+      frameData = m_buf;
+    }
 
     // If format is interleaved, then perform reinterleaving
     //if ((format->m_chromaFormat != CF_420) || m_isInterleaved) {
     if (format->m_chromaFormat != CF_420) {
-      reFormat ( &m_buf, &m_iBuf, format, m_picUnitSizeShift3);
-    }
-    else {
+      reFormat ( &frameData, &iBuf, format, m_picUnitSizeShift3);
     }
     
     if(m_avi->m_mode==AVI_MODE_READ) {
@@ -1798,7 +1863,7 @@ int OutputAVI::writeOneFrame (IOVideo *outputFile, int frameNumber, int fileHead
     pos = m_avi->m_pos;
     int keyframe = 0;
     
-    if (writeData((char *) m_buf, (int) framesizeInBytes, 0, keyframe))
+    if (writeData((char *) frameData, (int) framesizeInBytes, 0, keyframe))
       return -1;
     
     m_avi->m_lastPosition = pos;
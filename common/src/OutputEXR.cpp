@@ -56,11 +56,21 @@
 #include "OutputEXR.H"
 #include "Global.H"
 #include "IOFunctions.H"
+#include "CPUFeatures.H"
+#include "ThreadPool.H"
+#include "EXRCodec.H"
+#include <atomic>
+
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
 
 //-----------------------------------------------------------------------------
 // Macros/Defines
 //-----------------------------------------------------------------------------
 
+// Maximum number of chunks handed to a single writev call
+#define EXR_WRITE_VECTORS 1024
 
 static uint16 floatToHalfTrunc (uint32 value)
 {
@@ -153,6 +163,81 @@ static uint16 floatToHalfRound(uint32 value)
   return *((uint16*) &o);
 }
 
+//-----------------------------------------------------------------------------
+// SIMD kernels
+//-----------------------------------------------------------------------------
+
+// Single to half precision conversion of count values, matching floatToHalfTrunc and
+// floatToHalfRound bit for bit. Return the number of values processed.
+#if ENABLE_SIMD_DISPATCH
+SIMD_TARGET("avx2")
+static inline __m256i floatToHalfTruncAVX2(__m256i x)
+{
+  __m256i sign = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(0x8000));
+  __m256i exp  = _mm256_and_si256(_mm256_srli_epi32(x, 23), _mm256_set1_epi32(0xff));
+  __m256i sig  = _mm256_srli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x7fffff)), 13);
+  __m256i inf  = _mm256_set1_epi32(0x7C00);
+  
+  __m256i h = _mm256_or_si256(_mm256_slli_epi32(_mm256_sub_epi32(exp, _mm256_set1_epi32(112)), 10), sig);
+  // underflow (including zeros and subnormals) to zero, overflow to infinity
+  h = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(113), exp), h);
+  h = _mm256_blendv_epi8(h, inf, _mm256_cmpgt_epi32(exp, _mm256_set1_epi32(142)));
+  // Inf/NaN keep the upper significand bits
+  h = _mm256_blendv_epi8(h, _mm256_or_si256(inf, sig), _mm256_cmpeq_epi32(exp, _mm256_set1_epi32(255)));
+  
+  return _mm256_or_si256(h, sign);
+}
+
+SIMD_TARGET("avx2")
+static inline __m256i floatToHalfRoundAVX2(__m256i x)
+{
+  __m256i one  = _mm256_set1_epi32(1);
+  __m256i sign = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(0x8000));
+  __m256i exp  = _mm256_and_si256(_mm256_srli_epi32(x, 23), _mm256_set1_epi32(0xff));
+  __m256i sig  = _mm256_and_si256(x, _mm256_set1_epi32(0x7fffff));
+  __m256i inf  = _mm256_set1_epi32(0x7C00);
+  
+  // normalized halfs, rounding may carry into the exponent
+  __m256i h = _mm256_or_si256(_mm256_slli_epi32(_mm256_sub_epi32(exp, _mm256_set1_epi32(112)), 10), _mm256_srli_epi32(sig, 13));
+  h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_srli_epi32(sig, 12), one));
+  
+  // subnormal halfs. Shifts of 32 or more give zero, which covers the zeros and all smaller values
+  __m256i mant  = _mm256_or_si256(sig, _mm256_set1_epi32(0x800000));
+  __m256i shift = _mm256_sub_epi32(_mm256_set1_epi32(126), exp);
+  __m256i sub   = _mm256_add_epi32(_mm256_srlv_epi32(mant, shift), _mm256_and_si256(_mm256_srlv_epi32(mant, _mm256_sub_epi32(shift, one)), one));
+  h = _mm256_blendv_epi8(h, sub, _mm256_cmpgt_epi32(_mm256_set1_epi32(113), exp));
+  
+  h = _mm256_blendv_epi8(h, inf, _mm256_cmpgt_epi32(exp, _mm256_set1_epi32(142)));
+  // NaN->qNaN and Inf->Inf
+  __m256i nan = _mm256_or_si256(inf, _mm256_andnot_si256(_mm256_cmpeq_epi32(sig, _mm256_setzero_si256()), _mm256_set1_epi32(0x200)));
+  h = _mm256_blendv_epi8(h, nan, _mm256_cmpeq_epi32(exp, _mm256_set1_epi32(255)));
+  
+  return _mm256_or_si256(h, sign);
+}
+
+SIMD_TARGET("avx2")
+static int floatToHalfAVX2(const uint32 *src, uint16 *dst, int count, bool round)
+{
+  int i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i a = _mm256_loadu_si256((const __m256i *) (src + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *) (src + i + 8));
+    if (round) {
+      a = floatToHalfRoundAVX2(a);
+      b = floatToHalfRoundAVX2(b);
+    }
+    else {
+      a = floatToHalfTruncAVX2(a);
+      b = floatToHalfTruncAVX2(b);
+    }
+    // packus works within 128 bit lanes, so restore the order afterwards
+    __m256i h = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+    _mm256_storeu_si256((__m256i *) (dst + i), h);
+  }
+  return i;
+}
+#endif
+
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
@@ -183,6 +268,24 @@ OutputEXR::OutputEXR(IOVideo *outputFile, FrameFormat *format) {
   m_floatComp[V_COMP] = NULL;
   
   m_offsetTableSize = 0;
+  
+  m_compression = format->m_exrCompression;
+#ifndef USEZLIB
+  if (m_compression == ZIPS_COMPRESSION || m_compression == ZIP_COMPRESSION) {
+    printf("OpenEXR ZIP compression requires zlib support. Using PIZ compression instead.\n");
+    m_compression = PIZ_COMPRESSION;
+  }
+#endif
+  // Lines per chunk are fixed by the compression method
+  if (m_compression == ZIP_COMPRESSION)
+    m_linesPerChunk = 16;
+  else if (m_compression == PIZ_COMPRESSION)
+    m_linesPerChunk = 32;
+  else
+    m_linesPerChunk = 1;
+  m_tileWidth  = format->m_exrTileWidth;
+  m_tileHeight = (format->m_exrTileHeight > 0) ? format->m_exrTileHeight : format->m_exrTileWidth;
+  m_tilesX     = 0;
 
   m_colorSpace       = format->m_colorSpace;
   m_colorPrimaries   = format->m_colorPrimaries;
@@ -193,7 +296,7 @@ OutputEXR::OutputEXR(IOVideo *outputFile, FrameFormat *format) {
   // set default values
   m_magicNumber  = 20000630;
   m_version      = 2;
-  m_isTile       = FALSE;
+  m_isTile       = (m_tileWidth > 0);
   m_hasLongNames = FALSE;
   m_hasDeepData  = FALSE;
   m_isMultipart  = FALSE;
@@ -210,7 +313,8 @@ OutputEXR::OutputEXR(IOVideo *outputFile, FrameFormat *format) {
   m_pixelType[V_COMP] = format->m_pixelType[V_COMP];
   m_pixelType[A_COMP] = format->m_pixelType[A_COMP];
   
-  if (format->m_useFloatRound)
+  m_useFloatRound = format->m_useFloatRound;
+  if (m_useFloatRound)
     floatToHalf = &floatToHalfRound;
   else
     floatToHalf = &floatToHalfTrunc;
@@ -367,12 +471,16 @@ void OutputEXR::allocateMemory(FrameFormat *format)
     m_channels[channel].ySampling = 1;
   }
   
-  if (m_channels[Y_COMP].pixelType == HALF)
-    m_buffer.resize((unsigned int) m_size * 2);
+  // Chunks are encoded directly from the frame planes
+  if (m_isTile) {
+    m_tilesX          = (m_width[Y_COMP] + m_tileWidth - 1) / m_tileWidth;
+    m_offsetTableSize = m_tilesX * ((m_height[Y_COMP] + m_tileHeight - 1) / m_tileHeight);
+  }
   else
-    m_buffer.resize((unsigned int) m_size * 4);
+    m_offsetTableSize = (m_height[Y_COMP] + m_linesPerChunk - 1) / m_linesPerChunk;
+  m_chunkData.resize(m_offsetTableSize);
   
-  m_buf               = &m_buffer[0];
+  m_buf               = NULL;
   m_comp[Y_COMP]      = NULL;
   m_comp[U_COMP]      = NULL;
   m_comp[V_COMP]      = NULL;
@@ -514,7 +622,7 @@ int OutputEXR::writeAttributeInfo( int vfile, FrameFormat *source)
   strcpy(m_type, "compression");
   m_attributeSize = 1; // m_attributeSize < m_valueVectorSize
 
-  m_value[0] = NO_COMPRESSION;
+  m_value[0] = (char) m_compression;
   cCount += writeAttributeAndType( vfile, m_name, m_type, m_attributeSize, &m_value[0]);
   nCount++;
 
@@ -526,7 +634,6 @@ int OutputEXR::writeAttributeInfo( int vfile, FrameFormat *source)
   *((int32 *) &m_value[4])  = m_dataWindow.yMin;
   *((int32 *) &m_value[8])  = m_dataWindow.xMax;
   *((int32 *) &m_value[12]) = m_dataWindow.yMax;
-  m_offsetTableSize = (m_dataWindow.yMax + 1);
   
   cCount += writeAttributeAndType( vfile, m_name, m_type, m_attributeSize, &m_value[0]);
   nCount++;
@@ -574,6 +681,18 @@ int OutputEXR::writeAttributeInfo( int vfile, FrameFormat *source)
   cCount += writeAttributeAndType( vfile, m_name, m_type, m_attributeSize, &m_value[0]);
   nCount++;
 
+  if (m_isTile) {
+    strcpy(m_name, "tiles");
+    strcpy(m_type, "tiledesc");
+    m_attributeSize = 9; // m_attributeSize < m_valueVectorSize
+    
+    *((uint32 *) &m_value[0]) = m_tileWidth;
+    *((uint32 *) &m_value[4]) = m_tileHeight;
+    m_value[8] = 0; // single resolution level (ONE_LEVEL, ROUND_DOWN)
+    cCount += writeAttributeAndType( vfile, m_name, m_type, m_attributeSize, &m_value[0]);
+    nCount++;
+  }
+
   *m_name = 0;
   strcpy(m_type, "");
   m_attributeSize = 0;
@@ -621,94 +740,185 @@ int OutputEXR::writeHeaderData( int vfile, FrameFormat *source)
       }
     }
     
-    int i;
-   
-    int curPos = (int) tell((int) vfile);
-    // create offset table and then write
-
-    m_offsetTable.resize(m_offsetTableSize);
-    
-    if (m_channels[Y_COMP].pixelType == HALF)
-      m_pixelDataSize = 2 * m_noChannels * m_width[Y_COMP];
-    else
-      m_pixelDataSize = 4 * m_noChannels * m_width[Y_COMP];
-
-    for (i = 0; i < m_offsetTableSize; i++) {
-      m_offsetTable[i] = m_offsetTableSize * sizeof(uint64) + i * (m_pixelDataSize + 2 * sizeof(int))+ curPos;
-      if (mm_write(vfile, (char *) &m_offsetTable[i], sizeof(uint64)) != sizeof(uint64)) {
-        printf ("cannot write m_offsetTable number to output file!\n");
-        return 0;
-      }
-    }
     return count;
   }
 }
 
-int OutputEXR::writeData (int vfile,  uint8 *buf) {
-  uint8 *curBuf = buf;
+/*!
+ ************************************************************************
+ * \brief
+ *    Convert count samples of a row to the output pixel type
+ ************************************************************************
+ */
+void OutputEXR::convertRow (const float *src, uint8 *dst, int count) {
+  if (m_channels[Y_COMP].pixelType != HALF) {
+    memcpy(dst, src, count * sizeof(float));
+    return;
+  }
+  
+  const uint32 *in  = (const uint32 *) src;
+  uint16       *out = (uint16 *) dst;
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2())
+    i = floatToHalfAVX2(in, out, count, m_useFloatRound);
+#endif
+  for (; i < count; i++)
+    out[i] = floatToHalf(in[i]);
+}
 
-  for (int i = 0; i < m_offsetTableSize; i++) {
-    lseek(vfile, m_offsetTable[i], SEEK_SET);
-    
-    m_yCoordinate = i;
-    if (mm_write(vfile, (char *) &m_yCoordinate, sizeof(int)) != sizeof(int)) {
-      printf ("cannot write m_yCoordinate to output file!\n");
-      return 0;
+/*!
+ ************************************************************************
+ * \brief
+ *    Convert and compress one chunk (a block of lines or a tile) into
+ *    m_chunkData, chunk header included. Data that do not compress are
+ *    stored uncompressed, as expected by the OpenEXR readers.
+ *
+ * \return
+ *   0 if successful
+ ************************************************************************
+ */
+int OutputEXR::encodeChunk (int chunk) {
+  static thread_local vector<uint8> raw;
+  int   component[4] = {V_COMP, U_COMP, Y_COMP, A_COMP};
+  int   sampleSize = (m_channels[Y_COMP].pixelType == HALF) ? 2 : 4;
+  int   headerSize = m_isTile ? 5 * sizeof(int32) : 2 * sizeof(int32);
+  int   tileX = 0, tileY = 0;
+  int   x0, y0, nx, ny;
+  
+  if (m_noChannels == 4) {
+    component[0] = A_COMP;
+    component[1] = B_COMP;
+    component[2] = G_COMP;
+    component[3] = R_COMP;
+  }
+  
+  if (m_isTile) {
+    tileX = chunk % m_tilesX;
+    tileY = chunk / m_tilesX;
+    x0 = tileX * m_tileWidth;
+    y0 = tileY * m_tileHeight;
+    nx = iMin(m_tileWidth,  m_width [Y_COMP] - x0);
+    ny = iMin(m_tileHeight, m_height[Y_COMP] - y0);
+  }
+  else {
+    x0 = 0;
+    y0 = chunk * m_linesPerChunk;
+    nx = m_width[Y_COMP];
+    ny = iMin(m_linesPerChunk, m_height[Y_COMP] - y0);
+  }
+  
+  int64 size = (int64) nx * ny * m_noChannels * sampleSize;
+  vector<uint8> &out = m_chunkData[chunk];
+  uint8 *dst;
+  
+  // uncompressed data go straight behind the chunk header
+  if (m_compression == NO_COMPRESSION) {
+    out.resize((size_t) (headerSize + size));
+    dst = &out[headerSize];
+  }
+  else {
+    out.resize(headerSize);
+    raw.resize((size_t) size);
+    dst = &raw[0];
+  }
+  
+  // Unpack the data appropriately (interleaving is done at the row level).
+  for (int k = y0; k < y0 + ny; k++) {
+    for (int j = 0; j < m_noChannels; j++) {
+      convertRow(&m_floatComp[component[j]][k * m_width[component[j]] + x0], dst, nx);
+      dst += nx * sampleSize;
     }
-
-    if (mm_write(vfile, (char *) &m_pixelDataSize, sizeof(int)) != sizeof(int)) {
-      printf ("cannot write m_pixelDataSize to output file!\n");
-      return 0;
+  }
+  
+  if (m_compression != NO_COMPRESSION) {
+    int64 length = 0;
+    
+    switch (m_compression) {
+      case RLE_COMPRESSION:
+        length = EXRCodec::rleCompress(&raw[0], size, out);
+        break;
+#ifdef USEZLIB
+      case ZIPS_COMPRESSION:
+      case ZIP_COMPRESSION:
+        length = EXRCodec::zipCompress(&raw[0], size, out);
+        break;
+#endif
+      case PIZ_COMPRESSION:
+        length = EXRCodec::pizCompress(&raw[0], nx, ny, m_noChannels, sampleSize >> 1, out);
+        break;
+      default:
+        return 1;
     }
     
-    if (mm_write(vfile, curBuf, m_pixelDataSize) != m_pixelDataSize) {
-      printf ("readData: cannot write %d bytes to output file!\n", m_pixelDataSize);
-      return 0;
+    if (length == 0 || length >= size) {
+      out.resize(headerSize);
+      out.insert(out.end(), raw.begin(), raw.begin() + (size_t) size);
     }
-    curBuf += m_pixelDataSize;
   }
-
-  return 1;
+  
+  int32 *header = (int32 *) &out[0];
+  if (m_isTile) {
+    header[0] = tileX;
+    header[1] = tileY;
+    header[2] = 0;        // level
+    header[3] = 0;
+    header[4] = (int32) (out.size() - headerSize);
+  }
+  else {
+    header[0] = y0 + m_dataWindow.yMin;
+    header[1] = (int32) (out.size() - headerSize);
+  }
+  
+  return 0;
 }
 
-int OutputEXR::reformatData (uint8 *buf,  float  *floatComp[3]) {
-  int i, j, k;
-  int component[4] = {V_COMP, U_COMP, Y_COMP, A_COMP};
-  uint32 *comp = NULL;
+/*!
+ ************************************************************************
+ * \brief
+ *    Write the offset table and all chunks behind the header
+ ************************************************************************
+ */
+int OutputEXR::writeData (int vfile) {
+  int64 offset = (int64) tell(vfile) + m_offsetTableSize * sizeof(uint64);
   
+  m_offsetTable.resize(m_offsetTableSize);
+  for (int i = 0; i < m_offsetTableSize; i++) {
+    m_offsetTable[i] = offset;
+    offset += (int64) m_chunkData[i].size();
+  }
   
-  if (m_noChannels == 4) {
-    component[0] = A_COMP;
-    component[1] = B_COMP;
-    component[2] = G_COMP;
-    component[3] = R_COMP;
+  int tableSize = m_offsetTableSize * (int) sizeof(uint64);
+  if (mm_write(vfile, (char *) &m_offsetTable[0], tableSize) != tableSize) {
+    printf ("cannot write m_offsetTable number to output file!\n");
+    return 0;
   }
   
-  if (m_channels[Y_COMP].pixelType == HALF) {
-    uint16 *curBuf = (uint16 *) buf;
-    // Unpack the data appropriately (interleaving is done at the row level).
-    for (k = 0; k < m_height[Y_COMP]; k++) {
-      for (j = 0; j < m_noChannels; j++) {
-        comp   = (uint32 *) &floatComp[component[j]][k * m_width[component[j]]];
-        for (i = 0; i < m_width[component[j]]; i++) {
-          // Convert data from single precision to half.
-          *curBuf++ = floatToHalf(*comp++);
-        }
-      }
+#ifdef WIN32
+  for (int i = 0; i < m_offsetTableSize; i++) {
+    int size = (int) m_chunkData[i].size();
+    if (mm_write(vfile, (char *) &m_chunkData[i][0], size) != size) {
+      printf ("writeData: cannot write %d bytes to output file!\n", size);
+      return 0;
     }
   }
-  else {
-    uint32 *curBuf = (uint32 *) buf;
-
-    for (k = 0; k < m_height[Y_COMP]; k++) {
-      for (j = 0; j < m_noChannels; j++) {
-        comp   = (uint32 *) &floatComp[component[j]][k * m_width[component[j]]];
-        for (i = 0; i < m_width[component[j]]; i++) {
-          *curBuf++ = *comp++;
-        }
-      }
+#else
+  struct iovec iov[EXR_WRITE_VECTORS];
+  
+  for (int i = 0; i < m_offsetTableSize; i += EXR_WRITE_VECTORS) {
+    int     nVectors = iMin(EXR_WRITE_VECTORS, m_offsetTableSize - i);
+    ssize_t size = 0;
+    for (int j = 0; j < nVectors; j++) {
+      iov[j].iov_base = &m_chunkData[i + j][0];
+      iov[j].iov_len  = m_chunkData[i + j].size();
+      size += (ssize_t) iov[j].iov_len;
+    }
+    if (writev(vfile, iov, nVectors) != size) {
+      printf ("writeData: cannot write %lld bytes to output file!\n", (long long) size);
+      return 0;
     }
   }
+#endif
   
   return 1;
 }
@@ -751,9 +961,17 @@ int OutputEXR::writeOneFrame (IOVideo *outputFile, int frameNumber, int fileHead
     allocateMemory(format);
   }
 
-  reformatData (m_buf,  m_floatComp);
+  // Chunks are independent, so they are converted and compressed in parallel
+  std::atomic<int> failedChunks(0);
+  ThreadPool::parallelFor(m_offsetTableSize, [&](int chunk) {
+    if (encodeChunk(chunk) != 0)
+      failedChunks++;
+  });
   
-  fileWrite = writeData (*vfile, m_buf);
+  if (failedChunks > 0)
+    fprintf(stderr, "Could not encode %d OpenEXR chunks.\n", (int) failedChunks);
+  else
+    fileWrite = writeData (*vfile);
   
   
   if (*vfile != -1) {
@@ -60,11 +60,99 @@
 #include "OutputTIFF.H"
 #include "Global.H"
 #include "IOFunctions.H"
+#include "CPUFeatures.H"
+#include "ThreadPool.H"
+#include "TIFFCodec.H"
+#include <atomic>
+#include <algorithm>
+
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
+
+#ifdef USEZLIB
+#include <zlib.h>
+#endif
 
 //-----------------------------------------------------------------------------
 // Macros/Defines
 //-----------------------------------------------------------------------------
 
+// Approximate amount of image data encoded before it is handed to the file
+#define TIFF_STRIP_BYTES (1 << 20)
+// Approximate (uncompressed) size of a compressed strip. Strips are compressed in parallel.
+#define TIFF_COMPRESSED_STRIP_BYTES (1 << 18)
+// Space reserved in front of the image data for the headers (and the strip tables, if any)
+#define TIFF_HEADER_SIZE 256
+
+//-----------------------------------------------------------------------------
+// SIMD kernels
+//-----------------------------------------------------------------------------
+
+// Interleaves three planes of count samples into chunky (RGBRGB...) order. Samples are
+// elementSize (1 or 2) bytes wide and are byte swapped if requested. Returns the number of
+// samples processed.
+#if ENABLE_SIMD_DISPATCH
+SIMD_TARGET("ssse3")
+static int interleaveSSSE3(const uint8 *src0, const uint8 *src1, const uint8 *src2, uint8 *dst, int count, int elementSize, bool swap)
+{
+  // byte p of output register o takes a byte from plane c, or zero (0x80)
+  __m128i masks[3][3];
+  for (int o = 0; o < 3; o++) {
+    for (int c = 0; c < 3; c++) {
+      uint8 mask[16];
+      for (int p = 0; p < 16; p++) {
+        int q     = 16 * o + p;
+        int b     = q % elementSize;
+        int pixel = q / (3 * elementSize);
+        mask[p] = ((q / elementSize) % 3 == c) ? (uint8) (pixel * elementSize + (swap ? elementSize - 1 - b : b)) : 0x80;
+      }
+      masks[o][c] = _mm_loadu_si128((const __m128i *) mask);
+    }
+  }
+  
+  int step = 16 / elementSize;
+  int i = 0;
+  for (; i + step <= count; i += step, dst += 48) {
+    __m128i a = _mm_loadu_si128((const __m128i *) (src0 + i * elementSize));
+    __m128i b = _mm_loadu_si128((const __m128i *) (src1 + i * elementSize));
+    __m128i c = _mm_loadu_si128((const __m128i *) (src2 + i * elementSize));
+    for (int o = 0; o < 3; o++) {
+      __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, masks[o][0]), _mm_shuffle_epi8(b, masks[o][1])), _mm_shuffle_epi8(c, masks[o][2]));
+      _mm_storeu_si128((__m128i *) (dst + 16 * o), v);
+    }
+  }
+  return i;
+}
+#endif
+
+static void interleave(const uint8 *src0, const uint8 *src1, const uint8 *src2, uint8 *dst, int count, int elementSize, bool swap)
+{
+  const uint8 *src[3] = { src0, src1, src2 };
+  int i = 0;
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasSSSE3()) {
+    i = interleaveSSSE3(src0, src1, src2, dst, count, elementSize, swap);
+    dst += 3 * i * elementSize;
+  }
+#endif
+  for (; i < count; i++) {
+    for (int c = 0; c < 3; c++) {
+      const uint8 *s = src[c] + i * elementSize;
+      if (elementSize == 1)
+        *dst++ = s[0];
+      else if (swap == FALSE) {
+        *dst++ = s[0];
+        *dst++ = s[1];
+      }
+      else {
+        *dst++ = s[1];
+        *dst++ = s[0];
+      }
+    }
+  }
+}
+
 
 //-----------------------------------------------------------------------------
 // Constructor/destructor
@@ -79,6 +167,20 @@ OutputTIFF::OutputTIFF(IOVideo *videoFile, FrameFormat *format) {
   
   m_memoryAllocated = FALSE;
   
+  m_tiff.Compression = (uint16) format->m_tiffCompression;
+  if (m_tiff.Compression != 1 && m_tiff.Compression != 5 && m_tiff.Compression != 8) {
+    fprintf(stderr, "Unsupported TIFF compression %d. Writing uncompressed TIFF files.\n", m_tiff.Compression);
+    m_tiff.Compression = 1;
+  }
+#ifndef USEZLIB
+  if (m_tiff.Compression == 8) {
+    fprintf(stderr, "Deflate compressed TIFF output requires zlib support. Using LZW instead.\n");
+    m_tiff.Compression = 5;
+  }
+#endif
+  // horizontal differencing is only applied to compressed strips
+  m_tiff.Predictor = (m_tiff.Compression == 1 || format->m_tiffPredictor == 1) ? 1 : 2;
+  
   m_comp[Y_COMP]      = NULL;
   m_comp[U_COMP]      = NULL;
   m_comp[V_COMP]      = NULL;
@@ -281,8 +383,9 @@ uint32 OutputTIFF::writeDirectoryEntry (Tiff * t, uint32 tag, TiffType type, uin
       byteCounter += t->setU32( t, offset);
       break;
     case 273:                           // StripOffsets  SHORT or LONG
-      assert( count == 1);
       byteCounter += t->setU32( t, offset);
+      if (count > 1)
+        setIntArray( t, offset, type, t->StripOffsets, count);
       break;
     case 274:                           // Orientation  SHORT
       assert( count == 1);
@@ -297,8 +400,9 @@ uint32 OutputTIFF::writeDirectoryEntry (Tiff * t, uint32 tag, TiffType type, uin
       byteCounter += t->setU32( t, offset);
       break;
     case 279:                           // StripByteCounts LONG or SHORT
-      assert( count == 1);
       byteCounter += t->setU32( t, offset);
+      if (count > 1)
+        setIntArray( t, offset, type, t->StripByteCounts, count);
       break;
     case 282:                           // XResolution  RATIONAL
       assert( count == 1);
@@ -322,6 +426,10 @@ uint32 OutputTIFF::writeDirectoryEntry (Tiff * t, uint32 tag, TiffType type, uin
     case 305:                           // Software  ASCII
                                         // Not supported
       break;
+    case 317:                           // Predictor  SHORT 1 or 2
+      assert( count == 1);
+      byteCounter += t->setU32( t, offset);
+      break;
     case 339:                           // SampleFormat  SHORT 1
     default:
       // Not supported
@@ -334,31 +442,126 @@ uint32 OutputTIFF::writeDirectoryEntry (Tiff * t, uint32 tag, TiffType type, uin
 /*!
  ************************************************************************
  * \brief
- *   Write writeFileFromMemory into file named 'path' into memory buffer 't->fileInMemory'.
+ *   Write dataSize bytes of image data at the given file offset. If
+ *   headerSize is not zero, header is written right in front of the data
+ *   with the same call.
  *
  * \return
  *   0 if successful
  ************************************************************************
  */
-int OutputTIFF::writeFileFromMemory (Tiff * t, int *fd, uint32 counter)
+int OutputTIFF::writeStrip (int fd, int64 offset, uint8 *header, uint32 headerSize, uint8 *data, uint32 dataSize)
 {
-  long result;
+#ifdef WIN32
+  // No pwritev here. The file is written front to back, so sequential writes end up at offset.
+  if (headerSize != 0 && (uint32) mm_write( fd, (char *) header, headerSize) != headerSize)
+    return 1;
+  if ((uint32) mm_write( fd, (char *) data, dataSize) != dataSize)
+    return 1;
+#else
+  struct iovec iov[2];
+  int nVectors = 0;
   
-  assert( t);
+  if (headerSize != 0) {
+    iov[nVectors].iov_base = header;
+    iov[nVectors++].iov_len = headerSize;
+  }
+  iov[nVectors].iov_base = data;
+  iov[nVectors++].iov_len = dataSize;
   
-  //if (lseek( fd, 0, SEEK_SET) == -1L)   // reposition file at beginning
-  //return 1;
+  if (pwritev( fd, iov, nVectors, (off_t) (offset - headerSize)) != (ssize_t) (headerSize + dataSize))
+    return 1;
+#endif
   
+  return 0;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Interleave rows [firstRow, firstRow + rows) of the frame planes into
+ *    dst, in the sample order of the file. 16 bit samples are byte
+ *    swapped if requested.
+ *
+ ************************************************************************
+ */
+void OutputTIFF::encodeRows (Tiff * t, uint8 *dst, int firstRow, int rows, bool swap)
+{
+  int  elementSize = (t->BitsPerSample[0] == 8) ? 1 : 2;
+  int  rowBytes = 3 * m_width[Y_COMP] * elementSize;
   
-  result = (long) mm_write ( *fd, (char *) &t->fileInMemory[0], counter);
-  if (result != counter) {
-    if (*fd != -1) {
-      close( *fd);
-      *fd = -1;
+  for (int k = firstRow; k < firstRow + rows; k++, dst += rowBytes) {
+    if (elementSize == 1)
+      interleave(&m_comp[0][k * m_width[0]], &m_comp[1][k * m_width[1]], &m_comp[2][k * m_width[2]], dst, m_width[0], 1, swap);
+    else
+      interleave((uint8 *) &m_ui16Comp[0][k * m_width[0]], (uint8 *) &m_ui16Comp[1][k * m_width[1]], (uint8 *) &m_ui16Comp[2][k * m_width[2]], dst, m_width[0], 2, swap);
+  }
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Encode (horizontal differencing) and compress all strips, one strip
+ *    per job, and place them behind the headers and strip tables.
+ *
+ * \return
+ *   0 if successful
+ ************************************************************************
+ */
+int OutputTIFF::compressStrips (Tiff * t)
+{
+  int   bytesPerSample = (t->BitsPerSample[0] == 8) ? 1 : 2;
+  bool  swap = (bytesPerSample == 2 && t->setU16 != setU16);
+  int64 rowBytes = 3 * (int64) m_width[Y_COMP] * bytesPerSample;
+  std::atomic<int> failedStrips(0);
+  
+  ThreadPool::parallelFor(t->nStrips, [&](int strip) {
+    static thread_local vector<uint8> raw;
+    int   firstRow = strip * (int) t->RowsPerStrip;
+    int   rows     = iMin((int) t->RowsPerStrip, m_height[Y_COMP] - firstRow);
+    int64 size     = rows * rowBytes;
+    vector<uint8> &out = m_stripData[strip];
+    
+    // the predictor works on sample values, so bytes are swapped (if needed) afterwards
+    raw.resize((size_t) size);
+    encodeRows(t, &raw[0], firstRow, rows, FALSE);
+    if (t->Predictor == 2)
+      TIFFCodec::applyPredictor(&raw[0], rows, m_width[Y_COMP], 3, bytesPerSample);
+    if (swap) {
+      for (int64 i = 0; i < size; i += 2)
+        std::swap(raw[(size_t) i], raw[(size_t) i + 1]);
     }
+    
+    if (t->Compression == 5) {
+      out.resize((size_t) TIFFCodec::lzwBound(size));
+      out.resize((size_t) TIFFCodec::lzwEncode(&raw[0], size, &out[0]));
+    }
+#ifdef USEZLIB
+    else {
+      uLongf length = compressBound((uLong) size);
+      out.resize((size_t) length);
+      if (compress2(&out[0], &length, &raw[0], (uLong) size, Z_DEFAULT_COMPRESSION) != Z_OK)
+        failedStrips++;
+      out.resize((size_t) length);
+    }
+#endif
+  });
+  
+  if (failedStrips > 0) {
+    fprintf(stderr, "Could not compress %d TIFF strips.\n", (int) failedStrips);
     return 1;
   }
   
+  int64 offset = (int64) t->fileInMemory.size();
+  for (int i = 0; i < t->nStrips; i++) {
+    t->StripOffsets[i]    = (uint32) offset;
+    t->StripByteCounts[i] = (uint32) m_stripData[i].size();
+    offset += (int64) m_stripData[i].size();
+  }
+  if (offset > (int64) 0xFFFFFFFF) {
+    fprintf(stderr, "TIFF file size exceeds 4GB.\n");
+    return 1;
+  }
   
   return 0;
 }
@@ -366,48 +569,45 @@ int OutputTIFF::writeFileFromMemory (Tiff * t, int *fd, uint32 counter)
 /*!
  ************************************************************************
  * \brief
- *    Read image data into 't->img'.
+ *    Write the image data behind the headers kept in 't->fileInMemory'.
+ *    Uncompressed data are encoded straight from the frame planes and
+ *    written a few rows at a time. Compressed strips come from
+ *    compressStrips().
  *
+ * \return
+ *   0 if successful
  ************************************************************************
  */
-uint32 OutputTIFF::writeImageData (Tiff * t)
+int OutputTIFF::writeImageData (Tiff * t, int *fd)
 {
-  int     i, j, n;
-  uint8  *mp, *s;
-  uint16 *p;
-  uint32 byteCounter = 0;
+  uint32 headerSize = (uint32) t->fileInMemory.size();
+  int    result = 0;
   
-  switch (t->BitsPerSample[0]) {
-    case 8:
-      p = (uint16 *) &t->img[0];
-      for (i=0; i < t->nStrips; ++i) {
-        n = t->StripByteCounts[i];
-        s = (uint8 *) &t->fileInMemory[t->StripOffsets[i]];
-        byteCounter += n;
-        for (j=0; j < n; ++j) {
-          *s++ = (uint8) *p++;
-        }
-        if (maxFramePosition < (int64) s)
-          maxFramePosition = (int64) s;
-      }
-      break;
-    case 16:
-      mp = t->mp;                       // save memory pointer
-      p = (uint16 *) &t->img[0];
-      for (i=0; i < t->nStrips; ++i) {
-        n = t->StripByteCounts[i] / 2;
-        t->mp = (uint8 *) &t->fileInMemory[t->StripOffsets[i]];
-        for (j=0; j < n; ++j) {
-          byteCounter += t->setU16( t, *p++);
-        }
-      }
-      if (maxFramePosition < (int64) t->mp)
-        maxFramePosition = (int64) t->mp;
+  if (t->Compression != 1) {
+    for (int i = 0; i < t->nStrips && result == 0; i++) {
+      result = writeStrip(*fd, t->StripOffsets[i], &t->fileInMemory[0], (i == 0) ? headerSize : 0, &m_stripData[i][0], t->StripByteCounts[i]);
+    }
+  }
+  else {
+    int    bytesPerSample = (t->BitsPerSample[0] == 8) ? 1 : 2;
+    int    rowBytes = 3 * m_width[Y_COMP] * bytesPerSample;
+    bool   swap = (bytesPerSample == 2 && t->setU16 != setU16);
+    int64  offset = t->StripOffsets[0];
+    
+    for (int row = 0; row < m_height[Y_COMP] && result == 0; row += m_stripRows) {
+      int rows = iMin(m_stripRows, m_height[Y_COMP] - row);
       
-      t->mp = mp;                       // restore memory pointer
-      break;
+      encodeRows(t, &m_stripBuffer[0], row, rows, swap);
+      result = writeStrip(*fd, offset, &t->fileInMemory[0], (row == 0) ? headerSize : 0, &m_stripBuffer[0], rows * rowBytes);
+      offset += (int64) rows * rowBytes;
+    }
   }
-  return byteCounter;
+  
+  if (result != 0 && *fd != -1) {
+    close( *fd);
+    *fd = -1;
+  }
+  return result;
 }
 
 
@@ -421,23 +621,33 @@ uint32 OutputTIFF::writeImageData (Tiff * t)
 uint32 OutputTIFF::writeImageFileDirectory (Tiff * t)
 {
   uint32 count = 0;
-  uint32 nEntries = 10; // Currently lets add all entries (trim later)
+  bool   compressed = (t->Compression != 1);
+  uint32 nEntries = compressed ? 12 : 10; // Currently lets add all entries (trim later)
   count += t->setU16( t, nEntries);
   
   // Do not modify below entries. Only a limited set of options are supported at this point
   count += writeDirectoryEntry( t, 256, T_SHORT, 1, t->ImageWidth);  // ImageWidth
   count += writeDirectoryEntry( t, 257, T_SHORT, 1, t->ImageLength); // ImageLength
   count += writeDirectoryEntry( t, 258, T_SHORT, 3, 8); // bitdepth
-  count += writeDirectoryEntry( t, 259, T_SHORT, 1, 1); // compression
+  count += writeDirectoryEntry( t, 259, T_SHORT, 1, t->Compression); // compression
   count += writeDirectoryEntry( t, 262, T_SHORT, 1, 2); // PhotometricInterpretation
-  count += writeDirectoryEntry( t, 273, T_SHORT, t->nStrips, t->StripOffsets[0]); // StripOffsets
+  if (compressed) // the strip tables directly follow the headers
+    count += writeDirectoryEntry( t, 273, T_LONG, t->nStrips, t->nStrips == 1 ? t->StripOffsets[0] : TIFF_HEADER_SIZE); // StripOffsets
+  else
+    count += writeDirectoryEntry( t, 273, T_SHORT, t->nStrips, t->StripOffsets[0]); // StripOffsets
   count += writeDirectoryEntry( t, 274, T_SHORT, 1, (uint32) t->Orientation); // Orientation
   count += writeDirectoryEntry( t, 277, T_SHORT, 1, 3); // SamplesPerPixel
-                                                        // count += writeDirectoryEntry( t, 278, T_SHORT, 1, t->RowsPerStrip); // RowsPerStrip
-  count += writeDirectoryEntry( t, 279, T_LONG, 1, t->StripByteCounts[0]); // StripByteCounts
+  if (compressed)
+    count += writeDirectoryEntry( t, 278, T_LONG, 1, t->RowsPerStrip); // RowsPerStrip
+  if (compressed)
+    count += writeDirectoryEntry( t, 279, T_LONG, t->nStrips, t->nStrips == 1 ? t->StripByteCounts[0] : TIFF_HEADER_SIZE + 4 * t->nStrips); // StripByteCounts
+  else
+    count += writeDirectoryEntry( t, 279, T_LONG, 1, t->StripByteCounts[0]); // StripByteCounts
                                                                            // count += writeDirectoryEntry( t, 282, T_RATIONAL, 1, 0); // XResolution
                                                                            // count += writeDirectoryEntry( t, 283, T_RATIONAL, 1, 0); // YResolution
   count += writeDirectoryEntry( t, 284, T_SHORT, 1, 1); // PlanarConfiguration
+  if (compressed)
+    count += writeDirectoryEntry( t, 317, T_SHORT, 1, t->Predictor); // Predictor
                                                         // count += writeDirectoryEntry( t, 296, T_SHORT, 1, 1); // ResolutionUnit
                                                         // count += writeDirectoryEntry( t, 305, T_ASCII, 1, 1); // Software
                                                         // count += writeDirectoryEntry( t, 339, T_SHORT, 1, 1); // Unforseen
@@ -490,11 +700,14 @@ int OutputTIFF::writeTiff (FrameFormat *format, int *fd) {
     allocateMemory(format);
   }
   
+  // strip sizes, and hence the directory, are only known after compression
+  if (m_tiff.Compression != 1 && compressStrips( &m_tiff))
+    goto Error;
+  
   writeImageFileHeader( &m_tiff);
   writeImageFileDirectory( &m_tiff);
-  writeImageData( &m_tiff);
   
-  if (writeFileFromMemory( &m_tiff, fd, (uint32) (maxFramePosition - (int64) &m_tiff.fileInMemory[0])))
+  if (writeImageData( &m_tiff, fd))
     goto Error;
   
   return 1;
@@ -622,14 +835,11 @@ void OutputTIFF::allocateMemory(FrameFormat *format)
   // init size of file based on image data to write (without headers
   m_tiffSize = m_size * (m_tiff.BitsPerSample[Y_COMP] > 8 ? 2 : 1);
   
-  //uint32  size;
-  //assert( t);
-  //size = t->ImageWidth * t->ImageLength * 3 * sizeof(uint16);
-  
-  // memory buffer for the image data
-  m_tiff.img.resize((unsigned int) m_tiffSize);
-  // Assign a rather large buffer
-  m_tiff.fileInMemory.resize((long) m_size * 4);
+  // uncompressed image data are encoded a few rows at a time, straight from the frame planes
+  int rowBytes = 3 * m_width[Y_COMP] * (m_tiff.BitsPerSample[Y_COMP] > 8 ? 2 : 1);
+  m_stripRows = iMax(1, iMin(m_height[Y_COMP], TIFF_STRIP_BYTES / iMax(1, rowBytes)));
+  if (m_tiff.Compression == 1)
+    m_stripBuffer.resize((size_t) m_stripRows * rowBytes);
   
   if (format->m_bitDepthComp[Y_COMP] == 8) {
     m_data.resize((unsigned int) m_size);
@@ -670,13 +880,27 @@ void OutputTIFF::allocateMemory(FrameFormat *format)
     m_tiff.setU16 = setSwappedU16;
     m_tiff.setU32 = setSwappedU32;
   }
-  m_tiff.mp = (uint8 *) &m_tiff.fileInMemory[0];
-  
-  m_tiff.nStrips = 1;
-  m_tiff.StripOffsets[0] = 256;
-  m_tiff.StripByteCounts[0] = (uint32) m_tiffSize;
   m_tiff.Orientation = 1;
-  m_tiff.RowsPerStrip = m_height[Y_COMP];
+  if (m_tiff.Compression == 1) {
+    m_tiff.nStrips = 1;
+    m_tiff.StripOffsets[0] = TIFF_HEADER_SIZE;
+    m_tiff.StripByteCounts[0] = (uint32) m_tiffSize;
+    m_tiff.RowsPerStrip = m_height[Y_COMP];
+    
+    // only the headers, which precede the image data, are kept in memory
+    m_tiff.fileInMemory.resize(TIFF_HEADER_SIZE);
+  }
+  else {
+    // strips are compressed independently. Their offset and size tables follow the headers.
+    int rowsPerStrip = iMax(1, iMin(m_height[Y_COMP], TIFF_COMPRESSED_STRIP_BYTES / iMax(1, rowBytes)));
+    rowsPerStrip = iMax(rowsPerStrip, (m_height[Y_COMP] + YRES - 1) / YRES);
+    m_tiff.RowsPerStrip = rowsPerStrip;
+    m_tiff.nStrips = (m_height[Y_COMP] + rowsPerStrip - 1) / rowsPerStrip;
+    m_stripData.resize(m_tiff.nStrips);
+    
+    m_tiff.fileInMemory.resize(TIFF_HEADER_SIZE + 8 * m_tiff.nStrips);
+  }
+  m_tiff.mp = (uint8 *) &m_tiff.fileInMemory[0];
   
 }
 
@@ -718,51 +942,6 @@ int OutputTIFF::writeData (int vfile,  FrameFormat *source, uint8 *buf) {
   return 1;
 }
 
-int OutputTIFF::reformatData () {
-  int i, k;
-  
-  if (m_tiff.BitsPerSample[0] == 8) {
-    imgpel *comp0 = NULL;
-    imgpel *comp1 = NULL;
-    imgpel *comp2 = NULL;
-    
-    uint16 *curBuf = (uint16 *) &m_tiff.img[0];
-    
-    // Unpack the data appropriately (interleaving is done at the row level).
-    for (k = 0; k < m_height[Y_COMP]; k++) {
-      comp0   = &m_comp[0][k * m_width[0]];
-      comp1   = &m_comp[1][k * m_width[1]];
-      comp2   = &m_comp[2][k * m_width[2]];
-      for (i = 0; i < m_width[0]; i++) {
-        *curBuf++ = *comp0++;
-        *curBuf++ = *comp1++;
-        *curBuf++ = *comp2++;
-      }
-    }
-  }
-  else {
-    uint16 *comp0 = NULL;
-    uint16 *comp1 = NULL;
-    uint16 *comp2 = NULL;
-    
-    uint16 *curBuf = (uint16 *) &m_tiff.img[0];
-    
-    // Unpack the data appropriately (interleaving is done at the row level).
-    for (k = 0; k < m_height[Y_COMP]; k++) {
-      comp0   = &m_ui16Comp[0][k * m_width[0]];
-      comp1   = &m_ui16Comp[1][k * m_width[1]];
-      comp2   = &m_ui16Comp[2][k * m_width[2]];
-      for (i = 0; i < m_width[0]; i++) {
-        *curBuf++ = *comp0++;
-        *curBuf++ = *comp1++;
-        *curBuf++ = *comp2++;
-      }
-    }
-  }
-  return 1;
-}
-
-
 //-----------------------------------------------------------------------------
 // Public methods
 //-----------------------------------------------------------------------------
@@ -787,7 +966,6 @@ int OutputTIFF::writeOneFrame (IOVideo *outputFile, int frameNumber, int fileHea
   int *vfile = &outputFile->m_fileNum;
   FrameFormat *format = &outputFile->m_format;
   openFrameFile( outputFile, frameNumber + frameSkip);
-  reformatData ();
   
   fileWrite = writeTiff( format, vfile);
   
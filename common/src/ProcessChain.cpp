@@ -0,0 +1,226 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file ProcessChain.cpp
+ *
+ * \brief
+ *    Sequence of per sample frame processing stages, with identity stages skipped
+ *    and (optionally) runs of linear stages folded into a single affine pass
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "Global.H"
+#include "ProcessChain.H"
+
+//-----------------------------------------------------------------------------
+// Local functions
+//-----------------------------------------------------------------------------
+
+// A folded transform mixing components needs 4:4:4 data (see AffineTransform::process())
+static bool isFoldable(const Frame *out, const AffineTransform *affine) {
+  if (out == NULL || out->m_isFloat == FALSE)
+    return FALSE;
+  
+  return affine->isDiagonal() == TRUE || out->m_compSize[Y_COMP] == out->m_compSize[U_COMP];
+}
+
+//-----------------------------------------------------------------------------
+// Constructor/destructor
+//-----------------------------------------------------------------------------
+
+ProcessChain::ProcessChain(bool foldLinear) {
+  m_foldLinear = foldLinear;
+}
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+void ProcessChain::addStage(StageType type, Frame *out, ColorTransform *colorTransform, TransferFunction *transferFunction, DisplayGammaAdjust *displayAdjust) {
+  Stage stage;
+  stage.m_type             = type;
+  stage.m_out              = out;
+  stage.m_colorTransform   = colorTransform;
+  stage.m_transferFunction = transferFunction;
+  stage.m_displayAdjust    = displayAdjust;
+  stage.m_isLinear         = FALSE;
+  
+  m_stages.push_back(stage);
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+void ProcessChain::addColorTransform(ColorTransform *colorTransform, Frame *out) {
+  addStage(ST_COLOR_TRANSFORM, out, colorTransform, NULL, NULL);
+}
+
+void ProcessChain::addForward(TransferFunction *transferFunction, Frame *out) {
+  addStage(ST_TF_FORWARD, out, NULL, transferFunction, NULL);
+}
+
+void ProcessChain::addInverse(TransferFunction *transferFunction, Frame *out) {
+  addStage(ST_TF_INVERSE, out, NULL, transferFunction, NULL);
+}
+
+void ProcessChain::addForward(DisplayGammaAdjust *displayAdjust) {
+  addStage(ST_DISPLAY_FORWARD, NULL, NULL, NULL, displayAdjust);
+}
+
+void ProcessChain::addInverse(DisplayGammaAdjust *displayAdjust) {
+  addStage(ST_DISPLAY_INVERSE, NULL, NULL, NULL, displayAdjust);
+}
+
+void ProcessChain::plan() {
+  for (size_t i = 0; i < m_stages.size(); i++) {
+    Stage *stage = &m_stages[i];
+    double scale = 1.0;
+    
+    switch (stage->m_type) {
+      case ST_COLOR_TRANSFORM:
+        stage->m_isLinear = stage->m_colorTransform->getAffineTransform(&stage->m_affine);
+        break;
+      case ST_TF_FORWARD:
+        stage->m_isLinear = stage->m_transferFunction->getForwardScale(&scale);
+        stage->m_affine.setScale(scale);
+        break;
+      case ST_TF_INVERSE:
+        stage->m_isLinear = stage->m_transferFunction->getInverseScale(&scale);
+        stage->m_affine.setScale(scale);
+        break;
+      case ST_DISPLAY_FORWARD:
+      case ST_DISPLAY_INVERSE:
+        stage->m_isLinear = stage->m_displayAdjust->isIdentity();
+        stage->m_affine.setIdentity();
+        break;
+      default:
+        stage->m_isLinear = FALSE;
+        break;
+    }
+  }
+  
+  m_plan.clear();
+  size_t i = 0;
+  while (i < m_stages.size()) {
+    Stage *stage = &m_stages[i];
+    if (stage->m_isLinear == TRUE && stage->m_affine.isIdentity() == TRUE) {
+      // Nothing to do. The next stage reads the input of this one.
+      i++;
+      continue;
+    }
+    if (m_foldLinear == FALSE || stage->m_isLinear == FALSE || isFoldable(stage->m_out, &stage->m_affine) == FALSE) {
+      m_plan.push_back(*stage);
+      i++;
+      continue;
+    }
+    
+    // Compose the linear stages that follow into this one, for as long as the
+    // result can still be applied in a single pass.
+    Stage folded = *stage;
+    int   count  = 1;
+    size_t j;
+    for (j = i + 1; j < m_stages.size() && m_stages[j].m_isLinear == TRUE; j++) {
+      AffineTransform affine = folded.m_affine;
+      Frame *out = m_stages[j].m_out != NULL ? m_stages[j].m_out : folded.m_out;
+      if (affine.append(&m_stages[j].m_affine) == FALSE || isFoldable(out, &affine) == FALSE)
+        break;
+      folded.m_affine = affine;
+      folded.m_out    = out;
+      if (m_stages[j].m_affine.isIdentity() == FALSE)
+        count++;
+    }
+    
+    if (count > 1) {
+      folded.m_type = ST_AFFINE;
+      m_plan.push_back(folded);
+    }
+    else {
+      // Only identities were skipped. Keep the original stage (and its exact results).
+      m_plan.push_back(*stage);
+    }
+    i = j;
+  }
+}
+
+Frame *ProcessChain::process(Frame *inp) {
+  Frame *frame = inp;
+  
+  for (size_t i = 0; i < m_plan.size(); i++) {
+    Stage *stage = &m_plan[i];
+    switch (stage->m_type) {
+      case ST_COLOR_TRANSFORM:
+        stage->m_colorTransform->process(stage->m_out, frame);
+        frame = stage->m_out;
+        break;
+      case ST_TF_FORWARD:
+        stage->m_transferFunction->forward(stage->m_out, frame);
+        frame = stage->m_out;
+        break;
+      case ST_TF_INVERSE:
+        stage->m_transferFunction->inverse(stage->m_out, frame);
+        frame = stage->m_out;
+        break;
+      case ST_DISPLAY_FORWARD:
+        stage->m_displayAdjust->forward(frame);
+        break;
+      case ST_DISPLAY_INVERSE:
+        stage->m_displayAdjust->inverse(frame);
+        break;
+      case ST_AFFINE:
+        stage->m_affine.process(stage->m_out, frame);
+        frame = stage->m_out;
+        break;
+    }
+  }
+  
+  return frame;
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
@@ -0,0 +1,297 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file TIFFCodec.cpp
+ *
+ * \brief
+ *    TIFF LZW codec and horizontal differencing predictor
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "TIFFCodec.H"
+#include <string.h>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Macros/Defines
+//-----------------------------------------------------------------------------
+
+#define LZW_CLEAR       256
+#define LZW_EOI         257
+#define LZW_FIRST       258
+#define LZW_MIN_BITS      9
+#define LZW_MAX_BITS     12
+#define LZW_MAX_CODE   4095    // (1 << LZW_MAX_BITS) - 1
+#define LZW_HASH_BITS    14    // encoder string table (open addressing)
+
+//-----------------------------------------------------------------------------
+// Local classes
+//-----------------------------------------------------------------------------
+
+//! MSB first bit packer used by the LZW encoder
+class LZWBitWriter {
+public:
+  uint8  *m_out;
+  uint32  m_bits;
+  int     m_count;
+  
+  LZWBitWriter(uint8 *out) : m_out(out), m_bits(0), m_count(0) {}
+  
+  inline void put(int code, int width) {
+    m_bits   = (m_bits << width) | (uint32) code;
+    m_count += width;
+    while (m_count >= 8) {
+      m_count -= 8;
+      *m_out++ = (uint8) (m_bits >> m_count);
+    }
+  }
+  
+  inline void flush() {
+    if (m_count > 0)
+      *m_out++ = (uint8) (m_bits << (8 - m_count));
+    m_count = 0;
+  }
+};
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+int64 TIFFCodec::lzwBound(int64 srcSize)
+{
+  // one code of at most 12 bits per input byte, plus the clear codes and the end of information code
+  return ((srcSize + srcSize / 1024 + 4) * LZW_MAX_BITS + 7) / 8;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    LZW encoder. Codes are packed MSB first, the code width grows when
+ *    the next code no longer fits and the table is reset (clear code)
+ *    just before it would overflow, as done by libtiff, so that the
+ *    "early change" decoders of TIFF 6.0 stay in sync.
+ ************************************************************************
+ */
+int64 TIFFCodec::lzwEncode(const uint8 *src, int64 srcSize, uint8 *dst)
+{
+  const uint32 hashSize = 1 << LZW_HASH_BITS;
+  std::vector<int32>  hashKey (hashSize, -1);
+  std::vector<uint16> hashCode(hashSize);
+  LZWBitWriter writer(dst);
+  int width    = LZW_MIN_BITS;
+  int nextCode = LZW_FIRST;
+  
+  writer.put(LZW_CLEAR, width);
+  if (srcSize > 0) {
+    int prefix = src[0];
+    for (int64 i = 1; i < srcSize; i++) {
+      int32  key  = (prefix << 8) | src[i];
+      uint32 slot = ((uint32) key * 2654435761U) >> (32 - LZW_HASH_BITS);
+      while (hashKey[slot] != -1 && hashKey[slot] != key)
+        slot = (slot + 1) & (hashSize - 1);
+      if (hashKey[slot] == key) {
+        prefix = hashCode[slot];
+        continue;
+      }
+      
+      writer.put(prefix, width);
+      hashKey [slot] = key;
+      hashCode[slot] = (uint16) nextCode++;
+      if (nextCode == LZW_MAX_CODE - 1) {
+        writer.put(LZW_CLEAR, width);
+        std::fill(hashKey.begin(), hashKey.end(), -1);
+        nextCode = LZW_FIRST;
+        width    = LZW_MIN_BITS;
+      }
+      else if (nextCode > (1 << width) - 1) {
+        width++;
+      }
+      prefix = src[i];
+    }
+    
+    // the decoder adds an entry for the last code too, so keep the code width in step
+    writer.put(prefix, width);
+    if (++nextCode == LZW_MAX_CODE - 1) {
+      writer.put(LZW_CLEAR, width);
+      width = LZW_MIN_BITS;
+    }
+    else if (nextCode > (1 << width) - 1) {
+      width++;
+    }
+  }
+  writer.put(LZW_EOI, width);
+  writer.flush();
+  
+  return (int64) (writer.m_out - dst);
+}
+
+int64 TIFFCodec::lzwDecode(const uint8 *src, int64 srcSize, uint8 *dst, int64 dstSize)
+{
+  uint16 prefix[LZW_MAX_CODE + 1];
+  uint8  suffix[LZW_MAX_CODE + 1];
+  uint8  first [LZW_MAX_CODE + 1];
+  int32  length[LZW_MAX_CODE + 1];
+  const uint8 *srcEnd = src + srcSize;
+  uint8 *out = dst;
+  uint8 *outEnd = dst + dstSize;
+  uint32 bits  = 0;
+  int    count = 0;
+  int    width    = LZW_MIN_BITS;
+  int    nextCode = LZW_FIRST;
+  int    oldCode  = -1;
+  
+  // Pre-TIFF 6.0 (LSB first) LZW data start with a 0x00 0x01 pair, a clear code can not
+  if (srcSize >= 2 && src[0] == 0 && (src[1] & 0x1))
+    return -1;
+  
+  for (int c = 0; c < 256; c++) {
+    suffix[c] = first[c] = (uint8) c;
+    length[c] = 1;
+  }
+  
+  while (out < outEnd) {
+    while (count < width && src < srcEnd) {
+      bits   = (bits << 8) | *src++;
+      count += 8;
+    }
+    if (count < width)
+      break;                            // data ended without an end of information code
+    count -= width;
+    int code = (int) ((bits >> count) & ((1 << width) - 1));
+    
+    if (code == LZW_EOI)
+      break;
+    if (code == LZW_CLEAR) {
+      width    = LZW_MIN_BITS;
+      nextCode = LZW_FIRST;
+      oldCode  = -1;
+      continue;
+    }
+    
+    if (oldCode == -1) {                // first code after a clear code
+      if (code > 255)
+        return -1;
+      *out++  = (uint8) code;
+      oldCode = code;
+      continue;
+    }
+    
+    int firstByte;
+    if (code < nextCode)
+      firstByte = first[code];
+    else if (code == nextCode)
+      firstByte = first[oldCode];
+    else
+      return -1;
+    
+    if (nextCode > LZW_MAX_CODE)
+      return -1;
+    prefix[nextCode] = (uint16) oldCode;
+    suffix[nextCode] = (uint8) firstByte;
+    first [nextCode] = first[oldCode];
+    length[nextCode] = length[oldCode] + 1;
+    nextCode++;
+    if (nextCode >= (1 << width) - 1 && width < LZW_MAX_BITS)
+      width++;
+    
+    // write the string backwards, truncating it if it does not fit
+    int    n = length[code];
+    int    k = code;
+    uint8 *p = out + n;
+    while (k > 255) {
+      if (--p < outEnd)
+        *p = suffix[k];
+      k = prefix[k];
+    }
+    if (--p < outEnd)
+      *p = (uint8) k;
+    out = (n < outEnd - out) ? out + n : outEnd;
+    oldCode = code;
+  }
+  
+  return (int64) (out - dst);
+}
+
+void TIFFCodec::applyPredictor(uint8 *data, int rows, int width, int samplesPerPixel, int bytesPerSample)
+{
+  int rowSamples = width * samplesPerPixel;
+  
+  for (int j = 0; j < rows; j++) {
+    if (bytesPerSample == 1) {
+      uint8 *s = data + (int64) j * rowSamples;
+      for (int i = rowSamples - 1; i >= samplesPerPixel; i--)
+        s[i] = (uint8) (s[i] - s[i - samplesPerPixel]);
+    }
+    else {
+      uint16 *s = (uint16 *) data + (int64) j * rowSamples;
+      for (int i = rowSamples - 1; i >= samplesPerPixel; i--)
+        s[i] = (uint16) (s[i] - s[i - samplesPerPixel]);
+    }
+  }
+}
+
+void TIFFCodec::removePredictor(uint8 *data, int rows, int width, int samplesPerPixel, int bytesPerSample)
+{
+  int rowSamples = width * samplesPerPixel;
+  
+  for (int j = 0; j < rows; j++) {
+    if (bytesPerSample == 1) {
+      uint8 *s = data + (int64) j * rowSamples;
+      for (int i = samplesPerPixel; i < rowSamples; i++)
+        s[i] = (uint8) (s[i] + s[i - samplesPerPixel]);
+    }
+    else {
+      uint16 *s = (uint16 *) data + (int64) j * rowSamples;
+      for (int i = samplesPerPixel; i < rowSamples; i++)
+        s[i] = (uint16) (s[i] + s[i - samplesPerPixel]);
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
@@ -0,0 +1,209 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file ThreadPool.cpp
+ *
+ * \brief
+ *    Process wide worker pool. Workers are created on first use and are kept
+ *    alive until the thread count changes or the process exits.
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include "ThreadPool.H"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Local classes
+//-----------------------------------------------------------------------------
+
+class WorkerPool {
+public:
+  std::mutex                   m_dispatchMutex;    // serializes parallelFor calls from different threads
+  std::mutex                   m_mutex;
+  std::condition_variable      m_wake;
+  std::condition_variable      m_done;
+  std::vector<std::thread>     m_workers;
+  const std::function<void (int)> *m_job;
+  std::atomic<int>             m_nextJob;
+  int                          m_jobs;
+  int                          m_pending;
+  int64                        m_generation;
+  int                          m_threads;
+  bool                         m_quit;
+  
+  WorkerPool() : m_job(NULL), m_nextJob(0), m_jobs(0), m_pending(0), m_generation(0), m_threads(0), m_quit(FALSE) {
+    setThreads(0);
+  }
+  
+  ~WorkerPool() {
+    stop();
+  }
+  
+  void setThreads(int threads) {
+    stop();
+    if (threads <= 0)
+      threads = (int) std::thread::hardware_concurrency();
+    m_threads = iMax(1, threads);
+  }
+  
+  void start() {
+    if ((int) m_workers.size() == m_threads - 1)
+      return;
+    m_quit = FALSE;
+    for (int i = (int) m_workers.size(); i < m_threads - 1; i++)
+      m_workers.push_back(std::thread(&WorkerPool::workerLoop, this, m_generation));
+  }
+  
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = TRUE;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_workers.size(); i++)
+      m_workers[i].join();
+    m_workers.clear();
+  }
+  
+  void runJobs();
+  void workerLoop(int64 generation);
+};
+
+static thread_local bool t_insideJob = FALSE;
+
+static WorkerPool &getPool() {
+  static WorkerPool pool;
+  return pool;
+}
+
+void WorkerPool::runJobs() {
+  t_insideJob = TRUE;
+  for (int job = m_nextJob++; job < m_jobs; job = m_nextJob++)
+    (*m_job)(job);
+  t_insideJob = FALSE;
+}
+
+void WorkerPool::workerLoop(int64 generation) {
+  int64 seen = generation;
+  std::unique_lock<std::mutex> lock(m_mutex);
+  
+  for (;;) {
+    while (m_quit == FALSE && m_generation == seen)
+      m_wake.wait(lock);
+    if (m_quit == TRUE)
+      return;
+    seen = m_generation;
+    
+    lock.unlock();
+    runJobs();
+    lock.lock();
+    
+    if (--m_pending == 0)
+      m_done.notify_all();
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+void ThreadPool::setThreadCount(int threads) {
+  WorkerPool &pool = getPool();
+  std::lock_guard<std::mutex> dispatch(pool.m_dispatchMutex);
+  pool.setThreads(threads);
+}
+
+int ThreadPool::getThreadCount() {
+  return getPool().m_threads;
+}
+
+int ThreadPool::getBandCount(int height, int minRows) {
+  int bands = height / iMax(1, minRows);
+  return iClip(bands, 1, 4 * getThreadCount());
+}
+
+void ThreadPool::parallelFor(int jobs, const std::function<void (int)> &job) {
+  WorkerPool &pool = getPool();
+  
+  if (jobs <= 0)
+    return;
+  
+  if (jobs == 1 || pool.m_threads == 1 || t_insideJob == TRUE) {
+    for (int i = 0; i < jobs; i++)
+      job(i);
+    return;
+  }
+  
+  std::lock_guard<std::mutex> dispatch(pool.m_dispatchMutex);
+  pool.start();
+  
+  {
+    std::lock_guard<std::mutex> lock(pool.m_mutex);
+    pool.m_job     = &job;
+    pool.m_jobs    = jobs;
+    pool.m_nextJob = 0;
+    pool.m_pending = (int) pool.m_workers.size();
+    pool.m_generation++;
+  }
+  pool.m_wake.notify_all();
+  
+  // the calling thread takes part in the work as well
+  pool.runJobs();
+  
+  std::unique_lock<std::mutex> lock(pool.m_mutex);
+  while (pool.m_pending > 0)
+    pool.m_done.wait(lock);
+  pool.m_job = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
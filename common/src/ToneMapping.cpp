@@ -82,7 +82,7 @@ ToneMapping *ToneMapping::create(int method, ToneMappingParams *tmParams) {
       result = new ToneMappingBT2390( tmParams->m_minValue, tmParams->m_maxValue, tmParams->m_targetValue, tmParams->m_scaleGammut);
       break;
     case TM_BT2390IPT:
-      result = new ToneMappingBT2390IPT( tmParams->m_minValue, tmParams->m_maxValue, tmParams->m_targetValue, tmParams->m_scaleGammut);
+      result = new ToneMappingBT2390IPT( tmParams->m_minValue, tmParams->m_maxValue, tmParams->m_targetValue, tmParams->m_scaleGammut, tmParams->m_useLUT, tmParams->m_silentMode);
       break;
     case TM_CIE1931:
       result = new ToneMappingCIE1931( tmParams->m_minValue, tmParams->m_maxValue, tmParams->m_targetValue, tmParams->m_scaleGammut);
@@ -57,27 +57,59 @@
 #include "Global.H"
 #include "ColorTransformGeneric.H"
 #include "ToneMappingBT2390IPT.H"
+#include "CPUFeatures.H"
+#include <string.h>
 
 //-----------------------------------------------------------------------------
 // Macros
 //-----------------------------------------------------------------------------
 
+// PQ encoding table: 128 entries per octave over [2^-40, 1], indexed by the
+// exponent and the 7 most significant mantissa bits of a float
+#define PQ_ENC_OCTAVES   40
+#define PQ_ENC_BASE      ((127 - PQ_ENC_OCTAVES) << 7)
+#define PQ_ENC_SIZE      (PQ_ENC_OCTAVES * 128 + 2)
+// PQ decoding table: uniform intervals over [0, 1]
+#define PQ_DEC_INTERVALS 16384
+
 //-----------------------------------------------------------------------------
 // Constructor/destructor
 //-----------------------------------------------------------------------------
 
-ToneMappingBT2390IPT::ToneMappingBT2390IPT(double minValue, double maxValue, double targetValue, bool scaleGammut) {
-  m_scaleGammut = scaleGammut;
-  m_maxValue    = maxValue;
+ToneMappingBT2390IPT::ToneMappingBT2390IPT(double minValue, double maxValue, double targetValue, bool scaleGammut, bool useLUT, bool silentMode) {
+  m_scaleGammut  = scaleGammut;
+  m_maxValue     = maxValue;
+  m_useLUT       = useLUT;
+  m_lutPrimaries = -1;
+  m_lutMaxError  = 0.0;
+  m_silentMode   = silentMode;
+  // Gamut scaling and strong compression bend the mapping more, use a finer grid
+  m_lutSize      = (scaleGammut == TRUE || maxValue > 4.0 * targetValue) ? 65 : 33;
   
   m_transferFunction = TransferFunction::create(TF_PQ, TRUE, 1.0, 1.0, 0.0, 1.0, TRUE);
   m_maxIntensity = m_transferFunction->inverse(targetValue / 10000.0);
   m_KS = 1.5 * m_maxIntensity - 0.5;
   m_KSIntensity = m_transferFunction->forward(m_KS);
   
+  if (m_useLUT == TRUE) {
+    m_pqEncode.resize(PQ_ENC_SIZE);
+    m_pqDecode.resize(PQ_DEC_INTERVALS + 2);
+    for (int i = 0; i < PQ_ENC_SIZE; i++) {
+      uint32 bits = (uint32) (PQ_ENC_BASE + i) << 16;
+      float value;
+      memcpy(&value, &bits, sizeof(float));
+      m_pqEncode[i] = (float) m_transferFunction->inverse(dMin((double) value, 1.0));
+    }
+    for (int i = 0; i < PQ_DEC_INTERVALS + 2; i++)
+      m_pqDecode[i] = (float) m_transferFunction->forward(dMin((double) i / (double) PQ_DEC_INTERVALS, 1.0));
+  }
 }
 
 ToneMappingBT2390IPT::~ToneMappingBT2390IPT() {
+  if (m_transferFunction != NULL) {
+    delete m_transferFunction;
+    m_transferFunction = NULL;
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -146,6 +178,400 @@ void ToneMappingBT2390IPT::setColorConversion(int colorPrimaries, double transfo
 }
 
 
+/*!
+ ************************************************************************
+ * \brief
+ *    Exact tone mapping of one normalized linear RGB sample. Returns
+ *    FALSE, without touching rgbOutNormal, for samples below the
+ *    roll-off knee, which are passed through unchanged.
+ ************************************************************************
+ */
+bool ToneMappingBT2390IPT::toneMapPixel(double *rgbNormal, double *rgbOutNormal, const double transformFW[3][3], const double transformBW[3][3]) {
+  double xyzNormal[3], xyzOutNormal[3];
+  double LMSin[3], LMSout[3];
+  double IPTin[3], IPTout[3];
+  double LpMpSpin[3], LpMpSpout[3];
+  double E, t, p, tPower2, tPower3;
+  double colourScale;
+  
+  convertToXYZ(rgbNormal, xyzNormal, transformFW);
+  convertXYZToLMS(xyzNormal, LMSin);
+  LpMpSpin[0] = m_transferFunction->inverse(LMSin[0]);
+  LpMpSpin[1] = m_transferFunction->inverse(LMSin[1]);
+  LpMpSpin[2] = m_transferFunction->inverse(LMSin[2]);
+  convertLMSToIPT(LpMpSpin, IPTin);
+  
+  //printf("values %10.7f %10.7f %d\n", IPTin[0], m_KS, m_scaleGammut);
+  if (IPTin[0] < m_KS)
+    return FALSE;
+  
+  E = IPTin[0];
+  
+  t = (E - m_KS) / ( 1 - m_KS);
+  tPower2 = t * t;
+  tPower3 = t * tPower2;
+  p = (tPower3 - tPower2 - t + 1) * m_KS + (tPower3 - 2 * tPower2 + t) + (-2 * tPower3 + 3 * tPower2) * m_maxIntensity;
+  
+  colourScale = m_scaleGammut == FALSE ? 1.0 : dMin( p / E, E / p);
+  //printf("values %10.7f %10.7f %d %10.7f\n", IPTin[0], m_KS, m_scaleGammut, colourScale);
+  
+  IPTout[0] = p;
+  IPTout[1] = IPTin[1] * colourScale;
+  IPTout[2] = IPTin[2] * colourScale;
+  
+  convertIPTToLMS(IPTout, LpMpSpout);
+  
+  LMSout[0] = m_transferFunction->forward(LpMpSpout[0]);
+  LMSout[1] = m_transferFunction->forward(LpMpSpout[1]);
+  LMSout[2] = m_transferFunction->forward(LpMpSpout[2]);
+  
+  convertLMSToXYZ(LMSout, xyzOutNormal);
+  convertToRGB(xyzOutNormal, rgbOutNormal, transformBW);
+  
+  return TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Baked 3D LUT
+//-----------------------------------------------------------------------------
+
+// lookupPixel results
+enum {
+  LUT_OUTSIDE = 0,   //!< sample outside [0, 1], needs the exact path
+  LUT_PASS    = 1,   //!< sample below the knee, passed through unchanged
+  LUT_MAPPED  = 2    //!< mapped sample returned
+};
+
+static const float PQ_ENC_MIN = 9.094947017729282e-13f;   // 2^-40
+
+static inline float encodePQ(const float *table, float value)
+{
+  uint32 bits;
+  value = value < PQ_ENC_MIN ? PQ_ENC_MIN : (value > 1.0f ? 1.0f : value);
+  memcpy(&bits, &value, sizeof(float));
+  int   index = (int) (bits >> 16) - PQ_ENC_BASE;
+  float frac  = (float) (bits & 0xFFFF) * (1.0f / 65536.0f);
+  return table[index] + frac * (table[index + 1] - table[index]);
+}
+
+static inline float decodePQ(const float *table, float value)
+{
+  value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+  float pos   = value * (float) PQ_DEC_INTERVALS;
+  int   index = iMin((int) pos, PQ_DEC_INTERVALS - 1);
+  float frac  = pos - (float) index;
+  return table[index] + frac * (table[index + 1] - table[index]);
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Tetrahedral interpolation of the n^3 LUT (three component planes)
+ *    at PQ position pqIn. Returns the index of the enclosing cell.
+ ************************************************************************
+ */
+static inline int interpolateTetrahedral(const float *lut, int n, const float *pqIn, float *pqOut)
+{
+  int   planeSize = n * n * n;
+  int   stride[3] = { 1, n, n * n };
+  int   index[3];
+  float frac[3];
+  int   c, cMax, cMid, cMin;
+  
+  for (c = 0; c < 3; c++) {
+    float pos = pqIn[c] * (float) (n - 1);
+    index[c] = iMin((int) pos, n - 2);
+    frac[c]  = pos - (float) index[c];
+  }
+  
+  // The tetrahedron is given by the order of the fractional parts
+  if (frac[0] >= frac[1] && frac[0] >= frac[2]) {
+    cMax = 0;
+    cMid = frac[1] < frac[2] ? 2 : 1;
+  }
+  else if (frac[1] >= frac[2]) {
+    cMax = 1;
+    cMid = frac[0] < frac[2] ? 2 : 0;
+  }
+  else {
+    cMax = 2;
+    cMid = frac[0] < frac[1] ? 1 : 0;
+  }
+  cMin = 3 - cMax - cMid;
+  
+  int node0 = (index[2] * n + index[1]) * n + index[0];
+  int nodeA = node0 + stride[cMax];
+  int nodeB = nodeA + stride[cMid];
+  int node1 = node0 + 1 + n + n * n;
+  
+  for (c = 0; c < 3; c++) {
+    const float *plane = lut + c * planeSize;
+    pqOut[c] = plane[node0] + frac[cMax] * (plane[nodeA] - plane[node0]) + frac[cMid] * (plane[nodeB] - plane[nodeA]) + frac[cMin] * (plane[node1] - plane[nodeB]);
+  }
+  
+  return (index[2] * (n - 1) + index[1]) * (n - 1) + index[0];
+}
+
+#if ENABLE_SIMD_DISPATCH
+/*!
+ ************************************************************************
+ * \brief
+ *    AVX2 version of the LUT path for 8 samples starting at pos, with the
+ *    same operation order as the scalar code. Samples outside [0, 1] are
+ *    copied unchanged; the returned bit mask flags the samples that were
+ *    inside the LUT domain.
+ ************************************************************************
+ */
+SIMD_TARGET("avx2")
+static int lookupBlockAVX2(const float *lut, const int *identity, const float *encode, const float *decode, int n, float invMaxValue, float maxValue, float * const *out, const float * const *inp, int pos)
+{
+  const __m256  zero    = _mm256_setzero_ps();
+  const __m256  one     = _mm256_set1_ps(1.0f);
+  const __m256  all     = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  const __m256i nV      = _mm256_set1_epi32(n);
+  const __m256i cellV   = _mm256_set1_epi32(n - 1);
+  const __m256i maxIdx  = _mm256_set1_epi32(n - 2);
+  const __m256  scale   = _mm256_set1_ps((float) (n - 1));
+  int planeSize = n * n * n;
+  __m256  input[3], frac[3];
+  __m256i index[3];
+  __m256  valid = all;
+  int c;
+  
+  for (c = 0; c < 3; c++) {
+    input[c] = _mm256_loadu_ps(inp[c] + pos);
+    __m256 value = _mm256_mul_ps(input[c], _mm256_set1_ps(invMaxValue));
+    valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(value, zero, _CMP_GE_OQ), _mm256_cmp_ps(value, one, _CMP_LE_OQ)));
+    
+    // PQ encoding
+    value = _mm256_min_ps(_mm256_max_ps(value, _mm256_set1_ps(PQ_ENC_MIN)), one);
+    __m256i bits  = _mm256_castps_si256(value);
+    __m256i entry = _mm256_sub_epi32(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(PQ_ENC_BASE));
+    __m256  f     = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(bits, _mm256_set1_epi32(0xFFFF))), _mm256_set1_ps(1.0f / 65536.0f));
+    __m256  e0    = _mm256_mask_i32gather_ps(zero, encode,     entry, all, 4);
+    __m256  e1    = _mm256_mask_i32gather_ps(zero, encode + 1, entry, all, 4);
+    __m256  pq    = _mm256_add_ps(e0, _mm256_mul_ps(f, _mm256_sub_ps(e1, e0)));
+    
+    // Grid position
+    __m256 gridPos = _mm256_mul_ps(pq, scale);
+    index[c] = _mm256_min_epi32(_mm256_cvttps_epi32(gridPos), maxIdx);
+    frac[c]  = _mm256_sub_ps(gridPos, _mm256_cvtepi32_ps(index[c]));
+  }
+  
+  // Tetrahedron selection, see interpolateTetrahedral
+  __m256  isR   = _mm256_and_ps(_mm256_cmp_ps(frac[0], frac[1], _CMP_GE_OQ), _mm256_cmp_ps(frac[0], frac[2], _CMP_GE_OQ));
+  __m256  isG   = _mm256_andnot_ps(isR, _mm256_cmp_ps(frac[1], frac[2], _CMP_GE_OQ));
+  __m256  midR2 = _mm256_cmp_ps(frac[1], frac[2], _CMP_LT_OQ);
+  __m256  midG2 = _mm256_cmp_ps(frac[0], frac[2], _CMP_LT_OQ);
+  __m256  midB1 = _mm256_cmp_ps(frac[0], frac[1], _CMP_LT_OQ);
+  __m256i s0 = _mm256_set1_epi32(1), s1 = nV, s2 = _mm256_set1_epi32(n * n);
+  
+  __m256  wMax = _mm256_blendv_ps(_mm256_blendv_ps(frac[2], frac[1], isG), frac[0], isR);
+  __m256  wMid = _mm256_blendv_ps(_mm256_blendv_ps(_mm256_blendv_ps(frac[0], frac[1], midB1), _mm256_blendv_ps(frac[0], frac[2], midG2), isG), _mm256_blendv_ps(frac[1], frac[2], midR2), isR);
+  __m256  wMin = _mm256_blendv_ps(_mm256_blendv_ps(_mm256_blendv_ps(frac[1], frac[0], midB1), _mm256_blendv_ps(frac[2], frac[0], midG2), isG), _mm256_blendv_ps(frac[2], frac[1], midR2), isR);
+  __m256i iR   = _mm256_castps_si256(isR);
+  __m256i iG   = _mm256_castps_si256(isG);
+  __m256i sMax = _mm256_blendv_epi8(_mm256_blendv_epi8(s2, s1, iG), s0, iR);
+  __m256i sMid = _mm256_blendv_epi8(_mm256_blendv_epi8(_mm256_blendv_epi8(s0, s1, _mm256_castps_si256(midB1)), _mm256_blendv_epi8(s0, s2, _mm256_castps_si256(midG2)), iG),
+                                    _mm256_blendv_epi8(s1, s2, _mm256_castps_si256(midR2)), iR);
+  
+  __m256i node0 = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(index[2], nV), index[1]), nV), index[0]);
+  __m256i nodeA = _mm256_add_epi32(node0, sMax);
+  __m256i nodeB = _mm256_add_epi32(nodeA, sMid);
+  __m256i node1 = _mm256_add_epi32(node0, _mm256_set1_epi32(1 + n + n * n));
+  __m256i cell  = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(index[2], cellV), index[1]), cellV), index[0]);
+  __m256i pass  = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), identity, cell, _mm256_set1_epi32(-1), 4);
+  __m256  keep  = _mm256_or_ps(_mm256_xor_ps(valid, all), _mm256_castsi256_ps(_mm256_cmpgt_epi32(pass, _mm256_setzero_si256())));
+  
+  for (c = 0; c < 3; c++) {
+    const float *plane = lut + c * planeSize;
+    __m256 g0 = _mm256_mask_i32gather_ps(zero, plane, node0, all, 4);
+    __m256 gA = _mm256_mask_i32gather_ps(zero, plane, nodeA, all, 4);
+    __m256 gB = _mm256_mask_i32gather_ps(zero, plane, nodeB, all, 4);
+    __m256 g1 = _mm256_mask_i32gather_ps(zero, plane, node1, all, 4);
+    __m256 pq = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(g0, _mm256_mul_ps(wMax, _mm256_sub_ps(gA, g0))), _mm256_mul_ps(wMid, _mm256_sub_ps(gB, gA))), _mm256_mul_ps(wMin, _mm256_sub_ps(g1, gB)));
+    
+    // PQ decoding
+    __m256  value = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(pq, zero), one), _mm256_set1_ps((float) PQ_DEC_INTERVALS));
+    __m256i entry = _mm256_min_epi32(_mm256_cvttps_epi32(value), _mm256_set1_epi32(PQ_DEC_INTERVALS - 1));
+    __m256  f     = _mm256_sub_ps(value, _mm256_cvtepi32_ps(entry));
+    __m256  d0    = _mm256_mask_i32gather_ps(zero, decode,     entry, all, 4);
+    __m256  d1    = _mm256_mask_i32gather_ps(zero, decode + 1, entry, all, 4);
+    __m256  mapped = _mm256_mul_ps(_mm256_add_ps(d0, _mm256_mul_ps(f, _mm256_sub_ps(d1, d0))), _mm256_set1_ps(maxValue));
+    
+    _mm256_storeu_ps(out[c] + pos, _mm256_blendv_ps(mapped, input[c], keep));
+  }
+  
+  return _mm256_movemask_ps(valid);
+}
+#endif
+
+int ToneMappingBT2390IPT::lookupPixel(const float *rgbNormal, float *rgbOutNormal) {
+  float pqIn[3], pqOut[3];
+  int c;
+  
+  for (c = 0; c < 3; c++) {
+    if (!(rgbNormal[c] >= 0.0f && rgbNormal[c] <= 1.0f))
+      return LUT_OUTSIDE;
+    pqIn[c] = encodePQ(&m_pqEncode[0], rgbNormal[c]);
+  }
+  
+  if (m_lutIdentity[interpolateTetrahedral(&m_lut[0], m_lutSize, pqIn, pqOut)] != 0)
+    return LUT_PASS;
+  
+  for (c = 0; c < 3; c++)
+    rgbOutNormal[c] = decodePQ(&m_pqDecode[0], pqOut[c]);
+  return LUT_MAPPED;
+}
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Sample the exact mapping on a regular PQ domain grid and report the
+ *    maximum error of the LUT path against the exact path. Nodes below
+ *    the knee store their own coordinates, and cells whose corners are
+ *    all below the knee pass samples through unchanged, as the exact
+ *    path does.
+ ************************************************************************
+ */
+void ToneMappingBT2390IPT::bakeLUT(int colorPrimaries, const double transformFW[3][3], const double transformBW[3][3]) {
+  int n = m_lutSize;
+  int planeSize = n * n * n;
+  int r, g, b, c;
+  vector<char> isMapped(planeSize);
+  double rgbNormal[3], rgbOutNormal[3];
+  
+  m_lut.resize(3 * planeSize);
+  m_lutIdentity.resize((n - 1) * (n - 1) * (n - 1));
+  
+  for (b = 0; b < n; b++) {
+    for (g = 0; g < n; g++) {
+      for (r = 0; r < n; r++) {
+        int node = (b * n + g) * n + r;
+        double pq[3] = { (double) r / (double) (n - 1), (double) g / (double) (n - 1), (double) b / (double) (n - 1) };
+        for (c = 0; c < 3; c++)
+          rgbNormal[c] = m_transferFunction->forward(pq[c]);
+        isMapped[node] = toneMapPixel(rgbNormal, rgbOutNormal, transformFW, transformBW);
+        for (c = 0; c < 3; c++)
+          m_lut[c * planeSize + node] = (float) (isMapped[node] ? m_transferFunction->inverse(rgbOutNormal[c]) : pq[c]);
+      }
+    }
+  }
+  
+  for (b = 0; b < n - 1; b++) {
+    for (g = 0; g < n - 1; g++) {
+      for (r = 0; r < n - 1; r++) {
+        int node = (b * n + g) * n + r;
+        int mapped = isMapped[node] | isMapped[node + 1] | isMapped[node + n] | isMapped[node + n + 1];
+        node += n * n;
+        mapped |= isMapped[node] | isMapped[node + 1] | isMapped[node + n] | isMapped[node + n + 1];
+        m_lutIdentity[(b * (n - 1) + g) * (n - 1) + r] = mapped == 0;
+      }
+    }
+  }
+  m_lutPrimaries = colorPrimaries;
+  
+  // Error against the exact path at all cell centers and a set of pseudo-random samples.
+  // The maximum is reached close to the clipping boundaries of the exact path, where
+  // small outputs of saturated colors are interpolated across a kink; the mean error
+  // is reported as well.
+  double sumError = 0.0;
+  uint32 seed = 12345;
+  int cells = (n - 1) * (n - 1) * (n - 1);
+  int samples = cells + 65536;
+  m_lutMaxError = 0.0;
+  for (int i = 0; i < samples; i++) {
+    float  rgbSample[3], rgbLUT[3];
+    double pq[3];
+    if (i < cells) {
+      pq[0] = ((i % (n - 1)) + 0.5) / (double) (n - 1);
+      pq[1] = (((i / (n - 1)) % (n - 1)) + 0.5) / (double) (n - 1);
+      pq[2] = ((i / ((n - 1) * (n - 1))) + 0.5) / (double) (n - 1);
+    }
+    else {
+      for (c = 0; c < 3; c++) {
+        seed = seed * 1664525 + 1013904223;
+        pq[c] = (double) (seed >> 8) / (double) (1 << 24);
+      }
+    }
+    for (c = 0; c < 3; c++) {
+      rgbSample[c] = (float) m_transferFunction->forward(pq[c]);
+      rgbNormal[c] = rgbSample[c];
+    }
+    if (toneMapPixel(rgbNormal, rgbOutNormal, transformFW, transformBW) == FALSE) {
+      for (c = 0; c < 3; c++)
+        rgbOutNormal[c] = (float) rgbNormal[c];
+    }
+    if (lookupPixel(rgbSample, rgbLUT) != LUT_MAPPED) {
+      for (c = 0; c < 3; c++)
+        rgbLUT[c] = rgbSample[c];
+    }
+    for (c = 0; c < 3; c++) {
+      double error = dAbs(m_transferFunction->inverse(dMax((double) rgbLUT[c], 0.0)) - m_transferFunction->inverse(dMax(rgbOutNormal[c], 0.0)));
+      m_lutMaxError = dMax(m_lutMaxError, error);
+      sumError += error;
+    }
+  }
+  sumError /= 3.0 * (double) samples;
+  
+  if (m_silentMode == FALSE)
+    printf("BT.2390 IPT tone mapping LUT %dx%dx%d, error against exact path (PQ): max %.6f (%.3f 10 bit codes), mean %.6f (%.3f 10 bit codes)\n", n, n, n, m_lutMaxError, m_lutMaxError * 1023.0, sumError, sumError * 1023.0);
+}
+
+void ToneMappingBT2390IPT::applyLUT(float * const *out, const float * const *inp, int size, const double transformFW[3][3], const double transformBW[3][3]) {
+  float invMaxValue = (float) (1.0 / m_maxValue);
+  float maxValue    = (float) m_maxValue;
+  int i = 0, c;
+  
+  // Samples outside of the LUT domain go through the exact path
+  auto exactPixel = [&](int pos) {
+    double rgbNormal[3], rgbOutNormal[3];
+    for (int k = 0; k < 3; k++)
+      rgbNormal[k] = inp[k][pos] / m_maxValue;
+    if (toneMapPixel(rgbNormal, rgbOutNormal, transformFW, transformBW) == TRUE) {
+      for (int k = 0; k < 3; k++)
+        out[k][pos] = (float) ( rgbOutNormal[k] * m_maxValue );
+    }
+    else {
+      for (int k = 0; k < 3; k++)
+        out[k][pos] = inp[k][pos];
+    }
+  };
+  
+#if ENABLE_SIMD_DISPATCH
+  if (CPUFeatures::hasAVX2()) {
+    for (; i + 8 <= size; i += 8) {
+      int valid = lookupBlockAVX2(&m_lut[0], &m_lutIdentity[0], &m_pqEncode[0], &m_pqDecode[0], m_lutSize, invMaxValue, maxValue, out, inp, i);
+      if (valid != 0xFF) {
+        for (int k = 0; k < 8; k++) {
+          if (((valid >> k) & 1) == 0)
+            exactPixel(i + k);
+        }
+      }
+    }
+  }
+#endif
+  
+  for (; i < size; i++) {
+    float rgbNormal[3], rgbOutNormal[3];
+    for (c = 0; c < 3; c++)
+      rgbNormal[c] = inp[c][i] * invMaxValue;
+    switch (lookupPixel(rgbNormal, rgbOutNormal)) {
+      case LUT_MAPPED:
+        for (c = 0; c < 3; c++)
+          out[c][i] = rgbOutNormal[c] * maxValue;
+        break;
+      case LUT_PASS:
+        for (c = 0; c < 3; c++)
+          out[c][i] = inp[c][i];
+        break;
+      default:
+        exactPixel(i);
+        break;
+    }
+  }
+}
+
 //-----------------------------------------------------------------------------
 // Public methods
 //-----------------------------------------------------------------------------
@@ -158,52 +584,23 @@ void ToneMappingBT2390IPT::process ( Frame* frame) {
   if (frame->m_isFloat == TRUE ) {
     double transformFW[3][3];
     double transformBW[3][3];
-    double rgbNormal[3], xyzNormal[3];
-    double rgbOutNormal[3], xyzOutNormal[3];
-    double LMSin[3], LMSout[3];
-    double IPTin[3], IPTout[3];
-    double LpMpSpin[3], LpMpSpout[3];
-    double E, t, p, tPower2, tPower3;
-    double colourScale;
+    double rgbNormal[3];
+    double rgbOutNormal[3];
     setColorConversion(frame->m_colorPrimaries, transformFW, transformBW);
     
+    if (m_useLUT == TRUE) {
+      if (m_lutPrimaries != frame->m_colorPrimaries)
+        bakeLUT(frame->m_colorPrimaries, transformFW, transformBW);
+      applyLUT(frame->m_floatComp, frame->m_floatComp, frame->m_compSize[Y_COMP], transformFW, transformBW);
+      return;
+    }
+    
     for (int i = 0; i < frame->m_compSize[Y_COMP]; i++) {
       rgbNormal[R_COMP] = frame->m_floatComp[R_COMP][i] / m_maxValue;
       rgbNormal[G_COMP] = frame->m_floatComp[G_COMP][i] / m_maxValue;
       rgbNormal[B_COMP] = frame->m_floatComp[B_COMP][i] / m_maxValue;
       
-      convertToXYZ(rgbNormal, xyzNormal, transformFW);
-      convertXYZToLMS(xyzNormal, LMSin);
-      LpMpSpin[0] = m_transferFunction->inverse(LMSin[0]);
-      LpMpSpin[1] = m_transferFunction->inverse(LMSin[1]);
-      LpMpSpin[2] = m_transferFunction->inverse(LMSin[2]);
-      convertLMSToIPT(LpMpSpin, IPTin);
-      
-      //printf("values %10.7f %10.7f %d\n", IPTin[0], m_KS, m_scaleGammut);
-      if (IPTin[0] >= m_KS) {
-        E = IPTin[0];
-        
-        t = (E - m_KS) / ( 1 - m_KS);
-        tPower2 = t * t;
-        tPower3 = t * tPower2;
-        p = (tPower3 - tPower2 - t + 1) * m_KS + (tPower3 - 2 * tPower2 + t) + (-2 * tPower3 + 3 * tPower2) * m_maxIntensity;
-
-        colourScale = m_scaleGammut == FALSE ? 1.0 : dMin( p / E, E / p);
-        //printf("values %10.7f %10.7f %d %10.7f\n", IPTin[0], m_KS, m_scaleGammut, colourScale);
-
-        IPTout[0] = p;
-        IPTout[1] = IPTin[1] * colourScale;
-        IPTout[2] = IPTin[2] * colourScale;
-        
-        convertIPTToLMS(IPTout, LpMpSpout);
-        
-        LMSout[0] = m_transferFunction->forward(LpMpSpout[0]);
-        LMSout[1] = m_transferFunction->forward(LpMpSpout[1]);
-        LMSout[2] = m_transferFunction->forward(LpMpSpout[2]);
-        
-        convertLMSToXYZ(LMSout, xyzOutNormal);
-        convertToRGB(xyzOutNormal, rgbOutNormal, transformBW);
-        
+      if (toneMapPixel(rgbNormal, rgbOutNormal, transformFW, transformBW) == TRUE) {
         frame->m_floatComp[R_COMP][i] = (float) ( rgbOutNormal[R_COMP] * m_maxValue );
         frame->m_floatComp[G_COMP][i] = (float) ( rgbOutNormal[G_COMP] * m_maxValue );
         frame->m_floatComp[B_COMP][i] = (float) ( rgbOutNormal[B_COMP] * m_maxValue );
@@ -220,53 +617,25 @@ void ToneMappingBT2390IPT::process ( Frame* out, const Frame *inp) {
   }
   else {
     if (inp->m_isFloat == TRUE && out->m_isFloat == TRUE && inp->m_size == out->m_size) {
-    double transformFW[3][3];
-    double transformBW[3][3];
-    double rgbNormal[3], xyzNormal[3];
-    double rgbOutNormal[3], xyzOutNormal[3];
-    double LMSin[3], LMSout[3];
-    double IPTin[3], IPTout[3];
-    double LpMpSpin[3], LpMpSpout[3];
-    double E, t, p, tPower2, tPower3;
-    double colourScale;
-    setColorConversion(inp->m_colorPrimaries, transformFW, transformBW);
+      double transformFW[3][3];
+      double transformBW[3][3];
+      double rgbNormal[3];
+      double rgbOutNormal[3];
+      setColorConversion(inp->m_colorPrimaries, transformFW, transformBW);
+      
+      if (m_useLUT == TRUE) {
+        if (m_lutPrimaries != inp->m_colorPrimaries)
+          bakeLUT(inp->m_colorPrimaries, transformFW, transformBW);
+        applyLUT(out->m_floatComp, inp->m_floatComp, inp->m_compSize[Y_COMP], transformFW, transformBW);
+        return;
+      }
     
       for (int i = 0; i < inp->m_compSize[Y_COMP]; i++) {
         rgbNormal[R_COMP] = inp->m_floatComp[R_COMP][i] / m_maxValue;
         rgbNormal[G_COMP] = inp->m_floatComp[G_COMP][i] / m_maxValue;
         rgbNormal[B_COMP] = inp->m_floatComp[B_COMP][i] / m_maxValue;
         
-        convertToXYZ(rgbNormal, xyzNormal, transformFW);
-        convertXYZToLMS(xyzNormal, LMSin);
-        LpMpSpin[0] = m_transferFunction->inverse(LMSin[0]);
-        LpMpSpin[1] = m_transferFunction->inverse(LMSin[1]);
-        LpMpSpin[2] = m_transferFunction->inverse(LMSin[2]);
-        convertLMSToIPT(LpMpSpin, IPTin);
-        
-        if (IPTin[0] >= m_KS) {
-          E = IPTin[0];
-          
-          t = (E - m_KS) / ( 1 - m_KS);
-          tPower2 = t * t;
-          tPower3 = t * tPower2;
-          p = (tPower3 - tPower2 - t + 1) * m_KS + (tPower3 - 2 * tPower2 + t) + (-2 * tPower3 + 3 * tPower2) * m_maxIntensity;
-          
-          colourScale = m_scaleGammut == FALSE ? 1.0 : dMin( p / E, E / p);
-          //printf("values %10.7f %10.7f %d %10.7f\n", IPTin[0], m_KS, m_scaleGammut, colourScale);
-          
-          IPTout[0] = p;
-          IPTout[1] = IPTin[1] * colourScale;
-          IPTout[2] = IPTin[2] * colourScale;
-          
-          convertIPTToLMS(IPTout, LpMpSpout);
-          
-          LMSout[0] = m_transferFunction->forward(LpMpSpout[0]);
-          LMSout[1] = m_transferFunction->forward(LpMpSpout[1]);
-          LMSout[2] = m_transferFunction->forward(LpMpSpout[2]);
-          
-          convertLMSToXYZ(LMSout, xyzOutNormal);
-          convertToRGB(xyzOutNormal, rgbOutNormal, transformBW);
-          
+        if (toneMapPixel(rgbNormal, rgbOutNormal, transformFW, transformBW) == TRUE) {
           out->m_floatComp[R_COMP][i] =  (float) ( rgbOutNormal[R_COMP] * m_maxValue );
           out->m_floatComp[G_COMP][i] =  (float) ( rgbOutNormal[G_COMP] * m_maxValue );
           out->m_floatComp[B_COMP][i] =  (float) ( rgbOutNormal[B_COMP] * m_maxValue );
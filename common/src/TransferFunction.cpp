@@ -173,6 +173,17 @@ TransferFunction *TransferFunction::create(int method, bool singleStep, float sc
     result->m_invNormalFactor = 1.0;
   }
   
+  // Everything the forward/inverse functions depend on. Used to share the LUTs across instances.
+  char key[MAX_LINE_LEN];
+  snprintf(key, MAX_LINE_LEN, "TF %d %d %.17g %.17g %.17g %.17g", method, singleStep, scale, systemGamma, minValue, maxValue);
+  result->m_lutKey = key;
+  if (params != NULL) {
+    snprintf(key, MAX_LINE_LEN, " %d %d %.17g %.17g %.17g %d %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g", params->m_method, params->m_singleStep, params->m_scale, params->m_systemGamma, params->m_minValue, params->m_enableLUT, params->m_maxValue, params->m_dpxSoftClip, params->m_dpxRefWhite, params->m_dpxRefBlack, params->m_dpxDisplayGamma, params->m_dpxLinRef, params->m_dpxLogRef, params->m_dpxNegGamma);
+    result->m_lutKey += key;
+    snprintf(key, MAX_LINE_LEN, " %.17g", params->m_dpxDensityValue);
+    result->m_lutKey += key;
+  }
+  
   if (method == TF_NULL) {
     result->m_enableLUT = FALSE;
     result->m_enableFwdDerivLUT = FALSE;
@@ -274,15 +285,13 @@ void TransferFunction::initLUT() {
   }
   else {
     printf("Initializing LUTs for TF computations\n");
-    uint32 i, j;
+    uint32 i;
     m_binsLUT = MAX_BIN_LUT;
     m_binsLUTExt = m_binsLUT + 2;
 
     m_elementsLUT.resize    (m_binsLUTExt);
     m_multiplierLUT.resize  (m_binsLUTExt);
     m_boundLUT.resize       (m_binsLUTExt + 1);
-    m_invTransformLUT.resize(m_binsLUTExt);
-    m_fwdTransformLUT.resize(m_binsLUTExt);
     m_boundLUT[0] = 0.0;
 
     for (i = 0; i < m_binsLUTExt; i++) {
@@ -294,18 +303,18 @@ void TransferFunction::initLUT() {
       else
         m_boundLUT[i + 1] = pow( 10.0 , (double) (-index)); // upper bin boundary
       
-      double stepSize = (m_boundLUT[i + 1] -  m_boundLUT[i]) / (m_elementsLUT[i] - 1);
       m_multiplierLUT[i] = (double) (m_elementsLUT[i] - 1) / (m_boundLUT[i + 1] -  m_boundLUT[i]);
-
-      // Now allocate memory given the specified size
-      m_invTransformLUT[i].resize(m_elementsLUT[i]);
-      m_fwdTransformLUT[i].resize(m_elementsLUT[i]);
-      for (j = 0; j < m_elementsLUT[i] ; j++) {
-        double curValue = m_boundLUT[i] + (double) j * stepSize;
-        m_invTransformLUT[i][j] = inverse(curValue);
-        m_fwdTransformLUT[i][j] = forward(curValue);
-      }
     }
+    
+    // The tables themselves are shared by all transfer functions with the same parameters
+    m_invTransformLUT = LUTCache::acquire(m_lutKey + " inverse", m_binsLUTExt, MAX_ELEMENTS_LUT, [this](uint32 i, uint32 j) {
+      double stepSize = (m_boundLUT[i + 1] -  m_boundLUT[i]) / (m_elementsLUT[i] - 1);
+      return inverse(m_boundLUT[i] + (double) j * stepSize);
+    });
+    m_fwdTransformLUT = LUTCache::acquire(m_lutKey + " forward", m_binsLUTExt, MAX_ELEMENTS_LUT, [this](uint32 i, uint32 j) {
+      double stepSize = (m_boundLUT[i + 1] -  m_boundLUT[i]) / (m_elementsLUT[i] - 1);
+      return forward(m_boundLUT[i] + (double) j * stepSize);
+    });
     m_maxFwdLUT = m_boundLUT[m_binsLUTExt];
     m_maxInvLUT = m_boundLUT[m_binsLUTExt];
   }
@@ -320,13 +329,12 @@ void TransferFunction::initfwdTFDerivLUT() {
     //bool enableLUT = m_enableLUT;
     //m_enableLUT = FALSE;  // To initialize forward derivative using real TF calculations
                             // the above does not really seem necessary. Lets use what we have.
-    uint32 i, j;
+    uint32 i;
     m_derivBinsLUT = MAX_BIN_DERIV_LUT;
     m_derivBinsLUTExt = m_derivBinsLUT + 2;
     m_derivElementsLUT.resize    (m_derivBinsLUTExt);
     m_derivMultiplierLUT.resize  (m_derivBinsLUTExt);
     m_derivBoundLUT.resize       (m_derivBinsLUTExt + 1);
-    m_fwdTFDerivativeLUT.resize  (m_derivBinsLUTExt);
     
     m_derivBoundLUT[0] = 0.0;
     for (i = 0; i < m_derivBinsLUTExt; i++) {
@@ -339,16 +347,14 @@ void TransferFunction::initfwdTFDerivLUT() {
       else
         m_derivBoundLUT[i + 1] = pow( 10.0 , (double) (-index)); // upper bin boundary
 
-      double stepSize = (m_derivBoundLUT[i + 1] -  m_derivBoundLUT[i]) / (m_derivElementsLUT[i] - 1);
       m_derivMultiplierLUT[i] = (double) (m_derivElementsLUT[i] - 1) / (m_derivBoundLUT[i + 1] -  m_derivBoundLUT[i]);
-      
-      // Allocate also memory for the derivative LUT
-      m_fwdTFDerivativeLUT[i].resize(m_derivElementsLUT[i]);
-      for (j = 0; j < m_derivElementsLUT[i] ; j++) {
-        double curValue = m_derivBoundLUT[i] + (double) j * stepSize;
-        m_fwdTFDerivativeLUT[i][j] = forwardDerivative(curValue);
-      }
     }
+    
+    // The derivative is computed through getForward(), and therefore also depends on whether the forward LUT is used
+    m_fwdTFDerivativeLUT = LUTCache::acquire(m_lutKey + (m_enableLUT == TRUE ? " derivative lut" : " derivative"), m_derivBinsLUTExt, MAX_ELEMENTS_DERIV_LUT, [this](uint32 i, uint32 j) {
+      double stepSize = (m_derivBoundLUT[i + 1] -  m_derivBoundLUT[i]) / (m_derivElementsLUT[i] - 1);
+      return forwardDerivative(m_derivBoundLUT[i] + (double) j * stepSize);
+    });
     m_maxFwdTFDerLUT = m_derivBoundLUT[m_derivBinsLUTExt];
 
     //m_enableLUT = enableLUT;
@@ -358,10 +364,10 @@ void TransferFunction::initfwdTFDerivLUT() {
 
 double TransferFunction::inverseLUT(double value) {
   if (value <= 0.0)
-    return m_invTransformLUT[0][0];
+    return (*m_invTransformLUT)[0][0];
   else if (value >= m_maxInvLUT) {
     // top value, most likely 1.0
-    return m_invTransformLUT[m_binsLUTExt - 1][m_elementsLUT[m_binsLUTExt - 1] - 1];
+    return (*m_invTransformLUT)[m_binsLUTExt - 1][m_elementsLUT[m_binsLUTExt - 1] - 1];
   }
   else { // now search for value in the table
     for (uint32 i = 0; i < m_binsLUTExt; i++) {
@@ -370,7 +376,7 @@ double TransferFunction::inverseLUT(double value) {
         //return (m_invTransformMap[(int) dRound(satValue)]);
         int    valuePlus     = (int) dCeil(satValue) ;
         double distancePlus  = (double) valuePlus - satValue;
-        return (m_invTransformLUT[i][valuePlus - 1] * distancePlus + m_invTransformLUT[i][valuePlus] * (1.0 - distancePlus));
+        return ((*m_invTransformLUT)[i][valuePlus - 1] * distancePlus + (*m_invTransformLUT)[i][valuePlus] * (1.0 - distancePlus));
       }
     }
   }
@@ -379,10 +385,10 @@ double TransferFunction::inverseLUT(double value) {
 
 double TransferFunction::forwardLUT(double value) {
   if (value <= 0.0)
-    return m_fwdTransformLUT[0][0];
+    return (*m_fwdTransformLUT)[0][0];
   else if (value >= m_maxFwdLUT ) {
     // top value, most likely 1.0
-    return m_fwdTransformLUT[m_binsLUTExt - 1][m_elementsLUT[m_binsLUTExt - 1] - 1];
+    return (*m_fwdTransformLUT)[m_binsLUTExt - 1][m_elementsLUT[m_binsLUTExt - 1] - 1];
   }
   else {
     // now search for value in the table
@@ -391,7 +397,7 @@ double TransferFunction::forwardLUT(double value) {
         double satValue     = (value - m_boundLUT[i]) * m_multiplierLUT[i];
         int    valuePlus    = (int) dCeil(satValue) ;
         double distancePlus = (double) valuePlus - satValue;
-        return (m_fwdTransformLUT[i][valuePlus - 1] * distancePlus + m_fwdTransformLUT[i][valuePlus] * (1.0 - distancePlus));
+        return ((*m_fwdTransformLUT)[i][valuePlus - 1] * distancePlus + (*m_fwdTransformLUT)[i][valuePlus] * (1.0 - distancePlus));
       }
     }
   }
@@ -400,10 +406,10 @@ double TransferFunction::forwardLUT(double value) {
 
 double TransferFunction::forwardDerivLUT(double value) {
   if (value <= 0.0)
-    return m_fwdTFDerivativeLUT[0][0];
+    return (*m_fwdTFDerivativeLUT)[0][0];
   else if (value >= m_maxFwdTFDerLUT ) {
     // top value, most likely 1.0
-    return m_fwdTFDerivativeLUT[m_derivBinsLUT - 1][m_derivElementsLUT[m_derivBinsLUT - 1] - 1];
+    return (*m_fwdTFDerivativeLUT)[m_derivBinsLUT - 1][m_derivElementsLUT[m_derivBinsLUT - 1] - 1];
   }
   else {
     // now search for value in the table
@@ -412,7 +418,7 @@ double TransferFunction::forwardDerivLUT(double value) {
         double satValue     = (value - m_derivBoundLUT[i]) * m_derivMultiplierLUT[i];
         int    valuePlus    = (int) dCeil(satValue) ;
         double distancePlus = (double) valuePlus - satValue;
-        return (m_fwdTFDerivativeLUT[i][valuePlus - 1] * distancePlus + m_fwdTFDerivativeLUT[i][valuePlus] * (1.0 - distancePlus));
+        return ((*m_fwdTFDerivativeLUT)[i][valuePlus - 1] * distancePlus + (*m_fwdTFDerivativeLUT)[i][valuePlus] * (1.0 - distancePlus));
       }
     }
   }
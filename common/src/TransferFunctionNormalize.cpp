@@ -86,6 +86,16 @@ double TransferFunctionNormalize::inverse(double value) {
   return (value / m_scale);
 }
 
+bool TransferFunctionNormalize::getForwardScale(double *scale) {
+  *scale = m_normalFactor * m_scale;
+  return (m_enableLUT == FALSE);
+}
+
+bool TransferFunctionNormalize::getInverseScale(double *scale) {
+  *scale = 1.0 / (m_normalFactor * m_scale);
+  return (m_enableLUT == FALSE);
+}
+
 
 
 
@@ -84,6 +84,17 @@ double TransferFunctionNull::forward(double value) {
 double TransferFunctionNull::inverse(double value) {
   return value;
 }
+
+// Only the normalization factor is applied to frames
+bool TransferFunctionNull::getForwardScale(double *scale) {
+  *scale = m_normalFactor;
+  return TRUE;
+}
+
+bool TransferFunctionNull::getInverseScale(double *scale) {
+  *scale = 1.0 / m_normalFactor;
+  return TRUE;
+}
 /*
 
 void TransferFunctionNull::forward ( Frame* out, const Frame *inp, int component) {
@@ -58,6 +58,7 @@
 
 #include "Global.H"
 #include "ProjectParameters.H"
+#include "ThreadPool.H"
 #include "ChromaConvert.H"
 #include "ChromaConvertYUV.H"
 
@@ -189,6 +190,7 @@ int main(int argc, char **argv) {
   
   // Prepare parameters
   params->configure(parfile, cl_params, numCLParams, readConfig );
+  ThreadPool::setThreadCount(params->m_numberOfThreads);
   
   hdrProcess = ChromaConvert::create((ProjectParameters *) params);
   
@@ -106,6 +106,7 @@ IntegerParameter intParameterList[] = {
 
   //! Various Params
   { "NumberOfFrames",         &pParams->m_numberOfFrames,                     1,           1,      INT_INF,    "Number of Frames to process"       },
+  { "NumberOfThreads",        &pParams->m_numberOfThreads,                    0,           0,      INT_INF,    "Number of threads (0: auto)"       },
   { "InputFileHeader",        &pParams->m_inputFile.m_fileHeader,             0,           0,      INT_INF,    "Source Header (bytes)"             },
   { "StartFrame",             &pParams->m_inputFile.m_startFrame,             0,           0,      INT_INF,    "Source Start Frame"                },
   { "FrameSkip",              &pParams->m_frameSkip,                          0,           0,      INT_INF,    "Source Frame Skipping"             },
@@ -58,6 +58,7 @@
 
 #include "Global.H"
 #include "ProjectParameters.H"
+#include "ThreadPool.H"
 #include "Parameters.H"
 #include "GamutTest.H"
 #include "GamutTestFrame.H"
@@ -207,6 +208,7 @@ int main(int argc, char **argv) {
   
   // Prepare parameters
   params->configure(parfile, cl_params, numCLParams, readConfig );
+  ThreadPool::setThreadCount(params->m_numberOfThreads);
   
   hdrProcess = GamutTest::create((ProjectParameters *) params);
   
@@ -106,6 +106,7 @@ IntegerParameter intParameterList[] = {
   { "CropOffsetBottom", &pParams->m_cropOffsetBottom,                 0,      -65536,      65536,    "Input Crop Offset Bottom position"},
   
   { "NumberOfFrames",         &pParams->m_numberOfFrames,                      1,           1,    INT_INF,    "Number of Frames to process"          },
+  { "NumberOfThreads",        &pParams->m_numberOfThreads,                     0,           0,    INT_INF,    "Number of threads (0: auto)"          },
   // SSIM parameters
   { "SSIMBlockDistance",      &ssim->m_blockDistance,                          1,           1,        128,    "Block Distance for SSIM computation"  },
   { "SSIMBlockSizeX",         &ssim->m_blockSizeX,                             4,           4,        128,    "Block Width for SSIM computation"     },
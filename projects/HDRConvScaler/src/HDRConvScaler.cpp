@@ -58,6 +58,7 @@
 
 #include "Global.H"
 #include "ProjectParameters.H"
+#include "ThreadPool.H"
 #include "HDRConvScaler.H"
 #include "HDRConvScalerTIFF.H"
 #include "HDRConvScalerEXR.H"
@@ -195,6 +196,7 @@ int main(int argc, char **argv) {
   
   // Prepare parameters
   params->configure(parfile, cl_params, numCLParams, readConfig );
+  ThreadPool::setThreadCount(params->m_numberOfThreads);
   
   hdrProcess = HDRConvScaler::create((ProjectParameters *) params);
   
@@ -58,6 +58,8 @@
 
 #include "Global.H"
 #include "ProjectParameters.H"
+#include "ThreadPool.H"
+#include "LUTCache.H"
 #include "HDRConvert.H"
 #include "HDRConvertTIFF.H"
 #include "HDRConvertEXR.H"
@@ -213,6 +215,10 @@ int main(int argc, char **argv) {
   
   // Prepare parameters
   params->configure(parfile, cl_params, numCLParams, readConfig );
+  ThreadPool::setThreadCount(params->m_numberOfThreads);
+  
+  if (params->m_lutCacheFile[0] != '\0')
+    LUTCache::setCacheFile(params->m_lutCacheFile);
   
   hdrProcess = HDRConvert::create((ProjectParameters *) params);
   
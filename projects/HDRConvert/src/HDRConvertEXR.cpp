@@ -56,132 +56,160 @@
 
 HDRConvertEXR::HDRConvertEXR(ProjectParameters *inputParams) {
   m_noOfFrameStores = 5;        // Number should only be increased to support more frame buffers for different processing
-  m_oFrameStore       = NULL;
+  m_numberOfOutputs = inputParams->m_numberOfOutputs;
   m_iFrameStore       = NULL;
-  m_dFrameStore       = NULL;
-  
-  for (int index = 0; index < m_noOfFrameStores; index++) {
-    m_pFrameStore[index]     = NULL;
-    m_pDFrameStore[index]    = NULL;
-  }
-  
-  m_convertProcess           = NULL;
-  m_colorTransform           = NULL;
-  m_normalizeFunction        = NULL;
-  m_outputTransferFunction   = NULL;
+  m_noiseFrameStore   = NULL;
+  m_linearFrame       = NULL;
+
+  m_outputFiles [0] = &inputParams->m_outputFile;
+  m_outputFormat[0] = &inputParams->m_output;
+  for (int index = 1; index < MAX_OUTPUTS; index++) {
+    m_outputFiles [index] = &inputParams->m_extraOutputFile[index - 1];
+    m_outputFormat[index] = &inputParams->m_extraOutput[index - 1];
+  }
+
+  for (int o = 0; o < MAX_OUTPUTS; o++) {
+    for (int index = 0; index < m_noOfFrameStores; index++) {
+      if (index < m_noOfFrameStores - 1)
+        m_pFrameStore[o][index] = NULL;
+      m_pDFrameStore[o][index]  = NULL;
+    }
+    m_oFrameStore[o]            = NULL;
+    m_dFrameStore[o]            = NULL;
+    m_outputFrame[o]            = NULL;
+    m_convertProcess[o]         = NULL;
+    m_colorTransform[o]         = NULL;
+    m_convertTo420[o]           = NULL;
+    m_chromaScale[o]            = NULL;
+    m_normalizeFunction[o]      = NULL;
+    m_outputTransferFunction[o] = NULL;
+    m_outDisplayGammaAdjust[o]  = NULL;
+    m_preEncodingLUT[o]         = NULL;
+    m_useSingleTransferStep[o]  = FALSE;
+    m_linearDownConversion[o]   = inputParams->m_linearDownConversion;
+    m_rgbDownConversion[o]      = inputParams->m_rgbDownConversion;
+  }
+
   m_inputTransferFunction    = NULL;
   m_inputFrame               = NULL;
-  m_outputFrame              = NULL;
-  m_convertTo420             = NULL;
-  
+
   m_addNoise                 = NULL;
   m_colorSpaceConvert        = NULL;
   m_colorSpaceFrame          = NULL;
   m_scaledFrame              = NULL;
   m_frameScale               = NULL;
-  m_chromaScale              = NULL;
-  
+
   m_frameFilterNoise0        = NULL;
   m_frameFilterNoise1        = NULL;
   m_frameFilterNoise2        = NULL;
-  
+
   m_useMinMax                = inputParams->m_useMinMax;
-  
+
   m_filterInFloat            = inputParams->m_filterInFloat;
-  
+
   m_inputFile                = &inputParams->m_inputFile;
   m_outputFile               = &inputParams->m_outputFile;
   m_startFrame               =  m_inputFile->m_startFrame;
-  
+
   m_cropOffsetLeft           = inputParams->m_cropOffsetLeft;
   m_cropOffsetTop            = inputParams->m_cropOffsetTop;
   m_cropOffsetRight          = inputParams->m_cropOffsetRight;
   m_cropOffsetBottom         = inputParams->m_cropOffsetBottom;
 
   m_croppedFrameStore        = NULL;
-  
-  m_linearDownConversion     = inputParams->m_linearDownConversion;
-  if (m_linearDownConversion == TRUE)
+
+  if (inputParams->m_linearDownConversion == TRUE)
     inputParams->m_closedLoopConversion = CLT_NULL;
-    
-  m_rgbDownConversion        = inputParams->m_rgbDownConversion;
+
   m_bUseWienerFiltering      = inputParams->m_bUseWienerFiltering;
   m_bUse2DSepFiltering       = inputParams->m_bUse2DSepFiltering;
   m_bUseNLMeansFiltering     = inputParams->m_bUseNLMeansFiltering;
 
   m_b2DSepMode               = inputParams->m_b2DSepMode;
-  
+
   m_srcDisplayGammaAdjust    = NULL;
-  m_outDisplayGammaAdjust    = NULL;
   m_toneMapping              = NULL;
 }
 
 void HDRConvertEXR::deleteMemory() {
-  
-  // delete processing frame stores if previous allocated
-  for (int i = 0; i < m_noOfFrameStores; i++) {
-    if (m_pFrameStore[i] != NULL) {
-      delete m_pFrameStore[i];
-      m_pFrameStore[i] = NULL;
+
+  for (int o = 0; o < m_numberOfOutputs; o++) {
+    // delete processing frame stores if previous allocated
+    for (int i = 0; i < m_noOfFrameStores; i++) {
+      if (i < m_noOfFrameStores - 1 && m_pFrameStore[o][i] != NULL) {
+        delete m_pFrameStore[o][i];
+        m_pFrameStore[o][i] = NULL;
+      }
+      if (m_pDFrameStore[o][i] != NULL) {
+        delete m_pDFrameStore[o][i];
+        m_pDFrameStore[o][i] = NULL;
+      }
     }
-    if (m_pDFrameStore[i] != NULL) {
-      delete m_pDFrameStore[i];
-      m_pDFrameStore[i] = NULL;
+
+    // output frame objects
+    if (m_oFrameStore[o] != NULL) {
+      delete m_oFrameStore[o];
+      m_oFrameStore[o] = NULL;
+    }
+
+    if (m_colorTransform[o] != NULL) {
+      delete m_colorTransform[o];
+      m_colorTransform[o] = NULL;
+    }
+
+    if (m_convertTo420[o] != NULL){
+      delete m_convertTo420[o];
+      m_convertTo420[o] = NULL;
+    }
+
+    if (m_dFrameStore[o] != NULL) {
+      delete m_dFrameStore[o];
+      m_dFrameStore[o] = NULL;
+    }
+
+    if (m_chromaScale[o] != NULL) {
+      delete m_chromaScale[o];
+      m_chromaScale[o] = NULL;
+    }
+
+    if (m_convertProcess[o] != NULL){
+      delete m_convertProcess[o];
+      m_convertProcess[o] = NULL;
+    }
+
+    if (m_outDisplayGammaAdjust[o] != NULL) {
+      delete m_outDisplayGammaAdjust[o];
+      m_outDisplayGammaAdjust[o] = NULL;
     }
   }
- 
-   // output frame objects
-  if (m_oFrameStore != NULL) {
-    delete m_oFrameStore;
-    m_oFrameStore = NULL;
+
+  if (m_noiseFrameStore != NULL) {
+    delete m_noiseFrameStore;
+    m_noiseFrameStore = NULL;
   }
+
   // input frame objects
   if (m_iFrameStore != NULL) {
     delete m_iFrameStore;
     m_iFrameStore = NULL;
   }
-  
-  if (m_colorTransform != NULL) {
-    delete m_colorTransform;
-    m_colorTransform = NULL;
-  }
-  
-  if (m_convertTo420 != NULL){
-    delete m_convertTo420;
-    m_convertTo420 = NULL;
-  }
-  
-  if (m_dFrameStore != NULL) {
-    delete m_dFrameStore;
-    m_dFrameStore = NULL;
-  }
-  
-  if (m_chromaScale != NULL) {
-    delete m_chromaScale;
-    m_chromaScale = NULL;
-  }
-  
+
   if (m_frameScale != NULL) {
     delete m_frameScale;
     m_frameScale = NULL;
   }
- 
-  if (m_convertProcess != NULL){
-    delete m_convertProcess;
-    m_convertProcess = NULL;
-  }
-  
+
   // Cropped frame store
   if (m_croppedFrameStore != NULL) {
     delete m_croppedFrameStore;
     m_croppedFrameStore = NULL;
   }
-  
+
   if (m_colorSpaceConvert != NULL) {
     delete m_colorSpaceConvert;
     m_colorSpaceConvert = NULL;
   }
-  
+
   if (m_colorSpaceFrame != NULL) {
     delete m_colorSpaceFrame;
     m_colorSpaceFrame = NULL;
@@ -192,20 +220,20 @@ void HDRConvertEXR::deleteMemory() {
     m_srcDisplayGammaAdjust = NULL;
   }
 
-  if (m_outDisplayGammaAdjust != NULL) {
-    delete m_outDisplayGammaAdjust;
-    m_outDisplayGammaAdjust = NULL;
-  }
-  
   if (m_toneMapping != NULL) {
     delete m_toneMapping;
     m_toneMapping = NULL;
   }
-  
+
   if (m_scaledFrame != NULL) {
     delete m_scaledFrame;
     m_scaledFrame = NULL;
   }
+
+  if (m_linearFrame != NULL) {
+    delete m_linearFrame;
+    m_linearFrame = NULL;
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -213,42 +241,49 @@ void HDRConvertEXR::deleteMemory() {
 //-----------------------------------------------------------------------------
 
 void HDRConvertEXR::destroy() {
-  
+
   deleteMemory();
-  
+
   if (m_addNoise != NULL) {
     delete m_addNoise;
     m_addNoise = NULL;
   }
-  
+
   if (m_inputFrame != NULL) {
     delete m_inputFrame;
     m_inputFrame = NULL;
   }
-  
-  if (m_outputFrame != NULL) {
-    delete m_outputFrame;
-    m_outputFrame = NULL;
-  }
-  
-  if (m_normalizeFunction != NULL) {
-    delete m_normalizeFunction;
-    m_normalizeFunction = NULL;
-  }
-  if (m_outputTransferFunction != NULL) {
-    delete m_outputTransferFunction;
-    m_outputTransferFunction = NULL;
+
+  for (int o = 0; o < m_numberOfOutputs; o++) {
+    if (m_outputFrame[o] != NULL) {
+      delete m_outputFrame[o];
+      m_outputFrame[o] = NULL;
+    }
+
+    if (m_normalizeFunction[o] != NULL) {
+      delete m_normalizeFunction[o];
+      m_normalizeFunction[o] = NULL;
+    }
+    if (m_outputTransferFunction[o] != NULL) {
+      delete m_outputTransferFunction[o];
+      m_outputTransferFunction[o] = NULL;
+    }
+    if (m_preEncodingLUT[o] != NULL) {
+      delete m_preEncodingLUT[o];
+      m_preEncodingLUT[o] = NULL;
+    }
   }
+
   if (m_inputTransferFunction != NULL) {
     delete m_inputTransferFunction;
     m_inputTransferFunction = NULL;
   }
-  
+
   if (m_frameFilterNoise0 != NULL) {
     delete m_frameFilterNoise0;
     m_frameFilterNoise0 = NULL;
   }
-  
+
   if (m_frameFilterNoise1 != NULL) {
     delete m_frameFilterNoise1;
     m_frameFilterNoise1 = NULL;
@@ -258,9 +293,10 @@ void HDRConvertEXR::destroy() {
     delete m_frameFilterNoise2;
     m_frameFilterNoise2 = NULL;
   }
-  
+
   IOFunctions::closeFile(m_inputFile);
-  IOFunctions::closeFile(m_outputFile);
+  for (int o = 0; o < m_numberOfOutputs; o++)
+    IOFunctions::closeFile(m_outputFiles[o]);
 }
 
 //-----------------------------------------------------------------------------
@@ -269,12 +305,9 @@ void HDRConvertEXR::destroy() {
 void HDRConvertEXR::allocateFrameStores(ProjectParameters *inputParams, FrameFormat   *input, FrameFormat   *output) {
 
   int width, height;
-  
+
   deleteMemory();
- 
-  // Create output file
-  IOFunctions::openFile (m_outputFile, OPENFLAGS_WRITE, OPEN_PERMISSIONS);
-  
+
   // create frame memory as necessary
   // Input. This has the same format as the Input file.
   m_iFrameStore  = new Frame(m_inputFrame->m_width[Y_COMP], m_inputFrame->m_height[Y_COMP], m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
@@ -295,123 +328,147 @@ void HDRConvertEXR::allocateFrameStores(ProjectParameters *inputParams, FrameFor
     height = m_inputFrame->m_height[Y_COMP];
   }
 
-  // Processing also happens here in the same space (for now). Likely we should change this into floats, or have this depending on the process we are doing (int to floats or floats to ints).
-  // Currently lets set this to the same format as the input store.
-  m_pFrameStore[0]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
-  m_pFrameStore[0]->clear();
-  
-  // Also creation of frame store for the normalized images
-  m_pFrameStore[1]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
-  m_pFrameStore[1]->clear();
-  // and of the transfer function converted pictures
-  m_pFrameStore[2]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, output->m_transferFunction, m_inputFrame->m_systemGamma);
-  m_pFrameStore[2]->clear();
-  
-
   // Noise addition frame store. This is of the same type as the input since we would be adding noise at that stage
-  m_pFrameStore[4]  = new Frame(width, height, m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
-  m_pFrameStore[4]->clear();
+  m_noiseFrameStore  = new Frame(width, height, m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
+  m_noiseFrameStore->clear();
 
-  
-  // Output. Since we don't support scaling, lets reset the width and height here.
-  
-  m_outputFrame = Output::create(m_outputFile, output);
-  
-  // Frame store for altering color space
+  // Frame store for altering color space. All outputs share the primaries of the main output.
   if (m_inputFrame->m_colorSpace == CM_XYZ && output->m_colorSpace != CM_XYZ && output->m_colorPrimaries != CP_NONE ) {
     m_colorSpaceFrame   = new Frame(width, height, TRUE, CM_RGB, output->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
+    m_colorSpaceConvert = ColorTransform::create(m_iFrameStore->m_colorSpace, m_iFrameStore->m_colorPrimaries, CM_RGB, output->m_colorPrimaries, inputParams->m_transformPrecision, inputParams->m_useHighPrecisionTransform, CLT_NULL, 0, 0);
   }
   else {
     m_colorSpaceFrame   = new Frame(width, height, TRUE, m_inputFrame->m_colorSpace, output->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
+    m_colorSpaceConvert = ColorTransform::create(m_iFrameStore->m_colorSpace, m_iFrameStore->m_colorPrimaries, m_iFrameStore->m_colorSpace, output->m_colorPrimaries, inputParams->m_transformPrecision, inputParams->m_useHighPrecisionTransform, CLT_NULL, input->m_iConstantLuminance, 0);
   }
   m_colorSpaceFrame->clear();
 
+  m_frameScale  = FrameScale::create(width, height, output->m_width[Y_COMP], output->m_height[Y_COMP], &inputParams->m_fsParams, inputParams->m_chromaDownsampleFilter, output->m_chromaLocation[FP_FRAME], inputParams->m_useMinMax);
+  m_scaledFrame = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NORMAL, 1.0);
+
+  // The output display adjustment is applied in place, so all but the last output work on a copy of the scaled frame
+  if (m_numberOfOutputs > 1 && output->m_displayAdjustment != DA_NULL) {
+    m_linearFrame = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NORMAL, 1.0);
+  }
+
+  if (m_bUseWienerFiltering == TRUE) {
+    m_frameFilterNoise0 = FrameFilter::create(output->m_width[Y_COMP], output->m_height[Y_COMP], FT_WIENER2DD);
+  }
+
+  if (m_bUse2DSepFiltering == TRUE) {
+    m_frameFilterNoise1 = FrameFilter::create(output->m_width[Y_COMP], output->m_height[Y_COMP], FT_2DSEP, m_b2DSepMode);
+  }
+
+  if (m_bUseNLMeansFiltering == TRUE) {
+    m_frameFilterNoise2 = FrameFilter::create(output->m_width[Y_COMP], output->m_height[Y_COMP], FT_NLMEANS);
+  }
+
+  for (int o = 0; o < m_numberOfOutputs; o++) {
+    allocateOutput(inputParams, o);
+  }
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    Allocate the frame stores and create the processes of a single
+ *    output, i.e. everything after the (shared) scaling stage.
+ ***********************************************************************
+ */
+void HDRConvertEXR::allocateOutput(ProjectParameters *inputParams, int index) {
+  IOVideo     *outputFile = m_outputFiles[index];
+  FrameFormat *output     = m_outputFormat[index];
+  Frame      **pFrameStore  = m_pFrameStore[index];
+  Frame      **pDFrameStore = m_pDFrameStore[index];
+
+  // Create output file
+  IOFunctions::openFile (outputFile, OPENFLAGS_WRITE, OPEN_PERMISSIONS);
+
+  // Processing also happens here in the same space (for now). Likely we should change this into floats, or have this depending on the process we are doing (int to floats or floats to ints).
+  // Currently lets set this to the same format as the input store.
+  pFrameStore[0]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
+  pFrameStore[0]->clear();
+
+  // Also creation of frame store for the normalized images
+  pFrameStore[1]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, m_inputFrame->m_transferFunction, m_inputFrame->m_systemGamma);
+  pFrameStore[1]->clear();
+  // and of the transfer function converted pictures
+  pFrameStore[2]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_isFloat, m_inputFrame->m_colorSpace, m_inputFrame->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, output->m_transferFunction, m_inputFrame->m_systemGamma);
+  pFrameStore[2]->clear();
+
+  // Output. Since we don't support scaling, lets reset the width and height here.
+
+  outputFile->m_numFrames = inputParams->m_numberOfFrames;
+  m_outputFrame[index] = Output::create(outputFile, output);
 
-  m_oFrameStore  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], output->m_isFloat, output->m_colorSpace, output->m_colorPrimaries, output->m_chromaFormat, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, output->m_systemGamma);
-  m_oFrameStore->clear();
+  m_oFrameStore[index]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], output->m_isFloat, output->m_colorSpace, output->m_colorPrimaries, output->m_chromaFormat, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, output->m_systemGamma);
+  m_oFrameStore[index]->clear();
 
   if (output->m_chromaFormat != m_inputFrame->m_chromaFormat) {
     if (m_filterInFloat == TRUE) {
-  //m_outputFile->m_format.m_height[Y_COMP] = output->m_height[Y_COMP] = height;
-  //m_outputFile->m_format.m_width [Y_COMP] = output->m_width [Y_COMP] = width;
-  m_outputFile->m_format.m_height[Y_COMP] = output->m_height[Y_COMP];
-  m_outputFile->m_format.m_width [Y_COMP] = output->m_width [Y_COMP];
+  //outputFile->m_format.m_height[Y_COMP] = output->m_height[Y_COMP] = height;
+  //outputFile->m_format.m_width [Y_COMP] = output->m_width [Y_COMP] = width;
+  outputFile->m_format.m_height[Y_COMP] = output->m_height[Y_COMP];
+  outputFile->m_format.m_width [Y_COMP] = output->m_width [Y_COMP];
 
-  m_pFrameStore[3]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_isFloat, output->m_colorSpace, output->m_colorPrimaries, output->m_chromaFormat, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, output->m_systemGamma);      
+  pFrameStore[3]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_isFloat, output->m_colorSpace, output->m_colorPrimaries, output->m_chromaFormat, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, output->m_systemGamma);
     }
     else {
-      m_pFrameStore[3]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], output->m_isFloat, output->m_colorSpace, output->m_colorPrimaries, m_inputFrame->m_chromaFormat, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, output->m_systemGamma);
+      pFrameStore[3]  = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], output->m_isFloat, output->m_colorSpace, output->m_colorPrimaries, m_inputFrame->m_chromaFormat, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, output->m_systemGamma);
     }
-    m_pFrameStore[3]->clear();
+    pFrameStore[3]->clear();
   }
   else {
-    m_pFrameStore[3] = NULL;
+    pFrameStore[3] = NULL;
   }
 
   // Format conversion process
-  m_convertProcess = Convert::create(&m_iFrameStore->m_format, output, &inputParams->m_cvParams);
-  
-  
+  m_convertProcess[index] = Convert::create(&m_iFrameStore->m_format, output, &inputParams->m_cvParams);
+
+
   // initiate the color transform process. Maybe we can move this in the process section though
-  
-  if (m_iFrameStore->m_colorSpace == CM_XYZ && m_oFrameStore->m_colorSpace != CM_XYZ && m_oFrameStore->m_colorPrimaries != CP_NONE) {
-    m_colorSpaceConvert = ColorTransform::create(m_iFrameStore->m_colorSpace, m_iFrameStore->m_colorPrimaries, CM_RGB, m_oFrameStore->m_colorPrimaries, inputParams->m_transformPrecision, inputParams->m_useHighPrecisionTransform, CLT_NULL, 0, 0);
-    m_colorTransform = ColorTransform::create(CM_RGB, m_oFrameStore->m_colorPrimaries, m_oFrameStore->m_colorSpace, m_oFrameStore->m_colorPrimaries, inputParams->m_transformPrecision, inputParams->m_useHighPrecisionTransform, inputParams->m_closedLoopConversion, 0, output->m_iConstantLuminance);
+
+  if (m_iFrameStore->m_colorSpace == CM_XYZ && m_oFrameStore[index]->m_colorSpace != CM_XYZ && m_oFrameStore[index]->m_colorPrimaries != CP_NONE) {
+    m_colorTransform[index] = ColorTransform::create(CM_RGB, m_oFrameStore[index]->m_colorPrimaries, m_oFrameStore[index]->m_colorSpace, m_oFrameStore[index]->m_colorPrimaries, inputParams->m_transformPrecision, inputParams->m_useHighPrecisionTransform, inputParams->m_closedLoopConversion, 0, output->m_iConstantLuminance);
   }
   else {
-    m_colorSpaceConvert = ColorTransform::create(m_iFrameStore->m_colorSpace, m_iFrameStore->m_colorPrimaries, m_iFrameStore->m_colorSpace, m_oFrameStore->m_colorPrimaries, inputParams->m_transformPrecision, inputParams->m_useHighPrecisionTransform, CLT_NULL, input->m_iConstantLuminance, 0);
-    m_colorTransform = ColorTransform::create(m_iFrameStore->m_colorSpace, m_oFrameStore->m_colorPrimaries, m_oFrameStore->m_colorSpace, m_oFrameStore->m_colorPrimaries, inputParams->m_transformPrecision, inputParams->m_useHighPrecisionTransform, inputParams->m_closedLoopConversion, 0, output->m_iConstantLuminance, output->m_transferFunction, output->m_bitDepthComp[Y_COMP], output->m_sampleRange, inputParams->m_chromaDownsampleFilter, inputParams->m_chromaUpsampleFilter, inputParams->m_useAdaptiveDownsampling, inputParams->m_useAdaptiveUpsampling, inputParams->m_useMinMax, inputParams->m_closedLoopIterations, output->m_chromaFormat, output->m_chromaLocation, inputParams->m_filterInFloat, inputParams->m_enableTFLUTs, &inputParams->m_ctParams);
+    m_colorTransform[index] = ColorTransform::create(m_iFrameStore->m_colorSpace, m_oFrameStore[index]->m_colorPrimaries, m_oFrameStore[index]->m_colorSpace, m_oFrameStore[index]->m_colorPrimaries, inputParams->m_transformPrecision, inputParams->m_useHighPrecisionTransform, inputParams->m_closedLoopConversion, 0, output->m_iConstantLuminance, output->m_transferFunction, output->m_bitDepthComp[Y_COMP], output->m_sampleRange, inputParams->m_chromaDownsampleFilter, inputParams->m_chromaUpsampleFilter, inputParams->m_useAdaptiveDownsampling, inputParams->m_useAdaptiveUpsampling, inputParams->m_useMinMax, inputParams->m_closedLoopIterations, output->m_chromaFormat, output->m_chromaLocation, inputParams->m_filterInFloat, inputParams->m_enableTFLUTs, &inputParams->m_ctParams);
   }
-  
+
   // Chroma subsampling
   // We may wish to create a single convert class that uses as inputs the output resolution as well the input and output chroma format, and the downsampling/upsampling method. That would make the code easier to handle.
   // To be done later.
-    m_convertTo420 = ConvertColorFormat::create(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_chromaFormat, output->m_chromaFormat, inputParams->m_chromaDownsampleFilter,  m_inputFrame->m_chromaLocation, output->m_chromaLocation, inputParams->m_useAdaptiveDownsampling, inputParams->m_useMinMax);
-    
+    m_convertTo420[index] = ConvertColorFormat::create(output->m_width[Y_COMP], output->m_height[Y_COMP], m_inputFrame->m_chromaFormat, output->m_chromaFormat, inputParams->m_chromaDownsampleFilter,  m_inputFrame->m_chromaLocation, output->m_chromaLocation, inputParams->m_useAdaptiveDownsampling, inputParams->m_useMinMax);
+
   if (output->m_chromaFormat != CF_420) {
-    m_linearDownConversion = FALSE;
-    m_rgbDownConversion = FALSE;
+    m_linearDownConversion[index] = FALSE;
+    m_rgbDownConversion[index] = FALSE;
   }
-    
+
   // To simplify things we always create the frame store for linear downconversion regardless of the target when this flag is enabled (To be cleaned later)
-  if (m_linearDownConversion == TRUE) {
+  if (m_linearDownConversion[index] == TRUE) {
     int dWidth  = output->m_width [Y_COMP] / 2;
     int dHeight = output->m_height[Y_COMP] / 2;
-    m_pDFrameStore[3]  = new Frame(output->m_width [Y_COMP], output->m_height[Y_COMP], TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NORMAL, 1.0); 
+    pDFrameStore[3]  = new Frame(output->m_width [Y_COMP], output->m_height[Y_COMP], TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NORMAL, 1.0);
+
+    m_dFrameStore[index]  = new Frame(dWidth, dHeight, TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NORMAL, 1.0);
+    pDFrameStore[4]  = new Frame(dWidth, dHeight, TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NULL, 1.0);
+    m_chromaScale[index]   = FrameScale::create(output->m_width[Y_COMP], output->m_height[Y_COMP], dWidth, dHeight, &inputParams->m_fsParams, inputParams->m_chromaDownsampleFilter, output->m_chromaLocation[FP_FRAME], inputParams->m_useMinMax);
 
-    m_dFrameStore  = new Frame(dWidth, dHeight, TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NORMAL, 1.0); 
-    m_pDFrameStore[4]  = new Frame(dWidth, dHeight, TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NULL, 1.0); 
-    m_chromaScale   = FrameScale::create(output->m_width[Y_COMP], output->m_height[Y_COMP], dWidth, dHeight, &inputParams->m_fsParams, inputParams->m_chromaDownsampleFilter, output->m_chromaLocation[FP_FRAME], inputParams->m_useMinMax);
-    
-    m_pDFrameStore[0]  = new Frame(dWidth, dHeight, TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
-    m_pDFrameStore[1]  = new Frame(dWidth, dHeight, TRUE, output->m_colorSpace, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
-    //m_pDFrameStore[2]  = new Frame(dWidth, dHeight, TRUE, output->m_colorSpace, output->m_colorPrimaries, output->m_chromaFormat, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
+    pDFrameStore[0]  = new Frame(dWidth, dHeight, TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
+    pDFrameStore[1]  = new Frame(dWidth, dHeight, TRUE, output->m_colorSpace, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
+    //pDFrameStore[2]  = new Frame(dWidth, dHeight, TRUE, output->m_colorSpace, output->m_colorPrimaries, output->m_chromaFormat, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
 
   }
-  else if (m_rgbDownConversion == TRUE) {
+  else if (m_rgbDownConversion[index] == TRUE) {
     int dWidth  = output->m_width [Y_COMP] / 2;
     int dHeight = output->m_height[Y_COMP] / 2;
-    
-    m_dFrameStore  = new Frame(dWidth, dHeight, TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0); 
-    m_chromaScale   = FrameScale::create(output->m_width[Y_COMP], output->m_height[Y_COMP], dWidth, dHeight, &inputParams->m_fsParams, inputParams->m_chromaDownsampleFilter, output->m_chromaLocation[FP_FRAME], inputParams->m_useMinMax);
-    
-    m_pDFrameStore[0]  = new Frame(dWidth, dHeight, TRUE, output->m_colorSpace, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
-  }  
-  m_frameScale  = FrameScale::create(width, height, output->m_width[Y_COMP], output->m_height[Y_COMP], &inputParams->m_fsParams, inputParams->m_chromaDownsampleFilter, output->m_chromaLocation[FP_FRAME], inputParams->m_useMinMax);
-  m_scaledFrame = new Frame(output->m_width[Y_COMP], output->m_height[Y_COMP], TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, TF_NORMAL, 1.0);
-  
-  if (m_bUseWienerFiltering == TRUE) {
-    m_frameFilterNoise0 = FrameFilter::create(output->m_width[Y_COMP], output->m_height[Y_COMP], FT_WIENER2DD);
-  }
-  
-  if (m_bUse2DSepFiltering == TRUE) {
-    m_frameFilterNoise1 = FrameFilter::create(output->m_width[Y_COMP], output->m_height[Y_COMP], FT_2DSEP, m_b2DSepMode);
-  }
-  
-  if (m_bUseNLMeansFiltering == TRUE) {
-    m_frameFilterNoise2 = FrameFilter::create(output->m_width[Y_COMP], output->m_height[Y_COMP], FT_NLMEANS);
-  }
 
+    m_dFrameStore[index]  = new Frame(dWidth, dHeight, TRUE, CM_RGB, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
+    m_chromaScale[index]   = FrameScale::create(output->m_width[Y_COMP], output->m_height[Y_COMP], dWidth, dHeight, &inputParams->m_fsParams, inputParams->m_chromaDownsampleFilter, output->m_chromaLocation[FP_FRAME], inputParams->m_useMinMax);
+
+    pDFrameStore[0]  = new Frame(dWidth, dHeight, TRUE, output->m_colorSpace, output->m_colorPrimaries, CF_444, output->m_sampleRange, output->m_bitDepthComp[Y_COMP], output->m_isInterlaced, output->m_transferFunction, 1.0);
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -420,7 +477,7 @@ void HDRConvertEXR::allocateFrameStores(ProjectParameters *inputParams, FrameFor
 void HDRConvertEXR::init (ProjectParameters *inputParams) {
   FrameFormat   *input  = &inputParams->m_source;
   FrameFormat   *output = &inputParams->m_output;
-  
+
    // Input frame objects initialization
   IOFunctions::openFile (m_inputFile);
 
@@ -430,9 +487,9 @@ void HDRConvertEXR::init (ProjectParameters *inputParams) {
   }
 
   // create memory for reading the input filesource
-  
+
   m_inputFrame = Input::create(m_inputFile, input, inputParams);
-  
+
   // Read first frame just to see if there is need to update any parameters. This is very important for OpenEXR files
   if (m_inputFrame->readOneFrame(m_inputFile, 0, m_inputFile->m_fileHeader, m_startFrame) == TRUE) {
     allocateFrameStores(inputParams, input, output);
@@ -442,43 +499,280 @@ void HDRConvertEXR::init (ProjectParameters *inputParams) {
     destroy();
     exit(EXIT_FAILURE);
   }
-    
+
   m_addNoise = AddNoise::create(inputParams->m_addNoise, inputParams->m_noiseVariance, inputParams->m_noiseMean);
   m_inputTransferFunction  = TransferFunction::create(input->m_transferFunction, TRUE, inputParams->m_srcNormalScale, input->m_systemGamma, inputParams->m_srcMinValue, inputParams->m_srcMaxValue, inputParams->m_enableTFunctionLUT);
 
-  if ( output->m_iConstantLuminance !=0 || (output->m_transferFunction != TF_NULL && output->m_transferFunction != TF_POWER && ( inputParams->m_useSingleTransferStep == FALSE || (output->m_transferFunction != TF_PQ && output->m_transferFunction != TF_HPQ && output->m_transferFunction != TF_HPQ2 && output->m_transferFunction != TF_APQ && output->m_transferFunction != TF_APQS && output->m_transferFunction != TF_MPQ && output->m_transferFunction != TF_AMPQ  && output->m_transferFunction != TF_PH  && output->m_transferFunction != TF_APH && output->m_transferFunction != TF_HLG && output->m_transferFunction != TF_NORMAL)) )) {
-    m_useSingleTransferStep = FALSE;
-    m_normalizeFunction = TransferFunction::create(TF_NORMAL, FALSE, inputParams->m_outNormalScale, output->m_systemGamma, inputParams->m_outMinValue, inputParams->m_outMaxValue);
-    m_outputTransferFunction  = TransferFunction::create(output->m_transferFunction, FALSE, inputParams->m_outNormalScale, output->m_systemGamma, inputParams->m_outMinValue, inputParams->m_outMaxValue, inputParams->m_enableTFunctionLUT);
+  for (int o = 0; o < m_numberOfOutputs; o++) {
+    initOutput(inputParams, o);
   }
-  else {
-    m_useSingleTransferStep = TRUE;
-    //m_normalizeFunction = NULL;
-    m_normalizeFunction = TransferFunction::create(TF_NORMAL, FALSE, inputParams->m_outNormalScale, output->m_systemGamma, inputParams->m_outMinValue, inputParams->m_outMaxValue);
 
-    m_outputTransferFunction  = TransferFunction::create(output->m_transferFunction, TRUE, inputParams->m_outNormalScale, output->m_systemGamma, inputParams->m_outMinValue, inputParams->m_outMaxValue, inputParams->m_enableTFunctionLUT);
-  }
-  
-  m_srcDisplayGammaAdjust = DisplayGammaAdjust::create(input->m_displayAdjustment,  m_useSingleTransferStep ? inputParams->m_srcNormalScale : 1.0f, input->m_systemGamma);
-  m_outDisplayGammaAdjust = DisplayGammaAdjust::create(output->m_displayAdjustment, m_useSingleTransferStep ? inputParams->m_outNormalScale : 1.0f, output->m_systemGamma);
-  
+  m_srcDisplayGammaAdjust = DisplayGammaAdjust::create(input->m_displayAdjustment,  m_useSingleTransferStep[0] ? inputParams->m_srcNormalScale : 1.0f, input->m_systemGamma);
+
   if (input->m_displayAdjustment == DA_HLG) {
     m_inputTransferFunction->setNormalFactor(1.0);
   }
-  if (output->m_displayAdjustment == DA_HLG) {
-    m_outputTransferFunction->setNormalFactor(1.0);
-  }
 
-  
   m_toneMapping = ToneMapping::create(inputParams->m_toneMapping, &inputParams->m_tmParams);
 }
 
+/*!
+ ***********************************************************************
+ * \brief
+ *    Create the transfer functions (and the optional pre-encoding LUT)
+ *    of a single output
+ ***********************************************************************
+ */
+void HDRConvertEXR::initOutput (ProjectParameters *inputParams, int index) {
+  FrameFormat   *output = m_outputFormat[index];
+
+  if ( output->m_iConstantLuminance !=0 || (output->m_transferFunction != TF_NULL && output->m_transferFunction != TF_POWER && ( inputParams->m_useSingleTransferStep == FALSE || (output->m_transferFunction != TF_PQ && output->m_transferFunction != TF_HPQ && output->m_transferFunction != TF_HPQ2 && output->m_transferFunction != TF_APQ && output->m_transferFunction != TF_APQS && output->m_transferFunction != TF_MPQ && output->m_transferFunction != TF_AMPQ  && output->m_transferFunction != TF_PH  && output->m_transferFunction != TF_APH && output->m_transferFunction != TF_HLG && output->m_transferFunction != TF_NORMAL)) )) {
+    m_useSingleTransferStep[index] = FALSE;
+    m_normalizeFunction[index] = TransferFunction::create(TF_NORMAL, FALSE, inputParams->m_outNormalScale, output->m_systemGamma, inputParams->m_outMinValue, inputParams->m_outMaxValue);
+    m_outputTransferFunction[index]  = TransferFunction::create(output->m_transferFunction, FALSE, inputParams->m_outNormalScale, output->m_systemGamma, inputParams->m_outMinValue, inputParams->m_outMaxValue, inputParams->m_enableTFunctionLUT);
+  }
+  else {
+    m_useSingleTransferStep[index] = TRUE;
+    //m_normalizeFunction[index] = NULL;
+    m_normalizeFunction[index] = TransferFunction::create(TF_NORMAL, FALSE, inputParams->m_outNormalScale, output->m_systemGamma, inputParams->m_outMinValue, inputParams->m_outMaxValue);
+
+    m_outputTransferFunction[index]  = TransferFunction::create(output->m_transferFunction, TRUE, inputParams->m_outNormalScale, output->m_systemGamma, inputParams->m_outMinValue, inputParams->m_outMaxValue, inputParams->m_enableTFunctionLUT);
+  }
+
+  m_outDisplayGammaAdjust[index] = DisplayGammaAdjust::create(output->m_displayAdjustment, m_useSingleTransferStep[index] ? inputParams->m_outNormalScale : 1.0f, output->m_systemGamma);
+
+  if (output->m_displayAdjustment == DA_HLG) {
+    m_outputTransferFunction[index]->setNormalFactor(1.0);
+  }
+
+  if (inputParams->m_usePreEncodingLUT == TRUE) {
+    AffineTransform transform;
+    // The LUT replaces the inverse PQ, color transform and float to fixed conversion of the 4:4:4 data,
+    // so it can only be used if these are all per sample operations
+    if (m_useSingleTransferStep[index] == TRUE && output->m_transferFunction == TF_PQ && output->m_isFloat == FALSE
+        && m_linearDownConversion[index] == FALSE && m_rgbDownConversion[index] == FALSE && output->m_iConstantLuminance == 0
+        && (output->m_chromaFormat == CF_444 || m_filterInFloat == FALSE) && inputParams->m_cvParams.m_isDither == FALSE
+#ifdef __SIM2_SUPPORT_ENABLED__
+        && output->m_pixelFormat != PF_SIM2
+#endif
+        && m_colorTransform[index]->getAffineTransform(&transform) == TRUE && transform.hasClip() == FALSE && transform.hasOffset() == FALSE) {
+      m_preEncodingLUT[index] = new xPreEncodingProcLUT(m_outputTransferFunction[index], &transform);
+    }
+    else {
+      fprintf(stderr, "Warning: UsePreEncodingLUT is not supported for this conversion (%s) and will be ignored.\n", m_outputFiles[index]->m_fName);
+    }
+  }
+}
+
 
 
 //-----------------------------------------------------------------------------
 // main filtering function
 //-----------------------------------------------------------------------------
 
+/*!
+ ***********************************************************************
+ * \brief
+ *    Convert the (shared) linear light, scaled, frame to the format of
+ *    a single output. The result is placed in m_oFrameStore[index].
+ ***********************************************************************
+ */
+void HDRConvertEXR::processOutput( ProjectParameters *inputParams, int index, Frame *linearFrame ) {
+  FrameFormat   *output = m_outputFormat[index];
+  Frame        **pFrameStore  = m_pFrameStore[index];
+  Frame        **pDFrameStore = m_pDFrameStore[index];
+  Frame         *oFrameStore  = m_oFrameStore[index];
+  Frame         *dFrameStore  = m_dFrameStore[index];
+  Frame         *currentFrame = linearFrame, *processFrame;
+
+  ColorTransform     *colorTransform         = m_colorTransform[index];
+  Convert            *convertProcess         = m_convertProcess[index];
+  ConvertColorFormat *convertTo420           = m_convertTo420[index];
+  DisplayGammaAdjust *outDisplayGammaAdjust  = m_outDisplayGammaAdjust[index];
+  TransferFunction   *normalizeFunction      = m_normalizeFunction[index];
+  TransferFunction   *outputTransferFunction = m_outputTransferFunction[index];
+
+  if (m_linearDownConversion[index] == TRUE) {
+    // normalizeFunction->inverse(pDFrameStore[3], currentFrame);
+    // m_chromaScale[index]->process(dFrameStore, pDFrameStore[3]);
+    // normalizeFunction->forward(pDFrameStore[4], dFrameStore);
+    // outputTransferFunction->inverse(pDFrameStore[0], pDFrameStore[4]);
+    m_chromaScale[index]->process(dFrameStore, currentFrame);
+    outDisplayGammaAdjust->inverse(dFrameStore);
+
+    outputTransferFunction->inverse(pDFrameStore[0], dFrameStore);
+    colorTransform->process(pDFrameStore[1], pDFrameStore[0]);
+
+    if (!(output->m_iConstantLuminance != 0 && (output->m_colorSpace == CM_YCbCr || output->m_colorSpace == CM_ICtCp))) {
+      // Apply transfer function
+      if ( m_useSingleTransferStep[index] == FALSE ) {
+        processFrame = pFrameStore[1];
+        normalizeFunction->inverse(processFrame, currentFrame);
+        currentFrame = processFrame;
+        processFrame = pFrameStore[2];
+        outDisplayGammaAdjust->inverse(currentFrame);
+        outputTransferFunction->inverse (processFrame, currentFrame);
+      }
+      else {
+        processFrame = pFrameStore[2];
+        outDisplayGammaAdjust->inverse(currentFrame);
+        outputTransferFunction->inverse(processFrame, currentFrame);
+      }
+      currentFrame = processFrame;
+    }
+    else {
+      processFrame = pFrameStore[1];
+      normalizeFunction->inverse(processFrame, currentFrame);
+      currentFrame = processFrame;
+    }
+    // Output to pFrameStore[0] memory with appropriate color space conversion
+    processFrame = pFrameStore[0];
+    colorTransform->process(processFrame, currentFrame);
+    currentFrame = processFrame;
+
+    processFrame = pFrameStore[3];
+    processFrame->copy(currentFrame, Y_COMP);
+    currentFrame = processFrame;
+
+    currentFrame->copy(pDFrameStore[1], U_COMP);
+    currentFrame->copy(pDFrameStore[1], V_COMP);
+
+    // Now perform appropriate conversion to the output format (from float to fixed or vice versa)
+    processFrame = oFrameStore;
+    convertProcess->process(processFrame, currentFrame);
+  }
+  else {  //  (m_linearDownConversion == FALSE)
+    if (m_rgbDownConversion[index] == TRUE) {
+      if (!(output->m_iConstantLuminance != 0 && (output->m_colorSpace == CM_YCbCr || output->m_colorSpace == CM_ICtCp))) {
+        // Apply transfer function
+        if ( m_useSingleTransferStep[index] == FALSE ) {
+          processFrame = pFrameStore[1];
+          normalizeFunction->inverse(processFrame, currentFrame);
+          currentFrame = processFrame;
+          processFrame = pFrameStore[2];
+          outDisplayGammaAdjust->inverse(currentFrame);
+          outputTransferFunction->inverse (processFrame, currentFrame);
+        }
+        else {
+          processFrame = pFrameStore[2];
+          outDisplayGammaAdjust->inverse(currentFrame);
+          outputTransferFunction->inverse(processFrame, currentFrame);
+        }
+        currentFrame = processFrame;
+      }
+      else {
+        processFrame = pFrameStore[1];
+        normalizeFunction->inverse(processFrame, currentFrame);
+        currentFrame = processFrame;
+      }
+
+      // At this stage also create the downconverted RGB frame
+      m_chromaScale[index]->process(dFrameStore, currentFrame);
+      // And the YCbCr downscaled
+      colorTransform->process(pDFrameStore[0], dFrameStore);
+
+      // Output to pFrameStore[0] memory with appropriate color space conversion
+      processFrame = pFrameStore[0];
+      colorTransform->process(processFrame, currentFrame);
+      currentFrame = processFrame;
+
+      processFrame = pFrameStore[3];
+
+      processFrame->copy(currentFrame, Y_COMP);
+      currentFrame = processFrame;
+
+      currentFrame->copy(pDFrameStore[0], U_COMP);
+      currentFrame->copy(pDFrameStore[0], V_COMP);
+
+      processFrame = oFrameStore;
+
+      convertProcess->process(processFrame, currentFrame);
+    }
+    else if (m_preEncodingLUT[index] != NULL) {
+      outDisplayGammaAdjust->inverse(currentFrame);
+      // Transfer function, color transform and conversion to fixed point in a single pass
+      processFrame = (pFrameStore[3] != NULL) ? pFrameStore[3] : oFrameStore;
+      m_preEncodingLUT[index]->process(processFrame, currentFrame);
+
+      if (processFrame != oFrameStore) {
+        currentFrame = processFrame;
+        processFrame = oFrameStore;
+        convertTo420->process  (processFrame, currentFrame);
+      }
+    }
+    else {
+      if (!(output->m_iConstantLuminance != 0 && (output->m_colorSpace == CM_YCbCr || output->m_colorSpace == CM_ICtCp))) {
+        // Apply transfer function
+        if ( m_useSingleTransferStep[index] == FALSE ) {
+          processFrame = pFrameStore[1];
+          normalizeFunction->inverse(processFrame, currentFrame);
+          currentFrame = processFrame;
+          processFrame = pFrameStore[2];
+          outDisplayGammaAdjust->inverse(currentFrame);
+          outputTransferFunction->inverse (processFrame, currentFrame);
+        }
+        else {
+          processFrame = pFrameStore[2];
+          outDisplayGammaAdjust->inverse(currentFrame);
+//KW_KYH	1.inverse EOTF
+// Ŭ Frame
+//ȣ    m_floatData[]
+//LUT_KYH(m_floatData[index])    Լ 
+          outputTransferFunction->inverse(processFrame, currentFrame);
+        }
+        currentFrame = processFrame;
+      }
+      else {
+        processFrame = pFrameStore[1];
+        normalizeFunction->inverse(processFrame, currentFrame);
+        currentFrame = processFrame;
+      }
+      currentFrame->m_hasAlternate = TRUE;
+      currentFrame->m_altFrame = linearFrame;
+      currentFrame->m_altFrameNorm = inputParams->m_outNormalScale;
+
+      // Output to pFrameStore[0] memory with appropriate color space conversion
+      processFrame = pFrameStore[0];
+
+//KW_KYH	2. Color conersion: RGB to *NCL YCbCr
+//m_transform0 RGB -> Y ȯ 
+//m_transform1 RGB -> Cb ȯ 
+//m_transform2 RGB -> Cr  ȯ 
+      colorTransform->process(processFrame, currentFrame);
+
+      currentFrame = processFrame;
+
+      if (oFrameStore->m_chromaFormat != currentFrame->m_chromaFormat) {
+        // Now perform appropriate conversion to the output format (from float to fixed or vice versa)
+        processFrame = pFrameStore[3];
+        if (m_filterInFloat == TRUE) {
+          convertTo420->process  (processFrame, currentFrame);
+
+          currentFrame = processFrame;
+          processFrame = oFrameStore;
+
+          convertProcess->process(processFrame, currentFrame);
+        }
+        else {
+
+//KW_KYH	3. Float(16 bits) to Quant 10bits integer
+          convertProcess->process(processFrame, currentFrame);
+
+          currentFrame = processFrame;
+          processFrame = oFrameStore;
+          convertTo420->process  (processFrame, currentFrame);
+        }
+      }
+      else {
+        // Now perform appropriate conversion to the output format (from float to fixed or vice versa)
+        processFrame = oFrameStore;
+
+        convertProcess->process(processFrame, currentFrame);
+      }
+    }
+  }
+}
+
 void HDRConvertEXR::process( ProjectParameters *inputParams ) {
 
   int frameNumber;
@@ -488,22 +782,24 @@ void HDRConvertEXR::process( ProjectParameters *inputParams ) {
   FrameFormat   *input  = &inputParams->m_source;
   FrameFormat   *output = &inputParams->m_output;
 
-  clock_t clk;  
+  clock_t clk;
   bool errorRead = FALSE;
 
     // Now process all frames
   for (frameNumber = 0; frameNumber < inputParams->m_numberOfFrames; frameNumber ++) {
     clk = clock();
     iCurrentFrameToProcess = int(frameNumber * fDistance0);
-    
+
     // read frames
     m_iFrameStore->m_frameNo = frameNumber;
     if (m_inputFrame->readOneFrame(m_inputFile, iCurrentFrameToProcess, m_inputFile->m_fileHeader, m_startFrame) == TRUE) {
       // If the size of the images has changed, then reallocate space appropriately
       if ((m_inputFrame->m_width[Y_COMP] != m_iFrameStore->m_width[Y_COMP]) || (m_inputFrame->m_height[Y_COMP] != m_iFrameStore->m_height[Y_COMP])) {
         // Since we do not support scaling, width and height are also reset here
-        output->m_height[Y_COMP] = m_inputFrame->m_height[Y_COMP];
-        output->m_width [Y_COMP] = m_inputFrame->m_width [Y_COMP];
+        for (int o = 0; o < m_numberOfOutputs; o++) {
+          m_outputFormat[o]->m_height[Y_COMP] = m_inputFrame->m_height[Y_COMP];
+          m_outputFormat[o]->m_width [Y_COMP] = m_inputFrame->m_width [Y_COMP];
+        }
 
         allocateFrameStores(inputParams, input, output) ;
       }
@@ -515,227 +811,68 @@ void HDRConvertEXR::process( ProjectParameters *inputParams ) {
       errorRead = TRUE;
       break;
     }
-    
+
     if (errorRead == TRUE) {
       break;
     }
     else if (inputParams->m_silentMode == FALSE) {
       printf("%05d ", frameNumber );
     }
-    
+
     currentFrame = m_iFrameStore;
     if (m_croppedFrameStore != NULL) {
       m_croppedFrameStore->copy(m_iFrameStore, m_cropOffsetLeft, m_cropOffsetTop, m_iFrameStore->m_width[Y_COMP] + m_cropOffsetRight, m_iFrameStore->m_height[Y_COMP] + m_cropOffsetBottom, 0, 0);
-      
+
       currentFrame = m_croppedFrameStore;
     }
     // remove any embedded transfer function if any
 
     if (inputParams->m_enableLegacy == FALSE)
       m_inputTransferFunction->forward(currentFrame);
-    
+
     // Convert to appropriate color space (XYZ to RGB or different primaries) if needed
     processFrame = m_colorSpaceFrame;
     m_colorSpaceConvert->process(processFrame, currentFrame);
     currentFrame = processFrame;
 
-    processFrame = m_pFrameStore[4];
+    processFrame = m_noiseFrameStore;
 
     // Add noise
     m_addNoise->process(processFrame, currentFrame);
     currentFrame = processFrame;
-    
+
     // Apply denoising if specified (using Wiener2D currently)
     if (m_bUseWienerFiltering == TRUE)
       m_frameFilterNoise0->process(currentFrame);
 
-    // Separable denoiser      
+    // Separable denoiser
     if (m_bUse2DSepFiltering == TRUE)
       m_frameFilterNoise1->process(currentFrame);
 
-    // NLMeans denoiser      
+    // NLMeans denoiser
     if (m_bUseNLMeansFiltering == TRUE)
       m_frameFilterNoise2->process(currentFrame);
-    
+
     m_toneMapping->process(currentFrame);
 
     m_frameScale->process(m_scaledFrame, currentFrame);
     currentFrame = m_scaledFrame;
-    
-    linearFrame = currentFrame;
-    
-    if (m_linearDownConversion == TRUE) {
-      // m_normalizeFunction->inverse(m_pDFrameStore[3], currentFrame);
-      // m_chromaScale->process(m_dFrameStore, m_pDFrameStore[3]);
-      // m_normalizeFunction->forward(m_pDFrameStore[4], m_dFrameStore);
-      // m_outputTransferFunction->inverse(m_pDFrameStore[0], m_pDFrameStore[4]);
-      m_chromaScale->process(m_dFrameStore, currentFrame);
-      m_outDisplayGammaAdjust->inverse(m_dFrameStore);
-	  
-      m_outputTransferFunction->inverse(m_pDFrameStore[0], m_dFrameStore);
-      m_colorTransform->process(m_pDFrameStore[1], m_pDFrameStore[0]);
-      
-      if (!(output->m_iConstantLuminance != 0 && (output->m_colorSpace == CM_YCbCr || output->m_colorSpace == CM_ICtCp))) {
-        // Apply transfer function
-        if ( m_useSingleTransferStep == FALSE ) {
-          processFrame = m_pFrameStore[1];
-          m_normalizeFunction->inverse(processFrame, currentFrame);
-          currentFrame = processFrame;
-          processFrame = m_pFrameStore[2];
-          m_outDisplayGammaAdjust->inverse(currentFrame);
-          m_outputTransferFunction->inverse (processFrame, currentFrame);
-        }
-        else {
-          processFrame = m_pFrameStore[2];
-          m_outDisplayGammaAdjust->inverse(currentFrame);
-          m_outputTransferFunction->inverse(processFrame, currentFrame);
-        }
-        currentFrame = processFrame;
-      } 
-      else {
-        processFrame = m_pFrameStore[1];
-        m_normalizeFunction->inverse(processFrame, currentFrame);
-        currentFrame = processFrame;      
-      }
-      // Output to m_pFrameStore[0] memory with appropriate color space conversion
-      processFrame = m_pFrameStore[0];
-      m_colorTransform->process(processFrame, currentFrame);
-      currentFrame = processFrame;   
-      
-      processFrame = m_pFrameStore[3];
-      processFrame->copy(currentFrame, Y_COMP);      
-      currentFrame = processFrame;   
-      
-      currentFrame->copy(m_pDFrameStore[1], U_COMP);
-      currentFrame->copy(m_pDFrameStore[1], V_COMP);
-            
-      // Now perform appropriate conversion to the output format (from float to fixed or vice versa)
-      processFrame = m_oFrameStore;
-      m_convertProcess->process(processFrame, currentFrame);
-    }
-    else {  //  (m_linearDownConversion == FALSE)
-      if (m_rgbDownConversion == TRUE) {
-        if (!(output->m_iConstantLuminance != 0 && (output->m_colorSpace == CM_YCbCr || output->m_colorSpace == CM_ICtCp))) {
-          // Apply transfer function
-          if ( m_useSingleTransferStep == FALSE ) {
-            processFrame = m_pFrameStore[1];
-            m_normalizeFunction->inverse(processFrame, currentFrame);
-            currentFrame = processFrame;
-            processFrame = m_pFrameStore[2];
-            m_outDisplayGammaAdjust->inverse(currentFrame);
-            m_outputTransferFunction->inverse (processFrame, currentFrame);
-          }
-          else {
-            processFrame = m_pFrameStore[2];
-            m_outDisplayGammaAdjust->inverse(currentFrame);
-            m_outputTransferFunction->inverse(processFrame, currentFrame);
-          }
-          currentFrame = processFrame;
-        } 
-        else {
-          processFrame = m_pFrameStore[1];
-          m_normalizeFunction->inverse(processFrame, currentFrame);
-          currentFrame = processFrame;      
-        }
 
-        // At this stage also create the downconverted RGB frame
-        m_chromaScale->process(m_dFrameStore, currentFrame);
-        // And the YCbCr downscaled
-        m_colorTransform->process(m_pDFrameStore[0], m_dFrameStore);
-
-        // Output to m_pFrameStore[0] memory with appropriate color space conversion
-        processFrame = m_pFrameStore[0];
-        m_colorTransform->process(processFrame, currentFrame);
-        currentFrame = processFrame;   
-                
-        processFrame = m_pFrameStore[3];
-        
-        processFrame->copy(currentFrame, Y_COMP);      
-        currentFrame = processFrame;   
-        
-        currentFrame->copy(m_pDFrameStore[0], U_COMP);
-        currentFrame->copy(m_pDFrameStore[0], V_COMP);
-        
-        processFrame = m_oFrameStore;
-        
-        m_convertProcess->process(processFrame, currentFrame);        
+    // Each output branches off the scaled, linear light, frame
+    for (int o = 0; o < m_numberOfOutputs; o++) {
+      linearFrame = currentFrame;
+      if (m_linearFrame != NULL && o < m_numberOfOutputs - 1) {
+        m_linearFrame->copy(currentFrame);
+        linearFrame = m_linearFrame;
       }
-      else {
-        if (!(output->m_iConstantLuminance != 0 && (output->m_colorSpace == CM_YCbCr || output->m_colorSpace == CM_ICtCp))) {
-          // Apply transfer function
-          if ( m_useSingleTransferStep == FALSE ) {
-            processFrame = m_pFrameStore[1];
-            m_normalizeFunction->inverse(processFrame, currentFrame);
-            currentFrame = processFrame;
-            processFrame = m_pFrameStore[2];
-            m_outDisplayGammaAdjust->inverse(currentFrame);
-            m_outputTransferFunction->inverse (processFrame, currentFrame);
-          }
-          else {
-            processFrame = m_pFrameStore[2];
-            m_outDisplayGammaAdjust->inverse(currentFrame);
-//KW_KYH	1.inverse EOTF
-// Ŭ Frame
-//ȣ    m_floatData[]
-//LUT_KYH(m_floatData[index])    Լ 
-            m_outputTransferFunction->inverse(processFrame, currentFrame);
-          }
-          currentFrame = processFrame;
-        } 
-        else {
-          processFrame = m_pFrameStore[1];
-          m_normalizeFunction->inverse(processFrame, currentFrame);
-          currentFrame = processFrame;      
-        }
-        currentFrame->m_hasAlternate = TRUE;
-        currentFrame->m_altFrame = linearFrame;  
-        currentFrame->m_altFrameNorm = inputParams->m_outNormalScale;      
 
-        // Output to m_pFrameStore[0] memory with appropriate color space conversion
-        processFrame = m_pFrameStore[0];
+      processOutput(inputParams, o, linearFrame);
 
-//KW_KYH	2. Color conersion: RGB to *NCL YCbCr
-//m_transform0 RGB -> Y ȯ 
-//m_transform1 RGB -> Cb ȯ 
-//m_transform2 RGB -> Cr  ȯ 
-        m_colorTransform->process(processFrame, currentFrame);
-
-        currentFrame = processFrame;   
-                
-        if (m_oFrameStore->m_chromaFormat != currentFrame->m_chromaFormat) {
-          // Now perform appropriate conversion to the output format (from float to fixed or vice versa)
-          processFrame = m_pFrameStore[3];
-          if (m_filterInFloat == TRUE) {
-            m_convertTo420->process  (processFrame, currentFrame);
-
-            currentFrame = processFrame;
-            processFrame = m_oFrameStore;
-                        
-            m_convertProcess->process(processFrame, currentFrame);        
-          }
-          else {
-
-//KW_KYH	3. Float(16 bits) to Quant 10bits integer
-            m_convertProcess->process(processFrame, currentFrame);
-
-            currentFrame = processFrame;
-            processFrame = m_oFrameStore;
-            m_convertTo420->process  (processFrame, currentFrame);
-          }
-        }
-        else {
-          // Now perform appropriate conversion to the output format (from float to fixed or vice versa)
-          processFrame = m_oFrameStore;
-         
-          m_convertProcess->process(processFrame, currentFrame);
-        }
-      }
+      // frame output
+      m_outputFrame[o]->copyFrame(m_oFrameStore[o]);
+      m_outputFrame[o]->writeOneFrame(m_outputFiles[o], frameNumber, m_outputFiles[o]->m_fileHeader, 0);
     }
 
-    // frame output
-    m_outputFrame->copyFrame(m_oFrameStore);
-    m_outputFrame->writeOneFrame(m_outputFile, frameNumber, m_outputFile->m_fileHeader, 0);
-
     clk = clock() - clk;
     if (inputParams->m_silentMode == FALSE){
       printf("%7.3f", 1.0 * clk / CLOCKS_PER_SEC);
@@ -754,7 +891,6 @@ void HDRConvertEXR::process( ProjectParameters *inputParams ) {
 //-----------------------------------------------------------------------------
 void HDRConvertEXR::outputHeader(ProjectParameters *inputParams) {
   IOVideo *InpFile = &inputParams->m_inputFile;
-  IOVideo *OutFile = &inputParams->m_outputFile;
   printf("================================================================================================================\n");
   printf("Source: %s\n", InpFile->m_fName);
   printf("W x H:  (%dx%d) \n", m_inputFrame->m_width[Y_COMP], m_inputFrame->m_height[Y_COMP]);
@@ -763,13 +899,16 @@ void HDRConvertEXR::outputHeader(ProjectParameters *inputParams) {
   else
     printf("Format: %s%s, ColorSpace: %s (%s/%s), FrameRate: %7.3f, BitDepth: %d, Range: %s\n", COLOR_FORMAT[m_inputFrame->m_chromaFormat + 1], INTERLACED_TYPE[m_inputFrame->m_isInterlaced], COLOR_SPACE[m_inputFrame->m_colorSpace + 1], COLOR_PRIMARIES[m_inputFrame->m_colorPrimaries + 1], TRANSFER_CHAR[m_inputFrame->m_transferFunction], m_inputFrame->m_frameRate, m_inputFrame->m_bitDepthComp[Y_COMP], SOURCE_RANGE_TYPE[m_inputFrame->m_sampleRange + 1]);
 
-  printf("----------------------------------------------------------------------------------------------------------------\n");
-  printf("Output: %s\n", OutFile->m_fName);
-  printf("W x H:  (%dx%d) \n", m_outputFrame->m_width[Y_COMP], m_outputFrame->m_height[Y_COMP]);
-  if (m_outputFrame->m_isFloat == TRUE)
-    printf("Format: %s%s, ColorSpace: %s (%s/%s), FrameRate: %7.3f, Type: %s\n", COLOR_FORMAT[m_outputFrame->m_chromaFormat + 1], INTERLACED_TYPE[m_outputFrame->m_isInterlaced], COLOR_SPACE[m_outputFrame->m_colorSpace + 1], COLOR_PRIMARIES[m_outputFrame->m_colorPrimaries + 1], TRANSFER_CHAR[m_outputFrame->m_transferFunction], m_outputFrame->m_frameRate, PIXEL_TYPE[m_outputFrame->m_pixelType[Y_COMP]]);
-  else
-    printf("Format: %s%s, ColorSpace: %s (%s/%s), FrameRate: %7.3f, BitDepth: %d, Range: %s\n", COLOR_FORMAT[m_outputFrame->m_chromaFormat + 1], INTERLACED_TYPE[m_outputFrame->m_isInterlaced], COLOR_SPACE[m_outputFrame->m_colorSpace + 1], COLOR_PRIMARIES[m_outputFrame->m_colorPrimaries + 1], TRANSFER_CHAR[m_outputFrame->m_transferFunction], m_outputFrame->m_frameRate, m_outputFrame->m_bitDepthComp[Y_COMP], SOURCE_RANGE_TYPE[m_outputFrame->m_sampleRange + 1]);
+  for (int o = 0; o < m_numberOfOutputs; o++) {
+    Output *outputFrame = m_outputFrame[o];
+    printf("----------------------------------------------------------------------------------------------------------------\n");
+    printf("Output: %s\n", m_outputFiles[o]->m_fName);
+    printf("W x H:  (%dx%d) \n", outputFrame->m_width[Y_COMP], outputFrame->m_height[Y_COMP]);
+    if (outputFrame->m_isFloat == TRUE)
+      printf("Format: %s%s, ColorSpace: %s (%s/%s), FrameRate: %7.3f, Type: %s\n", COLOR_FORMAT[outputFrame->m_chromaFormat + 1], INTERLACED_TYPE[outputFrame->m_isInterlaced], COLOR_SPACE[outputFrame->m_colorSpace + 1], COLOR_PRIMARIES[outputFrame->m_colorPrimaries + 1], TRANSFER_CHAR[outputFrame->m_transferFunction], outputFrame->m_frameRate, PIXEL_TYPE[outputFrame->m_pixelType[Y_COMP]]);
+    else
+      printf("Format: %s%s, ColorSpace: %s (%s/%s), FrameRate: %7.3f, BitDepth: %d, Range: %s\n", COLOR_FORMAT[outputFrame->m_chromaFormat + 1], INTERLACED_TYPE[outputFrame->m_isInterlaced], COLOR_SPACE[outputFrame->m_colorSpace + 1], COLOR_PRIMARIES[outputFrame->m_colorPrimaries + 1], TRANSFER_CHAR[outputFrame->m_transferFunction], outputFrame->m_frameRate, outputFrame->m_bitDepthComp[Y_COMP], SOURCE_RANGE_TYPE[outputFrame->m_sampleRange + 1]);
+  }
   printf("================================================================================================================\n");
 }
 
@@ -324,6 +324,7 @@ void HDRConvertTIFF::allocateFrameStores(ProjectParameters *inputParams, FrameFo
   m_pFrameStore[4]   = new Frame(output->m_width [Y_COMP], output->m_height[Y_COMP], TRUE, m_inputFrame->m_colorSpace, output->m_colorPrimaries, m_inputFrame->m_chromaFormat, m_inputFrame->m_sampleRange, m_inputFrame->m_bitDepthComp[Y_COMP], m_inputFrame->m_isInterlaced, output->m_transferFunction, output->m_systemGamma);
   m_pFrameStore[4]->clear();
   
+  m_outputFile->m_numFrames = inputParams->m_numberOfFrames;
   m_outputFrame = Output::create(m_outputFile, output);
 
   // Frame store for altering color space
@@ -72,6 +72,7 @@ HDRConvertYUV::HDRConvertYUV(ProjectParameters *inputParams) {
   m_normalizeFunction      = NULL;
   m_inputTransferFunction  = NULL;
   m_outputTransferFunction = NULL;
+  m_processChain           = NULL;
   m_inputFrame             = NULL;
   m_outputFrame            = NULL;
   m_convertFormatIn        = NULL;
@@ -240,6 +241,10 @@ void HDRConvertYUV::destroy() {
     delete m_inputTransferFunction;
     m_inputTransferFunction = NULL;
   }
+  if (m_processChain != NULL) {
+    delete m_processChain;
+    m_processChain = NULL;
+  }
   
   if (m_srcDisplayGammaAdjust != NULL) {
     delete m_srcDisplayGammaAdjust;
@@ -300,6 +305,7 @@ void HDRConvertYUV::init (ProjectParameters *inputParams) {
   m_outputFile->m_format.m_width [Y_COMP] = output->m_width [Y_COMP];
   
   // Create output file
+  m_outputFile->m_numFrames = inputParams->m_numberOfFrames;
   m_outputFrame = Output::create(m_outputFile, output);
 
   ChromaFormat chromaFormat = (m_inputFrame->m_colorPrimaries != output->m_colorPrimaries)? CF_444 : output->m_chromaFormat;
@@ -514,6 +520,58 @@ void HDRConvertYUV::init (ProjectParameters *inputParams) {
     m_outputTransferFunction->setNormalFactor(1.0);
   }
     m_addNoise = AddNoise::create(inputParams->m_addNoise, inputParams->m_noiseVariance, inputParams->m_noiseMean);
+  
+  // Color format conversion. Stages that do nothing are skipped, and, if enabled, consecutive
+  // linear stages (normalization, matrix color transforms) are merged into a single pass.
+  m_processChain = new ProcessChain(inputParams->m_foldLinearStages);
+  if (!(input->m_iConstantLuminance != 0 && (input->m_colorSpace == CM_YCbCr || input->m_colorSpace == CM_ICtCp))) {
+    m_processChain->addColorTransform(m_colorTransform, m_pFrameStore[2]);
+    
+    if ( m_useSingleTransferStep == FALSE ) {
+      m_processChain->addForward(m_inputTransferFunction, m_pFrameStore[3]);
+      m_processChain->addForward(m_srcDisplayGammaAdjust);
+      m_processChain->addForward(m_normalizeFunction, m_pFrameStore[1]);
+    }
+    else {
+      m_processChain->addForward(m_inputTransferFunction, m_pFrameStore[1]);
+      m_processChain->addForward(m_srcDisplayGammaAdjust);
+    }
+  }
+  else {
+    m_processChain->addColorTransform(m_colorTransform, m_pFrameStore[2]);
+    if (m_normalizeFunction != NULL)
+      m_processChain->addForward(m_normalizeFunction, m_pFrameStore[1]);
+  }
+  
+  if (m_changeColorPrimaries == TRUE) {
+    m_processChain->addColorTransform(m_colorSpaceConvert, m_colorSpaceFrame);
+    m_processChain->addInverse(m_outDisplayGammaAdjust);
+    if (m_oFrameStore->m_colorSpace == CM_YCbCr || m_oFrameStore->m_colorSpace == CM_ICtCp) {
+      m_processChain->addInverse(m_outputTransferFunction, m_pFrameStore[6]);
+      m_processChain->addColorTransform(m_colorSpaceConvertMC, m_pFrameStore[4]);
+    }
+    else {
+      m_processChain->addInverse(m_outputTransferFunction, m_pFrameStore[4]);
+    }
+  }
+  else {
+    // here we apply the output transfer function (to be fixed)
+    m_processChain->addInverse(m_outDisplayGammaAdjust);
+    m_processChain->addInverse(m_outputTransferFunction, m_pFrameStore[4]);
+  }
+  m_processChain->plan();
+}
+
+//-----------------------------------------------------------------------------
+// Convert the input to the processing (float) format. If the conversion is a plain
+// copy, the input frame is used directly instead.
+//-----------------------------------------------------------------------------
+Frame *HDRConvertYUV::convertInput(Frame *out, Frame *inp) {
+  if (m_convertIQuantize->isIdentity() == TRUE && inp->m_isFloat == out->m_isFloat && inp->m_size == out->m_size && inp->m_chromaFormat == out->m_chromaFormat)
+    return inp;
+  
+  m_convertIQuantize->process(out, inp);
+  return out;
 }
 
 //-----------------------------------------------------------------------------
@@ -525,7 +583,7 @@ void HDRConvertYUV::process( ProjectParameters *inputParams ) {
   int iCurrentFrameToProcess = 0;
   float fDistance0 = inputParams->m_source.m_frameRate / inputParams->m_output.m_frameRate;
   //FrameFormat   *output = &inputParams->m_output;
-  FrameFormat   *input  = &inputParams->m_source;
+  //FrameFormat   *input  = &inputParams->m_source;
 
   clock_t clk;  
   bool errorRead = FALSE;
@@ -580,11 +638,12 @@ void HDRConvertYUV::process( ProjectParameters *inputParams ) {
       // The resolution of the below frame stores is actually at 4:4:4 regardless if the data in it are 4:2:0. Code works as is, but should be fixed.
       if (m_filterInFloat == TRUE) {
         // Convert to different format if needed (integer to float)
-        m_convertIQuantize->process (m_pFrameStore[0], currentFrame);
+        Frame *floatFrame = convertInput(m_pFrameStore[0], currentFrame);
         if (m_bUseChromaDeblocking == TRUE) // Perform deblocking
-          m_frameFilter->process(m_pFrameStore[0]);
+          m_frameFilter->process(floatFrame);
         // Chroma conversion
-        m_convertFormatIn->process(m_convertFrameStore, m_pFrameStore[0]);
+        m_convertFormatIn->process(m_convertFrameStore, floatFrame);
+        currentFrame = m_convertFrameStore;
       }
       else {      
         m_convertFormatIn->process (m_pFrameStore[0], currentFrame);
@@ -593,24 +652,23 @@ void HDRConvertYUV::process( ProjectParameters *inputParams ) {
           m_pFrameStore[0]->clipRange();
 
         // Convert to different format if needed (integer to float)
-        m_convertIQuantize->process(m_convertFrameStore, m_pFrameStore[0]);
+        currentFrame = convertInput(m_convertFrameStore, m_pFrameStore[0]);
       }
     }
     else {
       // Convert to different format if needed (integer to float)
-      m_convertIQuantize->process(m_convertFrameStore, currentFrame);
+      currentFrame = convertInput(m_convertFrameStore, currentFrame);
     }
     
     // Add noise
-    m_addNoise->process(m_convertFrameStore);
+    m_addNoise->process(currentFrame);
     
     if (m_bUseWienerFiltering == TRUE)
-      m_frameFilterNoise0->process(m_convertFrameStore);
+      m_frameFilterNoise0->process(currentFrame);
     if (m_bUse2DSepFiltering == TRUE)
-      m_frameFilterNoise1->process(m_convertFrameStore);
+      m_frameFilterNoise1->process(currentFrame);
     if (m_bUseNLMeansFiltering == TRUE)
-      m_frameFilterNoise2->process(m_convertFrameStore);
-    currentFrame = m_convertFrameStore;
+      m_frameFilterNoise2->process(currentFrame);
 
     
     m_frameScale->process(m_scaledFrame, currentFrame);
@@ -620,53 +678,21 @@ void HDRConvertYUV::process( ProjectParameters *inputParams ) {
     // Output to m_pFrameStore memory with appropriate color space conversion
     // Note that the name of "forward" may be a bit of a misnomer.
     
-    if (!(input->m_iConstantLuminance != 0 && (input->m_colorSpace == CM_YCbCr || input->m_colorSpace == CM_ICtCp))) {
-      m_colorTransform->process(m_pFrameStore[2], currentFrame);
+    currentFrame = m_processChain->process(currentFrame);
 
-      if ( m_useSingleTransferStep == FALSE ) {
-        m_inputTransferFunction->forward(m_pFrameStore[3], m_pFrameStore[2]);
-        m_srcDisplayGammaAdjust->forward(m_pFrameStore[3]);
-        m_normalizeFunction->forward(m_pFrameStore[1]  , m_pFrameStore[3]);
-      }
-      else {
-        m_inputTransferFunction->forward(m_pFrameStore[1], m_pFrameStore[2]);
-        m_srcDisplayGammaAdjust->forward(m_pFrameStore[1]);
-      }
-    }
-    else {
-      m_colorTransform->process(m_pFrameStore[2], currentFrame);
-      m_normalizeFunction->forward(m_pFrameStore[1], m_pFrameStore[2]);
+    if (m_iFrameStore->m_chromaFormat != CF_444 && m_oFrameStore->m_chromaFormat != CF_444 && m_iFrameStore->m_colorPrimaries != m_oFrameStore->m_colorPrimaries) {
+      m_convertFormatOut->process(m_pFrameStore[5], currentFrame);
+      currentFrame = m_pFrameStore[5];
     }
     
-    if (m_changeColorPrimaries == TRUE) {
-      m_colorSpaceConvert->process(m_colorSpaceFrame, m_pFrameStore[1]);
-      m_outDisplayGammaAdjust->inverse(m_colorSpaceFrame);
-      if (m_oFrameStore->m_colorSpace == CM_YCbCr || m_oFrameStore->m_colorSpace == CM_ICtCp) {
-        m_outputTransferFunction->inverse(m_pFrameStore[6], m_colorSpaceFrame);
-
-        m_colorSpaceConvertMC->process(m_pFrameStore[4], m_pFrameStore[6]);
-      }
-      else {
-        m_outputTransferFunction->inverse(m_pFrameStore[4], m_colorSpaceFrame);
-        m_outDisplayGammaAdjust->inverse(m_colorSpaceFrame);
-      }
-      
-    }
-    else{
-      // here we apply the output transfer function (to be fixed)
-      m_outDisplayGammaAdjust->inverse(m_pFrameStore[1]);
-      m_outputTransferFunction->inverse(m_pFrameStore[4], m_pFrameStore[1]);
-    }
-
-    if (m_iFrameStore->m_chromaFormat != CF_444 && m_oFrameStore->m_chromaFormat != CF_444 && m_iFrameStore->m_colorPrimaries != m_oFrameStore->m_colorPrimaries) {
-      m_convertFormatOut->process(m_pFrameStore[5], m_pFrameStore[4]);
-      m_convertProcess->process(m_oFrameStore, m_pFrameStore[5]);   
+    // The final conversion may be a plain copy (float output). Output straight from the processed frame then.
+    if (m_convertProcess->isIdentity() == FALSE || currentFrame->m_size != m_oFrameStore->m_size || currentFrame->m_chromaFormat != m_oFrameStore->m_chromaFormat) {
+      m_convertProcess->process(m_oFrameStore, currentFrame);
+      currentFrame = m_oFrameStore;
     }
-    else
-      m_convertProcess->process(m_oFrameStore, m_pFrameStore[4]);
     
     // frame output
-    m_outputFrame->copyFrame(m_oFrameStore);
+    m_outputFrame->copyFrame(currentFrame);
     m_outputFrame->writeOneFrame(m_outputFile, frameNumber, m_outputFile->m_fileHeader, 0);
     
     clk = clock() - clk;
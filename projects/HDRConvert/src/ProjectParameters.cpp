@@ -85,7 +85,10 @@ static char def_out_file[] = "output_conv.yuv";
 StringParameter stringParameterList[] = {
   { "SourceFile",          pParams->m_inputFile.m_fName,              NULL, "Source file name"                            },
   { "OutputFile",          pParams->m_outputFile.m_fName,     def_out_file, "Output file name"                            },
+  { "Output1File",         pParams->m_extraOutputFile[0].m_fName,     NULL, "Additional output file name (1)"             },
+  { "Output2File",         pParams->m_extraOutputFile[1].m_fName,     NULL, "Additional output file name (2)"             },
   { "LogFile",             pParams->m_logFile,                 def_logfile, "Output Log file name"                        },
+  { "LUTCacheFile",        pParams->m_lutCacheFile,                   NULL, "Transfer function LUT cache file name"       },
   { "YAdjustModelFile",    ctp->m_yAdjustModelFile,                   NULL, "Luma adjustment (2nd order) model file name" },
   { "",                    NULL,                                      NULL, "String Termination entry"                    }
 };
@@ -130,9 +133,25 @@ IntegerParameter intParameterList[] = {
   { "OutputDisplayAdjustment", (int *) &out->m_displayAdjustment,        DA_NULL,     DA_NULL,      DA_TOTAL-1,    "Output Gamma Display Adjustment"          },
   { "OutputDisplayAdjustment", (int *) &ctp->m_displayAdjustment,        DA_NULL,     DA_NULL,      DA_TOTAL-1,    "Output Gamma Display Adjustment"          },
 
+  { "Output1ChromaFormat",     &pParams->m_extraChromaFormat[0],              -1,          -1,          CF_444,    "Output 1 Chroma Format"                   },
+  { "Output1BitDepthCmp0",     &pParams->m_extraBitDepth[0][Y_COMP],          -1,          -1,              16,    "Output 1 Bitdepth Cmp0"                   },
+  { "Output1BitDepthCmp1",     &pParams->m_extraBitDepth[0][U_COMP],          -1,          -1,              16,    "Output 1 Bitdepth Cmp1"                   },
+  { "Output1BitDepthCmp2",     &pParams->m_extraBitDepth[0][V_COMP],          -1,          -1,              16,    "Output 1 Bitdepth Cmp2"                   },
+  { "Output1ColorSpace",       &pParams->m_extraColorSpace[0],                -1,          -1,      CM_TOTAL-1,    "Output 1 Color Space"                     },
+  { "Output1SampleRange",      &pParams->m_extraSampleRange[0],               -1,          -1,      SR_TOTAL-1,    "Output 1 Sample Range"                    },
+  { "Output1TransferFunction", &pParams->m_extraTransferFunction[0],          -1,          -1,      TF_TOTAL-1,    "Output 1 Transfer Function"               },
+  { "Output2ChromaFormat",     &pParams->m_extraChromaFormat[1],              -1,          -1,          CF_444,    "Output 2 Chroma Format"                   },
+  { "Output2BitDepthCmp0",     &pParams->m_extraBitDepth[1][Y_COMP],          -1,          -1,              16,    "Output 2 Bitdepth Cmp0"                   },
+  { "Output2BitDepthCmp1",     &pParams->m_extraBitDepth[1][U_COMP],          -1,          -1,              16,    "Output 2 Bitdepth Cmp1"                   },
+  { "Output2BitDepthCmp2",     &pParams->m_extraBitDepth[1][V_COMP],          -1,          -1,              16,    "Output 2 Bitdepth Cmp2"                   },
+  { "Output2ColorSpace",       &pParams->m_extraColorSpace[1],                -1,          -1,      CM_TOTAL-1,    "Output 2 Color Space"                     },
+  { "Output2SampleRange",      &pParams->m_extraSampleRange[1],               -1,          -1,      SR_TOTAL-1,    "Output 2 Sample Range"                    },
+  { "Output2TransferFunction", &pParams->m_extraTransferFunction[1],          -1,          -1,      TF_TOTAL-1,    "Output 2 Transfer Function"               },
+
 
   //! Various Params
   { "NumberOfFrames",          &pParams->m_numberOfFrames,                     1,           1,         INT_INF,    "Number of Frames to process"              },
+  { "NumberOfThreads",         &pParams->m_numberOfThreads,                    0,           0,         INT_INF,    "Number of threads (0: auto)"              },
   { "InputFileHeader",         &pParams->m_inputFile.m_fileHeader,             0,           0,         INT_INF,    "Source Header (bytes)"                    },
   { "StartFrame",              &pParams->m_inputFile.m_startFrame,             0,           0,         INT_INF,    "Source Start Frame"                       },
   { "FrameSkip",               &pParams->m_frameSkip,                          0,           0,         INT_INF,    "Source Frame Skipping"                    },
@@ -147,12 +166,20 @@ IntegerParameter intParameterList[] = {
   { "ClosedLoopIterations",    &pParams->m_closedLoopIterations,              10,           1,         1000000,    "Number of Closed Loop Iterations"         },
   { "SourceConstantLuminance", &src->m_iConstantLuminance,                     0,           0,               3,    "Constant Luminance Source"                },
   { "OutputConstantLuminance", &out->m_iConstantLuminance,                     0,           0,               3,    "Constant Luminance Output"                },
+  { "OutputTIFFCompression",   &out->m_tiffCompression,                        1,           1,               8,    "TIFF Output Compression (1/5/8)"          },
+  { "OutputTIFFPredictor",     &out->m_tiffPredictor,                          2,           1,               2,    "TIFF Output Predictor (1/2)"              },
+  { "OutputEXRCompression",    &out->m_exrCompression,                         0,           0,               4,    "OpenEXR Output Compression (0/1/2/3/4)"   },
+  { "OutputEXRTileWidth",      &out->m_exrTileWidth,                           0,           0,         INT_INF,    "OpenEXR Output Tile Width"                },
+  { "OutputEXRTileHeight",     &out->m_exrTileHeight,                          0,           0,         INT_INF,    "OpenEXR Output Tile Height"               },
   { "UseMinMaxFiltering",      &pParams->m_useMinMax,                          0,           0,               3,    "Use Min/Max Filtering"                    },
   { "ToneMappingMode",         &pParams->m_toneMapping,                  TM_NULL,     TM_NULL,    TM_TOTAL - 1,    "Tone Mapping Mode "                       },
   { "HighPrecisionColor",      &pParams->m_useHighPrecisionTransform,          0,           0,               2,    "High Precision Color Mode "               },
   { "UseAdaptiveUpsampling",   &pParams->m_useAdaptiveUpsampling,       ADF_NULL,    ADF_NULL,   ADF_TOTAL - 1,    "Use Adaptive Upsampler"                   },
   { "UseAdaptiveDownsampling", &pParams->m_useAdaptiveDownsampling,     ADF_NULL,    ADF_NULL,   ADF_TOTAL - 1,    "Use Adaptive Downsampler"                   },
   { "ForceClipping",           &pParams->m_forceClipping,                      0,           0,               2,    "Input Source Clipping"                   },
+  { "DitherModeCmp0",          &cvp->m_ditherMode[Y_COMP],          DM_BLUENOISE,     DM_NULL,     DM_TOTAL - 1,    "Dither Mode Cmp0 (if dithering is enabled)" },
+  { "DitherModeCmp1",          &cvp->m_ditherMode[U_COMP],          DM_BLUENOISE,     DM_NULL,     DM_TOTAL - 1,    "Dither Mode Cmp1 (if dithering is enabled)" },
+  { "DitherModeCmp2",          &cvp->m_ditherMode[V_COMP],          DM_BLUENOISE,     DM_NULL,     DM_TOTAL - 1,    "Dither Mode Cmp2 (if dithering is enabled)" },
   
   
   
@@ -171,6 +198,8 @@ BoolParameter boolParameterList[] = {
   { "FilterUsingFloats",          &pParams->m_filterInFloat,                  FALSE,       FALSE,         TRUE,    "Perform Filtering using Floats "            },
   { "LinearDownConversion",       &pParams->m_linearDownConversion,           FALSE,       FALSE,         TRUE,    "Perform linear downconversion to 420"       },
   { "RGBDownConversion",          &pParams->m_rgbDownConversion,              FALSE,       FALSE,         TRUE,    "Perform downconversion in RGB"              },
+  { "UsePreEncodingLUT",          &pParams->m_usePreEncodingLUT,              FALSE,       FALSE,         TRUE,    "Use the PQ/color transform LUT for 4:4:4"   },
+  { "FoldLinearStages",           &pParams->m_foldLinearStages,               FALSE,       FALSE,         TRUE,    "Merge consecutive linear stages"            },
   { "UseChromaDeblocking",        &pParams->m_bUseChromaDeblocking,           FALSE,       FALSE,         TRUE,    "Deblock Chroma before Upconversion"         },
   { "UseWienerFiltering",         &pParams->m_bUseWienerFiltering,            FALSE,       FALSE,         TRUE,    "Wiener Filtering before conversion"         },
   { "UseNLMeansFiltering",        &pParams->m_bUseNLMeansFiltering,           FALSE,       FALSE,         TRUE,    "NLMeans Filtering before conversion"        },
@@ -184,6 +213,7 @@ BoolParameter boolParameterList[] = {
   { "EnableSkew",                 &cvp->m_useSkew,                            FALSE,       FALSE,         TRUE,    "Enable Skew for dithering"                  },
   { "EnableGreenOffset",          &cvp->m_hasOffset,                          FALSE,       FALSE,         TRUE,    "Enable Table offset for Green dither"       },
   { "TMScaleGammut",              &tmp->m_scaleGammut,                        FALSE,       FALSE,         TRUE,    "Enable Color Gamut rescaling in TM"         },
+  { "TMUseLUT",                   &tmp->m_useLUT,                             FALSE,       FALSE,         TRUE,    "Apply BT2390IPT TM through a baked 3D LUT"  },
   { "EnableLegacy",               &pParams->m_enableLegacy,                   TRUE,        FALSE,         TRUE,    "Enable Legacy TF conversions"               },
 
   { "",                           NULL,                                           0,           0,            0,    "Boolean Termination entry"                  }
@@ -206,6 +236,8 @@ FloatParameter floatParameterList[] = {
   { "OutputRate",                  &out->m_frameRate,                       24.00F,       0.01F,      120.00F,    "Image Output Frame Rate"                           },
   { "SourceSystemGamma",           &src->m_systemGamma,                      1.00F,       0.00F,       10.00F,    "Overall System gamma for Hybrid Gamma TF"            },
   { "OutputSystemGamma",           &out->m_systemGamma,                      1.00F,       0.00F,       10.00F,    "Overall System gamma for Hybrid Gamma TF"            },
+  { "Output1SystemGamma",          &pParams->m_extraSystemGamma[0],         -1.00F,      -1.00F,       10.00F,    "Output 1 System gamma (-1: main output)"            },
+  { "Output2SystemGamma",          &pParams->m_extraSystemGamma[1],         -1.00F,      -1.00F,       10.00F,    "Output 2 System gamma (-1: main output)"            },
   { "SourceSystemGamma",           &ctp->m_iSystemGamma,                     1.00F,       0.00F,       10.00F,    "Copy for processing (input)"                   },
   { "OutputSystemGamma",           &ctp->m_oSystemGamma,                     1.00F,       0.00F,       10.00F,    "Copy for processing (output)"                  },
   { "SourceNormalizationScale",    &pParams->m_srcNormalScale,           10000.00F,       0.01F,  1000000.00F,    "Source Normalization Scale for Linear Data"  },
@@ -299,6 +331,62 @@ void ProjectParameters::update() {
   }
 
   m_inputFile.m_format = m_source;
+  m_tmParams.m_silentMode = m_silentMode;
+  
+  setupExtraOutputs();
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *    Set up the additional outputs. These are converted from the same
+ *    source frames as the main output and share all its processing up
+ *    to, and including, the color primaries conversion and scaling, so
+ *    only the chroma format, bit depth, color space, sample range and
+ *    transfer function can differ.
+ ***********************************************************************
+ */
+void ProjectParameters::setupExtraOutputs() {
+  m_numberOfOutputs = 1;
+  
+  for (int i = 0; i < MAX_OUTPUTS - 1 && m_extraOutputFile[i].m_fName[0] != '\0'; i++) {
+    FrameFormat *format = &m_extraOutput[i];
+    
+    *format = m_output;
+    if (m_extraChromaFormat[i] != -1)
+      format->m_chromaFormat = (ChromaFormat) m_extraChromaFormat[i];
+    for (int c = Y_COMP; c <= V_COMP; c++) {
+      if (m_extraBitDepth[i][c] != -1)
+        format->m_bitDepthComp[c] = m_extraBitDepth[i][c];
+    }
+    if (m_extraColorSpace[i] != -1)
+      format->m_colorSpace = (ColorSpace) m_extraColorSpace[i];
+    if (m_extraSampleRange[i] != -1)
+      format->m_sampleRange = (SampleRange) m_extraSampleRange[i];
+    if (m_extraTransferFunction[i] != -1)
+      format->m_transferFunction = (TransferFunctions) m_extraTransferFunction[i];
+    if (m_extraSystemGamma[i] >= 0.0)
+      format->m_systemGamma = m_extraSystemGamma[i];
+    setupFormat(format);
+    
+    // XYZ based outputs use different primaries, which are applied before the outputs branch
+    bool isXYZ      = (format->m_colorSpace   == CM_XYZ || format->m_colorSpace   == CM_YDZDX || format->m_colorSpace   == CM_YUpVp);
+    bool isXYZMain  = (m_output.m_colorSpace  == CM_XYZ || m_output.m_colorSpace  == CM_YDZDX || m_output.m_colorSpace  == CM_YUpVp);
+    if (isXYZ != isXYZMain) {
+      fprintf(stderr, "Output%dColorSpace requires different color primaries than the main output.\n", i + 1);
+      exit(EXIT_FAILURE);
+    }
+    
+    m_extraOutputFile[i].m_isInterleaved = m_outputFile.m_isInterleaved;
+    IOFunctions::parseVideoType   (&m_extraOutputFile[i]);
+    IOFunctions::parseFrameFormat (&m_extraOutputFile[i]);
+    m_numberOfOutputs++;
+  }
+  
+  if (m_numberOfOutputs > 1 && m_inputFile.m_videoType != VIDEO_EXR) {
+    fprintf(stderr, "Warning: Additional outputs are only supported for OpenEXR sources and will be ignored.\n");
+    m_numberOfOutputs = 1;
+  }
 }
 
 
@@ -0,0 +1,216 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file xPreEncodingProcLUT.cpp
+ *
+ * \brief
+ *    xPreEncodingProcLUT class source file. Linear light RGB 4:4:4 to quantized
+ *    Y'CbCr 4:4:4 conversion in a single, table driven, pass.
+ *
+ *************************************************************************************
+ */
+
+#include "Global.H"
+#include "xPreEncodingProcLUT.H"
+#include "ConvFloatToFixed.H"
+#include "CPUFeatures.H"
+#include "ThreadPool.H"
+#include <string.h>
+
+//-----------------------------------------------------------------------------
+// Macros
+//-----------------------------------------------------------------------------
+
+// The inverse transfer function table is indexed by the exponent and the
+// PEL_STEP_BITS most significant mantissa bits of the normalized input, i.e.
+// 256 linearly interpolated entries per octave over [2^-48, 1]. Inputs are
+// clamped to that range; below 2^-48 (about 4e-11 cd/m2 for a 10000 cd/m2
+// normalization) the PQ curve is flat to well within a code value.
+#define PEL_STEP_BITS    8
+#define PEL_FRAC_BITS    (23 - PEL_STEP_BITS)
+#define PEL_MIN_EXPONENT (127 - 48)
+#define PEL_MAX_EXPONENT 127
+#define PEL_BASE         (PEL_MIN_EXPONENT << PEL_STEP_BITS)
+#define PEL_SIZE         (((PEL_MAX_EXPONENT - PEL_MIN_EXPONENT) << PEL_STEP_BITS) + 2)
+#define PEL_MIN_VALUE    3.5527136788005009e-15f   // 2^-48
+
+//-----------------------------------------------------------------------------
+// Constructor/destructor
+//-----------------------------------------------------------------------------
+
+xPreEncodingProcLUT::xPreEncodingProcLUT(TransferFunction *transferFunction, const AffineTransform *transform)
+{
+  m_inputScale = (float) (1.0 / transferFunction->getNormalFactor());
+  for (int i = 0; i < 9; i++)
+    m_transform[i] = transform->getCoefficient(i / 3, i % 3);
+  
+  // The last entry duplicates 1.0 so that the interpolation at the top of the range stays in bounds
+  m_table.resize(PEL_SIZE);
+  for (int i = 0; i < PEL_SIZE - 1; i++) {
+    uint32 bits = (uint32) (PEL_BASE + i) << PEL_FRAC_BITS;
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    m_table[i] = (float) transferFunction->getInverse((double) value);
+  }
+  m_table[PEL_SIZE - 1] = m_table[PEL_SIZE - 2];
+}
+
+xPreEncodingProcLUT::~xPreEncodingProcLUT()
+{
+}
+
+//-----------------------------------------------------------------------------
+// Private methods
+//-----------------------------------------------------------------------------
+
+static inline float lookupValue(const float *table, float value)
+{
+  uint32 bits;
+  value = value > PEL_MIN_VALUE ? value : PEL_MIN_VALUE; // also catches NaNs
+  value = value < 1.0f ? value : 1.0f;
+  memcpy(&bits, &value, sizeof(float));
+  int   index = (int) (bits >> PEL_FRAC_BITS) - PEL_BASE;
+  float frac  = (float) (bits & ((1 << PEL_FRAC_BITS) - 1)) * (1.0f / (float) (1 << PEL_FRAC_BITS));
+  return table[index] + frac * (table[index + 1] - table[index]);
+}
+
+#if ENABLE_SIMD_DISPATCH
+// Converts 8 pixels starting at pos with the same operation order as the scalar code
+template <typename T>
+SIMD_TARGET("avx2")
+static void convertPixelsAVX2(T * const *out, const float * const *inp, int pos, const float *table, float inputScale, const float *weight, const float *offset, const float *maxValue, const int *bitScale)
+{
+  __m256 v[3];
+  for (int c = 0; c < 3; c++) {
+    __m256  value = _mm256_mul_ps(_mm256_loadu_ps(inp[c] + pos), _mm256_set1_ps(inputScale));
+    value         = _mm256_min_ps(_mm256_max_ps(value, _mm256_set1_ps(PEL_MIN_VALUE)), _mm256_set1_ps(1.0f));
+    __m256i bits  = _mm256_castps_si256(value);
+    __m256i index = _mm256_sub_epi32(_mm256_srli_epi32(bits, PEL_FRAC_BITS), _mm256_set1_epi32(PEL_BASE));
+    __m256  frac  = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(bits, _mm256_set1_epi32((1 << PEL_FRAC_BITS) - 1))), _mm256_set1_ps(1.0f / (float) (1 << PEL_FRAC_BITS)));
+    __m256  t0    = _mm256_i32gather_ps(table,     index, 4);
+    __m256  t1    = _mm256_i32gather_ps(table + 1, index, 4);
+    v[c] = _mm256_add_ps(t0, _mm256_mul_ps(frac, _mm256_sub_ps(t1, t0)));
+  }
+  
+  for (int k = 0; k < 3; k++) {
+    const float *w = weight + 3 * k;
+    __m256 y = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(w[0]), v[0]), _mm256_mul_ps(_mm256_set1_ps(w[1]), v[1])), _mm256_mul_ps(_mm256_set1_ps(w[2]), v[2])), _mm256_set1_ps(offset[k]));
+    y = _mm256_floor_ps(_mm256_add_ps(y, _mm256_set1_ps(0.5f)));
+    y = _mm256_min_ps(_mm256_max_ps(y, _mm256_setzero_ps()), _mm256_set1_ps(maxValue[k]));
+    __m256i code  = _mm256_sll_epi32(_mm256_cvttps_epi32(y), _mm_cvtsi32_si128(bitScale[k]));
+    __m128i code16 = _mm_packus_epi32(_mm256_castsi256_si128(code), _mm256_extracti128_si256(code, 1));
+    if (sizeof(T) == 1)
+      _mm_storel_epi64((__m128i *) (out[k] + pos), _mm_packus_epi16(code16, code16));
+    else
+      _mm_storeu_si128((__m128i *) (out[k] + pos), code16);
+  }
+}
+#endif
+
+/*!
+ ************************************************************************
+ * \brief
+ *    Convert the float RGB planes to fixed point planes, in row bands on
+ *    the thread pool. weight holds the color transform premultiplied by
+ *    the quantization weight of each output component.
+ ************************************************************************
+ */
+template <typename T>
+void xPreEncodingProcLUT::convertFrame(T * const *out, const float * const *inp, int width, int height, const float *weight, const float *offset, const float *maxValue, const int *bitScale)
+{
+  const float *table = &m_table[0];
+  float inputScale   = m_inputScale;
+  int   bands        = ThreadPool::getBandCount(height, 16);
+  
+  ThreadPool::parallelFor(bands, [&](int band) {
+    int start = (int) ((int64) band * height / bands) * width;
+    int end   = (int) ((int64) (band + 1) * height / bands) * width;
+    int i = start;
+    
+#if ENABLE_SIMD_DISPATCH
+    if (CPUFeatures::hasAVX2()) {
+      for (; i + 8 <= end; i += 8)
+        convertPixelsAVX2(out, inp, i, table, inputScale, weight, offset, maxValue, bitScale);
+    }
+#endif
+    
+    for (; i < end; i++) {
+      float v[3];
+      for (int c = 0; c < 3; c++)
+        v[c] = lookupValue(table, inp[c][i] * inputScale);
+      for (int k = 0; k < 3; k++) {
+        const float *w = weight + 3 * k;
+        float y = (float) floor(w[0] * v[0] + w[1] * v[1] + w[2] * v[2] + offset[k] + 0.5f);
+        out[k][i] = (T) (((int) fClip(y, 0.0f, maxValue[k])) << bitScale[k]);
+      }
+    }
+  });
+}
+
+//-----------------------------------------------------------------------------
+// Public methods
+//-----------------------------------------------------------------------------
+
+void xPreEncodingProcLUT::process(Frame *out, const Frame *inp)
+{
+  float weight[9], offset[3], maxValue[3];
+  int   bitScale[3];
+  
+  out->m_frameNo = inp->m_frameNo;
+  out->m_isAvailable = TRUE;
+  
+  // Same quantization as the ConvFloatToFixed step that this replaces
+  for (int k = 0; k < 3; k++) {
+    double compWeight, compOffset;
+    ConvFloatToFixed::getQuantizationParams(out, k, &compWeight, &compOffset, &bitScale[k]);
+    for (int c = 0; c < 3; c++)
+      weight[3 * k + c] = (float) (compWeight * m_transform[3 * k + c]);
+    offset[k]   = (float) compOffset;
+    maxValue[k] = (float) out->m_maxPelValue[k];
+  }
+  
+  if (out->m_bitDepth == 8)
+    convertFrame(out->m_comp, inp->m_floatComp, inp->m_width[Y_COMP], inp->m_height[Y_COMP], weight, offset, maxValue, bitScale);
+  else
+    convertFrame(out->m_ui16Comp, inp->m_floatComp, inp->m_width[Y_COMP], inp->m_height[Y_COMP], weight, offset, maxValue, bitScale);
+}
+
+//-----------------------------------------------------------------------------
+// End of file
+//-----------------------------------------------------------------------------
@@ -58,6 +58,8 @@
 
 #include "Global.H"
 #include "ProjectParameters.H"
+#include "ThreadPool.H"
+#include "LUTCache.H"
 #include "Parameters.H"
 #include "HDRMetrics.H"
 #include "HDRMetricsFrame.H"
@@ -207,6 +209,10 @@ int main(int argc, char **argv) {
   
   // Prepare parameters
   params->configure(parfile, cl_params, numCLParams, readConfig );
+  ThreadPool::setThreadCount(params->m_numberOfThreads);
+  
+  if (params->m_lutCacheFile[0] != '\0')
+    LUTCache::setCacheFile(params->m_lutCacheFile);
   
   hdrProcess = HDRMetrics::create((ProjectParameters *) params);
   
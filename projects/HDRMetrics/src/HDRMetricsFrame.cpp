@@ -98,6 +98,9 @@ HDRMetricsFrame::HDRMetricsFrame(ProjectParameters *inputParams)
   m_windowHeight  = 0;
   // Copy input distortion parameters
   m_distortionParameters = inputParams->m_distortionParameters;
+  // TF domain metrics share the TF encoded/color converted planes of each frame through this cache
+  m_frameCache = new DistortionFrameCache();
+  m_distortionParameters.m_frameCache = m_frameCache;
 
   for (int index = DIST_NULL; index < DIST_METRICS; index++) {
     m_distortionMetric[index] = NULL;
@@ -159,6 +162,10 @@ HDRMetricsFrame::~HDRMetricsFrame()
     delete [] m_windowDistortionMetric;
     m_windowDistortionMetric = NULL;
   }
+  if (m_frameCache != NULL) {
+    delete m_frameCache;
+    m_frameCache = NULL;
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -362,6 +369,9 @@ void HDRMetricsFrame::process( ProjectParameters *inputParams ) {
       printf("%06d ", frameNumber );
     }
     
+    // New frame content, so any cached metric domain planes are no longer valid
+    m_frameCache->reset();
+    
     for (int index = DIST_NULL; index < DIST_METRICS; index++) {
       if (m_enableMetric[index] == TRUE) {
         m_distortionMetric[index]->computeMetric(currentFrame[0], currentFrame[1]);
@@ -85,6 +85,7 @@ StringParameter stringParameterList[] = {
   { "Input0File",          pParams->m_inputFile[0].m_fName,           NULL, "1st Input file name"           },
   { "Input1File",          pParams->m_inputFile[1].m_fName,           NULL, "2nd Input file name"           },
   { "LogFile",             pParams->m_logFile,                 def_logfile, "Output Log file name"       },
+  { "LUTCacheFile",        pParams->m_lutCacheFile,                   NULL, "Transfer function LUT cache file name" },
   { "",                    NULL,                                      NULL, "String Termination entry"   }
 };
 
@@ -130,6 +131,7 @@ IntegerParameter intParameterList[] = {
   { "WindowMinPosY",          &pParams->m_windowMinPosY,                       0,      -65536,      65536,    "Minimum Window Y position"            },
   { "WindowMaxPosY",          &pParams->m_windowMaxPosY,                       0,      -65536,      65536,    "Maximum Window Y position"            },
   { "NumberOfFrames",         &pParams->m_numberOfFrames,                      1,           1,    INT_INF,    "Number of Frames to process"          },
+  { "NumberOfThreads",        &pParams->m_numberOfThreads,                     0,           0,    INT_INF,    "Number of threads (0: auto)"          },
   // SSIM parameters
   { "SSIMBlockDistance",      &ssim->m_blockDistance,                          1,           1,        128,    "Block Distance for SSIM computation"  },
   { "SSIMBlockSizeX",         &ssim->m_blockSizeX,                             4,           4,        128,    "Block Width for SSIM computation"     },
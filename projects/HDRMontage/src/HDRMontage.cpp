@@ -58,6 +58,7 @@
 
 #include "Global.H"
 #include "ProjectParameters.H"
+#include "ThreadPool.H"
 #include "Parameters.H"
 #include "HDRMontage.H"
 #include "HDRMontageFrame.H"
@@ -188,6 +189,7 @@ int main(int argc, char **argv) {
   
   // Prepare parameters
   params->configure(parfile, cl_params, numCLParams, readConfig );
+  ThreadPool::setThreadCount(params->m_numberOfThreads);
   
   hdrProcess = HDRMontage::create((ProjectParameters *) params);
   
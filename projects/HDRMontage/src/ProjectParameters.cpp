@@ -154,6 +154,7 @@ IntegerParameter intParameterList[] = {
   { "DestinationMinPosY1",    &pParams->m_destMinPosY[1],                            0,      -65536,        65536,  "Minimum Destination Y position for Inp1" },
   { "DestinationMaxPosY1",    &pParams->m_destMaxPosY[1],                            0,      -65536,        65536,  "Maximum Destination Y position for Inp1" },
   { "NumberOfFrames",         &pParams->m_numberOfFrames,                            1,           1,      INT_INF,  "Number of Frames to process"             },
+  { "NumberOfThreads",        &pParams->m_numberOfThreads,                           0,           0,      INT_INF,  "Number of threads (0: auto)"             },
 
   { "",                       NULL,                                                  0,           0,            0,  "Integer Termination entry"               }
 };
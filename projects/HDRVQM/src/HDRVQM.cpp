@@ -59,6 +59,7 @@
 
 #include "Global.H"
 #include "ProjectParameters.H"
+#include "ThreadPool.H"
 #include "Parameters.H"
 #include "HDRVQM.H"
 #include "HDRVQMFrame.H"
@@ -189,6 +190,7 @@ int main(int argc, char **argv) {
   
   // Prepare parameters
   params->configure(parfile, cl_params, numCLParams, readConfig );
+  ThreadPool::setThreadCount(params->m_numberOfThreads);
   
   hdrProcess = HDRVQM::create((ProjectParameters *) params);
   
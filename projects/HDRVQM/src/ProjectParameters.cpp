@@ -124,6 +124,7 @@ IntegerParameter intParameterList[] = {
   { "WindowMinPosY",          &pParams->m_windowMinPosY,                             0,      -65536,      65536,    "Minimum Window Y position"            },
   { "WindowMaxPosY",          &pParams->m_windowMaxPosY,                             0,      -65536,      65536,    "Maximum Window Y position"            },
   { "NumberOfFrames",         &pParams->m_numberOfFrames,                            1,           1,    INT_INF,    "Number of Frames to process"          },
+  { "NumberOfThreads",        &pParams->m_numberOfThreads,                           0,           0,    INT_INF,    "Number of threads (0: auto)"          },
   //VQM parameters
   { "AreaDisplay",            &vqm->m_displayArea,                                6100,        6100,       6100,    "Display Area"                         },
   { "RowsDisplay",            &vqm->m_rowsDisplay,                                1080,         512,       1080,    "Display Rows"                         },
@@ -146,6 +147,7 @@ BoolParameter boolParameterList[] = {
   { "ClipInputValues",        &dParams->m_clipInputValues,                FALSE,      FALSE,      TRUE,    "Clip input during distortion comp."            },
   { "EnableHDRVQM",           &pParams->m_enableMetric[DIST_VQM],          TRUE,       TRUE,      TRUE,    "Enable HDRVQM reporting"                       },
   { "DisplayAdapt",			      &vqm->m_displayAdapt,                        TRUE,      FALSE,      TRUE,    "Enable VQM display adaptation"                 },
+  { "StreamingPooling",       &vqm->m_streaming,                          FALSE,      FALSE,      TRUE,    "Pool VQM tubes incrementally (constant memory)"},
   { "",                       NULL,                                       FALSE,      FALSE,     FALSE,    "Boolean Termination entry"                     }
 };
 
@@ -0,0 +1,258 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file PackTest.cpp
+ *
+ * \brief
+ *    Packed format round trip test. Planes are packed through Output::reInterleave
+ *    and unpacked through Input::deInterleave with every SIMD level the host offers,
+ *    and the results are compared against the scalar code. The picture sizes are
+ *    chosen so that the SIMD kernels always leave a scalar tail.
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PackTest.H"
+#include "CPUFeatures.H"
+#include "Input.H"
+#include "Output.H"
+
+//-----------------------------------------------------------------------------
+// Local classes
+//-----------------------------------------------------------------------------
+
+//! Input that only exposes the packed format unpacking
+class PackTestInput : public Input {
+public:
+  virtual int readOneFrame (IOVideo *inputFile, int frameNumber, int fileHeader, int frameSkip) { return 0; }
+  void unpack (uint8 **input, uint8 **output, FrameFormat *format) { deInterleave(input, output, format, 2); }
+};
+
+//! Output that only exposes the packed format packing
+class PackTestOutput : public Output {
+public:
+  virtual int writeOneFrame (IOVideo *outputFile, int frameNumber, int fileHeader, int frameSkip) { return 0; }
+};
+
+//-----------------------------------------------------------------------------
+// Local functions
+//-----------------------------------------------------------------------------
+
+/*!
+ ***********************************************************************
+ * \brief
+ *   Reference UYVY10 packer (there is no UYVY10 writer): four big endian
+ *   words per 6 pixels, with the 10 bit fields stored from the top down
+ ***********************************************************************
+ */
+static void packUYVY10(uint8 *dst, const uint16 *y, const uint16 *u, const uint16 *v, int size)
+{
+  for (int i = 0; i < size; i += 6, y += 6, u += 3, v += 3) {
+    uint32 word[4];
+    word[0] = ((uint32) u[0] << 22) | ((uint32) y[0] << 12) | ((uint32) v[0] << 2);
+    word[1] = ((uint32) y[1] << 22) | ((uint32) u[1] << 12) | ((uint32) y[2] << 2);
+    word[2] = ((uint32) v[1] << 22) | ((uint32) y[3] << 12) | ((uint32) u[2] << 2);
+    word[3] = ((uint32) y[4] << 22) | ((uint32) v[2] << 12) | ((uint32) y[5] << 2);
+    for (int k = 0; k < 4; k++) {
+      *dst++ = (uint8) (word[k] >> 24);
+      *dst++ = (uint8) (word[k] >> 16);
+      *dst++ = (uint8) (word[k] >>  8);
+      *dst++ = (uint8) (word[k]      );
+    }
+  }
+}
+
+//! Number of bytes a picture occupies in the packed format
+static int packedSize(const PackTestCase *test)
+{
+  int size = test->m_width * test->m_height;
+  switch (test->m_pixelFormat) {
+    case PF_V210:
+    case PF_UYVY10:
+      return (size / 6) * 16;
+    case PF_B64A:
+      return size * 8;
+    default:
+      return size * 4;
+  }
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *   Packs and unpacks one picture at every SIMD level and compares the
+ *   packed bytes and the unpacked planes with the scalar results
+ *
+ * \return
+ *    TRUE if all levels match
+ ***********************************************************************
+ */
+static bool runTest(const PackTestCase *test)
+{
+  static const SIMDLevel levels[3]   = { SIMD_NONE, SIMD_SSSE3, SIMD_AVX2 };
+  static const char     *levelName[3] = { "scalar", "SSSE3", "AVX2" };
+  static const char     *formatName[PF_TOTAL] = { "UYVY", "YUY2", "YUYV", "YVYU", "BGR", "RGB", "V210", "UYVY10", "V410", "R210", "R10K", "XYZ", "B64A" };
+  // The kernels may read a few bytes past their last block, and a broken one may write past it
+  const int padding = 64;
+  bool passed = TRUE;
+  
+  FrameFormat format;
+  format.m_width[Y_COMP]    = test->m_width;
+  format.m_height[Y_COMP]   = test->m_height;
+  format.m_chromaFormat     = test->m_chromaFormat;
+  format.m_pixelFormat      = test->m_pixelFormat;
+  format.m_compSize[Y_COMP] = test->m_width * test->m_height;
+  format.m_compSize[U_COMP] = format.m_compSize[V_COMP] = (test->m_chromaFormat == CF_422 ? test->m_width / 2 : test->m_width) * test->m_height;
+  format.m_bitDepthComp[Y_COMP] = format.m_bitDepthComp[U_COMP] = format.m_bitDepthComp[V_COMP] = test->m_bitDepth;
+  
+  int planeSize = format.m_compSize[Y_COMP] + format.m_compSize[U_COMP] + format.m_compSize[V_COMP];
+  int byteSize  = packedSize(test);
+  
+  vector<uint16> source(planeSize + padding), unpacked(planeSize + padding), planes(planeSize + padding);
+  vector<uint8>  reference(byteSize + padding), packed(byteSize + padding);
+  
+  uint32 seed = 12345;
+  int    maxValue = (1 << test->m_bitDepth) - 1;
+  for (int i = 0; i < planeSize; i++) {
+    seed = seed * 1103515245 + 12345;
+    source[i] = (uint16) ((seed >> 8) & maxValue);
+  }
+  
+  PackTestInput  input;
+  PackTestOutput output;
+  
+  for (int l = 0; l < 3 && passed == TRUE; l++) {
+    CPUFeatures::setMaxLevel(levels[l]);
+    
+    // Pack
+    memset(&packed[0], 0xA5, packed.size());
+    if (test->m_pixelFormat == PF_UYVY10) {
+      packUYVY10(&packed[0], &source[0], &source[format.m_compSize[Y_COMP]], &source[format.m_compSize[Y_COMP] + format.m_compSize[U_COMP]], format.m_compSize[Y_COMP]);
+    }
+    else {
+      uint8 *in  = (uint8 *) &source[0];
+      uint8 *out = &packed[0];
+      output.reInterleave(&in, &out, &format, 2);
+    }
+    if (l == 0)
+      reference = packed;
+    else {
+      for (int i = 0; i < (int) packed.size(); i++) {
+        if (packed[i] != reference[i]) {
+          printf("  %s pack differs from scalar at byte %d: %02x != %02x\n", levelName[l], i, packed[i], reference[i]);
+          passed = FALSE;
+          break;
+        }
+      }
+    }
+    
+    // Unpack the scalar packed buffer, so that an unpack error is not hidden by a matching pack error
+    memset(&planes[0], 0xA5, planes.size() * sizeof(uint16));
+    uint8 *in  = &reference[0];
+    uint8 *out = (uint8 *) &planes[0];
+    input.unpack(&in, &out, &format);
+    if (l == 0)
+      unpacked = planes;
+    for (int i = 0; i < planeSize + padding; i++) {
+      if (planes[i] != unpacked[i]) {
+        printf("  %s unpack differs from scalar at sample %d: %d != %d\n", levelName[l], i, planes[i], unpacked[i]);
+        passed = FALSE;
+        break;
+      }
+    }
+  }
+  
+  // The scalar unpack must restore the source planes. The b64a reader stores G and B in
+  // each other's plane compared with the writer, so that format is only checked against
+  // the scalar code above.
+  for (int i = 0; i < planeSize + padding && passed == TRUE && test->m_pixelFormat != PF_B64A; i++) {
+    int expected = i < planeSize ? source[i] : 0xA5A5;
+    if (unpacked[i] != expected) {
+      printf("  round trip mismatch at sample %d: %d != %d\n", i, unpacked[i], expected);
+      passed = FALSE;
+    }
+  }
+  CPUFeatures::setMaxLevel(SIMD_AVX2);
+  
+  printf("%-6s %2d bit %4dx%-3d : %s\n", formatName[test->m_pixelFormat], test->m_bitDepth, test->m_width, test->m_height, passed == TRUE ? "OK" : "FAILED");
+  
+  return passed;
+}
+
+//-----------------------------------------------------------------------------
+// Main function
+//-----------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+  // widths are multiples of the 6 pixel V210 block, and no picture is a multiple of the 8 and 16 pixel SIMD steps
+  static const int sizes[5][2] = { { 6, 1 }, { 18, 1 }, { 42, 3 }, { 90, 1 }, { 1002, 3 } };
+  static const PackTestCase formats[5] = {
+    { PF_V210,   CF_422, 10, 0, 0 },
+    { PF_UYVY10, CF_422, 10, 0, 0 },
+    { PF_R10K,   CF_444, 10, 0, 0 },
+    { PF_R210,   CF_444, 10, 0, 0 },
+    { PF_B64A,   CF_444, 16, 0, 0 }
+  };
+  int failed = 0, total = 0;
+  
+  for (int f = 0; f < 5; f++) {
+    for (int s = 0; s < 5; s++) {
+      PackTestCase test = formats[f];
+      test.m_width  = sizes[s][0];
+      test.m_height = sizes[s][1];
+      if (runTest(&test) == FALSE)
+        failed++;
+      total++;
+    }
+  }
+  
+  printf("%d of %d pack round trip tests passed\n", total - failed, total);
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
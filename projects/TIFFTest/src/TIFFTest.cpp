@@ -0,0 +1,287 @@
+/* The copyright in this software is being made available under the BSD
+ * License, included below. This software may be subject to other third party
+ * and contributor rights, including patent rights, and no such rights are
+ * granted under this license.
+ *
+ * <OWNER> = Apple Inc.
+ * <ORGANIZATION> = Apple Inc.
+ * <YEAR> = 2017
+ *
+ * Copyright (c) 2017, Apple Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *  * Neither the name of the <ORGANIZATION> nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ *************************************************************************************
+ * \file TIFFTest.cpp
+ *
+ * \brief
+ *    TIFF round trip test. Frames are encoded through OutputTIFF, decoded through
+ *    the strip reader of InputTIFF and compared sample by sample.
+ *
+ * \author
+ *     - Alexis Michael Tourapis         <atourapis@apple.com>
+ *
+ *************************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Include headers
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "TIFFTest.H"
+#include "Frame.H"
+#include "InputTIFF.H"
+#include "OutputTIFF.H"
+
+//-----------------------------------------------------------------------------
+// Local functions
+//-----------------------------------------------------------------------------
+
+/*!
+ ***********************************************************************
+ * \brief
+ *   Fills the three planes with ramps (predictable), noise (incompressible)
+ *   and runs (highly compressible), alternating per row
+ ***********************************************************************
+ */
+static void fillPlanes(Output *output, const TIFFTestCase *test)
+{
+  uint32 seed = 12345;
+  int    maxValue = (1 << test->m_bitDepth) - 1;
+  
+  for (int c = Y_COMP; c <= V_COMP; c++) {
+    for (int y = 0; y < test->m_height; y++) {
+      for (int x = 0; x < test->m_width; x++) {
+        int value;
+        seed = seed * 1103515245 + 12345;
+        switch (y % 3) {
+          case 0:
+            value = (x * 7 + y * 3 + c * 11) & maxValue;
+            break;
+          case 1:
+            value = (int) (seed >> 8) & maxValue;
+            break;
+          default:
+            value = ((x / 17) & 1) ? maxValue : 0;
+            break;
+        }
+        int i = y * test->m_width + x;
+        if (test->m_bitDepth == 8)
+          output->m_comp[c][i] = (imgpel) value;
+        else
+          output->m_ui16Comp[c][i] = (uint16) value;
+      }
+    }
+  }
+}
+
+static uint32 readU16(const vector<uint8> &data, size_t pos)
+{
+  return pos + 2 <= data.size() ? (uint32) data[pos] | ((uint32) data[pos + 1] << 8) : 0;
+}
+
+static uint32 readU32(const vector<uint8> &data, size_t pos)
+{
+  return pos + 4 <= data.size() ? readU16(data, pos) | (readU16(data, pos + 2) << 16) : 0;
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *   Reads the compression, predictor and strip tags of a (little endian)
+ *   TIFF file
+ ***********************************************************************
+ */
+static int readLayout(const char *fileName, TIFFTestLayout *layout)
+{
+  FILE *f = fopen(fileName, "rb");
+  if (f == NULL)
+    return 0;
+  vector<uint8> data;
+  uint8 block[4096];
+  size_t n;
+  while ((n = fread(block, 1, sizeof(block), f)) > 0)
+    data.insert(data.end(), block, block + n);
+  fclose(f);
+  
+  if (data.size() < 8 || data[0] != 'I' || data[1] != 'I' || readU16(data, 2) != 42)
+    return 0;
+  
+  layout->m_compression  = 1;
+  layout->m_predictor    = 1;
+  layout->m_rowsPerStrip = 0;
+  layout->m_stripCount   = 0;
+  
+  size_t ifd     = readU32(data, 4);
+  uint32 entries = readU16(data, ifd);
+  for (uint32 e = 0; e < entries; e++) {
+    size_t entry = ifd + 2 + 12 * e;
+    uint32 tag   = readU16(data, entry);
+    uint32 type  = readU16(data, entry + 2);
+    uint32 count = readU32(data, entry + 4);
+    uint32 value = (type == 3) ? readU16(data, entry + 8) : readU32(data, entry + 8);
+    switch (tag) {
+      case 259: layout->m_compression  = (int) value; break;
+      case 317: layout->m_predictor    = (int) value; break;
+      case 278: layout->m_rowsPerStrip = (int) value; break;
+      case 273: layout->m_stripCount   = (int) count; break;
+      default: break;
+    }
+  }
+  return 1;
+}
+
+/*!
+ ***********************************************************************
+ * \brief
+ *   Writes, reads back and compares one frame
+ *
+ * \return
+ *    TRUE if the decoded planes match the source planes
+ ***********************************************************************
+ */
+static bool runTest(const TIFFTestCase *test)
+{
+  static const char *compressionName[9] = { "", "None", "", "", "", "LZW", "", "", "Deflate" };
+  bool passed = TRUE;
+  
+  FrameFormat format;
+  format.m_width[Y_COMP]   = test->m_width;
+  format.m_height[Y_COMP]  = test->m_height;
+  format.m_chromaFormat    = CF_444;
+  format.m_colorSpace      = CM_RGB;
+  format.m_colorPrimaries  = CP_709;
+  format.m_sampleRange     = SR_STANDARD;
+  format.m_bitDepthComp[Y_COMP] = format.m_bitDepthComp[U_COMP] = format.m_bitDepthComp[V_COMP] = test->m_bitDepth;
+  format.m_tiffCompression = test->m_compression;
+  format.m_tiffPredictor   = test->m_predictor;
+  
+  // Encode
+  IOVideo outputFile;
+  strcpy(outputFile.m_fHead, TIFF_TEST_FILE);
+  outputFile.m_videoType = VIDEO_TIFF;
+  outputFile.m_format    = format;
+  OutputTIFF *output = new OutputTIFF(&outputFile, &format);
+  fillPlanes(output, test);
+  if (output->writeOneFrame(&outputFile, 0, 0, 0) != 1) {
+    printf("  write failed\n");
+    passed = FALSE;
+  }
+  
+  // Check that the intended layout was written. Multi strip images must end with a partial strip.
+  TIFFTestLayout layout = { 0, 0, 0, 0 };
+#ifdef USEZLIB
+  int expectedCompression = test->m_compression;
+#else
+  int expectedCompression = test->m_compression == 8 ? 5 : test->m_compression;
+#endif
+  int expectedPredictor = test->m_compression == 1 ? 1 : test->m_predictor;
+  if (passed == TRUE && readLayout(TIFF_TEST_FILE, &layout) == 0) {
+    printf("  cannot parse %s\n", TIFF_TEST_FILE);
+    passed = FALSE;
+  }
+  else if (passed == TRUE && (layout.m_compression != expectedCompression || layout.m_predictor != expectedPredictor)) {
+    printf("  unexpected Compression %d / Predictor %d\n", layout.m_compression, layout.m_predictor);
+    passed = FALSE;
+  }
+  else if (passed == TRUE && layout.m_stripCount > 1 && test->m_height % layout.m_rowsPerStrip == 0) {
+    printf("  last strip is full (%d rows per strip)\n", layout.m_rowsPerStrip);
+    passed = FALSE;
+  }
+  
+  // Decode straight into a frame that matches the file, which uses the strip reader
+  IOVideo inputFile;
+  strcpy(inputFile.m_fHead, TIFF_TEST_FILE);
+  inputFile.m_videoType = VIDEO_TIFF;
+  inputFile.m_format    = format;
+  InputTIFF *input = new InputTIFF(&inputFile, &format);
+  Frame *frame = new Frame(test->m_width, test->m_height, FALSE, CM_RGB, CP_709, CF_444, SR_STANDARD, test->m_bitDepth, FALSE, TF_NULL, 1.0);
+  frame->clear();
+  
+  if (passed == TRUE && input->readOneFrame(&inputFile, 0, 0, 0) != 1) {
+    printf("  read failed\n");
+    passed = FALSE;
+  }
+  
+  if (passed == TRUE) {
+    input->copyFrame(frame);
+    int mismatches = 0;
+    for (int c = Y_COMP; c <= V_COMP; c++) {
+      for (int i = 0; i < test->m_width * test->m_height; i++) {
+        int source  = (test->m_bitDepth == 8) ? output->m_comp[c][i] : output->m_ui16Comp[c][i];
+        int decoded = (test->m_bitDepth == 8) ? frame->m_comp[c][i]  : frame->m_ui16Comp[c][i];
+        if (source != decoded && mismatches++ == 0)
+          printf("  mismatch in component %d at (%d, %d): %d != %d\n", c, i % test->m_width, i / test->m_width, decoded, source);
+      }
+    }
+    if (mismatches > 0) {
+      printf("  %d samples differ\n", mismatches);
+      passed = FALSE;
+    }
+  }
+  
+  printf("%2d bit %4dx%-5d %-7s Predictor %d Strips %3d : %s\n", test->m_bitDepth, test->m_width, test->m_height,
+         compressionName[test->m_compression], expectedPredictor, layout.m_stripCount, passed == TRUE ? "OK" : "FAILED");
+  
+  delete frame;
+  delete input;
+  delete output;
+  remove(TIFF_TEST_FILE);
+  
+  return passed;
+}
+
+//-----------------------------------------------------------------------------
+// Main function
+//-----------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+  // odd widths; the 1001 and 333 pixel wide images span several strips with a partial last strip
+  static const int sizes[3][2] = { { 1001, 100 }, { 333, 1000 }, { 1, 5 } };
+  // compression / predictor pairs
+  static const int modes[5][2] = { { 1, 1 }, { 5, 1 }, { 5, 2 }, { 8, 1 }, { 8, 2 } };
+  int failed = 0, total = 0;
+  
+  for (int bitDepth = 8; bitDepth <= 16; bitDepth += 8) {
+    for (int s = 0; s < 3; s++) {
+      for (int m = 0; m < 5; m++) {
+        TIFFTestCase test = { bitDepth, modes[m][0], modes[m][1], sizes[s][0], sizes[s][1] };
+        if (runTest(&test) == FALSE)
+          failed++;
+        total++;
+      }
+    }
+  }
+  
+  printf("%d of %d TIFF round trip tests passed\n", total - failed, total);
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}